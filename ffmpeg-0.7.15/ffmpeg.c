@@ -171,6 +171,8 @@ static int loop_output = AVFMT_NOOUTPUTLOOP;
 static int qp_hist = 0;
 #if CONFIG_AVFILTER
 static char *vfilters = NULL;
+static int filter_threads = 1;
+static int filter_pool_size = 0;
 #endif
 
 static int intra_only = 0;
@@ -374,6 +376,8 @@ static int configure_video_filters(AVInputStream *ist, AVOutputStream *ost)
     int ret;
 
     ost->graph = avfilter_graph_alloc();
+    ost->graph->thread_count = filter_threads;
+    ost->graph->pool_size = filter_pool_size;
 
     if (ist->st->sample_aspect_ratio.num){
         sample_aspect_ratio = ist->st->sample_aspect_ratio;
@@ -4480,6 +4484,8 @@ static const OptionDef options[] = {
     { "vstats_file", HAS_ARG | OPT_EXPERT | OPT_VIDEO, {(void*)opt_vstats_file}, "dump video coding statistics to file", "file" },
 #if CONFIG_AVFILTER
     { "vf", OPT_STRING | HAS_ARG, {(void*)&vfilters}, "video filters", "filter list" },
+    { "filter_threads", OPT_INT | HAS_ARG | OPT_EXPERT | OPT_VIDEO, {(void*)&filter_threads}, "number of threads running the video filters", "count" },
+    { "filter_pool_size", OPT_INT | HAS_ARG | OPT_EXPERT | OPT_VIDEO, {(void*)&filter_pool_size}, "maximum number of unused video buffers kept by the filters", "count" },
 #endif
     { "intra_matrix", HAS_ARG | OPT_EXPERT | OPT_VIDEO, {(void*)opt_intra_matrix}, "specify intra matrix coeffs", "matrix" },
     { "inter_matrix", HAS_ARG | OPT_EXPERT | OPT_VIDEO, {(void*)opt_inter_matrix}, "specify inter matrix coeffs", "matrix" },
@@ -28,21 +28,33 @@
 #include "dnxhddata.h"
 #include "dsputil.h"
 
+/**
+ * per thread state, macroblock rows are decoded independently
+ */
+typedef struct {
+    DECLARE_ALIGNED(16, DCTELEM, blocks)[8][64];
+    GetBitContext gb;
+    int last_dc[3];
+    int last_qscale;
+    int luma_scale[64];                 ///< qscale * luma weight, in zigzag order
+    int chroma_scale[64];               ///< qscale * chroma weight, in zigzag order
+} RowContext;
+
 typedef struct {
     AVCodecContext *avctx;
     AVFrame picture;
-    GetBitContext gb;
     int cid;                            ///< compression id
     unsigned int width, height;
     unsigned int mb_width, mb_height;
     uint32_t mb_scan_index[68];         /* max for 1080p */
     int cur_field;                      ///< current interlaced field
     VLC ac_vlc, dc_vlc, run_vlc;
-    int last_dc[3];
     DSPContext dsp;
-    DECLARE_ALIGNED(16, DCTELEM, blocks)[8][64];
     ScanTable scantable;
     const CIDEntry *cid_table;
+    RowContext *rows;                   ///< one per thread
+    const uint8_t *buf;                 ///< macroblock data of the current coding unit
+    int buf_size;
 } DNXHDContext;
 
 #define DNXHD_VLC_BITS 9
@@ -53,6 +65,9 @@ static av_cold int dnxhd_decode_init(AVCodecContext *avctx)
     DNXHDContext *ctx = avctx->priv_data;
 
     ctx->avctx = avctx;
+    ctx->rows = av_mallocz(FFMAX(avctx->thread_count, 1) * sizeof(*ctx->rows));
+    if (!ctx->rows)
+        return AVERROR(ENOMEM);
     dsputil_init(&ctx->dsp, avctx);
     avctx->coded_frame = &ctx->picture;
     avcodec_get_frame_defaults(&ctx->picture);
@@ -152,47 +167,53 @@ static int dnxhd_decode_header(DNXHDContext *ctx, const uint8_t *buf, int buf_si
     return 0;
 }
 
-static int dnxhd_decode_dc(DNXHDContext *ctx)
+static int dnxhd_decode_dc(DNXHDContext *ctx, RowContext *row)
 {
     int len;
 
-    len = get_vlc2(&ctx->gb, ctx->dc_vlc.table, DNXHD_DC_VLC_BITS, 1);
-    return len ? get_xbits(&ctx->gb, len) : 0;
+    len = get_vlc2(&row->gb, ctx->dc_vlc.table, DNXHD_DC_VLC_BITS, 1);
+    return len ? get_xbits(&row->gb, len) : 0;
 }
 
-static void dnxhd_decode_dct_block(DNXHDContext *ctx, DCTELEM *block, int n, int qscale)
+static void dnxhd_decode_dct_block(DNXHDContext *ctx, RowContext *row,
+                                   DCTELEM *block, int n)
 {
     int i, j, index, index2;
     int level, component, sign;
     const uint8_t *weigth_matrix;
+    const int *scale;
+    const int round = ctx->cid_table->bit_depth == 10 ? 8 : 32;
+    const int shift = ctx->cid_table->bit_depth == 10 ? 4 : 6;
 
     if (n&2) {
         component = 1 + (n&1);
         weigth_matrix = ctx->cid_table->chroma_weight;
+        scale = row->chroma_scale;
     } else {
         component = 0;
         weigth_matrix = ctx->cid_table->luma_weight;
+        scale = row->luma_scale;
     }
 
-    ctx->last_dc[component] += dnxhd_decode_dc(ctx);
-    block[0] = ctx->last_dc[component];
+    row->last_dc[component] += dnxhd_decode_dc(ctx, row);
+    block[0] = row->last_dc[component];
     //av_log(ctx->avctx, AV_LOG_DEBUG, "dc %d\n", block[0]);
     for (i = 1; ; i++) {
-        index = get_vlc2(&ctx->gb, ctx->ac_vlc.table, DNXHD_VLC_BITS, 2);
+        index = get_vlc2(&row->gb, ctx->ac_vlc.table, DNXHD_VLC_BITS, 2);
         //av_log(ctx->avctx, AV_LOG_DEBUG, "index %d\n", index);
         level = ctx->cid_table->ac_level[index];
         if (!level) { /* EOB */
             //av_log(ctx->avctx, AV_LOG_DEBUG, "EOB\n");
             return;
         }
-        sign = get_sbits(&ctx->gb, 1);
+        sign = get_sbits(&row->gb, 1);
 
         if (ctx->cid_table->ac_index_flag[index]) {
-            level += get_bits(&ctx->gb, ctx->cid_table->index_bits)<<6;
+            level += get_bits(&row->gb, ctx->cid_table->index_bits)<<6;
         }
 
         if (ctx->cid_table->ac_run_flag[index]) {
-            index2 = get_vlc2(&ctx->gb, ctx->run_vlc.table, DNXHD_VLC_BITS, 2);
+            index2 = get_vlc2(&row->gb, ctx->run_vlc.table, DNXHD_VLC_BITS, 2);
             i += ctx->cid_table->run[index2];
         }
 
@@ -204,22 +225,17 @@ static void dnxhd_decode_dct_block(DNXHDContext *ctx, DCTELEM *block, int n, int
         j = ctx->scantable.permutated[i];
         //av_log(ctx->avctx, AV_LOG_DEBUG, "j %d\n", j);
         //av_log(ctx->avctx, AV_LOG_DEBUG, "level %d, weigth %d\n", level, weigth_matrix[i]);
-        level = (2*level+1) * qscale * weigth_matrix[i];
-        if (ctx->cid_table->bit_depth == 10) {
-            if (weigth_matrix[i] != 8)
-                level += 8;
-            level >>= 4;
-        } else {
-            if (weigth_matrix[i] != 32)
-                level += 32;
-            level >>= 6;
-        }
+        level = (2*level+1) * scale[i];
+        if (weigth_matrix[i] != round)
+            level += round;
+        level >>= shift;
         //av_log(NULL, AV_LOG_DEBUG, "i %d, j %d, end level %d\n", i, j, level);
         block[j] = (level^sign) - sign;
     }
 }
 
-static int dnxhd_decode_macroblock(DNXHDContext *ctx, int x, int y)
+static int dnxhd_decode_macroblock(DNXHDContext *ctx, RowContext *row,
+                                   int x, int y)
 {
     int dct_linesize_luma   = ctx->picture.linesize[0];
     int dct_linesize_chroma = ctx->picture.linesize[1];
@@ -227,13 +243,21 @@ static int dnxhd_decode_macroblock(DNXHDContext *ctx, int x, int y)
     int dct_offset;
     int qscale, i;
 
-    qscale = get_bits(&ctx->gb, 11);
-    skip_bits1(&ctx->gb);
+    qscale = get_bits(&row->gb, 11);
+    skip_bits1(&row->gb);
     //av_log(ctx->avctx, AV_LOG_DEBUG, "qscale %d\n", qscale);
 
+    if (qscale != row->last_qscale) {
+        for (i = 0; i < 64; i++) {
+            row->luma_scale[i]   = qscale * ctx->cid_table->luma_weight[i];
+            row->chroma_scale[i] = qscale * ctx->cid_table->chroma_weight[i];
+        }
+        row->last_qscale = qscale;
+    }
+
     for (i = 0; i < 8; i++) {
-        ctx->dsp.clear_block(ctx->blocks[i]);
-        dnxhd_decode_dct_block(ctx, ctx->blocks[i], i, qscale);
+        ctx->dsp.clear_block(row->blocks[i]);
+        dnxhd_decode_dct_block(ctx, row, row->blocks[i], i);
     }
 
     if (ctx->picture.interlaced_frame) {
@@ -252,39 +276,49 @@ static int dnxhd_decode_macroblock(DNXHDContext *ctx, int x, int y)
     }
 
     dct_offset = dct_linesize_luma << 3;
-    ctx->dsp.idct_put(dest_y,                  dct_linesize_luma, ctx->blocks[0]);
-    ctx->dsp.idct_put(dest_y + 8,              dct_linesize_luma, ctx->blocks[1]);
-    ctx->dsp.idct_put(dest_y + dct_offset,     dct_linesize_luma, ctx->blocks[4]);
-    ctx->dsp.idct_put(dest_y + dct_offset + 8, dct_linesize_luma, ctx->blocks[5]);
+    ctx->dsp.idct_put(dest_y,                  dct_linesize_luma, row->blocks[0]);
+    ctx->dsp.idct_put(dest_y + 8,              dct_linesize_luma, row->blocks[1]);
+    ctx->dsp.idct_put(dest_y + dct_offset,     dct_linesize_luma, row->blocks[4]);
+    ctx->dsp.idct_put(dest_y + dct_offset + 8, dct_linesize_luma, row->blocks[5]);
 
     if (!(ctx->avctx->flags & CODEC_FLAG_GRAY)) {
         dct_offset = dct_linesize_chroma << 3;
-        ctx->dsp.idct_put(dest_u,              dct_linesize_chroma, ctx->blocks[2]);
-        ctx->dsp.idct_put(dest_v,              dct_linesize_chroma, ctx->blocks[3]);
-        ctx->dsp.idct_put(dest_u + dct_offset, dct_linesize_chroma, ctx->blocks[6]);
-        ctx->dsp.idct_put(dest_v + dct_offset, dct_linesize_chroma, ctx->blocks[7]);
+        ctx->dsp.idct_put(dest_u,              dct_linesize_chroma, row->blocks[2]);
+        ctx->dsp.idct_put(dest_v,              dct_linesize_chroma, row->blocks[3]);
+        ctx->dsp.idct_put(dest_u + dct_offset, dct_linesize_chroma, row->blocks[6]);
+        ctx->dsp.idct_put(dest_v + dct_offset, dct_linesize_chroma, row->blocks[7]);
     }
 
     return 0;
 }
 
-static int dnxhd_decode_macroblocks(DNXHDContext *ctx, const uint8_t *buf, int buf_size)
+static int dnxhd_decode_row(AVCodecContext *avctx, void *data, int y, int threadnr)
 {
-    int x, y;
-    for (y = 0; y < ctx->mb_height; y++) {
-        ctx->last_dc[0] =
-        ctx->last_dc[1] =
-        ctx->last_dc[2] = 1<<(ctx->cid_table->bit_depth+2); // for levels +2^(bitdepth-1)
-        init_get_bits(&ctx->gb, buf + ctx->mb_scan_index[y], (buf_size - ctx->mb_scan_index[y]) << 3);
-        for (x = 0; x < ctx->mb_width; x++) {
-            //START_TIMER;
-            dnxhd_decode_macroblock(ctx, x, y);
-            //STOP_TIMER("decode macroblock");
-        }
+    DNXHDContext *ctx = data;
+    RowContext *row = &ctx->rows[threadnr];
+    int x;
+
+    row->last_dc[0] =
+    row->last_dc[1] =
+    row->last_dc[2] = 1<<(ctx->cid_table->bit_depth+2); // for levels +2^(bitdepth-1)
+    init_get_bits(&row->gb, ctx->buf + ctx->mb_scan_index[y], (ctx->buf_size - ctx->mb_scan_index[y]) << 3);
+    for (x = 0; x < ctx->mb_width; x++) {
+        //START_TIMER;
+        dnxhd_decode_macroblock(ctx, row, x, y);
+        //STOP_TIMER("decode macroblock");
     }
     return 0;
 }
 
+static int dnxhd_decode_macroblocks(DNXHDContext *ctx, const uint8_t *buf, int buf_size)
+{
+    /* every macroblock row starts at its own offset from the header */
+    ctx->buf      = buf;
+    ctx->buf_size = buf_size;
+    ctx->avctx->execute2(ctx->avctx, dnxhd_decode_row, ctx, NULL, ctx->mb_height);
+    return 0;
+}
+
 static int dnxhd_decode_frame(AVCodecContext *avctx, void *data, int *data_size,
                               AVPacket *avpkt)
 {
@@ -344,6 +378,7 @@ static av_cold int dnxhd_decode_close(AVCodecContext *avctx)
     free_vlc(&ctx->ac_vlc);
     free_vlc(&ctx->dc_vlc);
     free_vlc(&ctx->run_vlc);
+    av_freep(&ctx->rows);
     return 0;
 }
 
@@ -356,6 +391,6 @@ AVCodec ff_dnxhd_decoder = {
     NULL,
     dnxhd_decode_close,
     dnxhd_decode_frame,
-    CODEC_CAP_DR1,
+    CODEC_CAP_DR1 | CODEC_CAP_SLICE_THREADS,
     .long_name = NULL_IF_CONFIG_SMALL("VC3/DNxHD"),
 };
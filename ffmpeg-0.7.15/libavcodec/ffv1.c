@@ -33,6 +33,8 @@
 #include "golomb.h"
 #include "mathops.h"
 #include "libavutil/avassert.h"
+#include "libavutil/crc.h"
+#include "libavutil/opt.h"
 
 #define MAX_PLANES 4
 #define CONTEXT_SIZE 32
@@ -228,6 +230,7 @@ typedef struct PlaneContext{
 #define MAX_SLICES 256
 
 typedef struct FFV1Context{
+    AVClass *class;
     AVCodecContext *avctx;
     RangeCoder c;
     GetBitContext gb;
@@ -235,6 +238,7 @@ typedef struct FFV1Context{
     uint64_t rc_stat[256][2];
     uint64_t (*rc_stat2[MAX_QUANT_TABLES])[32][2];
     int version;
+    int micro_version;                   ///< optional fields of the version 2 header, 0 if it has no CRC
     int width, height;
     int chroma_h_shift, chroma_v_shift;
     int flags;
@@ -253,6 +257,8 @@ typedef struct FFV1Context{
     int16_t *sample_buffer;
     int gob_count;
     int packed_at_lsb;
+    int ec;                              ///< every slice is followed by a CRC32 of its data
+    int slice_damaged;                   ///< slice state is invalid until the next keyframe
 
     int quant_table_count;
 
@@ -831,6 +837,7 @@ static int write_extra_header(FFV1Context *f){
     RangeCoder * const c= &f->c;
     uint8_t state[CONTEXT_SIZE];
     int i, j, k;
+    unsigned v;
     uint8_t state2[32][CONTEXT_SIZE];
 
     memset(state2, 128, sizeof(state2));
@@ -877,7 +884,16 @@ static int write_extra_header(FFV1Context *f){
         }
     }
 
+    put_symbol(c, state, f->micro_version, 0);
+    put_symbol(c, state, f->ec, 0);
+
     f->avctx->extradata_size= ff_rac_terminate(c);
+    /* the CRC tells the header from the ones written before it had a
+     * micro version, which end after the initial states; it is stored
+     * little endian so that the CRC of the whole header is 0 */
+    v= av_crc(av_crc_get_table(AV_CRC_32_IEEE), 0, f->avctx->extradata, f->avctx->extradata_size);
+    AV_WL32(f->avctx->extradata + f->avctx->extradata_size, v);
+    f->avctx->extradata_size+= 4;
 
     return 0;
 }
@@ -925,6 +941,28 @@ static int sort_stt(FFV1Context *s, uint8_t stt[256]){
     return print;
 }
 
+/**
+ * Select a slice grid with num_v_slices <= num_h_slices < 2*num_v_slices.
+ * @param count wanted number of slices
+ * @param exact if 0 the smallest grid with at least count slices is used
+ */
+static int set_slice_grid(FFV1Context *s, int count, int exact){
+    int h, v;
+
+    for(v=1; v*v<=MAX_SLICES; v++){
+        for(h=v; h<2*v; h++){
+            if(h*v > MAX_SLICES || h > s->width || v > s->height)
+                break;
+            if(h*v == count || (!exact && h*v > count)){
+                s->num_h_slices= h;
+                s->num_v_slices= v;
+                return 0;
+            }
+        }
+    }
+    return -1;
+}
+
 static av_cold int encode_init(AVCodecContext *avctx)
 {
     FFV1Context *s = avctx->priv_data;
@@ -1013,6 +1051,17 @@ static av_cold int encode_init(AVCodecContext *avctx)
 
     s->picture_number=0;
 
+    /* two pass statistics and slices need the version 2 bitstream,
+     * if it is allowed the slice grid follows the thread count */
+    if(   (avctx->flags & (CODEC_FLAG_PASS1|CODEC_FLAG_PASS2)) || avctx->slices > 1
+       || (avctx->thread_count > 1 && avctx->strict_std_compliance <= FF_COMPLIANCE_EXPERIMENTAL))
+        s->version= FFMAX(s->version, 2);
+
+    if(s->version > 1 && avctx->strict_std_compliance > FF_COMPLIANCE_EXPERIMENTAL){
+        av_log(avctx, AV_LOG_ERROR, "Version 2 needed for the requested features but version 2 is experimental and not enabled\n");
+        return -1;
+    }
+
     if(avctx->flags & (CODEC_FLAG_PASS1|CODEC_FLAG_PASS2)){
         for(i=0; i<s->quant_table_count; i++){
             s->rc_stat2[i]= av_mallocz(s->context_count[i]*sizeof(*s->rc_stat2[i]));
@@ -1080,10 +1129,20 @@ static av_cold int encode_init(AVCodecContext *avctx)
     }
 
     if(s->version>1){
-        s->num_h_slices=2;
-        s->num_v_slices=2;
+        if(avctx->slices){
+            if(set_slice_grid(s, avctx->slices, 1) < 0){
+                av_log(avctx, AV_LOG_ERROR, "Unsupported number %d of slices requested\n", avctx->slices);
+                return -1;
+            }
+        }else if(set_slice_grid(s, FFMAX(avctx->thread_count, 4), 0) < 0){
+            s->num_h_slices=2;
+            s->num_v_slices=2;
+        }
+        av_log(avctx, AV_LOG_DEBUG, "using %dx%d slices\n", s->num_h_slices, s->num_v_slices);
+        s->micro_version= 1;
         write_extra_header(s);
-    }
+    }else
+        s->ec= 0;
 
     if(init_slice_contexts(s) < 0)
         return -1;
@@ -1174,6 +1233,8 @@ static int encode_frame(AVCodecContext *avctx, unsigned char *buf, int buf_size,
     int used_count= 0;
     uint8_t keystate=128;
     uint8_t *buf_p;
+    int trailer= f->ec ? 4 + 3 : 3;
+    int slice0_size;
     int i;
 
     ff_init_range_encoder(c, buf, buf_size);
@@ -1193,11 +1254,20 @@ static int encode_frame(AVCodecContext *avctx, unsigned char *buf, int buf_size,
         p->key_frame= 0;
     }
 
-    if(!f->ac){
+    /* the first slice ends where the second one starts, and its CRC is
+     * stored within that space too */
+    if(!f->ac)
         used_count += ff_rac_terminate(c);
+    slice0_size= f->slice_count > 1 ? (buf_size-used_count)/f->slice_count : buf_size;
+    slice0_size-= f->ec ? 4 : 0;
+
+    if(!f->ac){
 //printf("pos=%d\n", used_count);
-        init_put_bits(&f->slice_context[0]->pb, buf + used_count, buf_size - used_count);
-    }else if (f->ac>1){
+        init_put_bits(&f->slice_context[0]->pb, buf + used_count, slice0_size - used_count);
+    }else{
+        c->bytestream_end= buf + slice0_size;
+    }
+    if (f->ac>1){
         int i;
         for(i=1; i<256; i++){
             c->one_state[i]= f->state_transition[i];
@@ -1208,7 +1278,7 @@ static int encode_frame(AVCodecContext *avctx, unsigned char *buf, int buf_size,
     for(i=1; i<f->slice_count; i++){
         FFV1Context *fs= f->slice_context[i];
         uint8_t *start= buf + (buf_size-used_count)*i/f->slice_count;
-        int len= buf_size/f->slice_count;
+        int len= buf_size/f->slice_count - trailer;
 
         if(fs->ac){
             ff_init_range_encoder(&fs->c, start, len);
@@ -1233,8 +1303,15 @@ static int encode_frame(AVCodecContext *avctx, unsigned char *buf, int buf_size,
             used_count= 0;
         }
         if(i>0){
-            av_assert0(bytes < buf_size/f->slice_count);
+            av_assert0(bytes < buf_size/f->slice_count - trailer);
             memmove(buf_p, fs->ac ? fs->c.bytestream_start : fs->pb.buf, bytes);
+        }else
+            av_assert0(bytes <= slice0_size);
+        if(f->ec){
+            AV_WB32(buf_p+bytes, av_crc(av_crc_get_table(AV_CRC_32_IEEE), 0, buf_p, bytes));
+            bytes+=4;
+        }
+        if(i>0){
             av_assert0(bytes < (1<<24));
             AV_WB24(buf_p+bytes, bytes);
             bytes+=3;
@@ -1479,6 +1556,9 @@ static int decode_slice(AVCodecContext *c, void *arg){
     const int ps= (c->bits_per_raw_sample>8)+1;
     AVFrame * const p= &f->picture;
 
+    if(fs->slice_damaged)
+        return 0;
+
     av_assert1(width && height);
     if(f->colorspace==0){
         const int chroma_width = -((-width )>>f->chroma_h_shift);
@@ -1542,13 +1622,19 @@ static int read_quant_tables(RangeCoder *c, int16_t quant_table[MAX_CONTEXT_INPU
 static int read_extra_header(FFV1Context *f){
     RangeCoder * const c= &f->c;
     uint8_t state[CONTEXT_SIZE];
-    int i, j, k;
+    int i, j, k, size, has_crc;
     uint8_t state2[32][CONTEXT_SIZE];
 
     memset(state2, 128, sizeof(state2));
     memset(state, 128, sizeof(state));
 
-    ff_init_range_decoder(c, f->avctx->extradata, f->avctx->extradata_size);
+    /* headers with a micro version end with a CRC of the rest */
+    size= f->avctx->extradata_size;
+    has_crc= size >= 4 && !av_crc(av_crc_get_table(AV_CRC_32_IEEE), 0, f->avctx->extradata, size);
+    if(has_crc)
+        size-= 4;
+
+    ff_init_range_decoder(c, f->avctx->extradata, size);
     ff_build_rac_states(c, 0.05*(1LL<<32), 256-8);
 
     f->version= get_symbol(c, state, 0);
@@ -1596,6 +1682,10 @@ static int read_extra_header(FFV1Context *f){
         }
     }
 
+    f->micro_version= has_crc ? get_symbol(c, state, 0) : 0;
+    if(f->micro_version > 0)
+        f->ec= get_symbol(c, state, 0);
+
     return 0;
 }
 
@@ -1692,6 +1782,7 @@ static int read_header(FFV1Context *f){
         FFV1Context *fs= f->slice_context[j];
         fs->ac= f->ac;
         fs->packed_at_lsb= f->packed_at_lsb;
+        fs->slice_damaged= 0;
 
         if(f->version >= 2){
             fs->slice_x     = get_symbol(c, state, 0)   *f->width ;
@@ -1761,6 +1852,7 @@ static int decode_frame(AVCodecContext *avctx, void *data, int *data_size, AVPac
     int bytes_read, i;
     uint8_t keystate= 128;
     const uint8_t *buf_p;
+    int crc_size= f->ec ? 4 : 0;
 
     AVFrame *picture = data;
 
@@ -1811,14 +1903,23 @@ static int decode_frame(AVCodecContext *avctx, void *data, int *data_size, AVPac
     }
 
     buf_p= buf + buf_size;
-    for(i=f->slice_count-1; i>0; i--){
+    for(i=f->slice_count-1; i>=0; i--){
         FFV1Context *fs= f->slice_context[i];
-        int v= AV_RB24(buf_p-3)+3;
-        if(buf_p - buf <= v){
+        int v= i ? AV_RB24(buf_p-3)+3 : buf_p - buf;
+        if(i && buf_p - buf <= v){
             av_log(avctx, AV_LOG_ERROR, "Slice pointer chain broken\n");
             return -1;
         }
         buf_p -= v;
+        if(crc_size){
+            int len= v - (i ? 3 : 0) - crc_size;
+            if(len < 0 || AV_RB32(buf_p + len) != av_crc(av_crc_get_table(AV_CRC_32_IEEE), 0, buf_p, len)){
+                av_log(avctx, AV_LOG_ERROR, "slice %d CRC mismatch, skipping it until the next keyframe\n", i);
+                fs->slice_damaged= 1;
+            }
+        }
+        if(!i)
+            break;
         if(fs->ac){
             ff_init_range_decoder(&fs->c, buf_p, v);
         }else{
@@ -1850,6 +1951,13 @@ AVCodec ff_ffv1_decoder = {
 };
 
 #if CONFIG_FFV1_ENCODER
+#define VE AV_OPT_FLAG_VIDEO_PARAM | AV_OPT_FLAG_ENCODING_PARAM
+static const AVOption options[]={
+    {"slicecrc", "follow each slice with a CRC, version 2 only", offsetof(FFV1Context, ec), FF_OPT_TYPE_INT, {.dbl = 1}, 0, 1, VE},
+{NULL}
+};
+static const AVClass class = { "ffv1", av_default_item_name, options, LIBAVUTIL_VERSION_INT };
+
 AVCodec ff_ffv1_encoder = {
     "ffv1",
     AVMEDIA_TYPE_VIDEO,
@@ -1859,6 +1967,7 @@ AVCodec ff_ffv1_encoder = {
     encode_frame,
     common_end,
     .capabilities = CODEC_CAP_SLICE_THREADS,
+    .priv_class = &class,
     .pix_fmts= (const enum PixelFormat[]){PIX_FMT_YUV420P, PIX_FMT_YUV444P, PIX_FMT_YUV422P, PIX_FMT_YUV411P, PIX_FMT_YUV410P, PIX_FMT_RGB32, PIX_FMT_YUV420P16, PIX_FMT_YUV422P16, PIX_FMT_YUV444P16, PIX_FMT_YUV420P9, PIX_FMT_YUV420P10, PIX_FMT_YUV422P10, PIX_FMT_NONE},
     .long_name= NULL_IF_CONFIG_SMALL("FFmpeg video codec #1"),
 };
@@ -37,6 +37,8 @@
 
 #define VLC_BITS 11
 
+#define MAX_SLICES 64
+
 #if HAVE_BIGENDIAN
 #define B 3
 #define G 2
@@ -81,6 +83,11 @@ typedef struct HYuvContext{
     uint8_t *bitstream_buffer;
     unsigned int bitstream_buffer_size;
     DSPContext dsp;
+
+    int slices;                             ///< number of independently coded horizontal bands, ffvhuff only
+    int band;                               ///< set in the contexts of the bands of a sliced frame
+    int slice_y;                            ///< first row of the band
+    struct HYuvContext *slice_context[MAX_SLICES];
 }HYuvContext;
 
 #define classic_shift_luma_table_size 42
@@ -418,6 +425,91 @@ static av_cold void alloc_temp(HYuvContext *s){
     }
 }
 
+static void free_slice_contexts(HYuvContext *s){
+    int i, j;
+
+    for(i=0; i<MAX_SLICES; i++){
+        HYuvContext *fs= s->slice_context[i];
+
+        if(!fs)
+            continue;
+        for(j=0; j<3; j++)
+            av_freep(&fs->temp[j]);
+        av_freep(&fs->bitstream_buffer);
+        av_freep(&s->slice_context[i]);
+    }
+}
+
+/**
+ * Set up one context per horizontal band. Each band is coded like a
+ * picture of its own, so the bands can be processed in parallel.
+ * Band boundaries are multiples of 4 rows to keep 4:2:0 chroma and the
+ * field parity of interlaced content aligned.
+ */
+static av_cold int init_slice_contexts(HYuvContext *s){
+    int i;
+
+    for(i=0; i<s->slices; i++){
+        HYuvContext *fs= av_mallocz(sizeof(*fs));
+        int sys= (s->height* i   /s->slices) & ~3;
+        int sye= i+1 < s->slices ? (s->height*(i+1)/s->slices) & ~3 : s->height;
+
+        if(!fs)
+            goto fail;
+        s->slice_context[i]= fs;
+        memcpy(fs, s, sizeof(*fs));
+        memset(fs->slice_context, 0, sizeof(fs->slice_context));
+        memset(fs->temp, 0, sizeof(fs->temp));
+        fs->bitstream_buffer= NULL;
+        fs->bitstream_buffer_size= 0;
+
+        fs->band   = 1;
+        fs->slice_y= sys;
+        fs->height = sye - sys;
+
+        alloc_temp(fs);
+        if(!fs->temp[0])
+            goto fail;
+    }
+    return 0;
+fail:
+    free_slice_contexts(s);
+    return AVERROR(ENOMEM);
+}
+
+static av_cold int check_slices(HYuvContext *s){
+    if(s->slices > MAX_SLICES || s->height < 16*s->slices){
+        av_log(s->avctx, AV_LOG_ERROR, "unsupported number of slices %d for height %d\n", s->slices, s->height);
+        return AVERROR(EINVAL);
+    }
+    return 0;
+}
+
+/**
+ * Copy the huffman tables of the frame into a band context.
+ * The VLC tables are shared and only owned by the main context.
+ */
+static void copy_tables(HYuvContext *fs, HYuvContext *s){
+    memcpy(fs->len , s->len , sizeof(s->len ));
+    memcpy(fs->bits, s->bits, sizeof(s->bits));
+    memcpy(fs->vlc , s->vlc , sizeof(s->vlc ));
+    memcpy(fs->pix_bgr_map, s->pix_bgr_map, sizeof(s->pix_bgr_map));
+}
+
+/**
+ * Point the picture of a band context to its rows in p.
+ */
+static void init_band_picture(HYuvContext *fs, const AVFrame *p){
+    int cy= fs->bitstream_bpp==12 ? fs->slice_y>>1 : fs->slice_y;
+
+    fs->picture= *p;
+    fs->picture.data[0]+= fs->slice_y*p->linesize[0];
+    if(fs->bitstream_bpp < 24){
+        fs->picture.data[1]+= cy*p->linesize[1];
+        fs->picture.data[2]+= cy*p->linesize[2];
+    }
+}
+
 static av_cold int common_init(AVCodecContext *avctx){
     HYuvContext *s = avctx->priv_data;
 
@@ -471,6 +563,8 @@ s->bgr32=1;
         interlace= (((uint8_t*)avctx->extradata)[2] & 0x30) >> 4;
         s->interlaced= (interlace==1) ? 1 : (interlace==2) ? 0 : s->interlaced;
         s->context= ((uint8_t*)avctx->extradata)[2] & 0x40 ? 1 : 0;
+        if(avctx->codec_id == CODEC_ID_FFVHUFF)
+            s->slices= ((uint8_t*)avctx->extradata)[3];
 
         if(read_huffman_tables(s, ((uint8_t*)avctx->extradata)+4, avctx->extradata_size-4) < 0)
             return -1;
@@ -529,6 +623,13 @@ s->bgr32=1;
 
     alloc_temp(s);
 
+    if(s->slices > 1){
+        if(check_slices(s) < 0)
+            return AVERROR_INVALIDDATA;
+        if(init_slice_contexts(s) < 0)
+            return AVERROR(ENOMEM);
+    }
+
 //    av_log(NULL, AV_LOG_DEBUG, "pred:%d bpp:%d hbpp:%d il:%d\n", s->predictor, s->bitstream_bpp, avctx->bits_per_coded_sample, s->interlaced);
 
     return 0;
@@ -553,6 +654,9 @@ static av_cold int decode_init_thread_copy(AVCodecContext *avctx)
             return -1;
     }
 
+    if(s->slices > 1 && init_slice_contexts(s) < 0)
+        return AVERROR(ENOMEM);
+
     return 0;
 }
 #endif /* CONFIG_HUFFYUV_DECODER || CONFIG_FFVHUFF_DECODER */
@@ -638,12 +742,22 @@ static av_cold int encode_init(AVCodecContext *avctx)
         return -1;
     }
 
+    if(avctx->slices > 1){
+        if(avctx->codec->id==CODEC_ID_HUFFYUV){
+            av_log(avctx, AV_LOG_ERROR, "Error: slices are not supported by huffyuv; use vcodec=ffvhuff\n");
+            return -1;
+        }
+        s->slices= avctx->slices;
+        if(check_slices(s) < 0)
+            return -1;
+    }
+
     ((uint8_t*)avctx->extradata)[0]= s->predictor | (s->decorrelate << 6);
     ((uint8_t*)avctx->extradata)[1]= s->bitstream_bpp;
     ((uint8_t*)avctx->extradata)[2]= s->interlaced ? 0x10 : 0x20;
     if(s->context)
         ((uint8_t*)avctx->extradata)[2]|= 0x40;
-    ((uint8_t*)avctx->extradata)[3]= 0;
+    ((uint8_t*)avctx->extradata)[3]= s->slices > 1 ? s->slices : 0;
     s->avctx->extradata_size= 4;
 
     if(avctx->stats_in){
@@ -703,6 +817,9 @@ static av_cold int encode_init(AVCodecContext *avctx)
 
     alloc_temp(s);
 
+    if(s->slices > 1 && init_slice_contexts(s) < 0)
+        return AVERROR(ENOMEM);
+
     s->picture_number=0;
 
     return 0;
@@ -934,7 +1051,7 @@ static void draw_slice(HYuvContext *s, int y){
     int h, cy;
     int offset[4];
 
-    if(s->avctx->draw_horiz_band==NULL)
+    if(s->avctx->draw_horiz_band==NULL || s->band)
         return;
 
     h= y - s->last_slice_end;
@@ -957,45 +1074,15 @@ static void draw_slice(HYuvContext *s, int y){
     s->last_slice_end= y + h;
 }
 
-static int decode_frame(AVCodecContext *avctx, void *data, int *data_size, AVPacket *avpkt){
-    const uint8_t *buf = avpkt->data;
-    int buf_size = avpkt->size;
-    HYuvContext *s = avctx->priv_data;
+/**
+ * Decode the picture of s, either a whole frame or one band of a sliced frame.
+ */
+static int decode_slice(HYuvContext *s){
     const int width= s->width;
     const int width2= s->width>>1;
     const int height= s->height;
     int fake_ystride, fake_ustride, fake_vstride;
     AVFrame * const p= &s->picture;
-    int table_size= 0;
-
-    AVFrame *picture = data;
-
-    av_fast_malloc(&s->bitstream_buffer, &s->bitstream_buffer_size, buf_size + FF_INPUT_BUFFER_PADDING_SIZE);
-    if (!s->bitstream_buffer)
-        return AVERROR(ENOMEM);
-
-    memset(s->bitstream_buffer + buf_size, 0, FF_INPUT_BUFFER_PADDING_SIZE);
-    s->dsp.bswap_buf((uint32_t*)s->bitstream_buffer, (const uint32_t*)buf, buf_size/4);
-
-    if(p->data[0])
-        ff_thread_release_buffer(avctx, p);
-
-    p->reference= 0;
-    if(ff_thread_get_buffer(avctx, p) < 0){
-        av_log(avctx, AV_LOG_ERROR, "get_buffer() failed\n");
-        return -1;
-    }
-
-    if(s->context){
-        table_size = read_huffman_tables(s, s->bitstream_buffer, buf_size);
-        if(table_size < 0)
-            return -1;
-    }
-
-    if((unsigned)(buf_size-table_size) >= INT_MAX/8)
-        return -1;
-
-    init_get_bits(&s->gb, s->bitstream_buffer+table_size, (buf_size-table_size)*8);
 
     fake_ystride= s->interlaced ? p->linesize[0]*2  : p->linesize[0];
     fake_ustride= s->interlaced ? p->linesize[1]*2  : p->linesize[1];
@@ -1014,7 +1101,7 @@ static int decode_frame(AVCodecContext *avctx, void *data, int *data_size, AVPac
             p->data[0][1]= get_bits(&s->gb, 8);
             p->data[0][0]= get_bits(&s->gb, 8);
 
-            av_log(avctx, AV_LOG_ERROR, "YUY2 output is not implemented yet\n");
+            av_log(s->avctx, AV_LOG_ERROR, "YUY2 output is not implemented yet\n");
             return -1;
         }else{
 
@@ -1188,16 +1275,106 @@ static int decode_frame(AVCodecContext *avctx, void *data, int *data_size, AVPac
                 draw_slice(s, height); // just 1 large slice as this is not possible in reverse order
                 break;
             default:
-                av_log(avctx, AV_LOG_ERROR, "prediction type not supported!\n");
+                av_log(s->avctx, AV_LOG_ERROR, "prediction type not supported!\n");
             }
         }else{
 
-            av_log(avctx, AV_LOG_ERROR, "BGR24 output is not implemented yet\n");
+            av_log(s->avctx, AV_LOG_ERROR, "BGR24 output is not implemented yet\n");
             return -1;
         }
     }
     emms_c();
 
+    return 0;
+}
+
+static int decode_slice_thread(AVCodecContext *avctx, void *arg){
+    HYuvContext *s= *(void**)arg;
+
+    return decode_slice(s);
+}
+
+static int decode_frame(AVCodecContext *avctx, void *data, int *data_size, AVPacket *avpkt){
+    const uint8_t *buf = avpkt->data;
+    int buf_size = avpkt->size;
+    HYuvContext *s = avctx->priv_data;
+    AVFrame * const p= &s->picture;
+    int table_size= 0;
+    int i;
+
+    AVFrame *picture = data;
+
+    av_fast_malloc(&s->bitstream_buffer, &s->bitstream_buffer_size, buf_size + FF_INPUT_BUFFER_PADDING_SIZE);
+    if (!s->bitstream_buffer)
+        return AVERROR(ENOMEM);
+
+    memset(s->bitstream_buffer + buf_size, 0, FF_INPUT_BUFFER_PADDING_SIZE);
+    s->dsp.bswap_buf((uint32_t*)s->bitstream_buffer, (const uint32_t*)buf, buf_size/4);
+
+    if(p->data[0])
+        ff_thread_release_buffer(avctx, p);
+
+    p->reference= 0;
+    if(ff_thread_get_buffer(avctx, p) < 0){
+        av_log(avctx, AV_LOG_ERROR, "get_buffer() failed\n");
+        return -1;
+    }
+
+    if(s->context){
+        table_size = read_huffman_tables(s, s->bitstream_buffer, buf_size);
+        if(table_size < 0)
+            return -1;
+    }
+
+    if((unsigned)(buf_size-table_size) >= INT_MAX/8)
+        return -1;
+
+    if(s->slices > 1){
+        /* the bands follow the tables, each one is followed by its size */
+        const uint8_t *end= buf + buf_size;
+        const int start= FFALIGN(table_size, 4);
+        int ret[MAX_SLICES];
+
+        for(i=s->slices-1; i>=0; i--){
+            HYuvContext *fs= s->slice_context[i];
+            unsigned size;
+
+            if(end - buf < start + 4)
+                goto slice_error;
+            size= AV_RB32(end - 4);
+            end-= 4;
+            if(size > end - buf - start || (size&3))
+                goto slice_error;
+            end-= size;
+
+            if(s->context)
+                copy_tables(fs, s);
+            init_band_picture(fs, p);
+            init_get_bits(&fs->gb, s->bitstream_buffer + (end - buf), size*8);
+        }
+
+        avctx->execute(avctx, decode_slice_thread, &s->slice_context[0], ret, s->slices, sizeof(void*));
+        for(i=0; i<s->slices; i++)
+            if(ret[i] < 0)
+                return -1;
+
+        s->last_slice_end= 0;
+        draw_slice(s, s->height);
+
+        *picture= *p;
+        *data_size = sizeof(AVFrame);
+
+        return buf_size;
+slice_error:
+        av_log(avctx, AV_LOG_ERROR, "invalid slice sizes\n");
+        return -1;
+    }
+
+    init_get_bits(&s->gb, s->bitstream_buffer+table_size, (buf_size-table_size)*8);
+
+    if(decode_slice(s) < 0)
+        return -1;
+
     *picture= *p;
     *data_size = sizeof(AVFrame);
 
@@ -1211,6 +1388,7 @@ static int common_end(HYuvContext *s){
     for(i=0; i<3; i++){
         av_freep(&s->temp[i]);
     }
+    free_slice_contexts(s);
     return 0;
 }
 
@@ -1235,38 +1413,19 @@ static av_cold int decode_end(AVCodecContext *avctx)
 #endif /* CONFIG_HUFFYUV_DECODER || CONFIG_FFVHUFF_DECODER */
 
 #if CONFIG_HUFFYUV_ENCODER || CONFIG_FFVHUFF_ENCODER
-static int encode_frame(AVCodecContext *avctx, unsigned char *buf, int buf_size, void *data){
-    HYuvContext *s = avctx->priv_data;
-    AVFrame *pict = data;
+/**
+ * Encode the picture of s, either a whole frame or one band of a sliced frame.
+ */
+static int encode_slice(HYuvContext *s){
     const int width= s->width;
     const int width2= s->width>>1;
     const int height= s->height;
-    const int fake_ystride= s->interlaced ? pict->linesize[0]*2  : pict->linesize[0];
-    const int fake_ustride= s->interlaced ? pict->linesize[1]*2  : pict->linesize[1];
-    const int fake_vstride= s->interlaced ? pict->linesize[2]*2  : pict->linesize[2];
     AVFrame * const p= &s->picture;
-    int i, j, size=0;
-
-    *p = *pict;
-    p->pict_type= AV_PICTURE_TYPE_I;
-    p->key_frame= 1;
+    const int fake_ystride= s->interlaced ? p->linesize[0]*2  : p->linesize[0];
+    const int fake_ustride= s->interlaced ? p->linesize[1]*2  : p->linesize[1];
+    const int fake_vstride= s->interlaced ? p->linesize[2]*2  : p->linesize[2];
 
-    if(s->context){
-        for(i=0; i<3; i++){
-            generate_len_table(s->len[i], s->stats[i]);
-            if(generate_bits_table(s->bits[i], s->len[i])<0)
-                return -1;
-            size+= store_table(s, s->len[i], &buf[size]);
-        }
-
-        for(i=0; i<3; i++)
-            for(j=0; j<256; j++)
-                s->stats[i][j] >>= 1;
-    }
-
-    init_put_bits(&s->pb, buf+size, buf_size-size);
-
-    if(avctx->pix_fmt == PIX_FMT_YUV422P || avctx->pix_fmt == PIX_FMT_YUV420P){
+    if(s->avctx->pix_fmt == PIX_FMT_YUV422P || s->avctx->pix_fmt == PIX_FMT_YUV420P){
         int lefty, leftu, leftv, y, cy;
 
         put_bits(&s->pb, 8, leftv= p->data[2][0]);
@@ -1370,7 +1529,7 @@ static int encode_frame(AVCodecContext *avctx, unsigned char *buf, int buf_size,
                 encode_422_bitstream(s, 0, width);
             }
         }
-    }else if(avctx->pix_fmt == PIX_FMT_RGB32){
+    }else if(s->avctx->pix_fmt == PIX_FMT_RGB32){
         uint8_t *data = p->data[0] + (height-1)*p->linesize[0];
         const int stride = -p->linesize[0];
         const int fake_stride = -fake_ystride;
@@ -1396,14 +1555,121 @@ static int encode_frame(AVCodecContext *avctx, unsigned char *buf, int buf_size,
             encode_bgr_bitstream(s, width);
         }
     }else{
-        av_log(avctx, AV_LOG_ERROR, "Format not supported!\n");
+        av_log(s->avctx, AV_LOG_ERROR, "Format not supported!\n");
     }
     emms_c();
 
-    size+= (put_bits_count(&s->pb)+31)/8;
-    put_bits(&s->pb, 16, 0);
-    put_bits(&s->pb, 15, 0);
-    size/= 4;
+    return 0;
+}
+
+static int encode_slice_thread(AVCodecContext *avctx, void *arg){
+    HYuvContext *s= *(void**)arg;
+
+    return encode_slice(s);
+}
+
+/**
+ * Encode the bands of a sliced frame in parallel and pack them after the
+ * size bytes of huffman tables already stored in buf.
+ * Every band is followed by its size in bytes, so a decoder can locate
+ * all bands from the end of the packet.
+ * Each band is written to a buffer of its own, large enough for its worst
+ * case, so a band that compresses badly cannot run into the next one.
+ * @return the size of the frame in bytes, or a negative value on error
+ */
+static int encode_sliced_frame(HYuvContext *s, uint8_t *buf, int buf_size, int size){
+    AVCodecContext *avctx= s->avctx;
+    uint8_t *buf_p;
+    int i, j, k;
+
+    /* the tables are read from the word swapped packet just like the bands */
+    while(size&3)
+        buf[size++]= 0;
+    s->dsp.bswap_buf((uint32_t*)buf, (uint32_t*)buf, size/4);
+
+    for(i=0; i<s->slices; i++){
+        HYuvContext *fs= s->slice_context[i];
+        /* at most 3 (rgb) or 2 (yuv) codes of 32 bits per pixel, plus the
+         * raw first pixels and the padding of the band */
+        int band_size= FFMIN((int64_t)fs->width*fs->height*(s->bitstream_bpp >= 24 ? 12 : 8) + 64,
+                             buf_size - size) & ~3;
+
+        av_fast_malloc(&fs->bitstream_buffer, &fs->bitstream_buffer_size, band_size);
+        if(!fs->bitstream_buffer)
+            return AVERROR(ENOMEM);
+        if(s->context)
+            copy_tables(fs, s);
+        memset(fs->stats, 0, sizeof(fs->stats));
+        init_band_picture(fs, &s->picture);
+        init_put_bits(&fs->pb, fs->bitstream_buffer, band_size - 4);
+    }
+
+    avctx->execute(avctx, encode_slice_thread, &s->slice_context[0], NULL, s->slices, sizeof(void*));
+
+    buf_p= buf + size;
+    for(i=0; i<s->slices; i++){
+        HYuvContext *fs= s->slice_context[i];
+        int bytes= (put_bits_count(&fs->pb)+31)/32*4;
+
+        for(j=0; j<3; j++)
+            for(k=0; k<256; k++)
+                s->stats[j][k]+= fs->stats[j][k];
+
+        if(buf + buf_size - buf_p < bytes + 4){
+            av_log(avctx, AV_LOG_ERROR, "encoded frame too large\n");
+            return -1;
+        }
+        if(!(avctx->flags2 & CODEC_FLAG2_NO_OUTPUT)){
+            put_bits(&fs->pb, 16, 0);
+            put_bits(&fs->pb, 15, 0);
+            flush_put_bits(&fs->pb);
+            s->dsp.bswap_buf((uint32_t*)buf_p, (uint32_t*)fs->pb.buf, bytes/4);
+        }
+        AV_WB32(buf_p + bytes, bytes);
+        buf_p+= bytes + 4;
+    }
+
+    return buf_p - buf;
+}
+
+static int encode_frame(AVCodecContext *avctx, unsigned char *buf, int buf_size, void *data){
+    HYuvContext *s = avctx->priv_data;
+    AVFrame *pict = data;
+    AVFrame * const p= &s->picture;
+    int i, j, size=0;
+
+    *p = *pict;
+    p->pict_type= AV_PICTURE_TYPE_I;
+    p->key_frame= 1;
+
+    if(s->context){
+        for(i=0; i<3; i++){
+            generate_len_table(s->len[i], s->stats[i]);
+            if(generate_bits_table(s->bits[i], s->len[i])<0)
+                return -1;
+            size+= store_table(s, s->len[i], &buf[size]);
+        }
+
+        for(i=0; i<3; i++)
+            for(j=0; j<256; j++)
+                s->stats[i][j] >>= 1;
+    }
+
+    if(s->slices > 1){
+        size= encode_sliced_frame(s, buf, buf_size, size);
+        if(size < 0)
+            return size;
+        size/= 4;
+    }else{
+        init_put_bits(&s->pb, buf+size, buf_size-size);
+
+        encode_slice(s);
+
+        size+= (put_bits_count(&s->pb)+31)/8;
+        put_bits(&s->pb, 16, 0);
+        put_bits(&s->pb, 15, 0);
+        size/= 4;
+    }
 
     if((s->flags&CODEC_FLAG_PASS1) && (s->picture_number&31)==0){
         int j;
@@ -1420,7 +1686,7 @@ static int encode_frame(AVCodecContext *avctx, unsigned char *buf, int buf_size,
         }
     } else
         avctx->stats_out[0] = '\0';
-    if(!(s->avctx->flags2 & CODEC_FLAG2_NO_OUTPUT)){
+    if(!(s->avctx->flags2 & CODEC_FLAG2_NO_OUTPUT) && s->slices <= 1){
         flush_put_bits(&s->pb);
         s->dsp.bswap_buf((uint32_t*)buf, (uint32_t*)buf, size);
     }
@@ -1470,7 +1736,7 @@ AVCodec ff_ffvhuff_decoder = {
     NULL,
     decode_end,
     decode_frame,
-    CODEC_CAP_DR1 | CODEC_CAP_DRAW_HORIZ_BAND | CODEC_CAP_FRAME_THREADS,
+    CODEC_CAP_DR1 | CODEC_CAP_DRAW_HORIZ_BAND | CODEC_CAP_FRAME_THREADS | CODEC_CAP_SLICE_THREADS,
     NULL,
     .init_thread_copy = ONLY_IF_THREADS_ENABLED(decode_init_thread_copy),
     .long_name = NULL_IF_CONFIG_SMALL("Huffyuv FFmpeg variant"),
@@ -1500,6 +1766,7 @@ AVCodec ff_ffvhuff_encoder = {
     encode_init,
     encode_frame,
     encode_end,
+    .capabilities = CODEC_CAP_SLICE_THREADS,
     .pix_fmts= (const enum PixelFormat[]){PIX_FMT_YUV420P, PIX_FMT_YUV422P, PIX_FMT_RGB32, PIX_FMT_NONE},
     .long_name = NULL_IF_CONFIG_SMALL("Huffyuv FFmpeg variant"),
 };
@@ -45,12 +45,26 @@ enum LagarithFrameType {
     FRAME_REDUCED_RES   = 11,   /*!< reduced resolution YV12 frame */
 };
 
+/**
+ * Per-plane decoding state, the planes are coded independently and
+ * may be decoded in parallel.
+ */
+typedef struct LagarithPlane {
+    uint8_t *dst;
+    int width;
+    int height;
+    int stride;
+    const uint8_t *src;         /*!< start of the coded plane */
+    int src_size;               /*!< bytes from src to the end of the packet */
+    int zeros;                  /*!< number of consecutive zero bytes encountered */
+    int zeros_rem;              /*!< number of zero bytes remaining to output */
+} LagarithPlane;
+
 typedef struct LagarithContext {
     AVCodecContext *avctx;
     AVFrame picture;
     DSPContext dsp;
-    int zeros;                  /*!< number of consecutive zero bytes encountered */
-    int zeros_rem;              /*!< number of zero bytes remaining to output */
+    LagarithPlane plane[3];
 } LagarithContext;
 
 /**
@@ -216,30 +230,6 @@ static int lag_read_prob_header(lag_rac *rac, GetBitContext *gb)
     return 0;
 }
 
-static void add_lag_median_prediction(uint8_t *dst, uint8_t *src1,
-                                      uint8_t *diff, int w, int *left,
-                                      int *left_top)
-{
-    /* This is almost identical to add_hfyu_median_prediction in dsputil.h.
-     * However the &0xFF on the gradient predictor yealds incorrect output
-     * for lagarith.
-     */
-    int i;
-    uint8_t l, lt;
-
-    l  = *left;
-    lt = *left_top;
-
-    for (i = 0; i < w; i++) {
-        l = mid_pred(l, src1[i], l + src1[i] - lt) + diff[i];
-        lt = src1[i];
-        dst[i] = l;
-    }
-
-    *left     = l;
-    *left_top = lt;
-}
-
 static void lag_pred_line(LagarithContext *l, uint8_t *buf,
                           int width, int stride, int line)
 {
@@ -261,11 +251,11 @@ static void lag_pred_line(LagarithContext *l, uint8_t *buf,
     /* Left pixel is actually prev_row[width] */
     L = buf[width - stride - 1];
 
-    add_lag_median_prediction(buf, buf - stride, buf,
-                              width, &L, &TL);
+    l->dsp.add_lag_median_prediction(buf, buf - stride, buf,
+                                     width, &L, &TL);
 }
 
-static int lag_decode_line(LagarithContext *l, lag_rac *rac,
+static int lag_decode_line(LagarithPlane *l, lag_rac *rac,
                            uint8_t *dst, int width, int stride,
                            int esc_count)
 {
@@ -307,8 +297,8 @@ handle_zeros:
     return ret;
 }
 
-static int lag_decode_zero_run_line(LagarithContext *l, uint8_t *dst,
-                                    const uint8_t *src, int width,
+static int lag_decode_zero_run_line(LagarithContext *lc, LagarithPlane *l,
+                                    uint8_t *dst, const uint8_t *src, int width,
                                     int esc_count)
 {
     int i = 0;
@@ -323,7 +313,7 @@ output_zeros:
     if (l->zeros_rem) {
         count = FFMIN(l->zeros_rem, width - i);
         if (end - dst < count) {
-            av_log(l->avctx, AV_LOG_ERROR, "Too many zeros remaining.\n");
+            av_log(lc->avctx, AV_LOG_ERROR, "Too many zeros remaining.\n");
             return AVERROR_INVALIDDATA;
         }
 
@@ -353,26 +343,30 @@ output_zeros:
             src += i;
         }
     }
-    return start - src;
+    return src - start;
 }
 
-
-
-static int lag_decode_arith_plane(LagarithContext *l, uint8_t *dst,
-                                  int width, int height, int stride,
-                                  const uint8_t *src, int src_size)
+static int lag_decode_arith_plane(LagarithContext *l, LagarithPlane *p)
 {
     int i = 0;
     int read = 0;
     uint32_t length;
     uint32_t offset = 1;
+    uint8_t *dst = p->dst;
+    int width  = p->width;
+    int height = p->height;
+    int stride = p->stride;
+    const uint8_t *src = p->src;
     int esc_count = src[0];
     GetBitContext gb;
     lag_rac rac;
 
     rac.avctx = l->avctx;
-    l->zeros = 0;
+    p->zeros     = 0;
+    p->zeros_rem = 0;
 
+    /* Each line is predicted right after it has been decoded, while it
+     * is still in cache; the prediction only depends on lines above. */
     if (esc_count < 4) {
         length = width * height;
         if (esc_count && AV_RL32(src + 1) < length) {
@@ -380,16 +374,22 @@ static int lag_decode_arith_plane(LagarithContext *l, uint8_t *dst,
             offset += 4;
         }
 
-        init_get_bits(&gb, src + offset, src_size * 8);
+        if (p->src_size < offset) {
+            av_log(l->avctx, AV_LOG_ERROR, "Plane data truncated.\n");
+            return -1;
+        }
+        init_get_bits(&gb, src + offset, (p->src_size - offset) * 8);
 
         if (lag_read_prob_header(&rac, &gb) < 0)
             return -1;
 
         lag_rac_init(&rac, &gb, length - stride);
 
-        for (i = 0; i < height; i++)
-            read += lag_decode_line(l, &rac, dst + (i * stride), width,
-                                    stride, esc_count);
+        for (i = 0; i < height; i++) {
+            read += lag_decode_line(p, &rac, dst, width, stride, esc_count);
+            lag_pred_line(l, dst, width, stride, i);
+            dst += stride;
+        }
 
         if (read > length)
             av_log(l->avctx, AV_LOG_WARNING,
@@ -399,14 +399,26 @@ static int lag_decode_arith_plane(LagarithContext *l, uint8_t *dst,
         esc_count -= 4;
         if (esc_count > 0) {
             /* Zero run coding only, no range coding. */
-            for (i = 0; i < height; i++)
-                src += lag_decode_zero_run_line(l, dst + (i * stride), src,
-                                                width, esc_count);
+            for (i = 0; i < height; i++) {
+                int ret = lag_decode_zero_run_line(l, p, dst, src, width,
+                                                   esc_count);
+                if (ret < 0)
+                    return ret;
+                src += ret;
+                lag_pred_line(l, dst, width, stride, i);
+                dst += stride;
+            }
         } else {
             /* Plane is stored uncompressed */
+            if (p->src_size < width * height) {
+                av_log(l->avctx, AV_LOG_ERROR, "Plane data truncated.\n");
+                return -1;
+            }
             for (i = 0; i < height; i++) {
-                memcpy(dst + (i * stride), src, width);
+                memcpy(dst, src, width);
                 src += width;
+                lag_pred_line(l, dst, width, stride, i);
+                dst += stride;
             }
         }
     } else if (esc_count == 0xff) {
@@ -416,21 +428,37 @@ static int lag_decode_arith_plane(LagarithContext *l, uint8_t *dst,
         /* Do not apply prediction.
            Note: memset to 0 above, setting first value to src[1]
            and applying prediction gives the same result. */
-        return 0;
     } else {
         av_log(l->avctx, AV_LOG_ERROR,
                "Invalid zero run escape code! (%#x)\n", esc_count);
         return -1;
     }
 
-    for (i = 0; i < height; i++) {
-        lag_pred_line(l, dst, width, stride, i);
-        dst += stride;
-    }
-
     return 0;
 }
 
+static int lag_decode_plane_thread(AVCodecContext *avctx, void *arg,
+                                   int jobnr, int threadnr)
+{
+    LagarithContext *l = arg;
+    int ret = lag_decode_arith_plane(l, &l->plane[jobnr]);
+
+    emms_c();
+    return ret;
+}
+
+static void lag_init_plane(LagarithPlane *p, uint8_t *dst, int width,
+                           int height, int stride, const uint8_t *buf,
+                           int buf_size, uint32_t offset)
+{
+    p->dst      = dst;
+    p->width    = width;
+    p->height   = height;
+    p->stride   = stride;
+    p->src      = buf + offset;
+    p->src_size = buf_size - offset;
+}
+
 /**
  * Decode a frame.
  * @param avctx codec context
@@ -448,6 +476,7 @@ static int lag_decode_frame(AVCodecContext *avctx,
     AVFrame *const p = &l->picture;
     uint8_t frametype = 0;
     uint32_t offset_gu = 0, offset_bv = 0, offset_ry = 9;
+    int ret[3];
 
     AVFrame *picture = data;
 
@@ -457,6 +486,11 @@ static int lag_decode_frame(AVCodecContext *avctx,
     p->reference = 0;
     p->key_frame = 1;
 
+    if (buf_size < 9) {
+        av_log(avctx, AV_LOG_ERROR, "Packet too small.\n");
+        return -1;
+    }
+
     frametype = buf[0];
 
     offset_gu = AV_RL32(buf + 1);
@@ -471,15 +505,25 @@ static int lag_decode_frame(AVCodecContext *avctx,
             return -1;
         }
 
-        lag_decode_arith_plane(l, p->data[0], avctx->width, avctx->height,
-                               p->linesize[0], buf + offset_ry,
-                               buf_size);
-        lag_decode_arith_plane(l, p->data[2], avctx->width / 2,
-                               avctx->height / 2, p->linesize[2],
-                               buf + offset_gu, buf_size);
-        lag_decode_arith_plane(l, p->data[1], avctx->width / 2,
-                               avctx->height / 2, p->linesize[1],
-                               buf + offset_bv, buf_size);
+        if (offset_gu >= buf_size || offset_bv >= buf_size) {
+            av_log(avctx, AV_LOG_ERROR, "Invalid plane offsets.\n");
+            return -1;
+        }
+
+        lag_init_plane(&l->plane[0], p->data[0], avctx->width,
+                       avctx->height, p->linesize[0], buf, buf_size,
+                       offset_ry);
+        lag_init_plane(&l->plane[1], p->data[2], avctx->width / 2,
+                       avctx->height / 2, p->linesize[2], buf, buf_size,
+                       offset_gu);
+        lag_init_plane(&l->plane[2], p->data[1], avctx->width / 2,
+                       avctx->height / 2, p->linesize[1], buf, buf_size,
+                       offset_bv);
+        /* the plane offsets are known from the header, so the planes
+         * are decoded concurrently */
+        avctx->execute2(avctx, lag_decode_plane_thread, l, ret, 3);
+        if (ret[0] < 0 || ret[1] < 0 || ret[2] < 0)
+            return -1;
         break;
     default:
         av_log(avctx, AV_LOG_ERROR,
@@ -522,6 +566,6 @@ AVCodec ff_lagarith_decoder = {
     NULL,
     lag_decode_end,
     lag_decode_frame,
-    CODEC_CAP_DR1,
+    CODEC_CAP_DR1 | CODEC_CAP_SLICE_THREADS,
     .long_name = NULL_IF_CONFIG_SMALL("Lagarith lossless"),
 };
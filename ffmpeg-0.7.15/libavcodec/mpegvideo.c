@@ -460,6 +460,19 @@ void ff_update_duplicate_context(MpegEncContext *dst, MpegEncContext *src){
 //STOP_TIMER("update_duplicate_context") //about 10k cycles / 0.01 sec for 1000frames on 1ghz with 2 threads
 }
 
+/**
+ * Split the picture into count bands of macroblock rows and assign them to
+ * the first count thread contexts.
+ */
+void ff_set_context_rows(MpegEncContext *s, int count){
+    int i;
+
+    for(i=0; i<count; i++){
+        s->thread_context[i]->start_mb_y= (s->mb_height*(i  ) + count/2) / count;
+        s->thread_context[i]->end_mb_y  = (s->mb_height*(i+1) + count/2) / count;
+    }
+}
+
 int ff_mpeg_update_thread_context(AVCodecContext *dst, const AVCodecContext *src)
 {
     MpegEncContext *s = dst->priv_data, *s1 = src->priv_data;
@@ -592,6 +605,15 @@ av_cold int MPV_common_init(MpegEncContext *s)
         return -1;
     }
 
+    s->slice_context_count= s->avctx->thread_count;
+    if(s->encoding && s->avctx->slices)
+        s->slice_context_count= s->avctx->slices;
+
+    if(s->slice_context_count > MAX_THREADS || (s->slice_context_count > s->mb_height && s->mb_height)){
+        av_log(s->avctx, AV_LOG_ERROR, "too many slices\n");
+        return -1;
+    }
+
     if((s->width || s->height) && av_image_check_size(s->width, s->height, 0, s->avctx))
         return -1;
 
@@ -746,7 +768,8 @@ av_cold int MPV_common_init(MpegEncContext *s)
     s->thread_context[0]= s;
 
     if (s->encoding || (HAVE_THREADS && s->avctx->active_thread_type&FF_THREAD_SLICE)) {
-        threads = s->avctx->thread_count;
+        /* the encoder may run motion estimation on more row bands than it codes slices */
+        threads = FFMAX(s->avctx->thread_count, s->slice_context_count);
 
         for(i=1; i<threads; i++){
             s->thread_context[i]= av_malloc(sizeof(MpegEncContext));
@@ -756,9 +779,8 @@ av_cold int MPV_common_init(MpegEncContext *s)
         for(i=0; i<threads; i++){
             if(init_duplicate_context(s->thread_context[i], s) < 0)
                 goto fail;
-            s->thread_context[i]->start_mb_y= (s->mb_height*(i  ) + s->avctx->thread_count/2) / s->avctx->thread_count;
-            s->thread_context[i]->end_mb_y  = (s->mb_height*(i+1) + s->avctx->thread_count/2) / s->avctx->thread_count;
         }
+        ff_set_context_rows(s, s->slice_context_count);
     } else {
         if(init_duplicate_context(s, s) < 0) goto fail;
         s->start_mb_y = 0;
@@ -778,10 +800,12 @@ void MPV_common_end(MpegEncContext *s)
     int i, j, k;
 
     if (s->encoding || (HAVE_THREADS && s->avctx->active_thread_type&FF_THREAD_SLICE)) {
-        for(i=0; i<s->avctx->thread_count; i++){
+        int threads = FFMAX(s->avctx->thread_count, s->slice_context_count);
+
+        for(i=0; i<threads; i++){
             free_duplicate_context(s->thread_context[i]);
         }
-        for(i=1; i<s->avctx->thread_count; i++){
+        for(i=1; i<threads; i++){
             av_freep(&s->thread_context[i]);
         }
     } else free_duplicate_context(s);
@@ -242,7 +242,7 @@ static void MPV_encode_defaults(MpegEncContext *s){
 av_cold int MPV_encode_init(AVCodecContext *avctx)
 {
     MpegEncContext *s = avctx->priv_data;
-    int i;
+    int i, slices;
     int chroma_h_shift, chroma_v_shift;
 
     MPV_encode_defaults(s);
@@ -470,7 +470,9 @@ av_cold int MPV_encode_init(AVCodecContext *avctx)
         }
     }
 
-    if(s->avctx->thread_count > 1 && s->codec_id != CODEC_ID_MPEG4
+    slices= avctx->slices ? avctx->slices : avctx->thread_count;
+
+    if(slices > 1 && s->codec_id != CODEC_ID_MPEG4
        && s->codec_id != CODEC_ID_MPEG1VIDEO && s->codec_id != CODEC_ID_MPEG2VIDEO
        && (s->codec_id != CODEC_ID_H263P || !(s->flags & CODEC_FLAG_H263P_SLICE_STRUCT))){
         av_log(avctx, AV_LOG_ERROR, "multi threaded encoding not supported by codec\n");
@@ -482,7 +484,7 @@ av_cold int MPV_encode_init(AVCodecContext *avctx)
         return -1;
     }
 
-    if(s->avctx->thread_count > 1)
+    if(slices > 1)
         s->rtp_mode= 1;
 
     if(!avctx->time_base.den || !avctx->time_base.num){
@@ -942,52 +944,145 @@ static int skip_check(MpegEncContext *s, Picture *p, Picture *ref){
     return 0;
 }
 
+static int b_frame_score_thread(AVCodecContext *c, void *arg, int jobnr, int threadnr){
+    MpegEncContext *s= arg;
+    Picture *pic= s->input_picture[jobnr+1];
+
+    if(pic && pic->b_frame_score==0){
+        pic->b_frame_score=
+            get_intra_count(s, pic->data[0], s->input_picture[jobnr]->data[0], s->linesize) + 1;
+    }
+    return 0;
+}
+
+/**
+ * state shared by the jobs of estimate_best_b_count(), one encoder per
+ * candidate so that the scores do not depend on the thread scheduling
+ */
+typedef struct BCountContext {
+    MpegEncContext *s;
+    AVCodecContext *c[FF_MAX_B_FRAMES+1];
+    uint8_t *outbuf[FF_MAX_B_FRAMES+1];
+    int outbuf_size;
+    AVFrame input[FF_MAX_B_FRAMES+2];
+    int p_lambda, b_lambda, lambda2;
+    int64_t rd[FF_MAX_B_FRAMES+1];
+} BCountContext;
+
+/**
+ * encodes the downscaled lookahead with j consecutive b frames and stores
+ * the rate distortion score in rd[j].
+ */
+static int estimate_b_count_thread(AVCodecContext *avctx, void *arg, int j, int threadnr){
+    BCountContext *bc= arg;
+    MpegEncContext *s= bc->s;
+    AVCodecContext *c= bc->c[j];
+    uint8_t *outbuf= bc->outbuf[j];
+    AVFrame input[FF_MAX_B_FRAMES+2];
+    int i, out_size;
+    int64_t rd=0;
+
+    memcpy(input, bc->input, sizeof(input));
+
+    input[0].pict_type= AV_PICTURE_TYPE_I;
+    input[0].quality= 1 * FF_QP2LAMBDA;
+    out_size = avcodec_encode_video(c, outbuf, bc->outbuf_size, &input[0]);
+//    rd += (out_size * lambda2) >> FF_LAMBDA_SHIFT;
+
+    for(i=0; i<s->max_b_frames+1; i++){
+        int is_p= i % (j+1) == j || i==s->max_b_frames;
+
+        input[i+1].pict_type= is_p ? AV_PICTURE_TYPE_P : AV_PICTURE_TYPE_B;
+        input[i+1].quality= is_p ? bc->p_lambda : bc->b_lambda;
+        out_size = avcodec_encode_video(c, outbuf, bc->outbuf_size, &input[i+1]);
+        rd += (out_size * bc->lambda2) >> (FF_LAMBDA_SHIFT - 3);
+    }
+
+    /* get the delayed frames */
+    while(out_size){
+        out_size = avcodec_encode_video(c, outbuf, bc->outbuf_size, NULL);
+        rd += (out_size * bc->lambda2) >> (FF_LAMBDA_SHIFT - 3);
+    }
+
+    rd += c->error[0] + c->error[1] + c->error[2];
+
+    bc->rd[j]= rd;
+    return 0;
+}
+
+/**
+ * tries every number of consecutive b frames on a downscaled copy of the
+ * lookahead. The candidates are independent, so they are encoded in parallel,
+ * each with a freshly opened trial encoder.
+ */
 static int estimate_best_b_count(MpegEncContext *s){
     AVCodec *codec= avcodec_find_encoder(s->avctx->codec_id);
-    AVCodecContext *c= avcodec_alloc_context();
-    AVFrame input[FF_MAX_B_FRAMES+2];
+    BCountContext bc;
     const int scale= s->avctx->brd_scale;
-    int i, j, out_size, p_lambda, b_lambda, lambda2;
-    int outbuf_size= s->width * s->height; //FIXME
-    uint8_t *outbuf= av_malloc(outbuf_size);
+    int width = s->width >> scale;
+    int height= s->height>> scale;
+    int i, j, count;
     int64_t best_rd= INT64_MAX;
     int best_b_count= -1;
 
     assert(scale>=0 && scale <=3);
 
+    memset(&bc, 0, sizeof(bc));
+    bc.s= s;
+    bc.outbuf_size= s->width * s->height; //FIXME
+
+    for(count=0; count<s->max_b_frames+1; count++)
+        if(!s->input_picture[count])
+            break;
+
 //    emms_c();
-    p_lambda= s->last_lambda_for[AV_PICTURE_TYPE_P]; //s->next_picture_ptr->quality;
-    b_lambda= s->last_lambda_for[AV_PICTURE_TYPE_B]; //p_lambda *FFABS(s->avctx->b_quant_factor) + s->avctx->b_quant_offset;
-    if(!b_lambda) b_lambda= p_lambda; //FIXME we should do this somewhere else
-    lambda2= (b_lambda*b_lambda + (1<<FF_LAMBDA_SHIFT)/2 ) >> FF_LAMBDA_SHIFT;
-
-    c->width = s->width >> scale;
-    c->height= s->height>> scale;
-    c->flags= CODEC_FLAG_QSCALE | CODEC_FLAG_PSNR | CODEC_FLAG_INPUT_PRESERVED /*| CODEC_FLAG_EMU_EDGE*/;
-    c->flags|= s->avctx->flags & CODEC_FLAG_QPEL;
-    c->mb_decision= s->avctx->mb_decision;
-    c->me_cmp= s->avctx->me_cmp;
-    c->mb_cmp= s->avctx->mb_cmp;
-    c->me_sub_cmp= s->avctx->me_sub_cmp;
-    c->pix_fmt = PIX_FMT_YUV420P;
-    c->time_base= s->avctx->time_base;
-    c->max_b_frames= s->max_b_frames;
-
-    if (avcodec_open2(c, codec, NULL) < 0)
-        return -1;
+    bc.p_lambda= s->last_lambda_for[AV_PICTURE_TYPE_P]; //s->next_picture_ptr->quality;
+    bc.b_lambda= s->last_lambda_for[AV_PICTURE_TYPE_B]; //p_lambda *FFABS(s->avctx->b_quant_factor) + s->avctx->b_quant_offset;
+    if(!bc.b_lambda) bc.b_lambda= bc.p_lambda; //FIXME we should do this somewhere else
+    bc.lambda2= (bc.b_lambda*bc.b_lambda + (1<<FF_LAMBDA_SHIFT)/2 ) >> FF_LAMBDA_SHIFT;
+
+    /* avcodec_open2() must not run concurrently, so open all trial encoders here */
+    for(i=0; i<count; i++){
+        AVCodecContext *c= avcodec_alloc_context();
+
+        if(!c)
+            goto fail;
+        bc.c[i]= c;
+
+        c->width = width;
+        c->height= height;
+        c->flags= CODEC_FLAG_QSCALE | CODEC_FLAG_PSNR | CODEC_FLAG_INPUT_PRESERVED /*| CODEC_FLAG_EMU_EDGE*/;
+        c->flags|= s->avctx->flags & CODEC_FLAG_QPEL;
+        c->mb_decision= s->avctx->mb_decision;
+        c->me_cmp= s->avctx->me_cmp;
+        c->mb_cmp= s->avctx->mb_cmp;
+        c->me_sub_cmp= s->avctx->me_sub_cmp;
+        c->pix_fmt = PIX_FMT_YUV420P;
+        c->time_base= s->avctx->time_base;
+        c->max_b_frames= s->max_b_frames;
+
+        if (avcodec_open2(c, codec, NULL) < 0)
+            goto fail;
+
+        bc.outbuf[i]= av_malloc(bc.outbuf_size);
+        if(!bc.outbuf[i])
+            goto fail;
+    }
 
     for(i=0; i<s->max_b_frames+2; i++){
-        int ysize= c->width*c->height;
-        int csize= (c->width/2)*(c->height/2);
+        int ysize= width*height;
+        int csize= (width/2)*(height/2);
         Picture pre_input, *pre_input_ptr= i ? s->input_picture[i-1] : s->next_picture_ptr;
 
-        avcodec_get_frame_defaults(&input[i]);
-        input[i].data[0]= av_malloc(ysize + 2*csize);
-        input[i].data[1]= input[i].data[0] + ysize;
-        input[i].data[2]= input[i].data[1] + csize;
-        input[i].linesize[0]= c->width;
-        input[i].linesize[1]=
-        input[i].linesize[2]= c->width/2;
+        avcodec_get_frame_defaults(&bc.input[i]);
+        bc.input[i].data[0]= av_mallocz(ysize + 2*csize);
+        if(!bc.input[i].data[0])
+            goto fail;
+        bc.input[i].data[1]= bc.input[i].data[0] + ysize;
+        bc.input[i].data[2]= bc.input[i].data[1] + csize;
+        bc.input[i].linesize[0]= width;
+        bc.input[i].linesize[1]=
+        bc.input[i].linesize[2]= width/2;
 
         if(pre_input_ptr && (!i || s->input_picture[i-1])) {
             pre_input= *pre_input_ptr;
@@ -998,54 +1093,31 @@ static int estimate_best_b_count(MpegEncContext *s){
                 pre_input.data[2]+=INPLACE_OFFSET;
             }
 
-            s->dsp.shrink[scale](input[i].data[0], input[i].linesize[0], pre_input.data[0], pre_input.linesize[0], c->width, c->height);
-            s->dsp.shrink[scale](input[i].data[1], input[i].linesize[1], pre_input.data[1], pre_input.linesize[1], c->width>>1, c->height>>1);
-            s->dsp.shrink[scale](input[i].data[2], input[i].linesize[2], pre_input.data[2], pre_input.linesize[2], c->width>>1, c->height>>1);
+            s->dsp.shrink[scale](bc.input[i].data[0], bc.input[i].linesize[0], pre_input.data[0], pre_input.linesize[0], width, height);
+            s->dsp.shrink[scale](bc.input[i].data[1], bc.input[i].linesize[1], pre_input.data[1], pre_input.linesize[1], width>>1, height>>1);
+            s->dsp.shrink[scale](bc.input[i].data[2], bc.input[i].linesize[2], pre_input.data[2], pre_input.linesize[2], width>>1, height>>1);
         }
     }
 
-    for(j=0; j<s->max_b_frames+1; j++){
-        int64_t rd=0;
-
-        if(!s->input_picture[j])
-            break;
-
-        c->error[0]= c->error[1]= c->error[2]= 0;
-
-        input[0].pict_type= AV_PICTURE_TYPE_I;
-        input[0].quality= 1 * FF_QP2LAMBDA;
-        out_size = avcodec_encode_video(c, outbuf, outbuf_size, &input[0]);
-//        rd += (out_size * lambda2) >> FF_LAMBDA_SHIFT;
+    s->avctx->execute2(s->avctx, estimate_b_count_thread, &bc, NULL, count);
 
-        for(i=0; i<s->max_b_frames+1; i++){
-            int is_p= i % (j+1) == j || i==s->max_b_frames;
-
-            input[i+1].pict_type= is_p ? AV_PICTURE_TYPE_P : AV_PICTURE_TYPE_B;
-            input[i+1].quality= is_p ? p_lambda : b_lambda;
-            out_size = avcodec_encode_video(c, outbuf, outbuf_size, &input[i+1]);
-            rd += (out_size * lambda2) >> (FF_LAMBDA_SHIFT - 3);
-        }
-
-        /* get the delayed frames */
-        while(out_size){
-            out_size = avcodec_encode_video(c, outbuf, outbuf_size, NULL);
-            rd += (out_size * lambda2) >> (FF_LAMBDA_SHIFT - 3);
-        }
-
-        rd += c->error[0] + c->error[1] + c->error[2];
-
-        if(rd < best_rd){
-            best_rd= rd;
+    for(j=0; j<count; j++){
+        if(bc.rd[j] < best_rd){
+            best_rd= bc.rd[j];
             best_b_count= j;
         }
     }
 
-    av_freep(&outbuf);
-    avcodec_close(c);
-    av_freep(&c);
+fail:
+    for(i=0; i<count; i++){
+        av_freep(&bc.outbuf[i]);
+        if(bc.c[i])
+            avcodec_close(bc.c[i]);
+        av_freep(&bc.c[i]);
+    }
 
     for(i=0; i<s->max_b_frames+2; i++){
-        av_freep(&input[i].data[0]);
+        av_freep(&bc.input[i].data[0]);
     }
 
     return best_b_count;
@@ -1110,13 +1182,7 @@ static int select_input_picture(MpegEncContext *s){
                 b_frames= s->max_b_frames;
                 while(b_frames && !s->input_picture[b_frames]) b_frames--;
             }else if(s->avctx->b_frame_strategy==1){
-                for(i=1; i<s->max_b_frames+1; i++){
-                    if(s->input_picture[i] && s->input_picture[i]->b_frame_score==0){
-                        s->input_picture[i]->b_frame_score=
-                            get_intra_count(s, s->input_picture[i  ]->data[0],
-                                               s->input_picture[i-1]->data[0], s->linesize) + 1;
-                    }
-                }
+                s->avctx->execute2(s->avctx, b_frame_score_thread, s, NULL, s->max_b_frames);
                 for(i=0; i<s->max_b_frames+1; i++){
                     if(s->input_picture[i]==NULL || s->input_picture[i]->b_frame_score - 1 > s->mb_num/s->avctx->b_sensitivity) break;
                 }
@@ -1227,7 +1293,7 @@ int MPV_encode_picture(AVCodecContext *avctx,
 {
     MpegEncContext *s = avctx->priv_data;
     AVFrame *pic_arg = data;
-    int i, stuffing_count, context_count = avctx->thread_count;
+    int i, stuffing_count, context_count = s->slice_context_count;
 
     for(i=0; i<context_count; i++){
         int start_y= s->thread_context[i]->start_mb_y;
@@ -2760,7 +2826,8 @@ static int encode_picture(MpegEncContext *s, int picture_number)
 {
     int i;
     int bits;
-    int context_count = s->avctx->thread_count;
+    int context_count = s->slice_context_count;
+    int me_context_count = FFMAX(s->avctx->thread_count, context_count);
 
     s->picture_number = picture_number;
 
@@ -2800,10 +2867,15 @@ static int encode_picture(MpegEncContext *s, int picture_number)
     }
 
     s->mb_intra=0; //for the rate distortion & bit compare functions
-    for(i=1; i<context_count; i++){
+    for(i=1; i<me_context_count; i++){
         ff_update_duplicate_context(s->thread_context[i], s);
     }
 
+    /* motion estimation does not depend on the slice structure, so it is
+     * split into as many row bands as there are threads */
+    if(me_context_count != context_count)
+        ff_set_context_rows(s, me_context_count);
+
     if(ff_init_me(s)<0)
         return -1;
 
@@ -2813,11 +2885,11 @@ static int encode_picture(MpegEncContext *s, int picture_number)
         s->lambda2= (s->lambda2* (int64_t)s->avctx->me_penalty_compensation + 128)>>8;
         if(s->pict_type != AV_PICTURE_TYPE_B && s->avctx->me_threshold==0){
             if((s->avctx->pre_me && s->last_non_b_pict_type==AV_PICTURE_TYPE_I) || s->avctx->pre_me==2){
-                s->avctx->execute(s->avctx, pre_estimate_motion_thread, &s->thread_context[0], NULL, context_count, sizeof(void*));
+                s->avctx->execute(s->avctx, pre_estimate_motion_thread, &s->thread_context[0], NULL, me_context_count, sizeof(void*));
             }
         }
 
-        s->avctx->execute(s->avctx, estimate_motion_thread, &s->thread_context[0], NULL, context_count, sizeof(void*));
+        s->avctx->execute(s->avctx, estimate_motion_thread, &s->thread_context[0], NULL, me_context_count, sizeof(void*));
     }else /* if(s->pict_type == AV_PICTURE_TYPE_I) */{
         /* I-Frame */
         for(i=0; i<s->mb_stride*s->mb_height; i++)
@@ -2825,12 +2897,14 @@ static int encode_picture(MpegEncContext *s, int picture_number)
 
         if(!s->fixed_qscale){
             /* finding spatial complexity for I-frame rate control */
-            s->avctx->execute(s->avctx, mb_var_thread, &s->thread_context[0], NULL, context_count, sizeof(void*));
+            s->avctx->execute(s->avctx, mb_var_thread, &s->thread_context[0], NULL, me_context_count, sizeof(void*));
         }
     }
-    for(i=1; i<context_count; i++){
+    for(i=1; i<me_context_count; i++){
         merge_context_after_me(s, s->thread_context[i]);
     }
+    if(me_context_count != context_count)
+        ff_set_context_rows(s, context_count);
     s->current_picture.mc_mb_var_sum= s->current_picture_ptr->mc_mb_var_sum= s->me.mc_mb_var_sum_temp;
     s->current_picture.   mb_var_sum= s->current_picture_ptr->   mb_var_sum= s->me.   mb_var_sum_temp;
     emms_c();
@@ -615,6 +615,74 @@ static void add_hfyu_median_prediction_cmov(uint8_t *dst, const uint8_t *top, co
 }
 #endif
 
+/* one pixel of lagarith's median prediction: the gradient l+t-tl is
+ * clipped to 0..255 instead of wrapped, which leaves the median unchanged
+ * since l and t are within that range */
+#define LAG_MEDIAN_STEP(shift) \
+        "movq      %%mm3, %%mm4         \n\t"\
+        "paddusb   %%mm0, %%mm4         \n\t"\
+        "psubusb   %%mm6, %%mm4         \n\t"\
+        "movq      %%mm3, %%mm5         \n\t"\
+        "pmaxub    %%mm1, %%mm3         \n\t"\
+        "pminub    %%mm1, %%mm5         \n\t"\
+        "pminub    %%mm4, %%mm3         \n\t"\
+        "pmaxub    %%mm5, %%mm3         \n\t"\
+        "paddb     %%mm2, %%mm3         \n\t"\
+        "movq      %%mm3, %%mm4         \n\t"\
+        "psrlq        $8, %%mm7         \n\t"\
+        "psllq       $56, %%mm4         \n\t"\
+        "por       %%mm4, %%mm7         \n\t"\
+        shift
+
+#define LAG_MEDIAN_SHIFT \
+        "psrlq        $8, %%mm0         \n\t"\
+        "psrlq        $8, %%mm6         \n\t"\
+        "psrlq        $8, %%mm1         \n\t"\
+        "psrlq        $8, %%mm2         \n\t"
+
+static void add_lag_median_prediction_mmx2(uint8_t *dst, const uint8_t *top, const uint8_t *diff, int w, int *left, int *left_top) {
+    x86_reg w2 = -w;
+
+    if (w <= 0)
+        return;
+    __asm__ volatile(
+        "movd         %4, %%mm3         \n\t" // l
+        "movd         %5, %%mm4         \n\t"
+        "movq  (%2,%0), %%mm1           \n\t" // t
+        "movq      %%mm1, %%mm5         \n\t"
+        "psllq        $8, %%mm5         \n\t"
+        "por       %%mm5, %%mm4         \n\t" // tl
+        "jmp 2f                         \n\t"
+        "1:                             \n\t"
+        "movq  (%2,%0), %%mm4           \n\t"
+        "movq      %%mm4, %%mm5         \n\t"
+        "psllq        $8, %%mm4         \n\t"
+        "por       %%mm1, %%mm4         \n\t" // tl
+        "movq      %%mm5, %%mm1         \n\t" // t
+        "2:                             \n\t"
+        "movq      %%mm1, %%mm0         \n\t"
+        "movq      %%mm4, %%mm6         \n\t"
+        "psubusb   %%mm4, %%mm0         \n\t" // t-tl if positive
+        "psubusb   %%mm1, %%mm6         \n\t" // tl-t if positive
+        "movq  (%3,%0), %%mm2           \n\t" // residual
+        LAG_MEDIAN_STEP(LAG_MEDIAN_SHIFT)
+        LAG_MEDIAN_STEP(LAG_MEDIAN_SHIFT)
+        LAG_MEDIAN_STEP(LAG_MEDIAN_SHIFT)
+        LAG_MEDIAN_STEP(LAG_MEDIAN_SHIFT)
+        LAG_MEDIAN_STEP(LAG_MEDIAN_SHIFT)
+        LAG_MEDIAN_STEP(LAG_MEDIAN_SHIFT)
+        LAG_MEDIAN_STEP(LAG_MEDIAN_SHIFT)
+        LAG_MEDIAN_STEP("")
+        "movq      %%mm7, (%1,%0)       \n\t"
+        "add          $8, %0            \n\t"
+        "jl 1b                          \n\t"
+        : "+r"(w2)
+        : "r"(dst+w), "r"(top+w), "r"(diff+w), "rm"(*left & 0xff), "rm"(*left_top & 0xff)
+    );
+    *left     = dst[w-1];
+    *left_top = top[w-1];
+}
+
 #define H263_LOOP_FILTER \
         "pxor %%mm7, %%mm7              \n\t"\
         "movq  %0, %%mm0                \n\t"\
@@ -2577,6 +2645,7 @@ void dsputil_init_mmx(DSPContext* c, AVCodecContext *avctx)
 
             c->add_hfyu_median_prediction = ff_add_hfyu_median_prediction_mmx2;
 #endif
+            c->add_lag_median_prediction = add_lag_median_prediction_mmx2;
 #if HAVE_7REGS && HAVE_TEN_OPERANDS
             if( mm_flags&AV_CPU_FLAG_3DNOW )
                 c->add_hfyu_median_prediction = add_hfyu_median_prediction_cmov;
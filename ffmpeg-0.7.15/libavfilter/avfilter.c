@@ -26,6 +26,7 @@
 #include "libavutil/audioconvert.h"
 #include "libavutil/imgutils.h"
 #include "libavutil/avassert.h"
+#include "config.h"
 #include "avfilter.h"
 #include "internal.h"
 
@@ -70,41 +71,13 @@ AVFilterBufferRef *avfilter_ref_buffer(AVFilterBufferRef *ref, int pmask)
     return ret;
 }
 
-static void store_in_pool(AVFilterBufferRef *ref)
-{
-    int i;
-    AVFilterPool *pool= ref->buf->priv;
-
-    av_assert0(ref->buf->data[0]);
-
-    if (pool->count == POOL_SIZE) {
-        AVFilterBufferRef *ref1 = pool->pic[0];
-        av_freep(&ref1->video);
-        av_freep(&ref1->audio);
-        av_freep(&ref1->buf->data[0]);
-        av_freep(&ref1->buf);
-        av_free(ref1);
-        memmove(&pool->pic[0], &pool->pic[1], sizeof(void*)*(POOL_SIZE-1));
-        pool->count--;
-        pool->pic[POOL_SIZE-1] = NULL;
-    }
-
-    for (i = 0; i < POOL_SIZE; i++) {
-        if (!pool->pic[i]) {
-            pool->pic[i] = ref;
-            pool->count++;
-            break;
-        }
-    }
-}
-
 void avfilter_unref_buffer(AVFilterBufferRef *ref)
 {
     if (!ref)
         return;
     if (!(--ref->buf->refcount)) {
         if (!ref->buf->free) {
-            store_in_pool(ref);
+            ff_pool_store(ref);
             return;
         }
         ref->buf->free(ref->buf);
@@ -170,24 +143,7 @@ void avfilter_link_free(AVFilterLink **link)
     if (!*link)
         return;
 
-    if ((*link)->pool) {
-        int i;
-        for (i = 0; i < POOL_SIZE; i++) {
-            if ((*link)->pool->pic[i]) {
-                AVFilterBufferRef *picref = (*link)->pool->pic[i];
-                /* free buffer: picrefs stored in the pool are not
-                 * supposed to contain a free callback */
-                av_freep(&picref->buf->data[0]);
-                av_freep(&picref->buf);
-
-                av_freep(&picref->audio);
-                av_freep(&picref->video);
-                av_freep(&(*link)->pool->pic[i]);
-            }
-        }
-        (*link)->pool->count = 0;
-//        av_freep(&(*link)->pool);
-    }
+    ff_pool_release(&(*link)->pool);
     av_freep(link);
 }
 
@@ -785,3 +741,30 @@ int avfilter_init_filter(AVFilterContext *filter, const char *args, void *opaque
     return ret;
 }
 
+
+static int use_graph_threads(AVFilterContext *ctx)
+{
+    return HAVE_PTHREADS && ctx->graph && ctx->graph->thread &&
+           ctx->filter->flags & AVFILTER_FLAG_SLICE_THREADS;
+}
+
+int ff_filter_nb_threads(AVFilterContext *ctx)
+{
+    return use_graph_threads(ctx) ? ctx->graph->thread_count : 1;
+}
+
+int ff_filter_execute(AVFilterContext *ctx, avfilter_job_func *func,
+                      void *arg, int nb_jobs)
+{
+    int i, ret = 0;
+
+    if (use_graph_threads(ctx))
+        return ff_graph_thread_execute(ctx->graph, ctx, func, arg, nb_jobs);
+
+    for (i = 0; i < nb_jobs; i++) {
+        int err = func(ctx, arg, i, nb_jobs);
+        if (err < 0 && !ret)
+            ret = err;
+    }
+    return ret;
+}
@@ -26,7 +26,7 @@
 #include "libavutil/samplefmt.h"
 
 #define LIBAVFILTER_VERSION_MAJOR  1
-#define LIBAVFILTER_VERSION_MINOR 80
+#define LIBAVFILTER_VERSION_MINOR 82
 #define LIBAVFILTER_VERSION_MICRO  0
 
 #define LIBAVFILTER_VERSION_INT AV_VERSION_INT(LIBAVFILTER_VERSION_MAJOR, \
@@ -545,8 +545,17 @@ typedef struct AVFilter {
      * NULL_IF_CONFIG_SMALL() macro to define it.
      */
     const char *description;
+
+    int flags;                  ///< combination of AVFILTER_FLAG_*
 } AVFilter;
 
+/**
+ * The filter splits the processing of a frame into jobs with
+ * ff_filter_execute(), which may then run concurrently on the threads of
+ * the graph.
+ */
+#define AVFILTER_FLAG_SLICE_THREADS 1
+
 /** An instance of a filter */
 struct AVFilterContext {
     const AVClass *av_class;              ///< needed for av_log()
@@ -564,6 +573,8 @@ struct AVFilterContext {
     AVFilterLink **outputs;         ///< array of pointers to output links
 
     void *priv;                     ///< private data for use by the filter
+
+    struct AVFilterGraph *graph;    ///< graph the filter was added to, or NULL
 };
 
 /**
@@ -23,6 +23,7 @@
 #include <ctype.h>
 #include <string.h>
 
+#include "config.h"
 #include "avfilter.h"
 #include "avfiltergraph.h"
 #include "internal.h"
@@ -36,13 +37,27 @@ void avfilter_graph_free(AVFilterGraph **graph)
 {
     if (!*graph)
         return;
+#if HAVE_PTHREADS
+    ff_graph_thread_free(*graph);
+#endif
     for (; (*graph)->filter_count > 0; (*graph)->filter_count--)
         avfilter_free((*graph)->filters[(*graph)->filter_count - 1]);
+    ff_pool_release(&(*graph)->pool);
     av_freep(&(*graph)->scale_sws_opts);
     av_freep(&(*graph)->filters);
     av_freep(graph);
 }
 
+void avfilter_graph_get_pool_stats(AVFilterGraph *graph, AVFilterPoolStats *stats)
+{
+    if (!graph->pool) {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+    *stats = graph->pool->stats;
+    stats->nb_unused = graph->pool->count;
+}
+
 int avfilter_graph_add_filter(AVFilterGraph *graph, AVFilterContext *filter)
 {
     AVFilterContext **filters = av_realloc(graph->filters,
@@ -52,6 +67,7 @@ int avfilter_graph_add_filter(AVFilterGraph *graph, AVFilterContext *filter)
 
     graph->filters = filters;
     graph->filters[graph->filter_count++] = filter;
+    filter->graph = graph;
 
     return 0;
 }
@@ -246,6 +262,10 @@ int avfilter_graph_config(AVFilterGraph *graphctx, void *log_ctx)
         return ret;
     if ((ret = ff_avfilter_graph_config_links(graphctx, log_ctx)))
         return ret;
+#if HAVE_PTHREADS
+    if ((ret = ff_graph_thread_init(graphctx, log_ctx)) < 0)
+        return ret;
+#endif
 
     return 0;
 }
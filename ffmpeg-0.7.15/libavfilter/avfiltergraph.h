@@ -24,11 +24,39 @@
 
 #include "avfilter.h"
 
+/**
+ * Statistics of the video buffer pool shared by the links of a graph.
+ */
+typedef struct AVFilterPoolStats {
+    uint64_t nb_requests;       ///< video buffers requested by the filters
+    uint64_t nb_hits;           ///< requests served with an unused buffer of the pool
+    uint64_t nb_allocs;         ///< buffers allocated
+    uint64_t nb_evictions;      ///< unused buffers freed because the pool was full
+    int nb_used;                ///< buffers currently in use
+    int nb_used_max;            ///< largest number of buffers in use at the same time
+    int nb_unused;              ///< unused buffers currently kept for reuse
+} AVFilterPoolStats;
+
 typedef struct AVFilterGraph {
     unsigned filter_count;
     AVFilterContext **filters;
 
     char *scale_sws_opts; ///< sws options to use for the auto-inserted scale filters
+
+    /**
+     * Number of threads running the jobs of the slice threaded filters and
+     * passed to the scalers, set before avfilter_graph_config().
+     * 0 or 1 runs everything in the calling thread.
+     */
+    int thread_count;
+    struct AVFilterGraphThread *thread; ///< private thread pool
+
+    /**
+     * Maximum number of unused video buffers the graph keeps for reuse by
+     * its links, set before the first frame. 0 selects the default.
+     */
+    int pool_size;
+    struct AVFilterPool *pool;  ///< private video buffer pool
 } AVFilterGraph;
 
 /**
@@ -78,6 +106,12 @@ int avfilter_graph_create_filter(AVFilterContext **filt_ctx, AVFilter *filt,
  */
 int avfilter_graph_config(AVFilterGraph *graphctx, void *log_ctx);
 
+/**
+ * Get the statistics of the video buffer pool of graph, all zero if no
+ * buffer was requested yet.
+ */
+void avfilter_graph_get_pool_stats(AVFilterGraph *graph, AVFilterPoolStats *stats);
+
 /**
  * Free a graph, destroy its links, and set *graph to NULL.
  * If *graph is NULL, do nothing.
@@ -20,6 +20,7 @@
  */
 
 #include "libavutil/audioconvert.h"
+#include "libavutil/avassert.h"
 #include "libavutil/imgutils.h"
 #include "libavutil/samplefmt.h"
 #include "avfilter.h"
@@ -31,52 +32,140 @@ void ff_avfilter_default_free_buffer(AVFilterBuffer *ptr)
     av_free(ptr);
 }
 
-/* TODO: set the buffer's priv member to a context structure for the whole
- * filter chain.  This will allow for a buffer pool instead of the constant
- * alloc & free cycle currently implemented. */
+AVFilterPool *ff_pool_alloc(int size)
+{
+    AVFilterPool *pool = av_mallocz(sizeof(AVFilterPool));
+
+    if (!pool)
+        return NULL;
+    pool->size = size > 0 ? size : POOL_SIZE;
+    if (!(pool->pic = av_malloc(pool->size * sizeof(*pool->pic)))) {
+        av_free(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+/* picrefs stored in a pool are the original references of their buffers,
+ * which do not have a free callback */
+static void free_pool_buffer(AVFilterBufferRef *picref)
+{
+    av_freep(&picref->buf->data[0]);
+    av_freep(&picref->buf);
+    av_freep(&picref->audio);
+    av_freep(&picref->video);
+    av_free(picref);
+}
+
+static void free_pool(AVFilterPool *pool)
+{
+    av_free(pool->pic);
+    av_free(pool);
+}
+
+void ff_pool_release(AVFilterPool **pool)
+{
+    if (!*pool)
+        return;
+    while ((*pool)->count)
+        free_pool_buffer((*pool)->pic[--(*pool)->count]);
+    if ((*pool)->stats.nb_used)
+        (*pool)->draining = 1;
+    else
+        free_pool(*pool);
+    *pool = NULL;
+}
+
+void ff_pool_store(AVFilterBufferRef *ref)
+{
+    AVFilterPool *pool = ref->buf->priv;
+
+    av_assert0(ref->buf->data[0]);
+
+    pool->stats.nb_used--;
+    if (pool->draining) {
+        free_pool_buffer(ref);
+        if (!pool->stats.nb_used)
+            free_pool(pool);
+        return;
+    }
+
+    if (pool->count == pool->size) {
+        free_pool_buffer(pool->pic[0]);
+        memmove(&pool->pic[0], &pool->pic[1], sizeof(*pool->pic) * (pool->count - 1));
+        pool->count--;
+        pool->stats.nb_evictions++;
+    }
+    pool->pic[pool->count++] = ref;
+}
+
+/**
+ * Take the most recently released unused buffer of the given format and
+ * size out of pool.
+ */
+static AVFilterBufferRef *pool_get_video_buffer(AVFilterPool *pool, int perms,
+                                                int w, int h, enum PixelFormat format)
+{
+    int i;
+
+    for (i = pool->count - 1; i >= 0; i--) {
+        AVFilterBufferRef *picref = pool->pic[i];
+        AVFilterBuffer *pic = picref->buf;
+
+        if (pic->format == format && pic->w == w && pic->h == h) {
+            memmove(&pool->pic[i], &pool->pic[i + 1], sizeof(*pool->pic) * (pool->count - i - 1));
+            pool->count--;
+            picref->video->w = w;
+            picref->video->h = h;
+            picref->perms = perms | AV_PERM_READ;
+            picref->format = format;
+            pic->refcount = 1;
+            memcpy(picref->data,     pic->data,     sizeof(picref->data));
+            memcpy(picref->linesize, pic->linesize, sizeof(picref->linesize));
+            return picref;
+        }
+    }
+    return NULL;
+}
+
 AVFilterBufferRef *avfilter_default_get_video_buffer(AVFilterLink *link, int perms, int w, int h)
 {
     int linesize[4];
     uint8_t *data[4];
     int i;
     AVFilterBufferRef *picref = NULL;
-    AVFilterPool *pool = link->pool;
-
-    if (pool) {
-        for (i = 0; i < POOL_SIZE; i++) {
-            picref = pool->pic[i];
-            if (picref && picref->buf->format == link->format && picref->buf->w == w && picref->buf->h == h) {
-                AVFilterBuffer *pic = picref->buf;
-                pool->pic[i] = NULL;
-                pool->count--;
-                picref->video->w = w;
-                picref->video->h = h;
-                picref->perms = perms | AV_PERM_READ;
-                picref->format = link->format;
-                pic->refcount = 1;
-                memcpy(picref->data,     pic->data,     sizeof(picref->data));
-                memcpy(picref->linesize, pic->linesize, sizeof(picref->linesize));
-                return picref;
-            }
-        }
-    } else
-        pool = link->pool = av_mallocz(sizeof(AVFilterPool));
+    AVFilterGraph *graph = link->src->graph ? link->src->graph : link->dst->graph;
+    AVFilterPool **pool_ptr = graph ? &graph->pool : &link->pool;
+    AVFilterPool *pool;
 
-    // align: +2 is needed for swscaler, +16 to be SIMD-friendly
-    if ((i = av_image_alloc(data, linesize, w, h, link->format, 16)) < 0)
+    /* the links of a graph share its pool */
+    if (!*pool_ptr && !(*pool_ptr = ff_pool_alloc(graph ? graph->pool_size : 0)))
         return NULL;
+    pool = *pool_ptr;
+    pool->stats.nb_requests++;
 
-    picref = avfilter_get_video_buffer_ref_from_arrays(data, linesize,
-                                                       perms, w, h, link->format);
-    if (!picref) {
-        av_free(data[0]);
-        return NULL;
-    }
-    memset(data[0], 128, i);
+    if ((picref = pool_get_video_buffer(pool, perms, w, h, link->format))) {
+        pool->stats.nb_hits++;
+    } else {
+        // align: +2 is needed for swscaler, +16 to be SIMD-friendly
+        if ((i = av_image_alloc(data, linesize, w, h, link->format, 16)) < 0)
+            return NULL;
+
+        picref = avfilter_get_video_buffer_ref_from_arrays(data, linesize,
+                                                           perms, w, h, link->format);
+        if (!picref) {
+            av_free(data[0]);
+            return NULL;
+        }
+        memset(data[0], 128, i);
 
-    picref->buf->priv = pool;
-    picref->buf->free = NULL;
+        picref->buf->priv = pool;
+        picref->buf->free = NULL;
+        pool->stats.nb_allocs++;
+    }
 
+    pool->stats.nb_used++;
+    pool->stats.nb_used_max = FFMAX(pool->stats.nb_used_max, pool->stats.nb_used);
     return picref;
 }
 
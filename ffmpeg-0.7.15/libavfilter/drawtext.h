@@ -0,0 +1,37 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFILTER_DRAWTEXT_H
+#define AVFILTER_DRAWTEXT_H
+
+#include <stdint.h>
+
+/**
+ * Blend w bytes of a line with a color layer, skipping the bytes where
+ * alpha is 0. alpha is the color alpha times the coverage, premul is
+ * alpha times the color component:
+ * dst[x] = (premul[x] + (255 * 255 - alpha[x]) * dst[x]) * 129 >> 23
+ */
+void ff_drawtext_blend_line_c(uint8_t *dst, const uint16_t *alpha,
+                              const uint32_t *premul, int w);
+void ff_drawtext_blend_line_sse2(uint8_t *dst, const uint16_t *alpha,
+                                 const uint32_t *premul, int w);
+void ff_drawtext_blend_line_avx2(uint8_t *dst, const uint16_t *alpha,
+                                 const uint32_t *premul, int w);
+
+#endif /* AVFILTER_DRAWTEXT_H */
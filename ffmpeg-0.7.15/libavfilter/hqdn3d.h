@@ -0,0 +1,53 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with FFmpeg; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef AVFILTER_HQDN3D_H
+#define AVFILTER_HQDN3D_H
+
+#include <stdint.h>
+
+typedef struct {
+    int Coefs[4][512*16];
+    unsigned int *Spacial;          ///< horizontally then vertically filtered plane
+    unsigned short *Frame[3];
+    int hsub, vsub;
+    uint64_t time;                  ///< time spent filtering, in AV_READ_TIME() units
+    int frames;
+
+    /// DSP functions.
+    void (*line)(uint8_t *FrameDest, unsigned int *LineCur, const unsigned int *LinePrev,
+                 unsigned short *FrameAnt, int W, int *Vertical, int *Temporal);
+    void (*temporal_line)(uint8_t *FrameDest, const uint8_t *FrameSrc,
+                          unsigned short *FrameAnt, int W, int *Temporal);
+} HQDN3DContext;
+
+/**
+ * Filter vertically a line of the horizontally filtered plane against the
+ * line above it, then temporally if FrameAnt is not NULL, and write it out.
+ */
+void ff_hqdn3d_line_c(uint8_t *FrameDest, unsigned int *LineCur, const unsigned int *LinePrev,
+                      unsigned short *FrameAnt, int W, int *Vertical, int *Temporal);
+void ff_hqdn3d_temporal_line_c(uint8_t *FrameDest, const uint8_t *FrameSrc,
+                               unsigned short *FrameAnt, int W, int *Temporal);
+
+void ff_hqdn3d_line_avx2(uint8_t *FrameDest, unsigned int *LineCur, const unsigned int *LinePrev,
+                         unsigned short *FrameAnt, int W, int *Vertical, int *Temporal);
+void ff_hqdn3d_temporal_line_avx2(uint8_t *FrameDest, const uint8_t *FrameSrc,
+                                  unsigned short *FrameAnt, int W, int *Temporal);
+
+#endif /* AVFILTER_HQDN3D_H */
@@ -27,12 +27,38 @@
 #include "avfilter.h"
 #include "avfiltergraph.h"
 
-#define POOL_SIZE 32
+#define POOL_SIZE 32 ///< default number of unused buffers kept by a pool
+
+/**
+ * Video buffer pool, shared by all the links of a graph, or owned by a link
+ * outside of any graph. Unused buffers are reused for requests of the same
+ * format and size, the most recently released first.
+ */
 typedef struct AVFilterPool {
-    AVFilterBufferRef *pic[POOL_SIZE];
-    int count;
+    AVFilterBufferRef **pic;    ///< unused buffers, the least recently released first
+    int count;                  ///< number of unused buffers
+    int size;                   ///< maximum number of unused buffers kept
+    int draining;               ///< released by its owner, freed with the last buffer in use
+    AVFilterPoolStats stats;
 } AVFilterPool;
 
+/**
+ * Allocate a pool keeping at most size unused buffers, or POOL_SIZE if
+ * size is not positive.
+ */
+AVFilterPool *ff_pool_alloc(int size);
+
+/**
+ * Release a pool by its owner and set *pool to NULL. The unused buffers are
+ * freed now, the pool itself when the last buffer in use is unreferenced.
+ */
+void ff_pool_release(AVFilterPool **pool);
+
+/**
+ * Give back to its pool a buffer which is not referenced anymore.
+ */
+void ff_pool_store(AVFilterBufferRef *ref);
+
 /**
  * Check for the validity of graph.
  *
@@ -58,4 +84,40 @@ int ff_avfilter_graph_config_formats(AVFilterGraph *graphctx, AVClass *log_ctx);
 /** default handler for freeing audio/video buffer when there are no references left */
 void ff_avfilter_default_free_buffer(AVFilterBuffer *buf);
 
+typedef struct AVFilterGraphThread AVFilterGraphThread;
+
+/**
+ * A job run by ff_filter_execute().
+ *
+ * @param jobnr   index of the job, from 0 to nb_jobs - 1
+ * @return 0 in case of success, a negative AVERROR code otherwise
+ */
+typedef int (avfilter_job_func)(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs);
+
+/**
+ * Run func for each of nb_jobs jobs, concurrently on the graph threads if
+ * the filter has AVFILTER_FLAG_SLICE_THREADS, and return when all of them
+ * are done. Jobs must not call ff_filter_execute() themselves.
+ *
+ * @return 0, or the first negative value returned by a job
+ */
+int ff_filter_execute(AVFilterContext *ctx, avfilter_job_func *func,
+                      void *arg, int nb_jobs);
+
+/**
+ * Return the number of threads the jobs of ctx can run on, to choose the
+ * number of jobs.
+ */
+int ff_filter_nb_threads(AVFilterContext *ctx);
+
+/**
+ * Start the worker threads of graph if its thread_count is larger than 1.
+ */
+int ff_graph_thread_init(AVFilterGraph *graph, void *log_ctx);
+
+void ff_graph_thread_free(AVFilterGraph *graph);
+
+int ff_graph_thread_execute(AVFilterGraph *graph, AVFilterContext *ctx,
+                            avfilter_job_func *func, void *arg, int nb_jobs);
+
 #endif /* AVFILTER_INTERNAL_H */
@@ -0,0 +1,35 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFILTER_OVERLAY_H
+#define AVFILTER_OVERLAY_H
+
+#include <stdint.h>
+
+/**
+ * Blend w pixels of a line with a premultiplied overlay line:
+ * dst[x] = (dst[x] * inv_alpha[x] + premul[x]) / 255, rounded.
+ */
+void ff_overlay_blend_line_c(uint8_t *dst, const uint8_t *inv_alpha,
+                             const uint16_t *premul, int w);
+void ff_overlay_blend_line_sse2(uint8_t *dst, const uint8_t *inv_alpha,
+                                const uint16_t *premul, int w);
+void ff_overlay_blend_line_avx2(uint8_t *dst, const uint8_t *inv_alpha,
+                                const uint16_t *premul, int w);
+
+#endif /* AVFILTER_OVERLAY_H */
@@ -0,0 +1,171 @@
+/*
+ * Filter graph threads
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * A pool of worker threads shared by all the filters of a graph.
+ * The graph is still driven by a single thread; a filter with
+ * AVFILTER_FLAG_SLICE_THREADS splits the work on a frame into jobs with
+ * ff_filter_execute(), which are run by the workers and the calling thread
+ * and have all completed when it returns.
+ */
+
+#include <pthread.h>
+
+#include "libavutil/mem.h"
+#include "avfilter.h"
+#include "avfiltergraph.h"
+#include "internal.h"
+
+struct AVFilterGraphThread {
+    pthread_t *workers;
+    int nb_workers;
+    pthread_mutex_t mutex;
+    pthread_cond_t work_cond;       ///< signaled when jobs are available or on exit
+    pthread_cond_t done_cond;       ///< signaled when all the jobs are done
+    int exit;
+
+    AVFilterContext *ctx;           ///< filter running the jobs
+    avfilter_job_func *func;
+    void *arg;
+    int nb_jobs;
+    int next_job;                   ///< next job to be run, nb_jobs when idle
+    int jobs_done;
+    int ret;                        ///< first error returned by a job
+};
+
+static void run_job(AVFilterGraphThread *t, int jobnr)
+{
+    int ret = t->func(t->ctx, t->arg, jobnr, t->nb_jobs);
+
+    pthread_mutex_lock(&t->mutex);
+    if (ret < 0 && !t->ret)
+        t->ret = ret;
+    if (++t->jobs_done == t->nb_jobs)
+        pthread_cond_signal(&t->done_cond);
+    pthread_mutex_unlock(&t->mutex);
+}
+
+static void *worker(void *arg)
+{
+    AVFilterGraphThread *t = arg;
+
+    pthread_mutex_lock(&t->mutex);
+    for (;;) {
+        int jobnr;
+
+        while (!t->exit && t->next_job >= t->nb_jobs)
+            pthread_cond_wait(&t->work_cond, &t->mutex);
+        if (t->exit)
+            break;
+        jobnr = t->next_job++;
+        pthread_mutex_unlock(&t->mutex);
+        run_job(t, jobnr);
+        pthread_mutex_lock(&t->mutex);
+    }
+    pthread_mutex_unlock(&t->mutex);
+
+    return NULL;
+}
+
+int ff_graph_thread_init(AVFilterGraph *graph, void *log_ctx)
+{
+    AVFilterGraphThread *t;
+    int i;
+
+    if (graph->thread || graph->thread_count < 2)
+        return 0;
+    if (!(t = graph->thread = av_mallocz(sizeof(*t))))
+        return AVERROR(ENOMEM);
+    pthread_mutex_init(&t->mutex, NULL);
+    pthread_cond_init(&t->work_cond, NULL);
+    pthread_cond_init(&t->done_cond, NULL);
+    if (!(t->workers = av_malloc((graph->thread_count - 1) * sizeof(*t->workers)))) {
+        ff_graph_thread_free(graph);
+        return AVERROR(ENOMEM);
+    }
+    for (i = 0; i < graph->thread_count - 1; i++) {
+        if (pthread_create(&t->workers[i], NULL, worker, t)) {
+            av_log(log_ctx, AV_LOG_ERROR, "pthread_create failed\n");
+            ff_graph_thread_free(graph);
+            return AVERROR(ENOMEM);
+        }
+        t->nb_workers++;
+    }
+    av_log(log_ctx, AV_LOG_VERBOSE, "filter graph running with %d threads\n",
+           graph->thread_count);
+
+    return 0;
+}
+
+void ff_graph_thread_free(AVFilterGraph *graph)
+{
+    AVFilterGraphThread *t = graph->thread;
+    int i;
+
+    if (!t)
+        return;
+    pthread_mutex_lock(&t->mutex);
+    t->exit = 1;
+    pthread_cond_broadcast(&t->work_cond);
+    pthread_mutex_unlock(&t->mutex);
+    for (i = 0; i < t->nb_workers; i++)
+        pthread_join(t->workers[i], NULL);
+    av_freep(&t->workers);
+    pthread_cond_destroy(&t->done_cond);
+    pthread_cond_destroy(&t->work_cond);
+    pthread_mutex_destroy(&t->mutex);
+    av_freep(&graph->thread);
+}
+
+int ff_graph_thread_execute(AVFilterGraph *graph, AVFilterContext *ctx,
+                            avfilter_job_func *func, void *arg, int nb_jobs)
+{
+    AVFilterGraphThread *t = graph->thread;
+    int jobnr, ret;
+
+    if (nb_jobs <= 0)
+        return 0;
+
+    pthread_mutex_lock(&t->mutex);
+    t->ctx       = ctx;
+    t->func      = func;
+    t->arg       = arg;
+    t->nb_jobs   = nb_jobs;
+    t->jobs_done = 0;
+    t->ret       = 0;
+    t->next_job  = 0;
+    if (nb_jobs > 1)
+        pthread_cond_broadcast(&t->work_cond);
+
+    /* the calling thread runs jobs too */
+    while (t->next_job < t->nb_jobs) {
+        jobnr = t->next_job++;
+        pthread_mutex_unlock(&t->mutex);
+        run_job(t, jobnr);
+        pthread_mutex_lock(&t->mutex);
+    }
+    while (t->jobs_done < t->nb_jobs)
+        pthread_cond_wait(&t->done_cond, &t->mutex);
+    ret = t->ret;
+    pthread_mutex_unlock(&t->mutex);
+
+    return ret;
+}
@@ -0,0 +1,69 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFILTER_UNSHARP_H
+#define AVFILTER_UNSHARP_H
+
+#include <stdint.h>
+
+typedef struct FilterParam {
+    int msize_x;                             ///< matrix width
+    int msize_y;                             ///< matrix height
+    int amount;                              ///< effect amount
+    int steps_x;                             ///< horizontal step count
+    int steps_y;                             ///< vertical step count
+    int scalebits;                           ///< bits to shift pixel
+    int32_t halfscale;                       ///< amount to add to pixel
+} FilterParam;
+
+typedef struct {
+    FilterParam luma;   ///< luma parameters (width, height, amount)
+    FilterParam chroma; ///< chroma parameters (width, height, amount)
+
+    uint32_t *buf;      ///< line buffers of each job
+    int buf_jobs;       ///< number of jobs buf has room for
+    int line_size;      ///< size of a line buffer, in elements
+    int job_size;       ///< size of the buffers of a job, in elements
+
+    /**
+     * buf[x] = buf[x] + 2 * buf[x + 1] + buf[x + 2] for x < w, in place.
+     * buf is padded so that w may be rounded up to a multiple of 8.
+     */
+    void (*hpass)(uint32_t *buf, int w);
+    /**
+     * Two steps of the vertical state machine: the column sums in acc are
+     * added to the previous ones saved in sc0, then sc1, which are updated.
+     * The lines are padded so that w may be rounded up to a multiple of 8.
+     */
+    void (*vpass)(uint32_t *acc, uint32_t *sc0, uint32_t *sc1, int w);
+    /// Mix a line with its blurred version sum.
+    void (*apply)(uint8_t *dst, const uint8_t *src, const uint32_t *sum, int w,
+                  int amount, int scalebits, int32_t halfscale);
+} UnsharpContext;
+
+void ff_unsharp_hpass_c(uint32_t *buf, int w);
+void ff_unsharp_vpass_c(uint32_t *acc, uint32_t *sc0, uint32_t *sc1, int w);
+void ff_unsharp_apply_c(uint8_t *dst, const uint8_t *src, const uint32_t *sum, int w,
+                        int amount, int scalebits, int32_t halfscale);
+
+void ff_unsharp_hpass_avx2(uint32_t *buf, int w);
+void ff_unsharp_vpass_avx2(uint32_t *acc, uint32_t *sc0, uint32_t *sc1, int w);
+void ff_unsharp_apply_avx2(uint8_t *dst, const uint8_t *src, const uint32_t *sum, int w,
+                           int amount, int scalebits, int32_t halfscale);
+
+#endif /* AVFILTER_UNSHARP_H */
@@ -30,12 +30,14 @@
 #include <time.h>
 
 #include "libavutil/colorspace.h"
+#include "libavutil/cpu.h"
 #include "libavutil/file.h"
 #include "libavutil/opt.h"
 #include "libavutil/parseutils.h"
 #include "libavutil/pixdesc.h"
 #include "libavutil/tree.h"
 #include "avfilter.h"
+#include "drawtext.h"
 #include "drawutils.h"
 
 #undef time
@@ -45,6 +47,30 @@
 #include FT_FREETYPE_H
 #include FT_GLYPH_H
 
+struct Glyph;
+
+/**
+ * A character of the laid out text.
+ */
+typedef struct {
+    struct Glyph *glyph;            ///< glyph to draw, NULL if nothing is drawn for the character
+    int x, y;                       ///< position of the glyph bitmap in the frame
+} TextCell;
+
+/**
+ * A color layer of the text block, blended over each frame.
+ */
+typedef struct {
+    int enabled;
+    int dx, dy;                     ///< offset of the glyphs in the layer
+    uint8_t color[4];               ///< YUVA color, or RGBA color for packed RGB
+    uint8_t *coverage;              ///< coverage of the layer, for each pixel of the block
+    uint16_t *alpha[3];             ///< color alpha times coverage, for each byte of the block planes
+    uint32_t *premul[3];            ///< alpha times the color component
+} TextLayer;
+
+enum { LAYER_BOX, LAYER_SHADOW, LAYER_TEXT, NB_LAYERS };
+
 typedef struct {
     const AVClass *class;
     uint8_t *fontfile;              ///< font to be used
@@ -52,8 +78,10 @@ typedef struct {
     uint8_t *expanded_text;         ///< used to contain the strftime()-expanded text
     size_t   expanded_text_size;    ///< size in bytes of the expanded_text buffer
     int ft_load_flags;              ///< flags used for loading fonts, see FT_LOAD_*
-    FT_Vector *positions;           ///< positions for each element in the text
-    size_t nb_positions;            ///< number of elements of positions array
+    TextCell *cells;                ///< layout of the current text
+    TextCell *block_cells;          ///< layout of the text in the cached block
+    int nb_cells, nb_block_cells;   ///< number of elements in cells and block_cells
+    size_t cells_size;              ///< number of allocated elements of both arrays
     char *textfile;                 ///< file with text to be drawn
     unsigned int x;                 ///< x position to start drawing text
     unsigned int y;                 ///< y position to start drawing text
@@ -81,6 +109,18 @@ typedef struct {
     int pixel_step[4];              ///< distance in bytes between the component of each pixel
     uint8_t rgba_map[4];            ///< map RGBA offsets to the positions in the packed RGBA format
     uint8_t *box_line[4];           ///< line used for filling the box background
+
+    char *block_text;               ///< text the cached block was built for, NULL if none
+    int frame_w, frame_h;           ///< frame size the cached block was built for
+    int block_x, block_y, block_w, block_h; ///< area of the frame covered by the block
+    int box_x, box_y, box_w, box_h; ///< area of the box
+    int nb_planes;
+    int plane_x[3], plane_y[3];     ///< position of the block in each plane, in bytes and lines
+    int plane_w[3], plane_h[3];     ///< size of the block in each plane, in bytes and lines
+    TextLayer layers[NB_LAYERS];    ///< box, shadow and text layers, in blending order
+
+    void (*blend_line)(uint8_t *dst, const uint16_t *alpha,
+                       const uint32_t *premul, int w);
 } DrawTextContext;
 
 #define OFFSET(x) offsetof(DrawTextContext, x)
@@ -145,7 +185,7 @@ struct ft_error
 
 #define FT_ERRMSG(e) ft_errors[e].err_msg
 
-typedef struct {
+typedef struct Glyph {
     FT_Glyph *glyph;
     uint32_t code;
     FT_Bitmap bitmap; ///< array holding bitmaps of font
@@ -315,6 +355,12 @@ static av_cold int init(AVFilterContext *ctx, const char *args, void *opaque)
     }
     dtext->tabsize *= glyph->advance;
 
+    dtext->blend_line = ff_drawtext_blend_line_c;
+    if (HAVE_SSE && av_get_cpu_flags() & AV_CPU_FLAG_SSE2)
+        dtext->blend_line = ff_drawtext_blend_line_sse2;
+    if (HAVE_AVX2 && av_get_cpu_flags() & AV_CPU_FLAG_AVX2)
+        dtext->blend_line = ff_drawtext_blend_line_avx2;
+
 #if !HAVE_LOCALTIME_R
     av_log(ctx, AV_LOG_WARNING, "strftime() expansion unavailable!\n");
 #endif
@@ -344,6 +390,20 @@ static int glyph_enu_free(void *opaque, void *elem)
     return 0;
 }
 
+static void free_block(DrawTextContext *dtext)
+{
+    int i, p;
+
+    for (i = 0; i < NB_LAYERS; i++) {
+        TextLayer *layer = &dtext->layers[i];
+        av_freep(&layer->coverage);
+        for (p = 0; p < 3; p++) {
+            av_freep(&layer->alpha[p]);
+            av_freep(&layer->premul[p]);
+        }
+    }
+}
+
 static av_cold void uninit(AVFilterContext *ctx)
 {
     DrawTextContext *dtext = ctx->priv;
@@ -354,7 +414,10 @@ static av_cold void uninit(AVFilterContext *ctx)
     av_freep(&dtext->expanded_text);
     av_freep(&dtext->fontcolor_string);
     av_freep(&dtext->boxcolor_string);
-    av_freep(&dtext->positions);
+    av_freep(&dtext->cells);
+    av_freep(&dtext->block_cells);
+    av_freep(&dtext->block_text);
+    free_block(dtext);
     av_freep(&dtext->shadowcolor_string);
     av_tree_enumerate(dtext->glyphs, NULL, NULL, glyph_enu_free);
     av_tree_destroy(dtext->glyphs);
@@ -398,6 +461,23 @@ static int config_input(AVFilterLink *inlink)
         dtext->shadowcolor[3] = rgba[3];
     }
 
+    memcpy(dtext->layers[LAYER_BOX].color, dtext->boxcolor, 4);
+    memcpy(dtext->layers[LAYER_SHADOW].color, dtext->is_packed_rgb ?
+           dtext->shadowcolor_rgba : dtext->shadowcolor, 4);
+    memcpy(dtext->layers[LAYER_TEXT].color, dtext->is_packed_rgb ?
+           dtext->fontcolor_rgba : dtext->fontcolor, 4);
+    dtext->layers[LAYER_SHADOW].dx = dtext->shadowx;
+    dtext->layers[LAYER_SHADOW].dy = dtext->shadowy;
+
+    /* an opaque box is filled directly, fully transparent colors are not drawn */
+    dtext->layers[LAYER_BOX].enabled    = dtext->draw_box && dtext->boxcolor[3] &&
+                                          dtext->boxcolor[3] != 0xFF;
+    dtext->layers[LAYER_SHADOW].enabled = (dtext->shadowx || dtext->shadowy) &&
+                                          dtext->layers[LAYER_SHADOW].color[3];
+    dtext->layers[LAYER_TEXT].enabled   = dtext->layers[LAYER_TEXT].color[3];
+    dtext->nb_planes = dtext->is_packed_rgb ? 1 : 3;
+    av_freep(&dtext->block_text);
+
     return 0;
 }
 
@@ -406,110 +486,17 @@ static int config_input(AVFilterLink *inlink)
         (bitmap->buffer[(r) * bitmap->pitch + ((c)>>3)] & (0x80 >> ((c)&7))) * 255 : \
          bitmap->buffer[(r) * bitmap->pitch +  (c)]
 
-#define SET_PIXEL_YUV(picref, yuva_color, val, x, y, hsub, vsub) {           \
-    luma_pos    = ((x)          ) + ((y)          ) * picref->linesize[0]; \
-    alpha = yuva_color[3] * (val) * 129;                               \
-    picref->data[0][luma_pos]    = (alpha * yuva_color[0] + (255*255*129 - alpha) * picref->data[0][luma_pos]   ) >> 23; \
-    if (((x) & ((1<<(hsub)) - 1)) == 0 && ((y) & ((1<<(vsub)) - 1)) == 0) {\
-        chroma_pos1 = ((x) >> (hsub)) + ((y) >> (vsub)) * picref->linesize[1]; \
-        chroma_pos2 = ((x) >> (hsub)) + ((y) >> (vsub)) * picref->linesize[2]; \
-        picref->data[1][chroma_pos1] = (alpha * yuva_color[1] + (255*255*129 - alpha) * picref->data[1][chroma_pos1]) >> 23; \
-        picref->data[2][chroma_pos2] = (alpha * yuva_color[2] + (255*255*129 - alpha) * picref->data[2][chroma_pos2]) >> 23; \
-    }\
-}
-
-static inline int draw_glyph_yuv(AVFilterBufferRef *picref, FT_Bitmap *bitmap, unsigned int x,
-                                 unsigned int y, unsigned int width, unsigned int height,
-                                 const uint8_t yuva_color[4], int hsub, int vsub)
-{
-    int r, c, alpha;
-    unsigned int luma_pos, chroma_pos1, chroma_pos2;
-    uint8_t src_val, dst_pixel[4];
-
-    for (r = 0; r < bitmap->rows && r+y < height; r++) {
-        for (c = 0; c < bitmap->width && c+x < width; c++) {
-            /* get pixel in the picref (destination) */
-            dst_pixel[0] = picref->data[0][  c+x           +  (y+r)          * picref->linesize[0]];
-            dst_pixel[1] = picref->data[1][((c+x) >> hsub) + ((y+r) >> vsub) * picref->linesize[1]];
-            dst_pixel[2] = picref->data[2][((c+x) >> hsub) + ((y+r) >> vsub) * picref->linesize[2]];
-
-            /* get intensity value in the glyph bitmap (source) */
-            src_val = GET_BITMAP_VAL(r, c);
-            if (!src_val)
-                continue;
-
-            SET_PIXEL_YUV(picref, yuva_color, src_val, c+x, y+r, hsub, vsub);
-        }
-    }
-
-    return 0;
-}
-
-#define SET_PIXEL_RGB(picref, rgba_color, val, x, y, pixel_step, r_off, g_off, b_off, a_off) { \
-    p   = picref->data[0] + (x) * pixel_step + ((y) * picref->linesize[0]); \
-    alpha = rgba_color[3] * (val) * 129;                              \
-    *(p+r_off) = (alpha * rgba_color[0] + (255*255*129 - alpha) * *(p+r_off)) >> 23; \
-    *(p+g_off) = (alpha * rgba_color[1] + (255*255*129 - alpha) * *(p+g_off)) >> 23; \
-    *(p+b_off) = (alpha * rgba_color[2] + (255*255*129 - alpha) * *(p+b_off)) >> 23; \
-}
-
-static inline int draw_glyph_rgb(AVFilterBufferRef *picref, FT_Bitmap *bitmap,
-                                 unsigned int x, unsigned int y,
-                                 unsigned int width, unsigned int height, int pixel_step,
-                                 const uint8_t rgba_color[4], const uint8_t rgba_map[4])
+void ff_drawtext_blend_line_c(uint8_t *dst, const uint16_t *alpha,
+                              const uint32_t *premul, int w)
 {
-    int r, c, alpha;
-    uint8_t *p;
-    uint8_t src_val, dst_pixel[4];
-
-    for (r = 0; r < bitmap->rows && r+y < height; r++) {
-        for (c = 0; c < bitmap->width && c+x < width; c++) {
-            /* get pixel in the picref (destination) */
-            dst_pixel[0] = picref->data[0][(c+x + rgba_map[0]) * pixel_step +
-                                           (y+r) * picref->linesize[0]];
-            dst_pixel[1] = picref->data[0][(c+x + rgba_map[1]) * pixel_step +
-                                           (y+r) * picref->linesize[0]];
-            dst_pixel[2] = picref->data[0][(c+x + rgba_map[2]) * pixel_step +
-                                           (y+r) * picref->linesize[0]];
-
-            /* get intensity value in the glyph bitmap (source) */
-            src_val = GET_BITMAP_VAL(r, c);
-            if (!src_val)
-                continue;
+    int x;
 
-            SET_PIXEL_RGB(picref, rgba_color, src_val, c+x, y+r, pixel_step,
-                          rgba_map[0], rgba_map[1], rgba_map[2], rgba_map[3]);
+    for (x = 0; x < w; x++) {
+        if (alpha[x]) {
+            unsigned v = premul[x] + (255 * 255 - alpha[x]) * dst[x];
+            dst[x] = (v + (v >> 7)) >> 16;
         }
     }
-
-    return 0;
-}
-
-static inline void drawbox(AVFilterBufferRef *picref, unsigned int x, unsigned int y,
-                           unsigned int width, unsigned int height,
-                           uint8_t *line[4], int pixel_step[4], uint8_t color[4],
-                           int hsub, int vsub, int is_rgba_packed, uint8_t rgba_map[4])
-{
-    int i, j, alpha;
-
-    if (color[3] != 0xFF) {
-        if (is_rgba_packed) {
-            uint8_t *p;
-            for (j = 0; j < height; j++)
-                for (i = 0; i < width; i++)
-                    SET_PIXEL_RGB(picref, color, 255, i+x, y+j, pixel_step[0],
-                                  rgba_map[0], rgba_map[1], rgba_map[2], rgba_map[3]);
-        } else {
-            unsigned int luma_pos, chroma_pos1, chroma_pos2;
-            for (j = 0; j < height; j++)
-                for (i = 0; i < width; i++)
-                    SET_PIXEL_YUV(picref, color, 255, i+x, y+j, hsub, vsub);
-        }
-    } else {
-        ff_draw_rectangle(picref->data, picref->linesize,
-                          line, pixel_step, hsub, vsub,
-                          x, y, width, height);
-    }
 }
 
 static inline int is_newline(uint32_t c)
@@ -517,90 +504,32 @@ static inline int is_newline(uint32_t c)
     return (c == '\n' || c == '\r' || c == '\f' || c == '\v');
 }
 
-static int draw_glyphs(DrawTextContext *dtext, AVFilterBufferRef *picref,
-                       int width, int height, const uint8_t rgbcolor[4], const uint8_t yuvcolor[4], int x, int y)
-{
-    char *text = HAVE_LOCALTIME_R ? dtext->expanded_text : dtext->text;
-    uint32_t code = 0;
-    int i;
-    uint8_t *p;
-    Glyph *glyph = NULL;
-
-    for (i = 0, p = text; *p; i++) {
-        Glyph dummy = { 0 };
-        GET_UTF8(code, *p++, continue;);
-
-        /* skip new line chars, just go to new line */
-        if (code == '\n' || code == '\r' || code == '\t')
-            continue;
-
-        dummy.code = code;
-        glyph = av_tree_find(dtext->glyphs, &dummy, (void *)glyph_cmp, NULL);
-
-        if (glyph->bitmap.pixel_mode != FT_PIXEL_MODE_MONO &&
-            glyph->bitmap.pixel_mode != FT_PIXEL_MODE_GRAY)
-            return AVERROR(EINVAL);
-
-        if (dtext->is_packed_rgb) {
-            draw_glyph_rgb(picref, &glyph->bitmap,
-                           dtext->positions[i].x+x, dtext->positions[i].y+y, width, height,
-                           dtext->pixel_step[0], rgbcolor, dtext->rgba_map);
-        } else {
-            draw_glyph_yuv(picref, &glyph->bitmap,
-                           dtext->positions[i].x+x, dtext->positions[i].y+y, width, height,
-                           yuvcolor, dtext->hsub, dtext->vsub);
-        }
-    }
-
-    return 0;
-}
-
-static int draw_text(AVFilterContext *ctx, AVFilterBufferRef *picref,
-                     int width, int height)
+/**
+ * Lay out text in dtext->cells, and compute the box around it.
+ */
+static int layout_text(AVFilterContext *ctx, const char *text, int width, int height)
 {
     DrawTextContext *dtext = ctx->priv;
     uint32_t code = 0, prev_code = 0;
     int x = 0, y = 0, i = 0, ret;
     int text_height, baseline;
-    char *text = dtext->text;
-    uint8_t *p;
+    const uint8_t *p;
     int str_w = 0, len;
     int y_min = 32000, y_max = -32000;
     FT_Vector delta;
     Glyph *glyph = NULL, *prev_glyph = NULL;
     Glyph dummy = { 0 };
 
-#if HAVE_LOCALTIME_R
-    time_t now = time(0);
-    struct tm ltime;
-    uint8_t *buf = dtext->expanded_text;
-    int buf_size = dtext->expanded_text_size;
-
-    if (!buf) {
-        buf_size = 2*strlen(dtext->text)+1;
-        buf = av_malloc(buf_size);
-    }
-
-    localtime_r(&now, &ltime);
-
-    do {
-        *buf = 1;
-        if (strftime(buf, buf_size, dtext->text, &ltime) != 0 || *buf == 0)
-            break;
-        buf_size *= 2;
-    } while ((buf = av_realloc(buf, buf_size)));
-
-    if (!buf)
-        return AVERROR(ENOMEM);
-    text = dtext->expanded_text = buf;
-    dtext->expanded_text_size = buf_size;
-#endif
-    if ((len = strlen(text)) > dtext->nb_positions) {
-        if (!(dtext->positions =
-              av_realloc(dtext->positions, len*sizeof(*dtext->positions))))
+    if ((len = strlen(text)) > dtext->cells_size) {
+        if (!(dtext->cells = av_realloc(dtext->cells, len*sizeof(*dtext->cells))) ||
+            !(dtext->block_cells =
+              av_realloc(dtext->block_cells, len*sizeof(*dtext->block_cells)))) {
+            dtext->cells_size = 0;
             return AVERROR(ENOMEM);
-        dtext->nb_positions = len;
+        }
+        dtext->cells_size = len;
     }
+    memset(dtext->cells, 0, len*sizeof(*dtext->cells));
 
     x = dtext->x;
     y = dtext->y;
@@ -612,8 +541,11 @@ static int draw_text(AVFilterContext *ctx, AVFilterBufferRef *picref,
         /* get glyph */
         dummy.code = code;
         glyph = av_tree_find(dtext->glyphs, &dummy, glyph_cmp, NULL);
-        if (!glyph)
-            load_glyph(ctx, &glyph, code);
+        if (!glyph && (ret = load_glyph(ctx, &glyph, code)) < 0)
+            return ret;
+        if (glyph->bitmap.pixel_mode != FT_PIXEL_MODE_MONO &&
+            glyph->bitmap.pixel_mode != FT_PIXEL_MODE_GRAY)
+            return AVERROR(EINVAL);
 
         y_min = FFMIN(glyph->bbox.yMin, y_min);
         y_max = FFMAX(glyph->bbox.yMax, y_max);
@@ -657,30 +589,365 @@ static int draw_text(AVFilterContext *ctx, AVFilterBufferRef *picref,
         }
 
         /* save position */
-        dtext->positions[i].x = x + glyph->bitmap_left;
-        dtext->positions[i].y = y - glyph->bitmap_top + baseline;
+        if (code != '\t') {
+            dtext->cells[i].glyph = glyph;
+            dtext->cells[i].x     = x + glyph->bitmap_left;
+            dtext->cells[i].y     = y - glyph->bitmap_top + baseline;
+        }
         if (code == '\t') x  = (x / dtext->tabsize + 1)*dtext->tabsize;
         else              x += glyph->advance;
     }
+    dtext->nb_cells = i;
 
     str_w = FFMIN(width - dtext->x - 1, FFMAX(str_w, x - dtext->x));
     y     = FFMIN(y + text_height, height - 1);
 
-    /* draw box */
-    if (dtext->draw_box)
-        drawbox(picref, dtext->x, dtext->y, str_w, y-dtext->y,
-                dtext->box_line, dtext->pixel_step, dtext->boxcolor,
-                dtext->hsub, dtext->vsub, dtext->is_packed_rgb, dtext->rgba_map);
+    dtext->box_x = dtext->x;
+    dtext->box_y = dtext->y;
+    dtext->box_w = dtext->draw_box ? FFMAX(str_w, 0) : 0;
+    dtext->box_h = dtext->draw_box ? FFMAX(y - (int)dtext->y, 0) : 0;
 
-    if (dtext->shadowx || dtext->shadowy) {
-        if ((ret = draw_glyphs(dtext, picref, width, height, dtext->shadowcolor_rgba,
-                               dtext->shadowcolor, dtext->shadowx, dtext->shadowy)) < 0)
-            return ret;
+    return 0;
+}
+
+/**
+ * Compute the area of the frame covered by the glyph of cell, moved by
+ * dx, dy. Glyphs starting left of or above the frame are not drawn.
+ *
+ * @return 0 if nothing of the glyph is drawn
+ */
+static int glyph_rect(const TextCell *cell, int dx, int dy,
+                      int width, int height, int rect[4])
+{
+    if (!cell->glyph || cell->x + dx < 0 || cell->y + dy < 0)
+        return 0;
+    rect[0] = cell->x + dx;
+    rect[1] = cell->y + dy;
+    rect[2] = FFMIN(rect[0] + cell->glyph->bitmap.width, width);
+    rect[3] = FFMIN(rect[1] + cell->glyph->bitmap.rows,  height);
+    return rect[0] < rect[2] && rect[1] < rect[3];
+}
+
+static void merge_rect(int dst[4], const int src[4])
+{
+    dst[0] = FFMIN(dst[0], src[0]);
+    dst[1] = FFMIN(dst[1], src[1]);
+    dst[2] = FFMAX(dst[2], src[2]);
+    dst[3] = FFMAX(dst[3], src[3]);
+}
+
+/**
+ * Render the glyphs of layer into its coverage, within the area rect of
+ * the frame. Overlapping glyphs are composited over each other.
+ */
+static void draw_layer_glyphs(DrawTextContext *dtext, TextLayer *layer, const int rect[4])
+{
+    int i, x, y, g[4];
+
+    for (i = 0; i < dtext->nb_cells; i++) {
+        const TextCell *cell = &dtext->cells[i];
+        FT_Bitmap *bitmap;
+        int gx = cell->x + layer->dx, gy = cell->y + layer->dy;
+
+        if (!glyph_rect(cell, layer->dx, layer->dy, dtext->frame_w, dtext->frame_h, g) ||
+            g[0] >= rect[2] || g[2] <= rect[0] || g[1] >= rect[3] || g[3] <= rect[1])
+            continue;
+        bitmap = &cell->glyph->bitmap;
+        for (y = FFMAX(g[1], rect[1]); y < FFMIN(g[3], rect[3]); y++) {
+            uint8_t *cov = layer->coverage + (y - dtext->block_y) * dtext->block_w - dtext->block_x;
+            for (x = FFMAX(g[0], rect[0]); x < FFMIN(g[2], rect[2]); x++) {
+                uint8_t v = GET_BITMAP_VAL(y - gy, x - gx);
+                if (v)
+                    cov[x] = cov[x] ? cov[x] + v - (cov[x] * v + 127) / 255 : v;
+            }
+        }
     }
+}
 
-    if ((ret = draw_glyphs(dtext, picref, width, height, dtext->fontcolor_rgba,
-                           dtext->fontcolor, 0, 0)) < 0)
-        return ret;
+/**
+ * Compute the alpha and premultiplied color of layer from its coverage,
+ * within the area rect of the frame. Chroma samples take the coverage of
+ * their top left luma pixel.
+ */
+static void update_layer(DrawTextContext *dtext, TextLayer *layer, const int rect[4])
+{
+    int p, x, y, k;
+
+    if (dtext->is_packed_rgb) {
+        int step = dtext->pixel_step[0];
+
+        for (y = rect[1]; y < rect[3]; y++) {
+            const uint8_t *cov = layer->coverage + (y - dtext->block_y) * dtext->block_w - dtext->block_x;
+            int off = (y - dtext->plane_y[0]) * dtext->plane_w[0] - dtext->plane_x[0];
+            uint16_t *alpha  = layer->alpha[0]  + off;
+            uint32_t *premul = layer->premul[0] + off;
+
+            for (x = rect[0]; x < rect[2]; x++) {
+                int a = layer->color[3] * cov[x];
+                for (k = 0; k < step; k++) {
+                    alpha [x * step + k] = 0;
+                    premul[x * step + k] = 0;
+                }
+                for (k = 0; k < 3; k++) {
+                    alpha [x * step + dtext->rgba_map[k]] = a;
+                    premul[x * step + dtext->rgba_map[k]] = a * layer->color[k];
+                }
+            }
+        }
+        return;
+    }
+
+    for (p = 0; p < 3; p++) {
+        int hsub = p ? dtext->hsub : 0, vsub = p ? dtext->vsub : 0;
+
+        for (y = -((-rect[1]) >> vsub); y < -((-rect[3]) >> vsub); y++) {
+            const uint8_t *cov = layer->coverage + ((y << vsub) - dtext->block_y) * dtext->block_w - dtext->block_x;
+            int off = (y - dtext->plane_y[p]) * dtext->plane_w[p] - dtext->plane_x[p];
+            uint16_t *alpha  = layer->alpha[p]  + off;
+            uint32_t *premul = layer->premul[p] + off;
+
+            for (x = -((-rect[0]) >> hsub); x < -((-rect[2]) >> hsub); x++) {
+                int a = layer->color[3] * cov[x << hsub];
+                alpha [x] = a;
+                premul[x] = a * layer->color[p];
+            }
+        }
+    }
+}
+
+/**
+ * Clear and redraw the area rect of a glyph layer.
+ */
+static void redraw_layer(DrawTextContext *dtext, TextLayer *layer, const int rect[4])
+{
+    int y;
+
+    for (y = rect[1]; y < rect[3]; y++)
+        memset(layer->coverage + (y - dtext->block_y) * dtext->block_w + rect[0] - dtext->block_x,
+               0, rect[2] - rect[0]);
+    draw_layer_glyphs(dtext, layer, rect);
+    update_layer(dtext, layer, rect);
+}
+
+/**
+ * Allocate and render all the layers of the block.
+ */
+static int build_block(DrawTextContext *dtext)
+{
+    int rect[4] = { dtext->block_x, dtext->block_y,
+                    dtext->block_x + dtext->block_w, dtext->block_y + dtext->block_h };
+    int i, p, y;
+
+    free_block(dtext);
+    for (p = 0; p < dtext->nb_planes; p++) {
+        int hsub = p ? dtext->hsub : 0, vsub = p ? dtext->vsub : 0;
+
+        if (dtext->is_packed_rgb) {
+            dtext->plane_x[p] = dtext->block_x * dtext->pixel_step[0];
+            dtext->plane_w[p] = dtext->block_w * dtext->pixel_step[0];
+        } else {
+            dtext->plane_x[p] = -((-rect[0]) >> hsub);
+            dtext->plane_w[p] = -((-rect[2]) >> hsub) - dtext->plane_x[p];
+        }
+        dtext->plane_y[p] = -((-rect[1]) >> vsub);
+        dtext->plane_h[p] = -((-rect[3]) >> vsub) - dtext->plane_y[p];
+    }
+    if (!dtext->block_w)
+        return 0;
+
+    for (i = 0; i < NB_LAYERS; i++) {
+        TextLayer *layer = &dtext->layers[i];
+
+        if (!layer->enabled)
+            continue;
+        if (!(layer->coverage = av_mallocz(dtext->block_w * dtext->block_h)))
+            return AVERROR(ENOMEM);
+        for (p = 0; p < dtext->nb_planes; p++) {
+            int size = dtext->plane_w[p] * dtext->plane_h[p];
+            if (!(layer->alpha[p]  = av_malloc(size * sizeof(*layer->alpha[p]))) ||
+                !(layer->premul[p] = av_malloc(size * sizeof(*layer->premul[p]))))
+                return AVERROR(ENOMEM);
+        }
+
+        if (i == LAYER_BOX) {
+            for (y = dtext->box_y; y < dtext->box_y + dtext->box_h; y++)
+                memset(layer->coverage + (y - dtext->block_y) * dtext->block_w +
+                       dtext->box_x - dtext->block_x, 255, dtext->box_w);
+        } else {
+            draw_layer_glyphs(dtext, layer, rect);
+        }
+        update_layer(dtext, layer, rect);
+    }
+
+    return 0;
+}
+
+/**
+ * Update the cached block for a new text. If the text keeps the same number
+ * of characters and the box does not change, the block only grows, and
+ * while it does not, only the areas of the characters which moved or
+ * changed are redrawn. Otherwise the block is rebuilt.
+ */
+static int update_block(AVFilterContext *ctx, const char *text, int width, int height)
+{
+    DrawTextContext *dtext = ctx->priv;
+    int block[4] = { INT_MAX, INT_MAX, INT_MIN, INT_MIN }, rect[4], rect2[4];
+    int box[4] = { dtext->box_x, dtext->box_y, dtext->box_w, dtext->box_h };
+    int i, l, ret, same_layout, incremental;
+    TextCell *cells;
+
+    if ((ret = layout_text(ctx, text, width, height)) < 0)
+        goto fail;
+
+    for (l = LAYER_SHADOW; l <= LAYER_TEXT; l++) {
+        TextLayer *layer = &dtext->layers[l];
+        if (!layer->enabled)
+            continue;
+        for (i = 0; i < dtext->nb_cells; i++)
+            if (glyph_rect(&dtext->cells[i], layer->dx, layer->dy, width, height, rect))
+                merge_rect(block, rect);
+    }
+    if (dtext->layers[LAYER_BOX].enabled && dtext->box_w && dtext->box_h) {
+        rect[0] = dtext->box_x;
+        rect[1] = dtext->box_y;
+        rect[2] = dtext->box_x + dtext->box_w;
+        rect[3] = dtext->box_y + dtext->box_h;
+        merge_rect(block, rect);
+    }
+
+    same_layout = dtext->block_text &&
+                  width  == dtext->frame_w && height == dtext->frame_h &&
+                  dtext->nb_cells == dtext->nb_block_cells &&
+                  (!dtext->layers[LAYER_BOX].enabled ||
+                   (box[0] == dtext->box_x && box[1] == dtext->box_y &&
+                    box[2] == dtext->box_w && box[3] == dtext->box_h));
+    if (same_layout && dtext->block_w) {
+        rect[0] = dtext->block_x;
+        rect[1] = dtext->block_y;
+        rect[2] = dtext->block_x + dtext->block_w;
+        rect[3] = dtext->block_y + dtext->block_h;
+        merge_rect(block, rect);
+    }
+    if (block[0] >= block[2])
+        block[0] = block[1] = block[2] = block[3] = 0;
+
+    incremental = same_layout &&
+                  block[0] == dtext->block_x && block[2] - block[0] == dtext->block_w &&
+                  block[1] == dtext->block_y && block[3] - block[1] == dtext->block_h;
+    av_freep(&dtext->block_text);
+
+    dtext->frame_w = width;
+    dtext->frame_h = height;
+    if (incremental) {
+        for (i = 0; i < dtext->nb_cells; i++) {
+            const TextCell *cur = &dtext->cells[i], *old = &dtext->block_cells[i];
+            if (cur->glyph == old->glyph && cur->x == old->x && cur->y == old->y)
+                continue;
+            for (l = LAYER_SHADOW; l <= LAYER_TEXT; l++) {
+                TextLayer *layer = &dtext->layers[l];
+                int have_old, have_cur;
+                if (!layer->enabled)
+                    continue;
+                have_old = glyph_rect(old, layer->dx, layer->dy, width, height, rect);
+                have_cur = glyph_rect(cur, layer->dx, layer->dy, width, height, rect2);
+                if (have_old && have_cur)
+                    merge_rect(rect, rect2);
+                else if (have_cur)
+                    memcpy(rect, rect2, sizeof(rect));
+                else if (!have_old)
+                    continue;
+                redraw_layer(dtext, layer, rect);
+            }
+        }
+    } else {
+        dtext->block_x = block[0];
+        dtext->block_y = block[1];
+        dtext->block_w = block[2] - block[0];
+        dtext->block_h = block[3] - block[1];
+        if ((ret = build_block(dtext)) < 0)
+            goto fail;
+    }
+
+    if (!(dtext->block_text = av_strdup(text))) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+    cells = dtext->block_cells;
+    dtext->block_cells    = dtext->cells;
+    dtext->nb_block_cells = dtext->nb_cells;
+    dtext->cells          = cells;
+    return 0;
+
+fail:
+    av_freep(&dtext->block_text);
+    return ret;
+}
+
+static void blend_block(DrawTextContext *dtext, AVFilterBufferRef *picref)
+{
+    int i, p, y;
+
+    for (i = 0; i < NB_LAYERS && dtext->block_w; i++) {
+        TextLayer *layer = &dtext->layers[i];
+
+        if (!layer->enabled)
+            continue;
+        for (p = 0; p < dtext->nb_planes; p++) {
+            uint8_t *dst = picref->data[p] + dtext->plane_y[p] * picref->linesize[p] +
+                           dtext->plane_x[p];
+            for (y = 0; y < dtext->plane_h[p]; y++)
+                dtext->blend_line(dst + y * picref->linesize[p],
+                                  layer->alpha[p]  + y * dtext->plane_w[p],
+                                  layer->premul[p] + y * dtext->plane_w[p],
+                                  dtext->plane_w[p]);
+        }
+    }
+}
+
+static int draw_text(AVFilterContext *ctx, AVFilterBufferRef *picref,
+                     int width, int height)
+{
+    DrawTextContext *dtext = ctx->priv;
+    char *text = dtext->text;
+    int ret;
+
+#if HAVE_LOCALTIME_R
+    time_t now = time(0);
+    struct tm ltime;
+    uint8_t *buf = dtext->expanded_text;
+    int buf_size = dtext->expanded_text_size;
+
+    if (!buf) {
+        buf_size = 2*strlen(dtext->text)+1;
+        buf = av_malloc(buf_size);
+    }
+
+    localtime_r(&now, &ltime);
+
+    do {
+        *buf = 1;
+        if (strftime(buf, buf_size, dtext->text, &ltime) != 0 || *buf == 0)
+            break;
+        buf_size *= 2;
+    } while ((buf = av_realloc(buf, buf_size)));
+
+    if (!buf)
+        return AVERROR(ENOMEM);
+    text = dtext->expanded_text = buf;
+    dtext->expanded_text_size = buf_size;
+#endif
+
+    /* the block is only updated when the text or the frame size change */
+    if (!dtext->block_text || strcmp(text, dtext->block_text) ||
+        width != dtext->frame_w || height != dtext->frame_h)
+        if ((ret = update_block(ctx, text, width, height)) < 0)
+            return ret;
+
+    if (dtext->draw_box && dtext->boxcolor[3] == 0xFF)
+        ff_draw_rectangle(picref->data, picref->linesize,
+                          dtext->box_line, dtext->pixel_step, dtext->hsub, dtext->vsub,
+                          dtext->box_x, dtext->box_y, dtext->box_w, dtext->box_h);
+    blend_block(dtext, picref);
 
     return 0;
 }
@@ -25,15 +25,12 @@
  * libmpcodecs/vf_hqdn3d.c.
  */
 
+#include "libavutil/cpu.h"
 #include "libavutil/pixdesc.h"
+#include "libavutil/timer.h"
 #include "avfilter.h"
-
-typedef struct {
-    int Coefs[4][512*16];
-    unsigned int *Line;
-    unsigned short *Frame[3];
-    int hsub, vsub;
-} HQDN3DContext;
+#include "internal.h"
+#include "hqdn3d.h"
 
 static inline unsigned int LowPassMul(unsigned int PrevMul, unsigned int CurrMul, int *Coef)
 {
@@ -43,77 +40,165 @@ static inline unsigned int LowPassMul(unsigned int PrevMul, unsigned int CurrMul
     return CurrMul + Coef[d];
 }
 
-static void deNoiseTemporal(unsigned char *FrameSrc,
-                            unsigned char *FrameDest,
-                            unsigned short *FrameAnt,
-                            int W, int H, int sStride, int dStride,
-                            int *Temporal)
+void ff_hqdn3d_temporal_line_c(uint8_t *FrameDest, const uint8_t *FrameSrc,
+                               unsigned short *FrameAnt, int W, int *Temporal)
 {
-    long X, Y;
+    long X;
     unsigned int PixelDst;
 
-    for (Y = 0; Y < H; Y++) {
+    for (X = 0; X < W; X++) {
+        PixelDst = LowPassMul(FrameAnt[X]<<8, FrameSrc[X]<<16, Temporal);
+        FrameAnt[X] = ((PixelDst+0x1000007F)>>8);
+        FrameDest[X]= ((PixelDst+0x10007FFF)>>16);
+    }
+}
+
+void ff_hqdn3d_line_c(uint8_t *FrameDest, unsigned int *LineCur, const unsigned int *LinePrev,
+                      unsigned short *FrameAnt, int W, int *Vertical, int *Temporal)
+{
+    long X;
+    unsigned int PixelDst;
+
+    if (!FrameAnt) {
         for (X = 0; X < W; X++) {
-            PixelDst = LowPassMul(FrameAnt[X]<<8, FrameSrc[X]<<16, Temporal);
-            FrameAnt[X] = ((PixelDst+0x1000007F)>>8);
+            PixelDst = LineCur[X] = LowPassMul(LinePrev[X], LineCur[X], Vertical);
             FrameDest[X]= ((PixelDst+0x10007FFF)>>16);
         }
-        FrameSrc  += sStride;
-        FrameDest += dStride;
-        FrameAnt += W;
+        return;
+    }
+    for (X = 0; X < W; X++) {
+        LineCur[X] = LowPassMul(LinePrev[X], LineCur[X], Vertical);
+        PixelDst = LowPassMul(FrameAnt[X]<<8, LineCur[X], Temporal);
+        FrameAnt[X] = ((PixelDst+0x1000007F)>>8);
+        FrameDest[X]= ((PixelDst+0x10007FFF)>>16);
     }
 }
 
-static void deNoiseSpacial(unsigned char *Frame,
-                           unsigned char *FrameDest,
-                           unsigned int *LineAnt,
-                           int W, int H, int sStride, int dStride,
-                           int *Horizontal, int *Vertical)
+typedef struct ThreadData {
+    unsigned char *Frame, *FrameDest;
+    unsigned short *FrameAnt;
+    int W, H, sStride, dStride;
+    int *Horizontal, *Vertical, *Temporal;
+} ThreadData;
+
+static int deNoiseTemporal(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
 {
-    long X, Y;
-    long sLineOffs = 0, dLineOffs = 0;
-    unsigned int PixelAnt;
-    unsigned int PixelDst;
+    HQDN3DContext *hqdn3d = ctx->priv;
+    ThreadData *td = arg;
+    int Y, start = td->H * jobnr / nb_jobs, end = td->H * (jobnr+1) / nb_jobs;
+
+    for (Y = start; Y < end; Y++)
+        hqdn3d->temporal_line(td->FrameDest + Y*td->dStride, td->Frame + Y*td->sStride,
+                              td->FrameAnt + Y*td->W, td->W, td->Temporal);
+    return 0;
+}
 
-    /* First pixel has no left nor top neighbor. */
-    PixelDst = LineAnt[0] = PixelAnt = Frame[0]<<16;
-    FrameDest[0]= ((PixelDst+0x10007FFF)>>16);
+/**
+ * Horizontal filter of 4 lines. The recursion of a line is a chain of
+ * dependent table lookups, running 4 of them together hides their latency.
+ */
+static void deNoiseHorizontal4(const unsigned char *Frame, unsigned int *LineDst,
+                               int W, int sStride, int *Horizontal)
+{
+    const unsigned char *Frame1 = Frame + sStride, *Frame2 = Frame1 + sStride, *Frame3 = Frame2 + sStride;
+    unsigned int *LineDst1 = LineDst + W, *LineDst2 = LineDst1 + W, *LineDst3 = LineDst2 + W;
+    unsigned int PixelAnt  = LineDst [0] = Frame [0]<<16;
+    unsigned int PixelAnt1 = LineDst1[0] = Frame1[0]<<16;
+    unsigned int PixelAnt2 = LineDst2[0] = Frame2[0]<<16;
+    unsigned int PixelAnt3 = LineDst3[0] = Frame3[0]<<16;
+    long X;
 
-    /* First line has no top neighbor, only left. */
     for (X = 1; X < W; X++) {
-        PixelDst = LineAnt[X] = LowPassMul(PixelAnt, Frame[X]<<16, Horizontal);
-        FrameDest[X]= ((PixelDst+0x10007FFF)>>16);
+        PixelAnt  = LineDst [X] = LowPassMul(PixelAnt,  Frame [X]<<16, Horizontal);
+        PixelAnt1 = LineDst1[X] = LowPassMul(PixelAnt1, Frame1[X]<<16, Horizontal);
+        PixelAnt2 = LineDst2[X] = LowPassMul(PixelAnt2, Frame2[X]<<16, Horizontal);
+        PixelAnt3 = LineDst3[X] = LowPassMul(PixelAnt3, Frame3[X]<<16, Horizontal);
     }
+}
+
+/**
+ * Horizontal filter, in bands of lines. Each line only depends on its own
+ * previous pixels, the result goes to the Spacial plane.
+ */
+static int deNoiseHorizontal(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    HQDN3DContext *hqdn3d = ctx->priv;
+    ThreadData *td = arg;
+    int Y, start = td->H * jobnr / nb_jobs, end = td->H * (jobnr+1) / nb_jobs;
+    long X;
 
-    for (Y = 1; Y < H; Y++) {
-        unsigned int PixelAnt;
-        sLineOffs += sStride, dLineOffs += dStride;
+    for (Y = start; Y < end; Y++) {
+        unsigned char *Frame = td->Frame + Y*td->sStride;
+        unsigned int *LineDst = hqdn3d->Spacial + Y*td->W;
         /* First pixel on each line doesn't have previous pixel */
-        PixelAnt = Frame[sLineOffs]<<16;
-        PixelDst = LineAnt[0] = LowPassMul(LineAnt[0], PixelAnt, Vertical);
-        FrameDest[dLineOffs]= ((PixelDst+0x10007FFF)>>16);
-
-        for (X = 1; X < W; X++) {
-            unsigned int PixelDst;
-            /* The rest are normal */
-            PixelAnt = LowPassMul(PixelAnt, Frame[sLineOffs+X]<<16, Horizontal);
-            PixelDst = LineAnt[X] = LowPassMul(LineAnt[X], PixelAnt, Vertical);
-            FrameDest[dLineOffs+X]= ((PixelDst+0x10007FFF)>>16);
+        unsigned int PixelAnt = LineDst[0] = Frame[0]<<16;
+
+        /* Without the temporal filter, the first line is filtered against
+         * its first pixel only, as the spatial only filter always did. */
+        if (!Y && !td->FrameAnt) {
+            for (X = 1; X < td->W; X++)
+                LineDst[X] = LowPassMul(PixelAnt, Frame[X]<<16, td->Horizontal);
+            continue;
         }
+        if (Y + 4 <= end) {
+            deNoiseHorizontal4(Frame, LineDst, td->W, td->sStride, td->Horizontal);
+            Y += 3;
+            continue;
+        }
+        for (X = 1; X < td->W; X++)
+            PixelAnt = LineDst[X] = LowPassMul(PixelAnt, Frame[X]<<16, td->Horizontal);
     }
+    return 0;
+}
+
+/**
+ * Vertical and temporal filters, in bands of columns a multiple of 16
+ * pixels wide. Each column only depends on the line above.
+ */
+static int deNoiseVertical(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    HQDN3DContext *hqdn3d = ctx->priv;
+    ThreadData *td = arg;
+    int W = td->W, n = (W + 15) >> 4;
+    int X0 =        (n *  jobnr    / nb_jobs) << 4;
+    int X1 = FFMIN(((n * (jobnr+1) / nb_jobs) << 4), W);
+    unsigned int *Line = hqdn3d->Spacial + X0;
+    unsigned short *FrameAnt = td->FrameAnt ? td->FrameAnt + X0 : NULL;
+    unsigned char *FrameDest = td->FrameDest + X0;
+    long X, Y;
+
+    /* First line has no top neighbor. */
+    for (X = 0; X < X1 - X0; X++) {
+        unsigned int PixelDst = Line[X];
+        if (FrameAnt) {
+            PixelDst = LowPassMul(FrameAnt[X]<<8, PixelDst, td->Temporal);
+            FrameAnt[X] = ((PixelDst+0x1000007F)>>8);
+        }
+        FrameDest[X]= ((PixelDst+0x10007FFF)>>16);
+    }
+
+    for (Y = 1; Y < td->H; Y++) {
+        Line      += W;
+        FrameDest += td->dStride;
+        if (FrameAnt)
+            FrameAnt += W;
+        hqdn3d->line(FrameDest, Line, Line - W, FrameAnt, X1 - X0,
+                     td->Vertical, td->Temporal);
+    }
+    return 0;
 }
 
-static void deNoise(unsigned char *Frame,
+static void deNoise(AVFilterContext *ctx,
+                    unsigned char *Frame,
                     unsigned char *FrameDest,
-                    unsigned int *LineAnt,
                     unsigned short **FrameAntPtr,
                     int W, int H, int sStride, int dStride,
                     int *Horizontal, int *Vertical, int *Temporal)
 {
+    ThreadData td = { Frame, FrameDest, NULL, W, H, sStride, dStride,
+                      Horizontal, Vertical, Temporal };
+    int nb_threads = ff_filter_nb_threads(ctx);
     long X, Y;
-    long sLineOffs = 0, dLineOffs = 0;
-    unsigned int PixelAnt;
-    unsigned int PixelDst;
     unsigned short* FrameAnt=(*FrameAntPtr);
 
     if (!FrameAnt) {
@@ -126,52 +211,15 @@ static void deNoise(unsigned char *Frame,
     }
 
     if (!Horizontal[0] && !Vertical[0]) {
-        deNoiseTemporal(Frame, FrameDest, FrameAnt,
-                        W, H, sStride, dStride, Temporal);
-        return;
-    }
-    if (!Temporal[0]) {
-        deNoiseSpacial(Frame, FrameDest, LineAnt,
-                       W, H, sStride, dStride, Horizontal, Vertical);
+        td.FrameAnt = FrameAnt;
+        ff_filter_execute(ctx, deNoiseTemporal, &td, FFMIN(H, nb_threads));
         return;
     }
+    if (Temporal[0])
+        td.FrameAnt = FrameAnt;
 
-    /* First pixel has no left nor top neighbor. Only previous frame */
-    LineAnt[0] = PixelAnt = Frame[0]<<16;
-    PixelDst = LowPassMul(FrameAnt[0]<<8, PixelAnt, Temporal);
-    FrameAnt[0] = ((PixelDst+0x1000007F)>>8);
-    FrameDest[0]= ((PixelDst+0x10007FFF)>>16);
-
-    /* First line has no top neighbor. Only left one for each pixel and
-     * last frame */
-    for (X = 1; X < W; X++) {
-        LineAnt[X] = PixelAnt = LowPassMul(PixelAnt, Frame[X]<<16, Horizontal);
-        PixelDst = LowPassMul(FrameAnt[X]<<8, PixelAnt, Temporal);
-        FrameAnt[X] = ((PixelDst+0x1000007F)>>8);
-        FrameDest[X]= ((PixelDst+0x10007FFF)>>16);
-    }
-
-    for (Y = 1; Y < H; Y++) {
-        unsigned int PixelAnt;
-        unsigned short* LinePrev=&FrameAnt[Y*W];
-        sLineOffs += sStride, dLineOffs += dStride;
-        /* First pixel on each line doesn't have previous pixel */
-        PixelAnt = Frame[sLineOffs]<<16;
-        LineAnt[0] = LowPassMul(LineAnt[0], PixelAnt, Vertical);
-        PixelDst = LowPassMul(LinePrev[0]<<8, LineAnt[0], Temporal);
-        LinePrev[0] = ((PixelDst+0x1000007F)>>8);
-        FrameDest[dLineOffs]= ((PixelDst+0x10007FFF)>>16);
-
-        for (X = 1; X < W; X++) {
-            unsigned int PixelDst;
-            /* The rest are normal */
-            PixelAnt = LowPassMul(PixelAnt, Frame[sLineOffs+X]<<16, Horizontal);
-            LineAnt[X] = LowPassMul(LineAnt[X], PixelAnt, Vertical);
-            PixelDst = LowPassMul(LinePrev[X]<<8, LineAnt[X], Temporal);
-            LinePrev[X] = ((PixelDst+0x1000007F)>>8);
-            FrameDest[dLineOffs+X]= ((PixelDst+0x10007FFF)>>16);
-        }
-    }
+    ff_filter_execute(ctx, deNoiseHorizontal, &td, FFMIN(H, nb_threads));
+    ff_filter_execute(ctx, deNoiseVertical,   &td, FFMIN((W + 15) >> 4, nb_threads));
 }
 
 static void PrecalcCoefs(int *Ct, double Dist25)
@@ -249,6 +297,13 @@ static int init(AVFilterContext *ctx, const char *args, void *opaque)
     PrecalcCoefs(hqdn3d->Coefs[2], ChromSpac);
     PrecalcCoefs(hqdn3d->Coefs[3], ChromTmp);
 
+    hqdn3d->line          = ff_hqdn3d_line_c;
+    hqdn3d->temporal_line = ff_hqdn3d_temporal_line_c;
+    if (HAVE_AVX2 && av_get_cpu_flags() & AV_CPU_FLAG_AVX2) {
+        hqdn3d->line          = ff_hqdn3d_line_avx2;
+        hqdn3d->temporal_line = ff_hqdn3d_temporal_line_avx2;
+    }
+
     return 0;
 }
 
@@ -256,7 +311,10 @@ static void uninit(AVFilterContext *ctx)
 {
     HQDN3DContext *hqdn3d = ctx->priv;
 
-    av_freep(&hqdn3d->Line);
+    if (hqdn3d->frames)
+        av_log(ctx, AV_LOG_VERBOSE, "%"PRIu64" kilocycles per frame over %d frames\n",
+               hqdn3d->time / 1000 / hqdn3d->frames, hqdn3d->frames);
+    av_freep(&hqdn3d->Spacial);
     av_freep(&hqdn3d->Frame[0]);
     av_freep(&hqdn3d->Frame[1]);
     av_freep(&hqdn3d->Frame[2]);
@@ -280,8 +338,8 @@ static int config_input(AVFilterLink *inlink)
     hqdn3d->hsub = av_pix_fmt_descriptors[inlink->format].log2_chroma_w;
     hqdn3d->vsub = av_pix_fmt_descriptors[inlink->format].log2_chroma_h;
 
-    hqdn3d->Line = av_malloc(inlink->w * sizeof(*hqdn3d->Line));
-    if (!hqdn3d->Line)
+    hqdn3d->Spacial = av_malloc(inlink->w * inlink->h * sizeof(*hqdn3d->Spacial));
+    if (!hqdn3d->Spacial)
         return AVERROR(ENOMEM);
 
     return 0;
@@ -291,32 +349,43 @@ static void null_draw_slice(AVFilterLink *link, int y, int h, int slice_dir) { }
 
 static void end_frame(AVFilterLink *inlink)
 {
-    HQDN3DContext *hqdn3d = inlink->dst->priv;
-    AVFilterLink *outlink = inlink->dst->outputs[0];
+    AVFilterContext *ctx = inlink->dst;
+    HQDN3DContext *hqdn3d = ctx->priv;
+    AVFilterLink *outlink = ctx->outputs[0];
     AVFilterBufferRef *inpic  = inlink ->cur_buf;
     AVFilterBufferRef *outpic = outlink->out_buf;
     int cw = inpic->video->w >> hqdn3d->hsub;
     int ch = inpic->video->h >> hqdn3d->vsub;
+#ifdef AV_READ_TIME
+    uint64_t t = AV_READ_TIME();
+#endif
 
-    deNoise(inpic->data[0], outpic->data[0],
-            hqdn3d->Line, &hqdn3d->Frame[0], inpic->video->w, inpic->video->h,
+    deNoise(ctx, inpic->data[0], outpic->data[0],
+            &hqdn3d->Frame[0], inpic->video->w, inpic->video->h,
             inpic->linesize[0], outpic->linesize[0],
             hqdn3d->Coefs[0],
             hqdn3d->Coefs[0],
             hqdn3d->Coefs[1]);
-    deNoise(inpic->data[1], outpic->data[1],
-            hqdn3d->Line, &hqdn3d->Frame[1], cw, ch,
+    deNoise(ctx, inpic->data[1], outpic->data[1],
+            &hqdn3d->Frame[1], cw, ch,
             inpic->linesize[1], outpic->linesize[1],
             hqdn3d->Coefs[2],
             hqdn3d->Coefs[2],
             hqdn3d->Coefs[3]);
-    deNoise(inpic->data[2], outpic->data[2],
-            hqdn3d->Line, &hqdn3d->Frame[2], cw, ch,
+    deNoise(ctx, inpic->data[2], outpic->data[2],
+            &hqdn3d->Frame[2], cw, ch,
             inpic->linesize[2], outpic->linesize[2],
             hqdn3d->Coefs[2],
             hqdn3d->Coefs[2],
             hqdn3d->Coefs[3]);
 
+#ifdef AV_READ_TIME
+    t = AV_READ_TIME() - t;
+    hqdn3d->time += t;
+    hqdn3d->frames++;
+    av_log(ctx, AV_LOG_DEBUG, "frame %d filtered in %"PRIu64" kilocycles\n",
+           hqdn3d->frames, t / 1000);
+#endif
     avfilter_draw_slice(outlink, 0, inpic->video->h, 1);
     avfilter_end_frame(outlink);
     avfilter_unref_buffer(inpic);
@@ -331,6 +400,7 @@ AVFilter avfilter_vf_hqdn3d = {
     .init          = init,
     .uninit        = uninit,
     .query_formats = query_formats,
+    .flags         = AVFILTER_FLAG_SLICE_THREADS,
 
     .inputs    = (AVFilterPad[]) {{ .name             = "default",
                                     .type             = AVMEDIA_TYPE_VIDEO,
@@ -28,6 +28,7 @@
 #include "libavutil/opt.h"
 #include "libavutil/pixdesc.h"
 #include "avfilter.h"
+#include "internal.h"
 
 static const char *var_names[] = {
     "E",
@@ -299,23 +300,30 @@ static int config_props(AVFilterLink *inlink)
     return 0;
 }
 
-static void draw_slice(AVFilterLink *inlink, int y, int h, int slice_dir)
+typedef struct {
+    AVFilterBufferRef *in, *out;
+    int y, h;                   ///< slice being filtered
+} ThreadData;
+
+static int filter_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
 {
-    AVFilterContext *ctx = inlink->dst;
     LutContext *lut = ctx->priv;
-    AVFilterLink *outlink = ctx->outputs[0];
-    AVFilterBufferRef *inpic  = inlink ->cur_buf;
-    AVFilterBufferRef *outpic = outlink->out_buf;
+    ThreadData *td = arg;
+    AVFilterBufferRef *inpic  = td->in;
+    AVFilterBufferRef *outpic = td->out;
+    int w = ctx->inputs[0]->w;
     uint8_t *inrow, *outrow;
     int i, j, k, plane;
 
     if (lut->is_rgb) {
         /* packed */
-        inrow  = inpic ->data[0] + y * inpic ->linesize[0];
-        outrow = outpic->data[0] + y * outpic->linesize[0];
+        int start = td->y + td->h *  jobnr      / nb_jobs;
+        int end   = td->y + td->h * (jobnr + 1) / nb_jobs;
 
-        for (i = 0; i < h; i ++) {
-            for (j = 0; j < inlink->w; j++) {
+        for (i = start; i < end; i++) {
+            inrow  = inpic ->data[0] + i * inpic ->linesize[0];
+            outrow = outpic->data[0] + i * outpic->linesize[0];
+            for (j = 0; j < w; j++) {
                 for (k = 0; k < lut->step; k++)
                     outrow[k] = lut->lut[lut->rgba_map[k]][inrow[k]];
                 outrow += lut->step;
@@ -327,12 +335,15 @@ static void draw_slice(AVFilterLink *inlink, int y, int h, int slice_dir)
         for (plane = 0; inpic->data[plane]; plane++) {
             int vsub = plane == 1 || plane == 2 ? lut->vsub : 0;
             int hsub = plane == 1 || plane == 2 ? lut->hsub : 0;
+            int h     = td->h >> vsub;
+            int start = (td->y >> vsub) + h *  jobnr      / nb_jobs;
+            int end   = (td->y >> vsub) + h * (jobnr + 1) / nb_jobs;
 
-            inrow  = inpic ->data[plane] + (y>>vsub) * inpic ->linesize[plane];
-            outrow = outpic->data[plane] + (y>>vsub) * outpic->linesize[plane];
+            inrow  = inpic ->data[plane] + start * inpic ->linesize[plane];
+            outrow = outpic->data[plane] + start * outpic->linesize[plane];
 
-            for (i = 0; i < h>>vsub; i ++) {
-                for (j = 0; j < inlink->w>>hsub; j++)
+            for (i = start; i < end; i++) {
+                for (j = 0; j < w>>hsub; j++)
                     outrow[j] = lut->lut[plane][inrow[j]];
                 inrow  += inpic ->linesize[plane];
                 outrow += outpic->linesize[plane];
@@ -340,6 +351,17 @@ static void draw_slice(AVFilterLink *inlink, int y, int h, int slice_dir)
         }
     }
 
+    return 0;
+}
+
+static void draw_slice(AVFilterLink *inlink, int y, int h, int slice_dir)
+{
+    AVFilterContext *ctx = inlink->dst;
+    AVFilterLink *outlink = ctx->outputs[0];
+    ThreadData td = { inlink->cur_buf, outlink->out_buf, y, h };
+
+    ff_filter_execute(ctx, filter_slice, &td, FFMIN(h, ff_filter_nb_threads(ctx)));
+
     avfilter_draw_slice(outlink, y, h, slice_dir);
 }
 
@@ -352,6 +374,7 @@ static void draw_slice(AVFilterLink *inlink, int y, int h, int slice_dir)
         .init          = init_,                                         \
         .uninit        = uninit,                                        \
         .query_formats = query_formats,                                 \
+        .flags         = AVFILTER_FLAG_SLICE_THREADS,                   \
                                                                         \
         .inputs    = (AVFilterPad[]) {{ .name            = "default",   \
                                         .type            = AVMEDIA_TYPE_VIDEO, \
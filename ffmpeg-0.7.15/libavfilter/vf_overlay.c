@@ -26,11 +26,14 @@
  */
 
 #include "avfilter.h"
+#include "libavutil/cpu.h"
 #include "libavutil/eval.h"
 #include "libavutil/avstring.h"
+#include "libavutil/mem.h"
 #include "libavutil/pixdesc.h"
 #include "libavutil/imgutils.h"
 #include "internal.h"
+#include "overlay.h"
 
 static const char *var_names[] = {
     "E",
@@ -57,6 +60,27 @@ enum var_name {
 #define MAIN    0
 #define OVERLAY 1
 
+/** transparent or opaque stretches shorter than this are blended */
+#define MIN_RUN 32
+
+/** x / 255 rounded to the nearest, exact for x <= 255 * 255 */
+#define FAST_DIV255(x) ((((x) + 128) * 257) >> 16)
+
+/** A run of overlay pixels, the transparent ones are left out. */
+typedef struct {
+    int start, len;
+    int blend;                  ///< 1 to blend, 0 to copy the opaque overlay
+} OverlayRun;
+
+/** Overlay plane prepared for blending, once per overlay frame. */
+typedef struct {
+    int w, h;
+    uint8_t  *inv_alpha;        ///< 255 - alpha
+    uint16_t *premul;           ///< overlay pixel * alpha
+    OverlayRun *runs;
+    int *row_runs;              ///< index in runs of the first run of each row, h + 1 entries
+} OverlayPlane;
+
 typedef struct {
     int x, y;                   ///< position of overlayed picture
 
@@ -66,8 +90,23 @@ typedef struct {
     int hsub, vsub;             ///< chroma subsampling values
 
     char x_expr[256], y_expr[256];
+
+    OverlayPlane planes[3];
+    int planes_ready;           ///< planes are prepared for overpicref
+
+    void (*blend_line)(uint8_t *dst, const uint8_t *inv_alpha,
+                       const uint16_t *premul, int w);
 } OverlayContext;
 
+void ff_overlay_blend_line_c(uint8_t *dst, const uint8_t *inv_alpha,
+                             const uint16_t *premul, int w)
+{
+    int x;
+
+    for (x = 0; x < w; x++)
+        dst[x] = FAST_DIV255(dst[x] * inv_alpha[x] + premul[x]);
+}
+
 static av_cold int init(AVFilterContext *ctx, const char *args, void *opaque)
 {
     OverlayContext *over = ctx->priv;
@@ -78,15 +117,35 @@ static av_cold int init(AVFilterContext *ctx, const char *args, void *opaque)
     if (args)
         sscanf(args, "%255[^:]:%255[^:]", over->x_expr, over->y_expr);
 
+    over->blend_line = ff_overlay_blend_line_c;
+    if (HAVE_SSE && av_get_cpu_flags() & AV_CPU_FLAG_SSE2)
+        over->blend_line = ff_overlay_blend_line_sse2;
+    if (HAVE_AVX2 && av_get_cpu_flags() & AV_CPU_FLAG_AVX2)
+        over->blend_line = ff_overlay_blend_line_avx2;
+
     return 0;
 }
 
+static void free_planes(OverlayContext *over)
+{
+    int i;
+
+    for (i = 0; i < 3; i++) {
+        av_freep(&over->planes[i].inv_alpha);
+        av_freep(&over->planes[i].premul);
+        av_freep(&over->planes[i].runs);
+        av_freep(&over->planes[i].row_runs);
+    }
+    over->planes_ready = 0;
+}
+
 static av_cold void uninit(AVFilterContext *ctx)
 {
     OverlayContext *over = ctx->priv;
 
     if (over->overpicref)
         avfilter_unref_buffer(over->overpicref);
+    free_planes(over);
 }
 
 static int query_formats(AVFilterContext *ctx)
@@ -121,7 +180,7 @@ static int config_input_overlay(AVFilterLink *inlink)
     OverlayContext  *over = inlink->dst->priv;
     char *expr;
     double var_values[VAR_VARS_NB], res;
-    int ret;
+    int i, ret;
 
     /* Finish the configuration by evaluating the expressions
        now when both inputs are configured. */
@@ -167,6 +226,26 @@ static int config_input_overlay(AVFilterLink *inlink)
                (int)var_values[VAR_MAIN_W], (int)var_values[VAR_MAIN_H]);
         return AVERROR(EINVAL);
     }
+
+    free_planes(over);
+    for (i = 0; i < 3; i++) {
+        OverlayPlane *p = &over->planes[i];
+        int hsub = i ? over->hsub : 0;
+        int vsub = i ? over->vsub : 0;
+
+        p->w = -((-inlink->w) >> hsub);
+        p->h = -((-inlink->h) >> vsub);
+        /* the stored runs of a row alternate between blended runs and
+         * copied runs of at least MIN_RUN pixels */
+        p->inv_alpha = av_malloc(p->w * p->h);
+        p->premul    = av_malloc(p->w * p->h * sizeof(*p->premul));
+        p->runs      = av_malloc((2 * p->w / MIN_RUN + 2) * p->h * sizeof(*p->runs));
+        p->row_runs  = av_malloc((p->h + 1) * sizeof(*p->row_runs));
+        if (!p->inv_alpha || !p->premul || !p->runs || !p->row_runs) {
+            free_planes(over);
+            return AVERROR(ENOMEM);
+        }
+    }
     return 0;
 
 fail:
@@ -237,6 +316,76 @@ static void start_frame_overlay(AVFilterLink *inlink, AVFilterBufferRef *inpicre
     over->overpicref = inpicref;
     over->overpicref->pts = av_rescale_q(inpicref->pts, ctx->inputs[OVERLAY]->time_base,
                                          ctx->outputs[0]->time_base);
+    over->planes_ready = 0;
+}
+
+/**
+ * Compute the alpha of each pixel of the overlay planes, premultiply the
+ * overlay by it and split each row into runs to copy or blend. Chroma
+ * alpha is the average of the luma alphas it covers.
+ */
+static void prepare_planes(OverlayContext *over, AVFilterBufferRef *src)
+{
+    int i, j, k;
+
+    for (i = 0; i < 3; i++) {
+        OverlayPlane *p = &over->planes[i];
+        int hsub = i ? over->hsub : 0;
+        int vsub = i ? over->vsub : 0;
+        int as = src->linesize[3];
+        int nb_runs = 0;
+
+        for (j = 0; j < p->h; j++) {
+            const uint8_t *a = src->data[3] + (j << vsub) * as;
+            const uint8_t *s = src->data[i] + j * src->linesize[i];
+            uint8_t  *ia = p->inv_alpha + j * p->w;
+            uint16_t *pm = p->premul    + j * p->w;
+            int run_start = 0, run_len = 0, run_type = 0; /* 0 transparent, 1 opaque, 2 blend */
+
+            p->row_runs[j] = nb_runs;
+            for (k = 0; k < p->w; k++) {
+                int alpha_v, alpha_h, alpha;
+                if (hsub && vsub && j+1 < p->h && k+1 < p->w) {
+                    alpha = (a[0] + a[as] + a[1] + a[as+1]) >> 2;
+                } else if (hsub || vsub) {
+                    alpha_h = hsub && k+1 < p->w ? (a[0] + a[1]) >> 1 : a[0];
+                    alpha_v = vsub && j+1 < p->h ? (a[0] + a[as]) >> 1 : a[0];
+                    alpha = (alpha_v + alpha_h) >> 1;
+                } else
+                    alpha = a[0];
+                ia[k] = 0xff - alpha;
+                pm[k] = s[k] * alpha;
+                a += 1 << hsub;
+            }
+
+            for (k = 0; k <= p->w; k++) {
+                int type = k == p->w ? -1 : ia[k] == 0xff ? 0 : !ia[k] ? 1 : 2;
+                if (type == run_type && k < p->w) {
+                    run_len++;
+                    continue;
+                }
+                if (run_len) {
+                    OverlayRun *last = nb_runs > p->row_runs[j] ? &p->runs[nb_runs - 1] : NULL;
+                    if (run_type != 2 && run_len < MIN_RUN)
+                        run_type = 2;
+                    if (run_type == 2 && last && last->blend &&
+                        last->start + last->len == run_start) {
+                        last->len += run_len;
+                    } else if (run_type) {
+                        p->runs[nb_runs].start = run_start;
+                        p->runs[nb_runs].len   = run_len;
+                        p->runs[nb_runs].blend = run_type == 2;
+                        nb_runs++;
+                    }
+                }
+                run_start = k;
+                run_len   = 1;
+                run_type  = type;
+            }
+        }
+        p->row_runs[p->h] = nb_runs;
+    }
+    over->planes_ready = 1;
 }
 
 static void blend_slice(AVFilterContext *ctx,
@@ -276,42 +425,34 @@ static void blend_slice(AVFilterContext *ctx,
             sp += src->linesize[0];
         }
     } else {
+        /* the lines of the overlay are placed as for a whole frame, a
+         * chroma line is blended by the slice holding its first luma line */
+        int frame_h = FFMIN(dst->video->h, overlay_end_y) - y;
+
+        if (!over->planes_ready)
+            prepare_planes(over, src);
+
         for (i = 0; i < 3; i++) {
+            OverlayPlane *p = &over->planes[i];
             int hsub = i ? over->hsub : 0;
             int vsub = i ? over->vsub : 0;
-            uint8_t *dp = dst->data[i] + (x >> hsub) +
-                (start_y >> vsub) * dst->linesize[i];
-            uint8_t *sp = src->data[i];
-            uint8_t *ap = src->data[3];
-            int wp = FFALIGN(width, 1<<hsub) >> hsub;
-            int hp = FFALIGN(height, 1<<vsub) >> vsub;
-            if (slice_y > y) {
-                sp += ((slice_y - y) >> vsub) * src->linesize[i];
-                ap += (slice_y - y) * src->linesize[3];
-            }
-            for (j = 0; j < hp; j++) {
-                uint8_t *d = dp, *s = sp, *a = ap;
-                for (k = 0; k < wp; k++) {
-                    // average alpha for color components, improve quality
-                    int alpha_v, alpha_h, alpha;
-                    if (hsub && vsub && j+1 < hp && k+1 < wp) {
-                        alpha = (a[0] + a[src->linesize[3]] +
-                                 a[1] + a[src->linesize[3]+1]) >> 2;
-                    } else if (hsub || vsub) {
-                        alpha_h = hsub && k+1 < wp ?
-                            (a[0] + a[1]) >> 1 : a[0];
-                        alpha_v = vsub && j+1 < hp ?
-                            (a[0] + a[src->linesize[3]]) >> 1 : a[0];
-                        alpha = (alpha_v + alpha_h) >> 1;
-                    } else
-                        alpha = a[0];
-                    *d = (*d * (0xff - alpha) + *s++ * alpha + 128) >> 8;
-                    d++;
-                    a += 1 << hsub;
+            int oy   = y >> vsub;
+            int sy   = FFMAX(oy, -((-slice_y) >> vsub)) - oy;
+            int ey   = FFMIN(FFMIN(-((-frame_h) >> vsub), p->h),
+                             -((-slice_end_y) >> vsub) - oy);
+            uint8_t *dp = dst->data[i] + (x >> hsub) + (oy + sy) * dst->linesize[i];
+            for (j = sy; j < ey; j++) {
+                const uint8_t *sp = src->data[i] + j * src->linesize[i];
+                int off = j * p->w;
+                for (k = p->row_runs[j]; k < p->row_runs[j + 1]; k++) {
+                    OverlayRun *run = &p->runs[k];
+                    if (run->blend)
+                        over->blend_line(dp + run->start, p->inv_alpha + off + run->start,
+                                         p->premul + off + run->start, run->len);
+                    else
+                        memcpy(dp + run->start, sp + run->start, run->len);
                 }
                 dp += dst->linesize[i];
-                sp += src->linesize[i];
-                ap += (1 << vsub) * src->linesize[3];
             }
         }
     }
@@ -326,7 +467,8 @@ static void draw_slice(AVFilterLink *inlink, int y, int h, int slice_dir)
 
     if (over->overpicref &&
         !(over->x >= outpicref->video->w || over->y >= outpicref->video->h ||
-          y+h < over->y || y >= over->y + over->overpicref->video->h)) {
+          y+h <= over->y >> over->vsub << over->vsub ||
+          y >= over->y + over->overpicref->video->h)) {
         blend_slice(ctx, outpicref, over->overpicref, over->x, over->y,
                     over->overpicref->video->w, over->overpicref->video->h,
                     y, outpicref->video->w, h);
@@ -24,8 +24,10 @@
  */
 
 #include "avfilter.h"
+#include "avfiltergraph.h"
 #include "libavutil/avstring.h"
 #include "libavutil/eval.h"
+#include "libavutil/opt.h"
 #include "libavutil/pixdesc.h"
 #include "libavutil/avassert.h"
 #include "libswscale/swscale.h"
@@ -140,6 +142,45 @@ static int query_formats(AVFilterContext *ctx)
     return 0;
 }
 
+/**
+ * Get a scaler for the link dimensions and formats, with src_h and dst_h
+ * lines, which uses as many threads as the graph. The scaler starts them
+ * for its first frame, so the unused ones of the progressive and field
+ * scalers hold no threads.
+ */
+static struct SwsContext *get_sws_context(AVFilterContext *ctx, int src_h, int dst_h)
+{
+    ScaleContext *scale = ctx->priv;
+    AVFilterLink *inlink  = ctx->inputs[0];
+    AVFilterLink *outlink = ctx->outputs[0];
+    struct SwsContext *sws;
+    int threads = ctx->graph ? ctx->graph->thread_count : 0;
+
+    if (threads < 2)
+        return sws_getContext(inlink->w, src_h, inlink->format,
+                              outlink->w, dst_h, outlink->format,
+                              scale->flags, NULL, NULL, NULL);
+
+    if (!(sws = sws_alloc_context()))
+        return NULL;
+    av_set_int(sws, "srcw",       inlink->w);
+    av_set_int(sws, "srch",       src_h);
+    av_set_int(sws, "src_format", inlink->format);
+    av_set_int(sws, "dstw",       outlink->w);
+    av_set_int(sws, "dsth",       dst_h);
+    av_set_int(sws, "dst_format", outlink->format);
+    av_set_int(sws, "sws_flags",  scale->flags);
+    av_set_int(sws, "threads",    threads);
+    if (sws_init_context(sws, NULL, NULL) < 0) {
+        sws_freeContext(sws);
+        return NULL;
+    }
+    sws_setColorspaceDetails(sws, sws_getCoefficients(SWS_CS_DEFAULT), av_get_int(sws, "src_range", NULL),
+                                  sws_getCoefficients(SWS_CS_DEFAULT), av_get_int(sws, "dst_range", NULL),
+                             0, 1 << 16, 1 << 16);
+    return sws;
+}
+
 static int config_props(AVFilterLink *outlink)
 {
     AVFilterContext *ctx = outlink->src;
@@ -214,21 +255,12 @@ static int config_props(AVFilterLink *outlink)
 
     scale->input_is_pal = av_pix_fmt_descriptors[inlink->format].flags & PIX_FMT_PAL;
 
-    if (scale->sws)
-        sws_freeContext(scale->sws);
-    scale->sws = sws_getContext(inlink ->w, inlink ->h, inlink ->format,
-                                outlink->w, outlink->h, outlink->format,
-                                scale->flags, NULL, NULL, NULL);
-    if (scale->isws[0])
-        sws_freeContext(scale->isws[0]);
-    scale->isws[0] = sws_getContext(inlink ->w, inlink ->h/2, inlink ->format,
-                                    outlink->w, outlink->h/2, outlink->format,
-                                    scale->flags, NULL, NULL, NULL);
-    if (scale->isws[1])
-        sws_freeContext(scale->isws[1]);
-    scale->isws[1] = sws_getContext(inlink ->w, inlink ->h/2, inlink ->format,
-                                    outlink->w, outlink->h/2, outlink->format,
-                                    scale->flags, NULL, NULL, NULL);
+    sws_freeContext(scale->sws);
+    sws_freeContext(scale->isws[0]);
+    sws_freeContext(scale->isws[1]);
+    scale->sws     = get_sws_context(ctx, inlink->h,   outlink->h);
+    scale->isws[0] = get_sws_context(ctx, inlink->h/2, outlink->h/2);
+    scale->isws[1] = get_sws_context(ctx, inlink->h/2, outlink->h/2);
     if (!scale->sws || !scale->isws[0] || !scale->isws[1])
         return AVERROR(EINVAL);
 
@@ -36,10 +36,14 @@
  * http://www.engin.umd.umich.edu/~jwvm/ece581/21_GBlur.pdf
  */
 
-#include "avfilter.h"
 #include "libavutil/common.h"
+#include "libavutil/cpu.h"
 #include "libavutil/mem.h"
 #include "libavutil/pixdesc.h"
+#include "avfilter.h"
+#include "avfiltergraph.h"
+#include "internal.h"
+#include "unsharp.h"
 
 #define MIN_SIZE 3
 #define MAX_SIZE 13
@@ -47,30 +51,98 @@
 #define CHROMA_WIDTH(link)  -((-link->w) >> av_pix_fmt_descriptors[link->format].log2_chroma_w)
 #define CHROMA_HEIGHT(link) -((-link->h) >> av_pix_fmt_descriptors[link->format].log2_chroma_h)
 
-typedef struct FilterParam {
-    int msize_x;                             ///< matrix width
-    int msize_y;                             ///< matrix height
-    int amount;                              ///< effect amount
-    int steps_x;                             ///< horizontal step count
-    int steps_y;                             ///< vertical step count
-    int scalebits;                           ///< bits to shift pixel
-    int32_t halfscale;                       ///< amount to add to pixel
-    uint32_t *sc[(MAX_SIZE * MAX_SIZE) - 1]; ///< finite state machine storage
-} FilterParam;
-
-typedef struct {
-    FilterParam luma;   ///< luma parameters (width, height, amount)
-    FilterParam chroma; ///< chroma parameters (width, height, amount)
-} UnsharpContext;
-
-static void unsharpen(uint8_t *dst, const uint8_t *src, int dst_stride, int src_stride, int width, int height, FilterParam *fp)
+/*
+ * The blur is the cascade of 2 * steps_x horizontal and 2 * steps_y
+ * vertical [1 1] filters of the original state machine, run separably:
+ * each line is filtered horizontally in pairs of steps, then goes through
+ * the vertical state machine, a whole line at a time.
+ */
+
+void ff_unsharp_hpass_c(uint32_t *buf, int w)
 {
-    uint32_t **sc = fp->sc;
-    uint32_t sr[(MAX_SIZE * MAX_SIZE) - 1], tmp1, tmp2;
+    int x;
+
+    for (x = 0; x < w; x++)
+        buf[x] = buf[x] + 2 * buf[x + 1] + buf[x + 2];
+}
+
+void ff_unsharp_vpass_c(uint32_t *acc, uint32_t *sc0, uint32_t *sc1, int w)
+{
+    uint32_t tmp1, tmp2;
+    int x;
+
+    for (x = 0; x < w; x++) {
+        tmp1 = acc[x];
+        tmp2 = sc0[x] + tmp1; sc0[x] = tmp1;
+        tmp1 = sc1[x] + tmp2; sc1[x] = tmp2;
+        acc[x] = tmp1;
+    }
+}
 
+void ff_unsharp_apply_c(uint8_t *dst, const uint8_t *src, const uint32_t *sum, int w,
+                        int amount, int scalebits, int32_t halfscale)
+{
     int32_t res;
+    int x;
+
+    for (x = 0; x < w; x++) {
+        res = (int32_t)src[x] + ((((int32_t)src[x] - (int32_t)((sum[x] + halfscale) >> scalebits)) * amount) >> 16);
+        dst[x] = av_clip_uint8(res);
+    }
+}
+
+typedef struct ThreadData {
+    uint8_t *dst;
+    const uint8_t *src;
+    int dst_stride, src_stride;
+    int width, height;
+    FilterParam *fp;
+} ThreadData;
+
+static int unsharp_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    UnsharpContext *unsharp = ctx->priv;
+    ThreadData *td = arg;
+    FilterParam *fp = td->fp;
+    int width  = td->width;
+    int height = td->height;
+    int slice_start = (height *  jobnr   ) / nb_jobs;
+    int slice_end   = (height * (jobnr+1)) / nb_jobs;
+    uint32_t *buf = unsharp->buf + jobnr * unsharp->job_size;
+    uint32_t *sc  = buf + unsharp->line_size;
     int x, y, z;
-    const uint8_t *src2;
+
+    memset(sc, 0, sizeof(*sc) * unsharp->line_size * 2 * fp->steps_y);
+
+    /* the state machine needs 2 * steps_y lines before its first output */
+    for (y = slice_start - fp->steps_y; y < slice_end + fp->steps_y; y++) {
+        const uint8_t *src = td->src + av_clip(y, 0, height - 1) * td->src_stride;
+
+        for (x = 0; x < fp->steps_x; x++) {
+            buf[x] = src[0];
+            buf[fp->steps_x + width + x] = src[width - 1];
+        }
+        for (x = 0; x < width; x++)
+            buf[fp->steps_x + x] = src[x];
+        for (z = fp->steps_x - 1; z >= 0; z--)
+            unsharp->hpass(buf, width + 2 * z);
+        for (z = 0; z < fp->steps_y; z++)
+            unsharp->vpass(buf, sc + 2 * z * unsharp->line_size,
+                           sc + (2 * z + 1) * unsharp->line_size, width);
+
+        if (y >= slice_start + fp->steps_y)
+            unsharp->apply(td->dst + (y - fp->steps_y) * td->dst_stride,
+                           td->src + (y - fp->steps_y) * td->src_stride, buf, width,
+                           fp->amount, fp->scalebits, fp->halfscale);
+    }
+    return 0;
+}
+
+static void unsharpen(AVFilterContext *ctx, uint8_t *dst, const uint8_t *src, int dst_stride, int src_stride, int width, int height, FilterParam *fp)
+{
+    UnsharpContext *unsharp = ctx->priv;
+    ThreadData td = { dst, src, dst_stride, src_stride, width, height, fp };
+    int y;
 
     if (!fp->amount) {
         if (dst_stride == src_stride)
@@ -81,37 +153,7 @@ static void unsharpen(uint8_t *dst, const uint8_t *src, int dst_stride, int src_
         return;
     }
 
-    for (y = 0; y < 2 * fp->steps_y; y++)
-        memset(sc[y], 0, sizeof(sc[y][0]) * (width + 2 * fp->steps_x));
-
-    for (y = -fp->steps_y; y < height + fp->steps_y; y++) {
-        if (y < height)
-            src2 = src;
-
-        memset(sr, 0, sizeof(sr[0]) * (2 * fp->steps_x - 1));
-        for (x = -fp->steps_x; x < width + fp->steps_x; x++) {
-            tmp1 = x <= 0 ? src2[0] : x >= width ? src2[width-1] : src2[x];
-            for (z = 0; z < fp->steps_x * 2; z += 2) {
-                tmp2 = sr[z + 0] + tmp1; sr[z + 0] = tmp1;
-                tmp1 = sr[z + 1] + tmp2; sr[z + 1] = tmp2;
-            }
-            for (z = 0; z < fp->steps_y * 2; z += 2) {
-                tmp2 = sc[z + 0][x + fp->steps_x] + tmp1; sc[z + 0][x + fp->steps_x] = tmp1;
-                tmp1 = sc[z + 1][x + fp->steps_x] + tmp2; sc[z + 1][x + fp->steps_x] = tmp2;
-            }
-            if (x >= fp->steps_x && y >= fp->steps_y) {
-                const uint8_t* srx = src - fp->steps_y * src_stride + x - fp->steps_x;
-                uint8_t* dsx = dst - fp->steps_y * dst_stride + x - fp->steps_x;
-
-                res = (int32_t)*srx + ((((int32_t) * srx - (int32_t)((tmp1 + fp->halfscale) >> fp->scalebits)) * fp->amount) >> 16);
-                *dsx = av_clip_uint8(res);
-            }
-        }
-        if (y >= 0) {
-            dst += dst_stride;
-            src += src_stride;
-        }
-    }
+    ff_filter_execute(ctx, unsharp_slice, &td, FFMIN3(height, ff_filter_nb_threads(ctx), unsharp->buf_jobs));
 }
 
 static void set_filter_param(FilterParam *fp, int msize_x, int msize_y, double amount)
@@ -148,6 +190,15 @@ static av_cold int init(AVFilterContext *ctx, const char *args, void *opaque)
     set_filter_param(&unsharp->luma,   lmsize_x, lmsize_y, lamount);
     set_filter_param(&unsharp->chroma, cmsize_x, cmsize_y, camount);
 
+    unsharp->hpass = ff_unsharp_hpass_c;
+    unsharp->vpass = ff_unsharp_vpass_c;
+    unsharp->apply = ff_unsharp_apply_c;
+    if (HAVE_AVX2 && av_get_cpu_flags() & AV_CPU_FLAG_AVX2) {
+        unsharp->hpass = ff_unsharp_hpass_avx2;
+        unsharp->vpass = ff_unsharp_vpass_avx2;
+        unsharp->apply = ff_unsharp_apply_avx2;
+    }
+
     return 0;
 }
 
@@ -166,16 +217,12 @@ static int query_formats(AVFilterContext *ctx)
 
 static void init_filter_param(AVFilterContext *ctx, FilterParam *fp, const char *effect_type, int width)
 {
-    int z;
     const char *effect;
 
     effect = fp->amount == 0 ? "none" : fp->amount < 0 ? "blur" : "sharpen";
 
     av_log(ctx, AV_LOG_INFO, "effect:%s type:%s msize_x:%d msize_y:%d amount:%0.2f\n",
            effect, effect_type, fp->msize_x, fp->msize_y, fp->amount / 65535.0);
-
-    for (z = 0; z < 2 * fp->steps_y; z++)
-        fp->sc[z] = av_malloc(sizeof(*(fp->sc[z])) * (width + 2 * fp->steps_x));
 }
 
 static int config_props(AVFilterLink *link)
@@ -185,23 +232,29 @@ static int config_props(AVFilterLink *link)
     init_filter_param(link->dst, &unsharp->luma,   "luma",   link->w);
     init_filter_param(link->dst, &unsharp->chroma, "chroma", CHROMA_WIDTH(link));
 
-    return 0;
-}
-
-static void free_filter_param(FilterParam *fp)
-{
-    int z;
+    /* a line of the padded source, then 2 * steps_y lines of column sums;
+     * the SIMD passes may run up to 8 elements past the lines */
+    unsharp->line_size = FFALIGN(link->w + 2 * FFMAX(unsharp->luma.steps_x, unsharp->chroma.steps_x), 8) + 8;
+    unsharp->job_size  = unsharp->line_size *
+                         (1 + 2 * FFMAX(unsharp->luma.steps_y, unsharp->chroma.steps_y));
+    /* the graph threads are started after the links are configured, the
+     * number of jobs is at most their count */
+    unsharp->buf_jobs  = link->dst->graph ? FFMAX(link->dst->graph->thread_count, 1) : 1;
+    av_freep(&unsharp->buf);
+    unsharp->buf = av_malloc(sizeof(*unsharp->buf) * unsharp->job_size * unsharp->buf_jobs);
+    if (!unsharp->buf) {
+        unsharp->buf_jobs = 0;
+        return AVERROR(ENOMEM);
+    }
 
-    for (z = 0; z < 2 * fp->steps_y; z++)
-        av_free(fp->sc[z]);
+    return 0;
 }
 
 static av_cold void uninit(AVFilterContext *ctx)
 {
     UnsharpContext *unsharp = ctx->priv;
 
-    free_filter_param(&unsharp->luma);
-    free_filter_param(&unsharp->chroma);
+    av_freep(&unsharp->buf);
 }
 
 static void end_frame(AVFilterLink *link)
@@ -210,9 +263,9 @@ static void end_frame(AVFilterLink *link)
     AVFilterBufferRef *in  = link->cur_buf;
     AVFilterBufferRef *out = link->dst->outputs[0]->out_buf;
 
-    unsharpen(out->data[0], in->data[0], out->linesize[0], in->linesize[0], link->w,            link->h,             &unsharp->luma);
-    unsharpen(out->data[1], in->data[1], out->linesize[1], in->linesize[1], CHROMA_WIDTH(link), CHROMA_HEIGHT(link), &unsharp->chroma);
-    unsharpen(out->data[2], in->data[2], out->linesize[2], in->linesize[2], CHROMA_WIDTH(link), CHROMA_HEIGHT(link), &unsharp->chroma);
+    unsharpen(link->dst, out->data[0], in->data[0], out->linesize[0], in->linesize[0], link->w,            link->h,             &unsharp->luma);
+    unsharpen(link->dst, out->data[1], in->data[1], out->linesize[1], in->linesize[1], CHROMA_WIDTH(link), CHROMA_HEIGHT(link), &unsharp->chroma);
+    unsharpen(link->dst, out->data[2], in->data[2], out->linesize[2], in->linesize[2], CHROMA_WIDTH(link), CHROMA_HEIGHT(link), &unsharp->chroma);
 
     avfilter_unref_buffer(in);
     avfilter_draw_slice(link->dst->outputs[0], 0, link->h, 1);
@@ -229,6 +282,7 @@ AVFilter avfilter_vf_unsharp = {
     .description = NULL_IF_CONFIG_SMALL("Sharpen or blur the input video."),
 
     .priv_size = sizeof(UnsharpContext),
+    .flags     = AVFILTER_FLAG_SLICE_THREADS,
 
     .init = init,
     .uninit = uninit,
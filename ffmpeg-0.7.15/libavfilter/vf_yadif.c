@@ -21,6 +21,7 @@
 #include "libavutil/common.h"
 #include "libavutil/pixdesc.h"
 #include "avfilter.h"
+#include "internal.h"
 #include "yadif.h"
 
 #undef NDEBUG
@@ -127,17 +128,56 @@ static void filter_line_c_16bit(uint16_t *dst,
     FILTER
 }
 
+typedef struct ThreadData {
+    AVFilterBufferRef *frame;
+    int plane;
+    int w, h;
+    int parity;
+    int tff;
+} ThreadData;
+
+static int filter_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    YADIFContext *yadif = ctx->priv;
+    ThreadData *td = arg;
+    int i = td->plane;
+    int w = td->w;
+    int h = td->h;
+    int refs = yadif->cur->linesize[i];
+    int df = (yadif->csp->comp[i].depth_minus1+1) / 8;
+    int slice_start = (h *  jobnr   ) / nb_jobs;
+    int slice_end   = (h * (jobnr+1)) / nb_jobs;
+    int y;
+
+    for (y = slice_start; y < slice_end; y++) {
+        if ((y ^ td->parity) & 1) {
+            uint8_t *prev = &yadif->prev->data[i][y*refs];
+            uint8_t *cur  = &yadif->cur ->data[i][y*refs];
+            uint8_t *next = &yadif->next->data[i][y*refs];
+            uint8_t *dst  = &td->frame->data[i][y*td->frame->linesize[i]];
+            int     mode  = y==1 || y+2==h ? 2 : yadif->mode;
+            yadif->filter_line(dst, prev, cur, next, w, y+1<h ? refs : -refs, y ? -refs : refs, td->parity ^ td->tff, mode);
+        } else {
+            memcpy(&td->frame->data[i][y*td->frame->linesize[i]],
+                   &yadif->cur->data[i][y*refs], w*df);
+        }
+    }
+#if HAVE_MMX
+    __asm__ volatile("emms \n\t" : : : "memory");
+#endif
+    return 0;
+}
+
 static void filter(AVFilterContext *ctx, AVFilterBufferRef *dstpic,
                    int parity, int tff)
 {
     YADIFContext *yadif = ctx->priv;
-    int y, i;
+    ThreadData td = { .frame = dstpic, .parity = parity, .tff = tff };
+    int i;
 
     for (i = 0; i < yadif->csp->nb_components; i++) {
         int w = dstpic->video->w;
         int h = dstpic->video->h;
-        int refs = yadif->cur->linesize[i];
-        int df = (yadif->csp->comp[i].depth_minus1+1) / 8;
 
         if (i) {
         /* Why is this not part of the per-plane description thing? */
@@ -145,23 +185,11 @@ static void filter(AVFilterContext *ctx, AVFilterBufferRef *dstpic,
             h >>= yadif->csp->log2_chroma_h;
         }
 
-        for (y = 0; y < h; y++) {
-            if ((y ^ parity) & 1) {
-                uint8_t *prev = &yadif->prev->data[i][y*refs];
-                uint8_t *cur  = &yadif->cur ->data[i][y*refs];
-                uint8_t *next = &yadif->next->data[i][y*refs];
-                uint8_t *dst  = &dstpic->data[i][y*dstpic->linesize[i]];
-                int     mode  = y==1 || y+2==h ? 2 : yadif->mode;
-                yadif->filter_line(dst, prev, cur, next, w, y+1<h ? refs : -refs, y ? -refs : refs, parity ^ tff, mode);
-            } else {
-                memcpy(&dstpic->data[i][y*dstpic->linesize[i]],
-                       &yadif->cur->data[i][y*refs], w*df);
-            }
-        }
+        td.plane = i;
+        td.w     = w;
+        td.h     = h;
+        ff_filter_execute(ctx, filter_slice, &td, FFMIN(h, ff_filter_nb_threads(ctx)));
     }
-#if HAVE_MMX
-    __asm__ volatile("emms \n\t" : : : "memory");
-#endif
 }
 
 static AVFilterBufferRef *get_video_buffer(AVFilterLink *link, int perms, int w, int h)
@@ -352,7 +380,9 @@ static av_cold int init(AVFilterContext *ctx, const char *args, void *opaque)
     if (args) sscanf(args, "%d:%d", &yadif->mode, &yadif->parity);
 
     yadif->filter_line = filter_line_c;
-    if (HAVE_SSSE3 && cpu_flags & AV_CPU_FLAG_SSSE3)
+    if (HAVE_AVX2 && cpu_flags & AV_CPU_FLAG_AVX2)
+        yadif->filter_line = ff_yadif_filter_line_avx2;
+    else if (HAVE_SSSE3 && cpu_flags & AV_CPU_FLAG_SSSE3)
         yadif->filter_line = ff_yadif_filter_line_ssse3;
     else if (HAVE_SSE && cpu_flags & AV_CPU_FLAG_SSE2)
         yadif->filter_line = ff_yadif_filter_line_sse2;
@@ -374,6 +404,7 @@ AVFilter avfilter_vf_yadif = {
     .init          = init,
     .uninit        = uninit,
     .query_formats = query_formats,
+    .flags         = AVFILTER_FLAG_SLICE_THREADS,
 
     .inputs    = (AVFilterPad[]) {{ .name             = "default",
                                     .type             = AVMEDIA_TYPE_VIDEO,
@@ -0,0 +1,144 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * SSE2 and AVX2 drawtext layer blending. (255 * 255 - alpha) * dst is
+ * widened to dwords with pmullw/pmulhuw, and X * 129 >> 23 is computed as
+ * X + (X >> 7) >> 16, which is exact and stays within 32 bits.
+ */
+
+#include "libavutil/x86_cpu.h"
+#include "libavfilter/drawtext.h"
+
+void ff_drawtext_blend_line_sse2(uint8_t *dst, const uint16_t *alpha,
+                                 const uint32_t *premul, int w)
+{
+#if HAVE_SSE
+    x86_reg x = -(w & ~7);
+
+    if (w & 7)
+        ff_drawtext_blend_line_c(dst + (w & ~7), alpha + (w & ~7),
+                                 premul + (w & ~7), w & 7);
+    if (!x)
+        return;
+    __asm__ volatile(
+        "pxor       %%xmm7, %%xmm7          \n\t"
+        "movd       %4, %%xmm6              \n\t"
+        "pshuflw    $0, %%xmm6, %%xmm6      \n\t"
+        "punpcklqdq %%xmm6, %%xmm6          \n\t" /* pw_65025 */
+        "1:                                 \n\t"
+        "movq       (%1, %0), %%xmm0        \n\t"
+        "movdqu     (%2, %0, 2), %%xmm5     \n\t"
+        "punpcklbw  %%xmm7, %%xmm0          \n\t"
+        "movdqa     %%xmm6, %%xmm1          \n\t"
+        "psubw      %%xmm5, %%xmm1          \n\t"
+        "pcmpeqw    %%xmm7, %%xmm5          \n\t" /* bytes left as they are */
+        "movdqa     %%xmm1, %%xmm2          \n\t"
+        "pmullw     %%xmm0, %%xmm1          \n\t"
+        "pmulhuw    %%xmm0, %%xmm2          \n\t"
+        "movdqa     %%xmm1, %%xmm3          \n\t"
+        "punpcklwd  %%xmm2, %%xmm1          \n\t"
+        "punpckhwd  %%xmm2, %%xmm3          \n\t"
+        "movdqu       (%3, %0, 4), %%xmm2   \n\t"
+        "movdqu     16(%3, %0, 4), %%xmm4   \n\t"
+        "paddd      %%xmm2, %%xmm1          \n\t"
+        "paddd      %%xmm4, %%xmm3          \n\t"
+        "movdqa     %%xmm1, %%xmm2          \n\t"
+        "movdqa     %%xmm3, %%xmm4          \n\t"
+        "psrld      $7, %%xmm2              \n\t"
+        "psrld      $7, %%xmm4              \n\t"
+        "paddd      %%xmm2, %%xmm1          \n\t"
+        "paddd      %%xmm4, %%xmm3          \n\t"
+        "psrld      $16, %%xmm1             \n\t"
+        "psrld      $16, %%xmm3             \n\t"
+        "packssdw   %%xmm3, %%xmm1          \n\t"
+        "pand       %%xmm5, %%xmm0          \n\t"
+        "pandn      %%xmm1, %%xmm5          \n\t"
+        "por        %%xmm5, %%xmm0          \n\t"
+        "packuswb   %%xmm0, %%xmm0          \n\t"
+        "movq       %%xmm0, (%1, %0)        \n\t"
+        "add        $8, %0                  \n\t"
+        " js        1b                      \n\t"
+        : "+r"(x)
+        : "r"(dst + (w & ~7)), "r"(alpha + (w & ~7)), "r"(premul + (w & ~7)),
+          "r"(255 * 255)
+        : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3", "%xmm4", "%xmm5",
+                       "%xmm6", "%xmm7",) "memory"
+    );
+#else
+    ff_drawtext_blend_line_c(dst, alpha, premul, w);
+#endif
+}
+
+void ff_drawtext_blend_line_avx2(uint8_t *dst, const uint16_t *alpha,
+                                 const uint32_t *premul, int w)
+{
+#if HAVE_AVX2
+    x86_reg x = -(w & ~15);
+
+    if (w & 15)
+        ff_drawtext_blend_line_sse2(dst + (w & ~15), alpha + (w & ~15),
+                                    premul + (w & ~15), w & 15);
+    if (!x)
+        return;
+    /* the word unpacks work within lanes, so premul is loaded in the same
+     * order, and packssdw puts the words back in order */
+    __asm__ volatile(
+        "vpxor          %%ymm7, %%ymm7, %%ymm7  \n\t"
+        "vmovd          %4, %%xmm6              \n\t"
+        "vpbroadcastw   %%xmm6, %%ymm6          \n\t" /* pw_65025 */
+        "1:                                     \n\t"
+        "vpmovzxbw      (%1, %0), %%ymm0        \n\t"
+        "vmovdqu        (%2, %0, 2), %%ymm5     \n\t"
+        "vpsubw         %%ymm5, %%ymm6, %%ymm1  \n\t"
+        "vpcmpeqw       %%ymm7, %%ymm5, %%ymm5  \n\t"
+        "vpmulhuw       %%ymm0, %%ymm1, %%ymm2  \n\t"
+        "vpmullw        %%ymm0, %%ymm1, %%ymm1  \n\t"
+        "vpunpckhwd     %%ymm2, %%ymm1, %%ymm3  \n\t"
+        "vpunpcklwd     %%ymm2, %%ymm1, %%ymm1  \n\t"
+        "vmovdqu          (%3, %0, 4), %%xmm2   \n\t"
+        "vmovdqu        16(%3, %0, 4), %%xmm4   \n\t"
+        "vinserti128    $1, 32(%3, %0, 4), %%ymm2, %%ymm2 \n\t"
+        "vinserti128    $1, 48(%3, %0, 4), %%ymm4, %%ymm4 \n\t"
+        "vpaddd         %%ymm2, %%ymm1, %%ymm1  \n\t"
+        "vpaddd         %%ymm4, %%ymm3, %%ymm3  \n\t"
+        "vpsrld         $7, %%ymm1, %%ymm2      \n\t"
+        "vpsrld         $7, %%ymm3, %%ymm4      \n\t"
+        "vpaddd         %%ymm2, %%ymm1, %%ymm1  \n\t"
+        "vpaddd         %%ymm4, %%ymm3, %%ymm3  \n\t"
+        "vpsrld         $16, %%ymm1, %%ymm1     \n\t"
+        "vpsrld         $16, %%ymm3, %%ymm3     \n\t"
+        "vpackssdw      %%ymm3, %%ymm1, %%ymm1  \n\t"
+        "vpblendvb      %%ymm5, %%ymm0, %%ymm1, %%ymm1 \n\t"
+        "vpackuswb      %%ymm1, %%ymm1, %%ymm1  \n\t"
+        "vpermq         $8, %%ymm1, %%ymm1      \n\t"
+        "vmovdqu        %%xmm1, (%1, %0)        \n\t"
+        "add            $16, %0                 \n\t"
+        " js            1b                      \n\t"
+        "vzeroupper                             \n\t"
+        : "+r"(x)
+        : "r"(dst + (w & ~15)), "r"(alpha + (w & ~15)), "r"(premul + (w & ~15)),
+          "r"(255 * 255)
+        : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3", "%xmm4", "%xmm5",
+                       "%xmm6", "%xmm7",) "memory"
+    );
+#else
+    ff_drawtext_blend_line_sse2(dst, alpha, premul, w);
+#endif
+}
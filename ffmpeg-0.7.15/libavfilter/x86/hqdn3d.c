@@ -0,0 +1,196 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with FFmpeg; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/**
+ * @file
+ * AVX2 vertical and temporal hqdn3d filters, 8 pixels at a time.
+ * The coefficient tables are built with pow() and have no exact closed
+ * form, and at 8192 entries are too large for byte shuffles, so they are
+ * read with scalar loads rather than vpgatherdd, which is microcoded on
+ * some AVX2 CPUs. The index computation and the rounding are the ones of
+ * the C code, the output is identical.
+ */
+
+#include "libavutil/common.h"
+#include "libavutil/mem.h"
+#include "libavutil/x86_cpu.h"
+#include "libavfilter/hqdn3d.h"
+
+#if HAVE_AVX2 && HAVE_7REGS
+DECLARE_ASM_CONST(32, const uint32_t, pd_idx_round)[8] = {
+    0x10007FF, 0x10007FF, 0x10007FF, 0x10007FF, 0x10007FF, 0x10007FF, 0x10007FF, 0x10007FF };
+DECLARE_ASM_CONST(32, const uint32_t, pd_ant_round)[8] = {
+    0x1000007F, 0x1000007F, 0x1000007F, 0x1000007F, 0x1000007F, 0x1000007F, 0x1000007F, 0x1000007F };
+DECLARE_ASM_CONST(32, const uint32_t, pd_dst_round)[8] = {
+    0x10007FFF, 0x10007FFF, 0x10007FFF, 0x10007FFF, 0x10007FFF, 0x10007FFF, 0x10007FFF, 0x10007FFF };
+/* low word, resp. low byte, of each dword to the start of its lane */
+DECLARE_ASM_CONST(32, const uint8_t, pb_dword_to_word)[32] = {
+    0, 1, 4, 5, 8, 9, 12, 13, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0, 1, 4, 5, 8, 9, 12, 13, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 };
+DECLARE_ASM_CONST(32, const uint8_t, pb_dword_to_byte)[32] = {
+    0, 4, 8, 12, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0, 4, 8, 12, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 };
+
+/* dst = the coef entries at the 4 dword indexes stored at idx, t = operand
+ * number of a scratch register */
+#define LOOKUP4(coef, t, idx, dst) \
+    "mov        "idx", %k"t"                    \n\t" \
+    "vmovd      ("coef", %"t", 4), "dst"        \n\t" \
+    "mov        4+"idx", %k"t"                  \n\t" \
+    "vpinsrd    $1, ("coef", %"t", 4), "dst", "dst" \n\t" \
+    "mov        8+"idx", %k"t"                  \n\t" \
+    "vpinsrd    $2, ("coef", %"t", 4), "dst", "dst" \n\t" \
+    "mov        12+"idx", %k"t"                 \n\t" \
+    "vpinsrd    $3, ("coef", %"t", 4), "dst", "dst" \n\t"
+
+/* %%ymm0 = CurrMul + Coef[(PrevMul - CurrMul + 0x10007FF) >> 12], ymm7 = rounding;
+ * the indexes are read back from idx, extracting them takes more shuffles */
+#define LOWPASS(prev, coef, t, idx) \
+    "vpsubd     %%ymm0, "prev", %%ymm1          \n\t" \
+    "vpaddd     %%ymm7, %%ymm1, %%ymm1          \n\t" \
+    "vpsrld     $12, %%ymm1, %%ymm1             \n\t" \
+    "vmovdqu    %%ymm1, "idx"                   \n\t" \
+    LOOKUP4(coef, t, idx, "%%xmm3")                   \
+    LOOKUP4(coef, t, "16+"idx, "%%xmm2")              \
+    "vinserti128 $1, %%xmm2, %%ymm3, %%ymm3     \n\t" \
+    "vpaddd     %%ymm3, %%ymm0, %%ymm0          \n\t"
+
+/* FrameAnt[X] = (PixelDst + 0x1000007F) >> 8 for %%ymm0 */
+#define STORE_ANT(ant) \
+    "vpaddd     "MANGLE(pd_ant_round)", %%ymm0, %%ymm4 \n\t" \
+    "vpsrld     $8, %%ymm4, %%ymm4              \n\t" \
+    "vpshufb    "MANGLE(pb_dword_to_word)", %%ymm4, %%ymm4 \n\t" \
+    "vpermq     $8, %%ymm4, %%ymm4              \n\t" \
+    "vmovdqu    %%xmm4, "ant"                   \n\t"
+
+/* FrameDest[X] = (PixelDst + 0x10007FFF) >> 16 for %%ymm0 */
+#define STORE_DST(dst) \
+    "vpaddd     "MANGLE(pd_dst_round)", %%ymm0, %%ymm0 \n\t" \
+    "vpsrld     $16, %%ymm0, %%ymm0             \n\t" \
+    "vpshufb    "MANGLE(pb_dword_to_byte)", %%ymm0, %%ymm0 \n\t" \
+    "vextracti128 $1, %%ymm0, %%xmm4            \n\t" \
+    "vpunpckldq %%xmm4, %%xmm0, %%xmm0          \n\t" \
+    "vmovq      %%xmm0, "dst"                   \n\t"
+#endif
+
+void ff_hqdn3d_line_avx2(uint8_t *FrameDest, unsigned int *LineCur, const unsigned int *LinePrev,
+                         unsigned short *FrameAnt, int W, int *Vertical, int *Temporal)
+{
+#if HAVE_AVX2 && HAVE_7REGS
+    x86_reg X = -(W & ~7);
+    x86_reg coef, t;
+    uint32_t idx[8];
+
+    if (W & 7) {
+        int x = W & ~7;
+        ff_hqdn3d_line_c(FrameDest + x, LineCur + x, LinePrev + x,
+                         FrameAnt ? FrameAnt + x : NULL, W - x, Vertical, Temporal);
+    }
+    if (!X)
+        return;
+    FrameDest += W & ~7;
+    LineCur   += W & ~7;
+    LinePrev  += W & ~7;
+
+    if (FrameAnt) {
+        FrameAnt += W & ~7;
+        __asm__ volatile(
+            "vmovdqa    "MANGLE(pd_idx_round)", %%ymm7  \n\t"
+            "1:                                         \n\t"
+            "vmovdqu    (%4, %0, 4), %%ymm0             \n\t"
+            "vmovdqu    (%5, %0, 4), %%ymm5             \n\t"
+            "mov        %8, %1                          \n\t"
+            LOWPASS("%%ymm5", "%1", "2", "%3")
+            "vmovdqu    %%ymm0, (%4, %0, 4)             \n\t"
+            "vpmovzxwd  (%6, %0, 2), %%ymm5             \n\t"
+            "vpslld     $8, %%ymm5, %%ymm5              \n\t"
+            "mov        %9, %1                          \n\t"
+            LOWPASS("%%ymm5", "%1", "2", "%3")
+            STORE_ANT("(%6, %0, 2)")
+            STORE_DST("(%7, %0)")
+            "add        $8, %0                          \n\t"
+            " js        1b                              \n\t"
+            "vzeroupper                                 \n\t"
+            : "+r"(X), "=&r"(coef), "=&r"(t), "=m"(idx)
+            : "r"(LineCur), "r"(LinePrev), "r"(FrameAnt), "r"(FrameDest),
+              "m"(Vertical), "m"(Temporal)
+            : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3",
+                           "%xmm4", "%xmm5", "%xmm7",) "memory"
+        );
+    } else {
+        __asm__ volatile(
+            "vmovdqa    "MANGLE(pd_idx_round)", %%ymm7  \n\t"
+            "1:                                         \n\t"
+            "vmovdqu    (%3, %0, 4), %%ymm0             \n\t"
+            "vmovdqu    (%4, %0, 4), %%ymm5             \n\t"
+            LOWPASS("%%ymm5", "%6", "1", "%2")
+            "vmovdqu    %%ymm0, (%3, %0, 4)             \n\t"
+            STORE_DST("(%5, %0)")
+            "add        $8, %0                          \n\t"
+            " js        1b                              \n\t"
+            "vzeroupper                                 \n\t"
+            : "+r"(X), "=&r"(t), "=m"(idx)
+            : "r"(LineCur), "r"(LinePrev), "r"(FrameDest), "r"(Vertical)
+            : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3",
+                           "%xmm4", "%xmm5", "%xmm7",) "memory"
+        );
+    }
+#else
+    ff_hqdn3d_line_c(FrameDest, LineCur, LinePrev, FrameAnt, W, Vertical, Temporal);
+#endif
+}
+
+void ff_hqdn3d_temporal_line_avx2(uint8_t *FrameDest, const uint8_t *FrameSrc,
+                                  unsigned short *FrameAnt, int W, int *Temporal)
+{
+#if HAVE_AVX2 && HAVE_7REGS
+    x86_reg X = -(W & ~7);
+    x86_reg t;
+    uint32_t idx[8];
+
+    if (W & 7) {
+        int x = W & ~7;
+        ff_hqdn3d_temporal_line_c(FrameDest + x, FrameSrc + x, FrameAnt + x,
+                                  W - x, Temporal);
+    }
+    if (!X)
+        return;
+
+    __asm__ volatile(
+        "vmovdqa    "MANGLE(pd_idx_round)", %%ymm7  \n\t"
+        "1:                                         \n\t"
+        "vpmovzxbd  (%3, %0), %%ymm0                \n\t"
+        "vpslld     $16, %%ymm0, %%ymm0             \n\t"
+        "vpmovzxwd  (%4, %0, 2), %%ymm5             \n\t"
+        "vpslld     $8, %%ymm5, %%ymm5              \n\t"
+        LOWPASS("%%ymm5", "%6", "1", "%2")
+        STORE_ANT("(%4, %0, 2)")
+        STORE_DST("(%5, %0)")
+        "add        $8, %0                          \n\t"
+        " js        1b                              \n\t"
+        "vzeroupper                                 \n\t"
+        : "+r"(X), "=&r"(t), "=m"(idx)
+        : "r"(FrameSrc + (W & ~7)), "r"(FrameAnt + (W & ~7)),
+          "r"(FrameDest + (W & ~7)), "r"(Temporal)
+        : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3",
+                       "%xmm4", "%xmm5", "%xmm7",) "memory"
+    );
+#else
+    ff_hqdn3d_temporal_line_c(FrameDest, FrameSrc, FrameAnt, W, Temporal);
+#endif
+}
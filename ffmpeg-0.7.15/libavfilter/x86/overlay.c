@@ -0,0 +1,128 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * SSE2 and AVX2 overlay blending on words. dst * inv_alpha + premul fits
+ * in 16 bits; adding 128 then t + (t >> 8) >> 8 gives the rounded
+ * division by 255 of the C code.
+ */
+
+#include "libavutil/x86_cpu.h"
+#include "libavfilter/overlay.h"
+
+void ff_overlay_blend_line_sse2(uint8_t *dst, const uint8_t *inv_alpha,
+                                const uint16_t *premul, int w)
+{
+#if HAVE_SSE
+    x86_reg x = -(w & ~15);
+
+    if (w & 15)
+        ff_overlay_blend_line_c(dst + (w & ~15), inv_alpha + (w & ~15),
+                                premul + (w & ~15), w & 15);
+    if (!x)
+        return;
+    __asm__ volatile(
+        "pxor       %%xmm7, %%xmm7          \n\t"
+        "pcmpeqw    %%xmm6, %%xmm6          \n\t"
+        "psrlw      $15, %%xmm6             \n\t"
+        "psllw      $7, %%xmm6              \n\t" /* pw_128 */
+        "1:                                 \n\t"
+        "movdqu     (%1, %0), %%xmm0        \n\t"
+        "movdqu     (%2, %0), %%xmm2        \n\t"
+        "movdqa     %%xmm0, %%xmm1          \n\t"
+        "movdqa     %%xmm2, %%xmm3          \n\t"
+        "punpcklbw  %%xmm7, %%xmm0          \n\t"
+        "punpckhbw  %%xmm7, %%xmm1          \n\t"
+        "punpcklbw  %%xmm7, %%xmm2          \n\t"
+        "punpckhbw  %%xmm7, %%xmm3          \n\t"
+        "pmullw     %%xmm2, %%xmm0          \n\t"
+        "pmullw     %%xmm3, %%xmm1          \n\t"
+        "movdqu       (%3, %0, 2), %%xmm2   \n\t"
+        "movdqu     16(%3, %0, 2), %%xmm3   \n\t"
+        "paddw      %%xmm6, %%xmm0          \n\t"
+        "paddw      %%xmm6, %%xmm1          \n\t"
+        "paddw      %%xmm2, %%xmm0          \n\t"
+        "paddw      %%xmm3, %%xmm1          \n\t"
+        "movdqa     %%xmm0, %%xmm2          \n\t"
+        "movdqa     %%xmm1, %%xmm3          \n\t"
+        "psrlw      $8, %%xmm2              \n\t"
+        "psrlw      $8, %%xmm3              \n\t"
+        "paddw      %%xmm2, %%xmm0          \n\t"
+        "paddw      %%xmm3, %%xmm1          \n\t"
+        "psrlw      $8, %%xmm0              \n\t"
+        "psrlw      $8, %%xmm1              \n\t"
+        "packuswb   %%xmm1, %%xmm0          \n\t"
+        "movdqu     %%xmm0, (%1, %0)        \n\t"
+        "add        $16, %0                 \n\t"
+        " js        1b                      \n\t"
+        : "+r"(x)
+        : "r"(dst + (w & ~15)), "r"(inv_alpha + (w & ~15)), "r"(premul + (w & ~15))
+        : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3", "%xmm6", "%xmm7",) "memory"
+    );
+#else
+    ff_overlay_blend_line_c(dst, inv_alpha, premul, w);
+#endif
+}
+
+void ff_overlay_blend_line_avx2(uint8_t *dst, const uint8_t *inv_alpha,
+                                const uint16_t *premul, int w)
+{
+#if HAVE_AVX2
+    x86_reg x = -(w & ~31);
+
+    if (w & 31)
+        ff_overlay_blend_line_sse2(dst + (w & ~31), inv_alpha + (w & ~31),
+                                   premul + (w & ~31), w & 31);
+    if (!x)
+        return;
+    __asm__ volatile(
+        "vpcmpeqw   %%ymm6, %%ymm6, %%ymm6  \n\t"
+        "vpsrlw     $15, %%ymm6, %%ymm6     \n\t"
+        "vpsllw     $7, %%ymm6, %%ymm6      \n\t" /* pw_128 */
+        "1:                                 \n\t"
+        "vpmovzxbw    (%1, %0), %%ymm0      \n\t"
+        "vpmovzxbw  16(%1, %0), %%ymm1      \n\t"
+        "vpmovzxbw    (%2, %0), %%ymm2      \n\t"
+        "vpmovzxbw  16(%2, %0), %%ymm3      \n\t"
+        "vpmullw    %%ymm2, %%ymm0, %%ymm0  \n\t"
+        "vpmullw    %%ymm3, %%ymm1, %%ymm1  \n\t"
+        "vpaddw       (%3, %0, 2), %%ymm0, %%ymm0 \n\t"
+        "vpaddw     32(%3, %0, 2), %%ymm1, %%ymm1 \n\t"
+        "vpaddw     %%ymm6, %%ymm0, %%ymm0  \n\t"
+        "vpaddw     %%ymm6, %%ymm1, %%ymm1  \n\t"
+        "vpsrlw     $8, %%ymm0, %%ymm2      \n\t"
+        "vpsrlw     $8, %%ymm1, %%ymm3      \n\t"
+        "vpaddw     %%ymm2, %%ymm0, %%ymm0  \n\t"
+        "vpaddw     %%ymm3, %%ymm1, %%ymm1  \n\t"
+        "vpsrlw     $8, %%ymm0, %%ymm0      \n\t"
+        "vpsrlw     $8, %%ymm1, %%ymm1      \n\t"
+        "vpackuswb  %%ymm1, %%ymm0, %%ymm0  \n\t"
+        "vpermq     $0xD8, %%ymm0, %%ymm0   \n\t"
+        "vmovdqu    %%ymm0, (%1, %0)        \n\t"
+        "add        $32, %0                 \n\t"
+        " js        1b                      \n\t"
+        "vzeroupper                         \n\t"
+        : "+r"(x)
+        : "r"(dst + (w & ~31)), "r"(inv_alpha + (w & ~31)), "r"(premul + (w & ~31))
+        : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3", "%xmm6",) "memory"
+    );
+#else
+    ff_overlay_blend_line_sse2(dst, inv_alpha, premul, w);
+#endif
+}
@@ -0,0 +1,130 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * AVX2 line passes of the unsharp filter, 8 pixels at a time on dwords.
+ */
+
+#include "libavutil/common.h"
+#include "libavutil/x86_cpu.h"
+#include "libavfilter/unsharp.h"
+
+void ff_unsharp_hpass_avx2(uint32_t *buf, int w)
+{
+#if HAVE_AVX2
+    x86_reg x = -FFALIGN(w, 8);
+
+    if (!x)
+        return;
+    /* each block is loaded before being overwritten, the next one only
+     * reads past it */
+    __asm__ volatile(
+        "1:                                     \n\t"
+        "vmovdqu     (%1, %0, 4), %%ymm0        \n\t"
+        "vmovdqu    4(%1, %0, 4), %%ymm1        \n\t"
+        "vmovdqu    8(%1, %0, 4), %%ymm2        \n\t"
+        "vpaddd     %%ymm1, %%ymm1, %%ymm1      \n\t"
+        "vpaddd     %%ymm2, %%ymm0, %%ymm0      \n\t"
+        "vpaddd     %%ymm1, %%ymm0, %%ymm0      \n\t"
+        "vmovdqu    %%ymm0, (%1, %0, 4)         \n\t"
+        "add        $8, %0                      \n\t"
+        " js        1b                          \n\t"
+        "vzeroupper                             \n\t"
+        : "+r"(x)
+        : "r"(buf + FFALIGN(w, 8))
+        : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2",) "memory"
+    );
+#else
+    ff_unsharp_hpass_c(buf, w);
+#endif
+}
+
+void ff_unsharp_vpass_avx2(uint32_t *acc, uint32_t *sc0, uint32_t *sc1, int w)
+{
+#if HAVE_AVX2
+    x86_reg x = -FFALIGN(w, 8);
+
+    if (!x)
+        return;
+    __asm__ volatile(
+        "1:                                     \n\t"
+        "vmovdqu    (%1, %0, 4), %%ymm0         \n\t"
+        "vmovdqu    (%2, %0, 4), %%ymm1         \n\t"
+        "vmovdqu    (%3, %0, 4), %%ymm2         \n\t"
+        "vmovdqu    %%ymm0, (%2, %0, 4)         \n\t"
+        "vpaddd     %%ymm0, %%ymm1, %%ymm1      \n\t"
+        "vmovdqu    %%ymm1, (%3, %0, 4)         \n\t"
+        "vpaddd     %%ymm1, %%ymm2, %%ymm2      \n\t"
+        "vmovdqu    %%ymm2, (%1, %0, 4)         \n\t"
+        "add        $8, %0                      \n\t"
+        " js        1b                          \n\t"
+        "vzeroupper                             \n\t"
+        : "+r"(x)
+        : "r"(acc + FFALIGN(w, 8)), "r"(sc0 + FFALIGN(w, 8)), "r"(sc1 + FFALIGN(w, 8))
+        : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2",) "memory"
+    );
+#else
+    ff_unsharp_vpass_c(acc, sc0, sc1, w);
+#endif
+}
+
+void ff_unsharp_apply_avx2(uint8_t *dst, const uint8_t *src, const uint32_t *sum, int w,
+                           int amount, int scalebits, int32_t halfscale)
+{
+#if HAVE_AVX2
+    x86_reg x = -(w & ~7);
+
+    if (w & 7)
+        ff_unsharp_apply_c(dst + (w & ~7), src + (w & ~7), sum + (w & ~7), w & 7,
+                           amount, scalebits, halfscale);
+    if (!x)
+        return;
+    /* packssdw then packuswb clip the 32 bit results to 8 bits */
+    __asm__ volatile(
+        "vmovd          %4, %%xmm5              \n\t"
+        "vpbroadcastd   %%xmm5, %%ymm5          \n\t"
+        "vmovd          %5, %%xmm6              \n\t"
+        "vmovd          %6, %%xmm7              \n\t"
+        "vpbroadcastd   %%xmm7, %%ymm7          \n\t"
+        "1:                                     \n\t"
+        "vpmovzxbd      (%1, %0), %%ymm0        \n\t"
+        "vmovdqu        (%3, %0, 4), %%ymm1     \n\t"
+        "vpaddd         %%ymm7, %%ymm1, %%ymm1  \n\t"
+        "vpsrld         %%xmm6, %%ymm1, %%ymm1  \n\t"
+        "vpsubd         %%ymm1, %%ymm0, %%ymm1  \n\t"
+        "vpmulld        %%ymm5, %%ymm1, %%ymm1  \n\t"
+        "vpsrad         $16, %%ymm1, %%ymm1     \n\t"
+        "vpaddd         %%ymm0, %%ymm1, %%ymm1  \n\t"
+        "vpackssdw      %%ymm1, %%ymm1, %%ymm1  \n\t"
+        "vpackuswb      %%ymm1, %%ymm1, %%ymm1  \n\t"
+        "vextracti128   $1, %%ymm1, %%xmm2      \n\t"
+        "vpunpckldq     %%xmm2, %%xmm1, %%xmm1  \n\t"
+        "vmovq          %%xmm1, (%2, %0)        \n\t"
+        "add            $8, %0                  \n\t"
+        " js            1b                      \n\t"
+        "vzeroupper                             \n\t"
+        : "+r"(x)
+        : "r"(src + (w & ~7)), "r"(dst + (w & ~7)), "r"(sum + (w & ~7)),
+          "r"(amount), "r"(scalebits), "r"(halfscale)
+        : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm5", "%xmm6", "%xmm7",) "memory"
+    );
+#else
+    ff_unsharp_apply_c(dst, src, sum, w, amount, scalebits, halfscale);
+#endif
+}
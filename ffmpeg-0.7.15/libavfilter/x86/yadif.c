@@ -47,3 +47,186 @@ DECLARE_ASM_CONST(16, const xmm_reg, pw_1) = {0x0001000100010001ULL, 0x000100010
 #define RENAME(a) a ## _mmx
 #include "yadif_template.c"
 #endif
+
+#if HAVE_AVX2
+/* 16 bytes at mem zero extended to the 16 words of dst */
+#define LOAD_AVX2(mem, dst) \
+            "vpmovzxbw "mem", "dst" \n\t"
+
+/* ABS(cur[x-refs+j+k] - cur[x+refs-j+k]) for k = -1, 0, 1 summed in %%ymm2,
+ * (cur[x-refs+j] + cur[x+refs-j])>>1 in %%ymm5 */
+#define CHECK_AVX2(m0, p0, m1, p1, m2, p2) \
+            LOAD_AVX2(#m0"(%[cur],%[mrefs])", "%%ymm2")\
+            LOAD_AVX2(#p0"(%[cur],%[prefs])", "%%ymm3")\
+            "vpsubw    %%ymm3, %%ymm2, %%ymm2 \n\t"\
+            "vpabsw    %%ymm2, %%ymm2 \n\t"\
+            LOAD_AVX2(#m1"(%[cur],%[mrefs])", "%%ymm3")\
+            LOAD_AVX2(#p1"(%[cur],%[prefs])", "%%ymm4")\
+            "vpaddw    %%ymm4, %%ymm3, %%ymm5 \n\t"\
+            "vpsrlw    $1, %%ymm5, %%ymm5 \n\t"\
+            "vpsubw    %%ymm4, %%ymm3, %%ymm3 \n\t"\
+            "vpabsw    %%ymm3, %%ymm3 \n\t"\
+            "vpaddw    %%ymm3, %%ymm2, %%ymm2 \n\t"\
+            LOAD_AVX2(#m2"(%[cur],%[mrefs])", "%%ymm3")\
+            LOAD_AVX2(#p2"(%[cur],%[prefs])", "%%ymm4")\
+            "vpsubw    %%ymm4, %%ymm3, %%ymm3 \n\t"\
+            "vpabsw    %%ymm3, %%ymm3 \n\t"\
+            "vpaddw    %%ymm3, %%ymm2, %%ymm2 \n\t" /* score */
+
+#define CHECK1_AVX2 \
+            "vpcmpgtw  %%ymm2, %%ymm0, %%ymm3 \n\t" /* if(score < spatial_score) */\
+            "vpminsw   %%ymm2, %%ymm0, %%ymm0 \n\t" /* spatial_score= score; */\
+            "vmovdqa   %%ymm3, %%ymm6 \n\t"\
+            "vpblendvb %%ymm3, %%ymm5, %%ymm1, %%ymm1 \n\t" /* spatial_pred= ... */
+
+/* as in the other versions, a bad dir=1 is made to fail dir=2 */
+#define CHECK2_AVX2 \
+            "vpsubw    %%ymm7, %%ymm6, %%ymm6 \n\t"\
+            "vpsllw    $14, %%ymm6, %%ymm6 \n\t"\
+            "vpaddsw   %%ymm6, %%ymm2, %%ymm2 \n\t"\
+            "vpcmpgtw  %%ymm2, %%ymm0, %%ymm3 \n\t"\
+            "vpminsw   %%ymm2, %%ymm0, %%ymm0 \n\t"\
+            "vpblendvb %%ymm3, %%ymm5, %%ymm1, %%ymm1 \n\t"
+
+/**
+ * Filter 16 pixels; c, d, e and diff are kept at 0, 32, 64 and 96 bytes
+ * of tmpA. The output pointer is only loaded at the end, into the copy of
+ * next, so that the asm needs no more registers than the SSE2 version.
+ */
+#define FILTER_AVX2(prev2, next2) \
+        __asm__ volatile(\
+            "vpcmpeqw  %%ymm7, %%ymm7, %%ymm7 \n\t" /* -1 */\
+            LOAD_AVX2("(%[cur],%[mrefs])", "%%ymm0") /* c = cur[x-refs] */\
+            LOAD_AVX2("(%[cur],%[prefs])", "%%ymm1") /* e = cur[x+refs] */\
+            LOAD_AVX2("(%["prev2"])", "%%ymm2") /* prev2[x] */\
+            LOAD_AVX2("(%["next2"])", "%%ymm3") /* next2[x] */\
+            "vpaddw    %%ymm3, %%ymm2, %%ymm4 \n\t"\
+            "vpsrlw    $1, %%ymm4, %%ymm4 \n\t" /* d = (prev2[x] + next2[x])>>1 */\
+            "vmovdqa   %%ymm0,   (%[tmpA]) \n\t" /* c */\
+            "vmovdqa   %%ymm4, 32(%[tmpA]) \n\t" /* d */\
+            "vmovdqa   %%ymm1, 64(%[tmpA]) \n\t" /* e */\
+            "vpsubw    %%ymm3, %%ymm2, %%ymm2 \n\t"\
+            "vpabsw    %%ymm2, %%ymm2 \n\t" /* temporal_diff0 */\
+            LOAD_AVX2("(%[prev],%[mrefs])", "%%ymm3") /* prev[x-refs] */\
+            LOAD_AVX2("(%[prev],%[prefs])", "%%ymm4") /* prev[x+refs] */\
+            "vpsubw    %%ymm0, %%ymm3, %%ymm3 \n\t"\
+            "vpsubw    %%ymm1, %%ymm4, %%ymm4 \n\t"\
+            "vpabsw    %%ymm3, %%ymm3 \n\t"\
+            "vpabsw    %%ymm4, %%ymm4 \n\t"\
+            "vpaddw    %%ymm4, %%ymm3, %%ymm3 \n\t" /* temporal_diff1 */\
+            "vpsrlw    $1, %%ymm2, %%ymm2 \n\t"\
+            "vpsrlw    $1, %%ymm3, %%ymm3 \n\t"\
+            "vpmaxsw   %%ymm3, %%ymm2, %%ymm2 \n\t"\
+            LOAD_AVX2("(%[next],%[mrefs])", "%%ymm3") /* next[x-refs] */\
+            LOAD_AVX2("(%[next],%[prefs])", "%%ymm4") /* next[x+refs] */\
+            "vpsubw    %%ymm0, %%ymm3, %%ymm3 \n\t"\
+            "vpsubw    %%ymm1, %%ymm4, %%ymm4 \n\t"\
+            "vpabsw    %%ymm3, %%ymm3 \n\t"\
+            "vpabsw    %%ymm4, %%ymm4 \n\t"\
+            "vpaddw    %%ymm4, %%ymm3, %%ymm3 \n\t" /* temporal_diff2 */\
+            "vpsrlw    $1, %%ymm3, %%ymm3 \n\t"\
+            "vpmaxsw   %%ymm3, %%ymm2, %%ymm2 \n\t"\
+            "vmovdqa   %%ymm2, 96(%[tmpA]) \n\t" /* diff */\
+\
+            "vpsubw    %%ymm1, %%ymm0, %%ymm2 \n\t"\
+            "vpaddw    %%ymm1, %%ymm0, %%ymm1 \n\t"\
+            "vpsrlw    $1, %%ymm1, %%ymm1 \n\t" /* spatial_pred */\
+            "vpabsw    %%ymm2, %%ymm0 \n\t" /* ABS(c-e) */\
+            LOAD_AVX2("-1(%[cur],%[mrefs])", "%%ymm2") /* cur[x-refs-1] */\
+            LOAD_AVX2("-1(%[cur],%[prefs])", "%%ymm3") /* cur[x+refs-1] */\
+            "vpsubw    %%ymm3, %%ymm2, %%ymm2 \n\t"\
+            "vpabsw    %%ymm2, %%ymm2 \n\t"\
+            "vpaddw    %%ymm2, %%ymm0, %%ymm0 \n\t"\
+            LOAD_AVX2("1(%[cur],%[mrefs])", "%%ymm2") /* cur[x-refs+1] */\
+            LOAD_AVX2("1(%[cur],%[prefs])", "%%ymm3") /* cur[x+refs+1] */\
+            "vpsubw    %%ymm3, %%ymm2, %%ymm2 \n\t"\
+            "vpabsw    %%ymm2, %%ymm2 \n\t"\
+            "vpaddw    %%ymm2, %%ymm0, %%ymm0 \n\t"\
+            "vpaddw    %%ymm7, %%ymm0, %%ymm0 \n\t" /* spatial_score */\
+\
+            CHECK_AVX2(-2, 0, -1, 1, 0, 2)\
+            CHECK1_AVX2\
+            CHECK_AVX2(-3, 1, -2, 2, -1, 3)\
+            CHECK2_AVX2\
+            CHECK_AVX2(0, -2, 1, -1, 2, 0)\
+            CHECK1_AVX2\
+            CHECK_AVX2(1, -3, 2, -2, 3, -1)\
+            CHECK2_AVX2\
+\
+            /* if(p->mode<2) ... */\
+            "vmovdqa   96(%[tmpA]), %%ymm6 \n\t" /* diff */\
+            "cmpl      $2, %[mode] \n\t"\
+            "jge       1f \n\t"\
+            LOAD_AVX2("(%["prev2"],%[mrefs],2)", "%%ymm2") /* prev2[x-2*refs] */\
+            LOAD_AVX2("(%["next2"],%[mrefs],2)", "%%ymm4") /* next2[x-2*refs] */\
+            LOAD_AVX2("(%["prev2"],%[prefs],2)", "%%ymm3") /* prev2[x+2*refs] */\
+            LOAD_AVX2("(%["next2"],%[prefs],2)", "%%ymm5") /* next2[x+2*refs] */\
+            "vpaddw    %%ymm4, %%ymm2, %%ymm2 \n\t"\
+            "vpaddw    %%ymm5, %%ymm3, %%ymm3 \n\t"\
+            "vpsrlw    $1, %%ymm2, %%ymm2 \n\t" /* b */\
+            "vpsrlw    $1, %%ymm3, %%ymm3 \n\t" /* f */\
+            "vmovdqa     (%[tmpA]), %%ymm4 \n\t" /* c */\
+            "vmovdqa   32(%[tmpA]), %%ymm5 \n\t" /* d */\
+            "vmovdqa   64(%[tmpA]), %%ymm7 \n\t" /* e */\
+            "vpsubw    %%ymm4, %%ymm2, %%ymm2 \n\t" /* b-c */\
+            "vpsubw    %%ymm7, %%ymm3, %%ymm3 \n\t" /* f-e */\
+            "vpsubw    %%ymm4, %%ymm5, %%ymm4 \n\t" /* d-c */\
+            "vpsubw    %%ymm7, %%ymm5, %%ymm5 \n\t" /* d-e */\
+            "vpminsw   %%ymm3, %%ymm2, %%ymm7 \n\t"\
+            "vpmaxsw   %%ymm3, %%ymm2, %%ymm2 \n\t"\
+            "vpmaxsw   %%ymm4, %%ymm7, %%ymm7 \n\t"\
+            "vpmaxsw   %%ymm5, %%ymm7, %%ymm7 \n\t" /* max */\
+            "vpminsw   %%ymm4, %%ymm2, %%ymm2 \n\t"\
+            "vpminsw   %%ymm5, %%ymm2, %%ymm2 \n\t" /* min */\
+            "vpmaxsw   %%ymm2, %%ymm6, %%ymm6 \n\t"\
+            "vpxor     %%ymm3, %%ymm3, %%ymm3 \n\t"\
+            "vpsubw    %%ymm7, %%ymm3, %%ymm3 \n\t" /* -max */\
+            "vpmaxsw   %%ymm3, %%ymm6, %%ymm6 \n\t" /* diff= MAX3(diff, min, -max); */\
+            "1: \n\t"\
+\
+            "vmovdqa   32(%[tmpA]), %%ymm2 \n\t" /* d */\
+            "vpsubw    %%ymm6, %%ymm2, %%ymm3 \n\t" /* d-diff */\
+            "vpaddw    %%ymm6, %%ymm2, %%ymm2 \n\t" /* d+diff */\
+            "vpmaxsw   %%ymm3, %%ymm1, %%ymm1 \n\t"\
+            "vpminsw   %%ymm2, %%ymm1, %%ymm1 \n\t" /* d = clip(spatial_pred, d-diff, d+diff); */\
+            "vpackuswb %%ymm1, %%ymm1, %%ymm1 \n\t"\
+            "vpermq    $8, %%ymm1, %%ymm1 \n\t"\
+            "mov       %[dst], %[next] \n\t"\
+            "vmovdqu   %%xmm1, (%[next]) \n\t"\
+            "vzeroupper \n\t"\
+            : [next] "+r"(nxt)\
+            : [tmpA] "r"(tmpA),\
+              [prev] "r"(prev),\
+              [cur]  "r"(cur),\
+              [prefs]"r"((x86_reg)prefs),\
+              [mrefs]"r"((x86_reg)mrefs),\
+              [dst]  "m"(dst),\
+              [mode] "g"(mode)\
+            : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3",\
+                           "%xmm4", "%xmm5", "%xmm6", "%xmm7",) "memory"\
+        );
+
+void ff_yadif_filter_line_avx2(uint8_t *dst,
+                               uint8_t *prev, uint8_t *cur, uint8_t *next,
+                               int w, int prefs, int mrefs, int parity, int mode)
+{
+    DECLARE_ALIGNED(32, uint8_t, tmpA)[4*32];
+    int x;
+
+    for (x = 0; x + 16 <= w; x += 16) {
+        uint8_t *nxt = next;
+
+        if (parity) {
+            FILTER_AVX2("prev", "cur")
+        } else {
+            FILTER_AVX2("cur", "next")
+        }
+        dst += 16;
+        prev+= 16;
+        cur += 16;
+        next+= 16;
+    }
+    if (x < w)
+        ff_yadif_filter_line_ssse3(dst, prev, cur, next, w - x, prefs, mrefs, parity, mode);
+}
+#endif /* HAVE_AVX2 */
@@ -33,4 +33,8 @@ void ff_yadif_filter_line_ssse3(uint8_t *dst,
                                 uint8_t *prev, uint8_t *cur, uint8_t *next,
                                 int w, int prefs, int mrefs, int parity, int mode);
 
+void ff_yadif_filter_line_avx2(uint8_t *dst,
+                               uint8_t *prev, uint8_t *cur, uint8_t *next,
+                               int w, int prefs, int mrefs, int parity, int mode);
+
 #endif /* AVFILTER_YADIF_H */
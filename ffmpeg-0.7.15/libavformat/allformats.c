@@ -236,6 +236,7 @@ void av_register_all(void)
 
     /* protocols */
     REGISTER_PROTOCOL (APPLEHTTP, applehttp);
+    REGISTER_PROTOCOL (ASYNC, async);
     REGISTER_PROTOCOL (CONCAT, concat);
     REGISTER_PROTOCOL (CRYPTO, crypto);
     REGISTER_PROTOCOL (FILE, file);
@@ -244,6 +245,7 @@ void av_register_all(void)
     REGISTER_PROTOCOL (MMSH, mmsh);
     REGISTER_PROTOCOL (MMST, mmst);
     REGISTER_PROTOCOL (MD5,  md5);
+    REGISTER_PROTOCOL (MMAP, mmap);
     REGISTER_PROTOCOL (PIPE, pipe);
     REGISTER_PROTOCOL (RTMP, rtmp);
 #if CONFIG_LIBRTMP
@@ -0,0 +1,255 @@
+/*
+ * Asynchronous read-ahead protocol
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <pthread.h>
+
+#include "libavutil/avstring.h"
+#include "libavutil/fifo.h"
+#include "libavutil/opt.h"
+#include "avformat.h"
+#include "url.h"
+
+/* largest read issued to the nested protocol at once */
+#define READ_BLOCK_SIZE (256 * 1024)
+
+typedef struct {
+    const AVClass *class;
+    URLContext *hd;
+    int buffer_size;
+    int64_t size;           ///< size of the nested resource, < 0 if unknown
+    int64_t pos;            ///< position of the next byte returned by async_read()
+    AVFifoBuffer *fifo;     ///< data read ahead from pos on
+    int eof;
+    int error;              ///< error returned by the nested protocol
+    int seek_request;
+    int64_t seek_pos;
+    int64_t seek_ret;
+    int abort_request;
+    unsigned reads;         ///< calls to async_read()
+    unsigned hits;          ///< reads that did not have to wait for the thread
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;    ///< signaled whenever data, space or a seek result is available
+} AsyncContext;
+
+#define OFFSET(x) offsetof(AsyncContext, x)
+static const AVOption options[] = {
+    {"buffer_size", "size of the read-ahead buffer", OFFSET(buffer_size), FF_OPT_TYPE_INT, {.dbl = 8 * 1024 * 1024}, 64 * 1024, INT_MAX, AV_OPT_FLAG_DECODING_PARAM },
+    { NULL }
+};
+
+static const AVClass async_class = {
+    .class_name     = "async",
+    .item_name      = av_default_item_name,
+    .option         = options,
+    .version        = LIBAVUTIL_VERSION_INT,
+};
+
+static void *async_buffer_task(void *arg)
+{
+    URLContext *h = arg;
+    AsyncContext *c = h->priv_data;
+
+    pthread_mutex_lock(&c->mutex);
+    for (;;) {
+        uint8_t *wptr;
+        int len, ret;
+
+        if (c->abort_request)
+            break;
+
+        if (c->seek_request) {
+            /* on failure the nested position did not change, keep the data */
+            c->seek_ret = ffurl_seek(c->hd, c->seek_pos, SEEK_SET);
+            if (c->seek_ret >= 0) {
+                av_fifo_reset(c->fifo);
+                c->eof   = 0;
+                c->error = 0;
+            }
+            c->seek_request = 0;
+            pthread_cond_broadcast(&c->cond);
+            continue;
+        }
+
+        /* read into the free space following the data, no copy needed */
+        len = FFMIN(av_fifo_space(c->fifo), c->fifo->end - c->fifo->wptr);
+        len = FFMIN(len, READ_BLOCK_SIZE);
+        if (c->eof || c->error || !len) {
+            pthread_cond_wait(&c->cond, &c->mutex);
+            continue;
+        }
+        wptr = c->fifo->wptr;
+
+        pthread_mutex_unlock(&c->mutex);
+        ret = ffurl_read(c->hd, wptr, len);
+        pthread_mutex_lock(&c->mutex);
+
+        if (ret > 0) {
+            c->fifo->wptr += ret;
+            if (c->fifo->wptr >= c->fifo->end)
+                c->fifo->wptr = c->fifo->buffer;
+            c->fifo->wndx += ret;
+        } else if (!ret || ret == AVERROR_EOF) {
+            c->eof = 1;
+        } else {
+            c->error = ret;
+        }
+        pthread_cond_broadcast(&c->cond);
+    }
+    pthread_mutex_unlock(&c->mutex);
+
+    return NULL;
+}
+
+static int async_open(URLContext *h, const char *uri, int flags)
+{
+    AsyncContext *c = h->priv_data;
+    const char *nested_url;
+    int ret;
+
+    if (!av_strstart(uri, "async+", &nested_url) &&
+        !av_strstart(uri, "async:", &nested_url)) {
+        av_log(h, AV_LOG_ERROR, "Unsupported url %s\n", uri);
+        return AVERROR(EINVAL);
+    }
+    if (flags != AVIO_RDONLY) {
+        av_log(h, AV_LOG_ERROR, "Only reading is supported\n");
+        return AVERROR(ENOSYS);
+    }
+    if ((ret = ffurl_open(&c->hd, nested_url, flags)) < 0)
+        return ret;
+
+    c->size = ffurl_size(c->hd);
+    h->is_streamed = c->hd->is_streamed;
+
+    c->fifo = av_fifo_alloc(c->buffer_size);
+    if (!c->fifo) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+    pthread_mutex_init(&c->mutex, NULL);
+    pthread_cond_init(&c->cond, NULL);
+    if (pthread_create(&c->thread, NULL, async_buffer_task, h)) {
+        av_log(h, AV_LOG_ERROR, "pthread_create failed\n");
+        pthread_cond_destroy(&c->cond);
+        pthread_mutex_destroy(&c->mutex);
+        ret = AVERROR(EIO);
+        goto fail;
+    }
+    return 0;
+
+fail:
+    av_fifo_free(c->fifo);
+    ffurl_close(c->hd);
+    return ret;
+}
+
+static int async_read(URLContext *h, unsigned char *buf, int size)
+{
+    AsyncContext *c = h->priv_data;
+    int ret;
+
+    pthread_mutex_lock(&c->mutex);
+    c->reads++;
+    if (av_fifo_size(c->fifo) || c->eof || c->error)
+        c->hits++;
+    while (!av_fifo_size(c->fifo) && !c->eof && !c->error)
+        pthread_cond_wait(&c->cond, &c->mutex);
+
+    ret = FFMIN(size, av_fifo_size(c->fifo));
+    if (ret > 0) {
+        av_fifo_generic_read(c->fifo, buf, ret, NULL);
+        c->pos += ret;
+        pthread_cond_broadcast(&c->cond);
+    } else {
+        ret = c->error ? c->error : AVERROR_EOF;
+    }
+    pthread_mutex_unlock(&c->mutex);
+
+    return ret;
+}
+
+static int64_t async_seek(URLContext *h, int64_t pos, int whence)
+{
+    AsyncContext *c = h->priv_data;
+    int64_t ret;
+
+    if (whence == AVSEEK_SIZE)
+        return c->size;
+    if (whence == SEEK_CUR)
+        pos += c->pos;
+    else if (whence == SEEK_END && c->size >= 0)
+        pos += c->size;
+    else if (whence != SEEK_SET)
+        return AVERROR(EINVAL);
+    if (pos < 0)
+        return AVERROR(EINVAL);
+
+    pthread_mutex_lock(&c->mutex);
+    if (pos >= c->pos && pos - c->pos <= av_fifo_size(c->fifo)) {
+        /* forward inside the read-ahead data */
+        av_fifo_drain(c->fifo, pos - c->pos);
+        c->pos = ret = pos;
+        pthread_cond_broadcast(&c->cond);
+    } else {
+        c->seek_request = 1;
+        c->seek_pos     = pos;
+        pthread_cond_broadcast(&c->cond);
+        while (c->seek_request)
+            pthread_cond_wait(&c->cond, &c->mutex);
+        ret = c->seek_ret;
+        if (ret >= 0)
+            c->pos = ret;
+    }
+    pthread_mutex_unlock(&c->mutex);
+
+    return ret;
+}
+
+static int async_close(URLContext *h)
+{
+    AsyncContext *c = h->priv_data;
+
+    pthread_mutex_lock(&c->mutex);
+    c->abort_request = 1;
+    pthread_cond_broadcast(&c->cond);
+    pthread_mutex_unlock(&c->mutex);
+    pthread_join(c->thread, NULL);
+
+    av_log(h, AV_LOG_VERBOSE, "%u reads, %u served without waiting (%.1f%%)\n",
+           c->reads, c->hits, c->reads ? 100.0 * c->hits / c->reads : 0.0);
+
+    pthread_cond_destroy(&c->cond);
+    pthread_mutex_destroy(&c->mutex);
+    av_fifo_free(c->fifo);
+    ffurl_close(c->hd);
+    return 0;
+}
+
+URLProtocol ff_async_protocol = {
+    .name            = "async",
+    .url_open        = async_open,
+    .url_read        = async_read,
+    .url_seek        = async_seek,
+    .url_close       = async_close,
+    .priv_data_size  = sizeof(AsyncContext),
+    .priv_data_class = &async_class,
+    .flags           = URL_PROTOCOL_FLAG_NESTED_SCHEME,
+};
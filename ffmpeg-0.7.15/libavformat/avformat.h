@@ -664,6 +664,11 @@ typedef struct AVStream {
         int duration_count;
         double duration_error[MAX_STD_TIMEBASES];
         int64_t codec_info_duration;
+        int64_t ready_time;     ///< microseconds until no more packets were needed
+        int64_t decode_time;    ///< microseconds spent decoding packets
+        int decode_pending;     ///< a packet is queued for the probe threads
+        AVPacket *pending_pkt;
+        int pending_nb_frames;
     } *info;
 
     /**
@@ -671,6 +676,13 @@ typedef struct AVStream {
      * NOT PART OF PUBLIC API
      */
     int request_probe;
+
+    /**
+     * first packet in packet_buffer for this stream when muxing, the
+     * packets up to last_in_packet_buffer form its interleaving queue.
+     * NOT PART OF PUBLIC API
+     */
+    struct AVPacketList *first_in_packet_buffer;
 } AVStream;
 
 #define AV_PROGRAM_RUNNING 1
@@ -826,6 +838,7 @@ typedef struct AVFormatContext {
 #define AVFMT_FLAG_SORT_DTS    0x10000 ///< try to interleave outputted packets by dts (using this flag can slow demuxing down)
 #define AVFMT_FLAG_PRIV_OPT    0x20000 ///< Enable use of private options by delaying codec open (this could be made default once all code is converted)
 #define AVFMT_FLAG_KEEP_SIDE_DATA 0x40000 ///< Dont merge side data but keep it seperate.
+#define AVFMT_FLAG_PROBE_CACHE 0x80000 ///< Reuse the format, stream parameters and index found when the same local file was opened before, see av_probe_cache_stats()
 
     int loop_input;
 
@@ -930,6 +943,54 @@ typedef struct AVFormatContext {
      * This will be moved into demuxer private options. Thus no API/ABI compatibility
      */
     int ts_id;
+
+    /**
+     * decoding: number of threads decoding packets of different streams in
+     * parallel in avformat_find_stream_info(), 0 for one per stream.
+     * Demuxers must not change the codec parameters of other streams than
+     * the one of the packet they return for this to be safe.
+     * - encoding: Unused.
+     * - decoding: Set by user.
+     */
+    int probe_threads;
+
+    /**
+     * decoding: maximum time in milliseconds spent reading packets in
+     * avformat_find_stream_info(), 0 for no limit. probesize limits the
+     * number of bytes read.
+     * - encoding: Unused.
+     * - decoding: Set by user.
+     */
+    int probe_time;
+
+    /**
+     * Indexes of the streams with packets waiting to be interleaved, a
+     * min-heap ordered by the first packet of each stream.
+     * NOT PART OF PUBLIC API
+     */
+    int *interleave_heap;
+    unsigned int interleave_heap_size;
+    int nb_interleave_heap;
+    int (*interleave_compare)(struct AVFormatContext *, AVPacket *, AVPacket *);
+
+    /**
+     * Unused interleaving queue entries, reused to avoid an allocation
+     * per packet.
+     * NOT PART OF PUBLIC API
+     */
+    struct AVPacketList *packet_pool;
+
+    /**
+     * Threads decoding packets for avformat_find_stream_info() while it runs.
+     * NOT PART OF PUBLIC API
+     */
+    struct ProbeThreads *probe_thread_pool;
+
+    /**
+     * Probe cache entry of the file, see AVFMT_FLAG_PROBE_CACHE.
+     * NOT PART OF PUBLIC API
+     */
+    struct ProbeCacheEntry *probe_cache;
 } AVFormatContext;
 
 typedef struct AVPacketList {
@@ -1280,6 +1341,19 @@ int av_find_stream_info(AVFormatContext *ic);
  */
 int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options);
 
+/**
+ * Get the statistics of the cache used with AVFMT_FLAG_PROBE_CACHE.
+ *
+ * @param hits   number of opens whose probing results came from the cache
+ * @param misses number of opens which probed the file
+ */
+void av_probe_cache_stats(unsigned *hits, unsigned *misses);
+
+/**
+ * Drop the entries of the cache used with AVFMT_FLAG_PROBE_CACHE.
+ */
+void av_probe_cache_flush(void);
+
 /**
  * Find the "best" stream in the file.
  * The best stream is determined according to various heuristics as the most
@@ -87,6 +87,14 @@ typedef struct {
      * A combination of AVIO_SEEKABLE_ flags or 0 when the stream is not seekable.
      */
     int seekable;
+
+    /**
+     * Map the next bytes of a memory-mapped resource instead of reading them
+     * into buffer. When set, buffer points into the mapping, which is
+     * read-only and must not be written to.
+     * This field is internal to libavformat and access from outside is not allowed.
+     */
+    int (*read_map)(void *opaque, uint8_t **data, int size);
 } AVIOContext;
 
 /* unbuffered I/O */
@@ -135,6 +143,7 @@ typedef struct URLProtocol {
     const AVClass *priv_data_class;
     int flags;
     int (*url_check)(URLContext *h, int mask);
+    int (*url_read_map)(URLContext *h, uint8_t **data, int size);
 } URLProtocol;
 
 typedef struct URLPollEntry {
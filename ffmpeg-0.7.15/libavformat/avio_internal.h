@@ -41,6 +41,18 @@ int ffio_init_context(AVIOContext *s,
  */
 int ffio_read_partial(AVIOContext *s, unsigned char *buf, int size);
 
+/**
+ * Read size bytes from AVIOContext, returning a pointer to them.
+ * The data is returned in place from the internal buffer when it is
+ * available there, otherwise it is copied into buf.
+ * @param buf buffer to copy the data into if it is not contiguous
+ *            in the internal buffer
+ * @param data set to the start of the data read, only valid until the
+ *             next operation on s
+ * @return number of bytes read or AVERROR
+ */
+int ffio_read_indirect(AVIOContext *s, unsigned char *buf, int size, const unsigned char **data);
+
 void ffio_fill(AVIOContext *s, int b, int count);
 
 static av_always_inline void ffio_wfourcc(AVIOContext *pb, const uint8_t *s)
@@ -37,6 +37,12 @@
  */
 #define SHORT_SEEK_THRESHOLD 4096
 
+/**
+ * Size of the window moved over the data of protocols providing
+ * url_read_map, which is read in place instead of into a buffer.
+ */
+#define MAP_WINDOW_SIZE (256 * 1024)
+
 static void fill_buffer(AVIOContext *s);
 #if !FF_API_URL_RESETBUF
 static int url_resetbuf(AVIOContext *s, int flags);
@@ -75,6 +81,7 @@ int ffio_init_context(AVIOContext *s,
     }
     s->read_pause = NULL;
     s->read_seek  = NULL;
+    s->read_map   = NULL;
     return 0;
 }
 
@@ -558,6 +565,22 @@ static void fill_buffer(AVIOContext *s)
         s->checksum_ptr= s->buffer;
     }
 
+    /* the protocol data is mapped, just move the window over it */
+    if (s->read_map) {
+        uint8_t *data;
+        len = s->read_map(s->opaque, &data, s->buffer_size);
+        if (len <= 0) {
+            s->eof_reached = 1;
+            if (len < 0)
+                s->error = len;
+        } else {
+            s->pos += len;
+            s->checksum_ptr = s->buf_ptr = s->buffer = data;
+            s->buf_end = s->buffer + len;
+        }
+        return;
+    }
+
     /* make buffer smaller in case it ended up large after probing */
     if (s->read_packet && s->buffer_size > max_buffer_size) {
         ffio_set_buf_size(s, max_buffer_size);
@@ -698,6 +721,20 @@ int ffio_read_partial(AVIOContext *s, unsigned char *buf, int size)
     return len;
 }
 
+int ffio_read_indirect(AVIOContext *s, unsigned char *buf, int size, const unsigned char **data)
+{
+    if (!s->write_flag && s->buf_ptr == s->buf_end)
+        fill_buffer(s);
+    if (!s->write_flag && s->buf_end - s->buf_ptr >= size) {
+        *data = s->buf_ptr;
+        s->buf_ptr += size;
+        return size;
+    } else {
+        *data = buf;
+        return avio_read(s, buf, size);
+    }
+}
+
 unsigned int avio_rl16(AVIOContext *s)
 {
     unsigned int val;
@@ -839,17 +876,19 @@ uint64_t ffio_read_varlen(AVIOContext *bc){
 
 int ffio_fdopen(AVIOContext **s, URLContext *h)
 {
-    uint8_t *buffer;
+    uint8_t *buffer = NULL;
     int buffer_size, max_packet_size;
+    int map = h->prot && h->prot->url_read_map && !(h->flags & (AVIO_WRONLY | AVIO_RDWR));
 
     max_packet_size = h->max_packet_size;
-    if (max_packet_size) {
+    if (map) {
+        buffer_size = MAP_WINDOW_SIZE; /* the data is read in place, no buffer */
+    } else if (max_packet_size) {
         buffer_size = max_packet_size; /* no need to bufferize more than one packet */
     } else {
         buffer_size = IO_BUFFER_SIZE;
     }
-    buffer = av_malloc(buffer_size);
-    if (!buffer)
+    if (!map && !(buffer = av_malloc(buffer_size)))
         return AVERROR(ENOMEM);
 
     *s = av_mallocz(sizeof(AVIOContext));
@@ -873,6 +912,8 @@ int ffio_fdopen(AVIOContext **s, URLContext *h)
     if(h->prot) {
         (*s)->read_pause = (int (*)(void *, int))h->prot->url_read_pause;
         (*s)->read_seek  = (int64_t (*)(void *, int, int64_t, int))h->prot->url_read_seek;
+        if (map)
+            (*s)->read_map = (int (*)(void *, uint8_t **, int))h->prot->url_read_map;
     }
     return 0;
 }
@@ -880,6 +921,8 @@ int ffio_fdopen(AVIOContext **s, URLContext *h)
 int ffio_set_buf_size(AVIOContext *s, int buf_size)
 {
     uint8_t *buffer;
+    if (s->read_map)
+        return 0;
     buffer = av_malloc(buf_size);
     if (!buffer)
         return AVERROR(ENOMEM);
@@ -924,6 +967,18 @@ int ffio_rewind_with_probe_data(AVIOContext *s, unsigned char *buf, int buf_size
     if (s->write_flag)
         return AVERROR(EINVAL);
 
+    /* the probe data is still mapped, go back to it instead */
+    if (s->read_map) {
+        int64_t ret = s->seek(s->opaque, 0, SEEK_SET);
+        if (ret < 0)
+            return ret;
+        av_free(buf);
+        s->buf_ptr = s->buf_end = s->buffer;
+        s->pos = 0;
+        s->eof_reached = 0;
+        return 0;
+    }
+
     buffer_size = s->buf_end - s->buffer;
 
     /* the buffers must touch or overlap */
@@ -974,7 +1029,8 @@ int avio_close(AVIOContext *s)
 {
     URLContext *h = s->opaque;
 
-    av_free(s->buffer);
+    if (!s->read_map)
+        av_free(s->buffer);
     av_free(s);
     return ffurl_close(h);
 }
@@ -27,6 +27,9 @@
 #endif
 #include <unistd.h>
 #include <sys/stat.h>
+#if HAVE_MMAP
+#include <sys/mman.h>
+#endif
 #include <stdlib.h>
 #include "os_support.h"
 #include "url.h"
@@ -156,3 +159,164 @@ URLProtocol ff_pipe_protocol = {
 };
 
 #endif /* CONFIG_PIPE_PROTOCOL */
+
+#if CONFIG_MMAP_PROTOCOL
+
+/* memory mapped file protocol, demuxers read the mapped pages in place */
+
+/* amount of data asked to be paged in ahead of the reader */
+#define MMAP_READAHEAD (4 * 1024 * 1024)
+/* far seeks after which the kernel readahead is disabled */
+#define MMAP_RANDOM_SEEKS 4
+
+typedef struct {
+    int fd;
+    uint8_t *data;
+    int64_t size;
+    int64_t pos;
+    int64_t advised;    ///< end of the range already announced with POSIX_MADV_WILLNEED
+    int64_t seq_bytes;  ///< bytes read since the last far seek
+    int seeks;          ///< far seeks since the last sequential run
+    int random;         ///< POSIX_MADV_RANDOM is in effect
+    int page_size;
+} MMapContext;
+
+static void mmap_advise(MMapContext *c, int64_t start, int64_t len, int advice)
+{
+    int64_t end = FFMIN(start + len, c->size);
+    start &= ~(int64_t)(c->page_size - 1);
+    if (end > start)
+        posix_madvise(c->data + start, end - start, advice);
+}
+
+/* follow the access pattern, prefetching ahead of sequential reads */
+static void mmap_update_hints(MMapContext *c, int len)
+{
+    c->seq_bytes += len;
+    if (c->seq_bytes >= MMAP_READAHEAD) {
+        if (c->random)
+            mmap_advise(c, 0, c->size, POSIX_MADV_SEQUENTIAL);
+        c->random = 0;
+        c->seeks  = 0;
+    }
+    if (!c->random && c->pos + MMAP_READAHEAD / 2 > c->advised && c->advised < c->size) {
+        int64_t start = FFMAX(c->pos, c->advised);
+        mmap_advise(c, start, MMAP_READAHEAD, POSIX_MADV_WILLNEED);
+        c->advised = start + MMAP_READAHEAD;
+    }
+}
+
+static int mmap_open(URLContext *h, const char *filename, int flags)
+{
+    MMapContext *c = h->priv_data;
+    struct stat st;
+    int access = O_RDONLY;
+
+    av_strstart(filename, "mmap:", &filename);
+
+    if (flags & (AVIO_WRONLY | AVIO_RDWR)) {
+        av_log(h, AV_LOG_ERROR, "Only reading is supported\n");
+        return AVERROR(ENOSYS);
+    }
+#ifdef O_BINARY
+    access |= O_BINARY;
+#endif
+    c->fd = open(filename, access);
+    if (c->fd == -1)
+        return AVERROR(errno);
+    if (fstat(c->fd, &st) < 0 || !S_ISREG(st.st_mode) ||
+        st.st_size != (size_t)st.st_size) {
+        av_log(h, AV_LOG_ERROR, "%s cannot be mapped\n", filename);
+        close(c->fd);
+        return AVERROR(EINVAL);
+    }
+    c->size = st.st_size;
+    c->page_size = sysconf(_SC_PAGESIZE);
+    if (c->size) {
+        c->data = mmap(NULL, c->size, PROT_READ, MAP_SHARED, c->fd, 0);
+        if (c->data == MAP_FAILED) {
+            int err = AVERROR(errno);
+            close(c->fd);
+            return err;
+        }
+        mmap_advise(c, 0, c->size, POSIX_MADV_SEQUENTIAL);
+    }
+    return 0;
+}
+
+static int mmap_read_map(URLContext *h, uint8_t **data, int size)
+{
+    MMapContext *c = h->priv_data;
+    int len = FFMIN(size, c->size - c->pos);
+
+    if (len <= 0)
+        return 0;
+    *data = c->data + c->pos;
+    c->pos += len;
+    mmap_update_hints(c, len);
+    return len;
+}
+
+static int mmap_read(URLContext *h, unsigned char *buf, int size)
+{
+    uint8_t *data;
+    int len = mmap_read_map(h, &data, size);
+
+    if (len > 0)
+        memcpy(buf, data, len);
+    return len;
+}
+
+static int64_t mmap_seek(URLContext *h, int64_t pos, int whence)
+{
+    MMapContext *c = h->priv_data;
+
+    switch (whence) {
+    case AVSEEK_SIZE: return c->size;
+    case SEEK_SET:                  break;
+    case SEEK_CUR:    pos += c->pos;  break;
+    case SEEK_END:    pos += c->size; break;
+    default:          return AVERROR(EINVAL);
+    }
+    if (pos < 0)
+        return AVERROR(EINVAL);
+
+    /* short jumps, e.g. between interleaved tracks, are still sequential */
+    if (FFABS(pos - c->pos) > MMAP_READAHEAD) {
+        c->seq_bytes = 0;
+        c->advised   = pos;
+        if (!c->random && ++c->seeks >= MMAP_RANDOM_SEEKS) {
+            mmap_advise(c, 0, c->size, POSIX_MADV_RANDOM);
+            c->random = 1;
+        }
+    }
+    return c->pos = pos;
+}
+
+static int mmap_get_handle(URLContext *h)
+{
+    MMapContext *c = h->priv_data;
+    return c->fd;
+}
+
+static int mmap_close(URLContext *h)
+{
+    MMapContext *c = h->priv_data;
+
+    if (c->size)
+        munmap(c->data, c->size);
+    return close(c->fd);
+}
+
+URLProtocol ff_mmap_protocol = {
+    .name                = "mmap",
+    .url_open            = mmap_open,
+    .url_read            = mmap_read,
+    .url_seek            = mmap_seek,
+    .url_close           = mmap_close,
+    .url_get_file_handle = mmap_get_handle,
+    .priv_data_size      = sizeof(MMapContext),
+    .url_read_map        = mmap_read_map,
+};
+
+#endif /* CONFIG_MMAP_PROTOCOL */
@@ -69,11 +69,19 @@ int ff_hex_to_data(uint8_t *data, const char *p);
 void ff_program_add_stream_index(AVFormatContext *ac, int progid, unsigned int idx);
 
 /**
- * Add packet to AVFormatContext->packet_buffer list, determining its
- * interleaved position using compare() function argument.
+ * Add packet to the interleaving queue of its stream. Packets are taken
+ * out across streams in the order given by the compare() function
+ * argument, which must be the same for all packets of a muxer.
+ * @return 0 on success, a negative AVERROR on failure
  */
-void ff_interleave_add_packet(AVFormatContext *s, AVPacket *pkt,
-                              int (*compare)(AVFormatContext *, AVPacket *, AVPacket *));
+int ff_interleave_add_packet(AVFormatContext *s, AVPacket *pkt,
+                             int (*compare)(AVFormatContext *, AVPacket *, AVPacket *));
+
+/**
+ * Take the first packet out of the interleaving queues.
+ * @return 1 if a packet was returned in out, 0 if the queues are empty
+ */
+int ff_interleave_get_packet(AVFormatContext *s, AVPacket *out);
 
 void ff_read_frame_flush(AVFormatContext *s);
 
@@ -87,6 +87,25 @@ typedef struct {
     unsigned flags;
 } MOVTrackExt;
 
+/**
+ * position in the compact sample tables of a track, the state needed to
+ * resolve a sample and to step to the next one
+ */
+typedef struct MOVSampleCursor {
+    unsigned sample;        ///< sample number
+    unsigned chunk;         ///< chunk containing the sample
+    unsigned chunk_sample;  ///< sample number inside the chunk
+    unsigned stsc_index;
+    unsigned stts_index;
+    unsigned stts_sample;
+    unsigned stss_index;
+    unsigned stps_index;
+    int64_t pos;
+    int64_t dts;
+    unsigned size;
+    int keyframe;
+} MOVSampleCursor;
+
 typedef struct MOVStreamContext {
     AVIOContext *pb;
     int ffindex;          ///< AVStream index
@@ -123,9 +142,19 @@ typedef struct MOVStreamContext {
     int width;            ///< tkhd width
     int height;           ///< tkhd height
     int dts_shift;        ///< dts shift when ctts is negative
+    int sched_sample;     ///< next sample of this track not yet in the read order
+    int64_t sched_dts;    ///< dts of sched_sample in AV_TIME_BASE units
+    int lazy_index;       ///< samples are resolved from the sample tables on demand
+    unsigned lazy_count;  ///< number of samples reachable through the sample tables
+    MOVSampleCursor lazy_start;     ///< first sample
+    MOVSampleCursor cursor;         ///< current_sample
+    MOVSampleCursor sched_cursor;   ///< sched_sample
+    MOVSampleCursor *seek_cursors;  ///< samples of the sparse keyframe index
+    AVIndexEntry lazy_entry;        ///< current_sample as index entry
 } MOVStreamContext;
 
 typedef struct MOVContext {
+    const AVClass *class;
     AVFormatContext *fc;
     int time_scale;
     int64_t duration;     ///< duration of the longest track
@@ -139,6 +168,10 @@ typedef struct MOVContext {
     unsigned trex_count;
     int itunes_metadata;  ///< metadata are itunes style
     int chapter_track;
+    int *read_order;      ///< stream indexes of the next samples to read
+    int read_order_count; ///< number of valid entries in read_order
+    int read_order_index; ///< next entry of read_order to use
+    int lazy_index;       ///< keep the sample tables instead of building full indexes
 } MOVContext;
 
 int ff_mp4_read_descr_len(AVIOContext *pb);
@@ -37,6 +37,7 @@
 #include "isom.h"
 #include "rm.h"
 #include "matroska.h"
+#include "probecache.h"
 #include "libavcodec/mpeg4audio.h"
 #include "libavutil/intfloat_readwrite.h"
 #include "libavutil/intreadwrite.h"
@@ -255,19 +256,11 @@ typedef struct {
     /* What to skip before effectively reading a packet. */
     int skip_to_keyframe;
     uint64_t skip_to_timecode;
-} MatroskaDemuxContext;
-
-typedef struct {
-    uint64_t duration;
-    int64_t  reference;
-    uint64_t non_simple;
-    EbmlBin  bin;
-} MatroskaBlock;
 
-typedef struct {
-    uint64_t timecode;
-    EbmlList blocks;
-} MatroskaCluster;
+    /* data of the block being parsed, reused for all blocks */
+    uint8_t *block_buf;
+    unsigned int block_buf_size;
+} MatroskaDemuxContext;
 
 static EbmlSyntax ebml_header[] = {
     { EBML_ID_EBMLREADVERSION,        EBML_UINT, 0, offsetof(Ebml,version), {.u=EBML_VERSION} },
@@ -512,26 +505,8 @@ static EbmlSyntax matroska_segments[] = {
     { 0 }
 };
 
-static EbmlSyntax matroska_blockgroup[] = {
-    { MATROSKA_ID_BLOCK,          EBML_BIN,  0, offsetof(MatroskaBlock,bin) },
-    { MATROSKA_ID_SIMPLEBLOCK,    EBML_BIN,  0, offsetof(MatroskaBlock,bin) },
-    { MATROSKA_ID_BLOCKDURATION,  EBML_UINT, 0, offsetof(MatroskaBlock,duration) },
-    { MATROSKA_ID_BLOCKREFERENCE, EBML_UINT, 0, offsetof(MatroskaBlock,reference) },
-    { 1,                          EBML_UINT, 0, offsetof(MatroskaBlock,non_simple), {.u=1} },
-    { 0 }
-};
-
-static EbmlSyntax matroska_cluster[] = {
-    { MATROSKA_ID_CLUSTERTIMECODE,EBML_UINT,0, offsetof(MatroskaCluster,timecode) },
-    { MATROSKA_ID_BLOCKGROUP,     EBML_NEST, sizeof(MatroskaBlock), offsetof(MatroskaCluster,blocks), {.n=matroska_blockgroup} },
-    { MATROSKA_ID_SIMPLEBLOCK,    EBML_PASS, sizeof(MatroskaBlock), offsetof(MatroskaCluster,blocks), {.n=matroska_blockgroup} },
-    { MATROSKA_ID_CLUSTERPOSITION,EBML_NONE },
-    { MATROSKA_ID_CLUSTERPREVSIZE,EBML_NONE },
-    { 0 }
-};
-
+/* clusters themselves are read by matroska_parse_cluster() */
 static EbmlSyntax matroska_clusters[] = {
-    { MATROSKA_ID_CLUSTER,        EBML_NEST, 0, 0, {.n=matroska_cluster} },
     { MATROSKA_ID_INFO,           EBML_NONE },
     { MATROSKA_ID_CUES,           EBML_NONE },
     { MATROSKA_ID_TAGS,           EBML_NONE },
@@ -1191,6 +1166,10 @@ static void matroska_execute_seekhead(MatroskaDemuxContext *matroska)
             || seekhead[i].id == MATROSKA_ID_SEEKHEAD
             || seekhead[i].id == MATROSKA_ID_CLUSTER)
             continue;
+        /* the index is restored from the probe cache */
+        if (seekhead[i].id == MATROSKA_ID_CUES &&
+            ff_probe_cache_has_index(matroska->ctx))
+            continue;
 
         /* seek */
         if (avio_seek(matroska->ctx->pb, offset, SEEK_SET) != offset)
@@ -1690,7 +1669,7 @@ static void matroska_clear_queue(MatroskaDemuxContext *matroska)
 static int matroska_parse_block(MatroskaDemuxContext *matroska, uint8_t *data,
                                 int size, int64_t pos, uint64_t cluster_time,
                                 uint64_t duration, int is_keyframe,
-                                int64_t cluster_pos)
+                                int64_t cluster_pos, int index_only)
 {
     uint64_t timecode = AV_NOPTS_VALUE;
     MatroskaTrack *track;
@@ -1738,6 +1717,8 @@ static int matroska_parse_block(MatroskaDemuxContext *matroska, uint8_t *data,
             av_add_index_entry(st, cluster_pos, timecode, 0,0,AVINDEX_KEYFRAME);
         track->end_timecode = FFMAX(track->end_timecode, timecode+duration);
     }
+    if (index_only)
+        return res;
 
     if (matroska->skip_to_keyframe && track->type != MATROSKA_TRACK_TYPE_SUBTITLE) {
         if (!is_keyframe || timecode < matroska->skip_to_timecode)
@@ -1953,29 +1934,189 @@ static int matroska_parse_block(MatroskaDemuxContext *matroska, uint8_t *data,
     return res;
 }
 
-static int matroska_parse_cluster(MatroskaDemuxContext *matroska)
+/* same limit as for any EBML binary element */
+#define MATROSKA_BLOCK_SIZE_MAX   0x10000000
+/* track number, timecode and flags, enough to index a block */
+#define MATROSKA_BLOCK_HEADER_MAX (8 + 2 + 1)
+
+typedef struct {
+    uint64_t duration;
+    uint64_t reference;
+    int      non_simple;
+    int64_t  pos;
+    int      size;
+} MatroskaBlock;
+
+/*
+ * Read the data of a block into matroska->block_buf. With index_only set
+ * only its header is read, the rest is skipped.
+ * Return: number of bytes read, < 0 on error
+ */
+static int matroska_read_block_data(MatroskaDemuxContext *matroska,
+                                    uint64_t length, int index_only,
+                                    int64_t *pos)
+{
+    AVIOContext *pb = matroska->ctx->pb;
+    int size = index_only ? FFMIN(length, MATROSKA_BLOCK_HEADER_MAX) : length;
+
+    av_fast_malloc(&matroska->block_buf, &matroska->block_buf_size, size);
+    if (!matroska->block_buf)
+        return AVERROR(ENOMEM);
+    *pos = avio_tell(pb);
+    if (avio_read(pb, matroska->block_buf, size) != size)
+        return AVERROR(EIO);
+    if (length > size && avio_skip(pb, length - size) < 0)
+        return AVERROR(EIO);
+    return size;
+}
+
+static int matroska_read_element_header(MatroskaDemuxContext *matroska,
+                                        uint32_t *id)
+{
+    uint64_t num;
+    int res;
+
+    if (matroska->current_id) {
+        *id = matroska->current_id;
+    } else {
+        if ((res = ebml_read_num(matroska, matroska->ctx->pb, 4, &num)) < 0)
+            return res;
+        *id = num | 1 << 7*res;
+    }
+    matroska->current_id = 0;
+    return 0;
+}
+
+static int matroska_skip_element(MatroskaDemuxContext *matroska,
+                                 uint32_t id, uint64_t length)
+{
+    if (id != EBML_ID_VOID && id != EBML_ID_CRC32)
+        av_log(matroska->ctx, AV_LOG_INFO, "Unknown entry 0x%X\n", id);
+    return avio_skip(matroska->ctx->pb, length) < 0 ? AVERROR(EIO) : 0;
+}
+
+static int matroska_read_blockgroup(MatroskaDemuxContext *matroska,
+                                    uint64_t length, int index_only,
+                                    MatroskaBlock *block)
+{
+    AVIOContext *pb = matroska->ctx->pb;
+    int64_t end = avio_tell(pb) + length;
+    uint32_t id;
+    int res = 0;
+
+    if (length == 0xffffffffffffffULL)
+        return AVERROR_INVALIDDATA;
+    while (!res && avio_tell(pb) < end) {
+        if ((res = matroska_read_element_header(matroska, &id)) < 0 ||
+            (res = ebml_read_length(matroska, pb, &length)) < 0)
+            break;
+        res = 0;
+        switch (id) {
+        case MATROSKA_ID_BLOCK:
+        case MATROSKA_ID_SIMPLEBLOCK:
+            if (length > MATROSKA_BLOCK_SIZE_MAX)
+                return AVERROR_INVALIDDATA;
+            res = matroska_read_block_data(matroska, length, index_only,
+                                           &block->pos);
+            block->size = FFMAX(res, 0);
+            break;
+        case MATROSKA_ID_BLOCKDURATION:
+            res = ebml_read_uint(pb, length, &block->duration);
+            break;
+        case MATROSKA_ID_BLOCKREFERENCE:
+            res = ebml_read_uint(pb, length, &block->reference);
+            break;
+        default:
+            res = matroska_skip_element(matroska, id, length);
+        }
+        if (res > 0)
+            res = 0;
+    }
+    return res;
+}
+
+/*
+ * Read one level 1 element. The blocks of a cluster are parsed as they are
+ * read, without going through the generic EBML parser. With index_only set
+ * only their keyframes are added to the index and no packet is queued.
+ */
+static int matroska_parse_cluster(MatroskaDemuxContext *matroska, int index_only)
 {
-    MatroskaCluster cluster = { 0 };
-    EbmlList *blocks_list;
-    MatroskaBlock *blocks;
-    int i, res;
-    int64_t pos = avio_tell(matroska->ctx->pb);
+    AVIOContext *pb = matroska->ctx->pb;
+    int64_t pos = avio_tell(pb), end;
+    uint64_t length, cluster_time = 0;
+    uint32_t id;
+    int res = 0, ret;
+
     matroska->prev_pkt = NULL;
     if (matroska->current_id)
         pos -= 4;  /* sizeof the ID which was already read */
-    res = ebml_parse(matroska, matroska_clusters, &cluster);
-    blocks_list = &cluster.blocks;
-    blocks = blocks_list->elem;
-    for (i=0; i<blocks_list->nb_elem; i++)
-        if (blocks[i].bin.size > 0 && blocks[i].bin.data) {
-            int is_keyframe = blocks[i].non_simple ? !blocks[i].reference : -1;
-            res=matroska_parse_block(matroska,
-                                     blocks[i].bin.data, blocks[i].bin.size,
-                                     blocks[i].bin.pos,  cluster.timecode,
-                                     blocks[i].duration, is_keyframe,
-                                     pos);
+    if ((ret = matroska_read_element_header(matroska, &id)) < 0)
+        goto end;
+    if (id != MATROSKA_ID_CLUSTER) {
+        matroska->current_id = id;
+        ret = ebml_parse(matroska, matroska_clusters, matroska);
+        goto end;
+    }
+    if ((ret = ebml_read_length(matroska, pb, &length)) < 0)
+        goto end;
+    end = length == 0xffffffffffffffULL ? INT64_MAX : avio_tell(pb) + length;
+
+    while (avio_tell(pb) < end) {
+        MatroskaBlock block = { 0 };
+
+        if ((ret = matroska_read_element_header(matroska, &id)) < 0)
+            break;
+        if (id == MATROSKA_ID_CLUSTER && end == INT64_MAX) {
+            /* we reached the end of an unknown size cluster */
+            matroska->current_id = id;
+            break;
         }
-    ebml_free(matroska_cluster, &cluster);
+        if ((ret = ebml_read_length(matroska, pb, &length)) < 0)
+            break;
+        switch (id) {
+        case MATROSKA_ID_CLUSTERTIMECODE:
+            ret = ebml_read_uint(pb, length, &cluster_time);
+            break;
+        case MATROSKA_ID_SIMPLEBLOCK:
+            if (length > MATROSKA_BLOCK_SIZE_MAX) {
+                ret = AVERROR_INVALIDDATA;
+                break;
+            }
+            ret = matroska_read_block_data(matroska, length, index_only,
+                                           &block.pos);
+            block.size = FFMAX(ret, 0);
+            break;
+        case MATROSKA_ID_BLOCKGROUP:
+            block.non_simple = 1;
+            ret = matroska_read_blockgroup(matroska, length, index_only, &block);
+            break;
+        case MATROSKA_ID_CLUSTERPOSITION:
+        case MATROSKA_ID_CLUSTERPREVSIZE:
+            ret = avio_skip(pb, length) < 0 ? AVERROR(EIO) : 0;
+            break;
+        default:
+            ret = matroska_skip_element(matroska, id, length);
+        }
+        if (ret < 0) {
+            if (ret == AVERROR_INVALIDDATA)
+                av_log(matroska->ctx, AV_LOG_ERROR, "Invalid element\n");
+            else if (ret == AVERROR(EIO))
+                av_log(matroska->ctx, AV_LOG_ERROR, "Read error\n");
+            break;
+        }
+        if (block.size > 0) {
+            int is_keyframe = block.non_simple ? !block.reference : -1;
+            res = matroska_parse_block(matroska, matroska->block_buf,
+                                       block.size, block.pos, cluster_time,
+                                       block.duration, is_keyframe, pos,
+                                       index_only);
+        }
+    }
+
+end:
+    if (ret < 0)
+        res = ret;
     if (res < 0)  matroska->done = 1;
     return res;
 }
@@ -1987,7 +2128,7 @@ static int matroska_read_packet(AVFormatContext *s, AVPacket *pkt)
     while (matroska_deliver_packet(matroska, pkt)) {
         if (matroska->done)
             return AVERROR_EOF;
-        matroska_parse_cluster(matroska);
+        matroska_parse_cluster(matroska, 0);
     }
 
     return 0;
@@ -2005,14 +2146,20 @@ static int matroska_read_seek(AVFormatContext *s, int stream_index,
         return 0;
     timestamp = FFMAX(timestamp, st->index_entries[0].timestamp);
 
-    if ((index = av_index_search_timestamp(st, timestamp, flags)) < 0) {
+    /* Past the last known keyframe, index the following clusters until one
+     * after the target is found. Only the block headers are read for this. */
+    index = av_index_search_timestamp(st, timestamp, flags);
+    if ((index < 0 || index == st->nb_index_entries - 1) &&
+        st->index_entries[st->nb_index_entries-1].timestamp < timestamp) {
         avio_seek(s->pb, st->index_entries[st->nb_index_entries-1].pos, SEEK_SET);
         matroska->current_id = 0;
-        while ((index = av_index_search_timestamp(st, timestamp, flags)) < 0) {
-            matroska_clear_queue(matroska);
-            if (matroska_parse_cluster(matroska) < 0)
+        matroska->done = 0;
+        while ((index = av_index_search_timestamp(st, timestamp, flags)) < 0 ||
+               index == st->nb_index_entries - 1) {
+            if (matroska_parse_cluster(matroska, 1) < 0)
                 break;
         }
+        index = av_index_search_timestamp(st, timestamp, flags);
     }
 
     matroska_clear_queue(matroska);
@@ -2055,6 +2202,7 @@ static int matroska_read_close(AVFormatContext *s)
     for (n=0; n < matroska->tracks.nb_elem; n++)
         if (tracks[n].type == MATROSKA_TRACK_TYPE_AUDIO)
             av_free(tracks[n].audio.buf);
+    av_freep(&matroska->block_buf);
     ebml_free(matroska_segment, matroska);
 
     return 0;
@@ -28,6 +28,7 @@
 #include "libavutil/intreadwrite.h"
 #include "libavutil/avstring.h"
 #include "libavutil/dict.h"
+#include "libavutil/opt.h"
 #include "avformat.h"
 #include "avio_internal.h"
 #include "riff.h"
@@ -1550,6 +1551,200 @@ static int mov_read_ctts(MOVContext *c, AVIOContext *pb, MOVAtom atom)
     return 0;
 }
 
+/* distance in samples between sparse index entries of tracks with
+   frequent keyframes */
+#define MOV_LAZY_INDEX_STEP 32
+
+/**
+ * Resolve size and keyframe flag of the sample c points to, the same way
+ * mov_build_index() does.
+ */
+static void mov_cursor_resolve(MOVStreamContext *sc, MOVSampleCursor *c)
+{
+    int key_off = sc->keyframes && sc->keyframes[0] == 1;
+
+    c->keyframe = 0;
+    if (!sc->keyframe_count || c->sample+key_off == sc->keyframes[c->stss_index]) {
+        c->keyframe = 1;
+        if (c->stss_index + 1 < sc->keyframe_count)
+            c->stss_index++;
+    } else if (sc->stps_count && c->sample+key_off == sc->stps_data[c->stps_index]) {
+        c->keyframe = 1;
+        if (c->stps_index + 1 < sc->stps_count)
+            c->stps_index++;
+    }
+    c->size = sc->sample_size > 0 ? sc->sample_size : sc->sample_sizes[c->sample];
+}
+
+/**
+ * Move c to the start of the first non empty chunk from c->chunk on.
+ * @return 0 on success, -1 if there is none
+ */
+static int mov_cursor_find_chunk(MOVStreamContext *sc, MOVSampleCursor *c)
+{
+    for (; c->chunk < sc->chunk_count; c->chunk++) {
+        while (c->stsc_index + 1 < sc->stsc_count &&
+               c->chunk + 1 == sc->stsc_data[c->stsc_index + 1].first)
+            c->stsc_index++;
+        if (sc->stsc_data[c->stsc_index].count) {
+            c->chunk_sample = 0;
+            c->pos = sc->chunk_offsets[c->chunk];
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static int mov_cursor_init(MOVStreamContext *sc, MOVSampleCursor *c, int64_t dts)
+{
+    memset(c, 0, sizeof(*c));
+    c->dts = dts;
+    if (!sc->sample_count || mov_cursor_find_chunk(sc, c) < 0)
+        return -1;
+    mov_cursor_resolve(sc, c);
+    return 0;
+}
+
+/**
+ * Step c to the next sample.
+ * @return 0 on success, -1 past the last sample
+ */
+static int mov_cursor_next(MOVStreamContext *sc, MOVSampleCursor *c)
+{
+    c->pos += c->size;
+    c->dts += sc->stts_data[c->stts_index].duration;
+    c->stts_sample++;
+    if (c->stts_index + 1 < sc->stts_count && c->stts_sample == sc->stts_data[c->stts_index].count) {
+        c->stts_sample = 0;
+        c->stts_index++;
+    }
+    if (++c->sample >= sc->sample_count)
+        return -1;
+    if (++c->chunk_sample >= (unsigned)sc->stsc_data[c->stsc_index].count) {
+        c->chunk++;
+        if (mov_cursor_find_chunk(sc, c) < 0)
+            return -1;
+    }
+    mov_cursor_resolve(sc, c);
+    return 0;
+}
+
+static void mov_cursor_get_entry(const MOVSampleCursor *c, AVIndexEntry *e)
+{
+    e->pos          = c->pos;
+    e->timestamp    = c->dts;
+    e->size         = c->size;
+    e->min_distance = 0;
+    e->flags        = c->keyframe ? AVINDEX_KEYFRAME : 0;
+}
+
+/**
+ * Keep the sample tables of the track and only index keyframes, at most
+ * one per MOV_LAZY_INDEX_STEP samples, each with the cursor to resume
+ * from. Samples are then resolved while reading.
+ * @return 0 on success, <0 if the track needs a full index
+ */
+static int mov_build_lazy_index(MOVContext *mov, AVStream *st, int64_t start_dts)
+{
+    MOVStreamContext *sc = st->priv_data;
+    MOVSampleCursor c;
+    uint64_t stream_size = 0;
+    unsigned last_key = 0, alloc = 0;
+    unsigned i;
+
+    /* samples of other stsd entries are not indexed */
+    if (sc->pseudo_stream_id != -1)
+        for (i = 0; i < sc->stsc_count; i++)
+            if (sc->stsc_data[i].id - 1 != sc->pseudo_stream_id)
+                return -1;
+
+    sc->lazy_count = 0;
+    if (mov_cursor_init(sc, &c, start_dts) >= 0) {
+        sc->lazy_start = c;
+        do {
+            if (c.keyframe && (!st->nb_index_entries ||
+                               c.sample - last_key >= MOV_LAZY_INDEX_STEP)) {
+                if (st->nb_index_entries >= alloc) {
+                    AVIndexEntry *entries;
+                    MOVSampleCursor *cursors;
+
+                    alloc = FFMAX(2 * alloc, 64);
+                    if (alloc >= UINT_MAX / sizeof(*cursors))
+                        goto fail;
+                    entries = av_realloc(st->index_entries, alloc * sizeof(*entries));
+                    if (!entries)
+                        goto fail;
+                    st->index_entries = entries;
+                    cursors = av_realloc(sc->seek_cursors, alloc * sizeof(*cursors));
+                    if (!cursors)
+                        goto fail;
+                    sc->seek_cursors = cursors;
+                }
+                mov_cursor_get_entry(&c, &st->index_entries[st->nb_index_entries]);
+                sc->seek_cursors[st->nb_index_entries++] = c;
+                last_key = c.sample;
+            }
+            stream_size += c.size;
+            sc->lazy_count++;
+        } while (mov_cursor_next(sc, &c) >= 0);
+    }
+    st->index_entries_allocated_size = alloc * sizeof(*st->index_entries);
+
+    if (st->duration > 0)
+        st->codec->bit_rate = stream_size*8*sc->time_scale/st->duration;
+    av_dlog(mov->fc, "stream %d, lazy index with %d of %u samples\n",
+            st->index, st->nb_index_entries, sc->lazy_count);
+    sc->cursor = sc->lazy_start;
+    sc->lazy_index = 1;
+    return 0;
+fail:
+    av_freep(&st->index_entries);
+    av_freep(&sc->seek_cursors);
+    st->nb_index_entries = 0;
+    return AVERROR(ENOMEM);
+}
+
+/**
+ * Expand the sample tables of a lazily indexed track into a full index,
+ * needed before adding fragment samples or walking the index directly.
+ */
+static int mov_expand_lazy_index(AVStream *st)
+{
+    MOVStreamContext *sc = st->priv_data;
+    MOVSampleCursor c = sc->lazy_start;
+    AVIndexEntry *entries;
+    unsigned i, distance = 0;
+
+    if (!sc->lazy_index)
+        return 0;
+    if (sc->lazy_count >= UINT_MAX / sizeof(*entries))
+        return -1;
+    entries = av_malloc(sc->lazy_count * sizeof(*entries));
+    if (!entries)
+        return AVERROR(ENOMEM);
+    for (i = 0; i < sc->lazy_count; i++) {
+        if (c.keyframe)
+            distance = 0;
+        mov_cursor_get_entry(&c, &entries[i]);
+        entries[i].min_distance = distance++;
+        mov_cursor_next(sc, &c);
+    }
+    av_free(st->index_entries);
+    st->index_entries = entries;
+    st->nb_index_entries = sc->lazy_count;
+    st->index_entries_allocated_size = sc->lazy_count * sizeof(*entries);
+    av_freep(&sc->seek_cursors);
+    sc->lazy_index = 0;
+
+    av_freep(&sc->chunk_offsets);
+    av_freep(&sc->stsc_data);
+    av_freep(&sc->sample_sizes);
+    av_freep(&sc->keyframes);
+    av_freep(&sc->stts_data);
+    av_freep(&sc->stps_data);
+    return 0;
+}
+
 static void mov_build_index(MOVContext *mov, AVStream *st)
 {
     MOVStreamContext *sc = st->priv_data;
@@ -1587,6 +1782,9 @@ static void mov_build_index(MOVContext *mov, AVStream *st)
 
         current_dts -= sc->dts_shift;
 
+        if (mov->lazy_index && mov_build_lazy_index(mov, st, current_dts) >= 0)
+            return;
+
         if (sc->sample_count >= UINT_MAX / sizeof(*st->index_entries))
             return;
         st->index_entries = av_malloc(sc->sample_count*sizeof(*st->index_entries));
@@ -1861,7 +2059,9 @@ static int mov_read_trak(MOVContext *c, AVIOContext *pb, MOVAtom atom)
         break;
     }
 
-    /* Do not need those anymore. */
+    /* Do not need those anymore, unless samples are resolved from them. */
+    if (sc->lazy_index)
+        return 0;
     av_freep(&sc->chunk_offsets);
     av_freep(&sc->stsc_data);
     av_freep(&sc->sample_sizes);
@@ -2054,7 +2254,7 @@ static int mov_read_trun(MOVContext *c, AVIOContext *pb, MOVAtom atom)
     int64_t dts;
     int data_offset = 0;
     unsigned entries, first_sample_flags = frag->flags;
-    int flags, distance, i;
+    int flags, distance, i, ret;
 
     for (i = 0; i < c->fc->nb_streams; i++) {
         if (c->fc->streams[i]->id == frag->track_id) {
@@ -2069,6 +2269,8 @@ static int mov_read_trun(MOVContext *c, AVIOContext *pb, MOVAtom atom)
     sc = st->priv_data;
     if (sc->pseudo_stream_id+1 != frag->stsd_id)
         return 0;
+    if ((ret = mov_expand_lazy_index(st)) < 0)
+        return ret;
     avio_r8(pb); /* version */
     flags = avio_rb24(pb);
     entries = avio_rb32(pb);
@@ -2378,6 +2580,8 @@ static void mov_read_chapters(AVFormatContext *s)
 
     st->discard = AVDISCARD_ALL;
     sc = st->priv_data;
+    if (mov_expand_lazy_index(st) < 0)
+        return;
     cur_pos = avio_tell(sc->pb);
 
     for (i = 0; i < st->nb_index_entries; i++) {
@@ -2458,30 +2662,122 @@ static int mov_read_header(AVFormatContext *s, AVFormatParameters *ap)
     return 0;
 }
 
-static AVIndexEntry *mov_find_next_sample(AVFormatContext *s, AVStream **st)
+#define MOV_READ_ORDER_SIZE 1024
+
+static int mov_nb_samples(AVStream *st)
 {
-    AVIndexEntry *sample = NULL;
-    int64_t best_dts = INT64_MAX;
-    int i;
+    MOVStreamContext *sc = st->priv_data;
+    return sc->lazy_index ? sc->lazy_count : st->nb_index_entries;
+}
+
+static int64_t mov_sched_pos(AVStream *st)
+{
+    MOVStreamContext *sc = st->priv_data;
+    return sc->lazy_index ? sc->sched_cursor.pos : st->index_entries[sc->sched_sample].pos;
+}
+
+static void mov_update_sched_dts(AVStream *st)
+{
+    MOVStreamContext *sc = st->priv_data;
+    if (sc->sched_sample < mov_nb_samples(st))
+        sc->sched_dts = av_rescale(sc->lazy_index ? sc->sched_cursor.dts :
+                                   st->index_entries[sc->sched_sample].timestamp,
+                                   AV_TIME_BASE, sc->time_scale);
+}
+
+/**
+ * Precompute which streams the next samples are read from, using the
+ * same interleaving rules as a per packet scan over all streams. The
+ * dts of the head sample of each stream is only rescaled when that
+ * stream advances, and reading a packet just takes the next entry.
+ */
+static int mov_fill_read_order(AVFormatContext *s)
+{
+    MOVContext *mov = s->priv_data;
+    int i, n;
+
+    if (!mov->read_order) {
+        mov->read_order = av_malloc(MOV_READ_ORDER_SIZE * sizeof(*mov->read_order));
+        if (!mov->read_order)
+            return AVERROR(ENOMEM);
+    }
+
     for (i = 0; i < s->nb_streams; i++) {
         AVStream *avst = s->streams[i];
         MOVStreamContext *msc = avst->priv_data;
-        if (msc->pb && msc->current_sample < avst->nb_index_entries) {
-            AVIndexEntry *current_sample = &avst->index_entries[msc->current_sample];
-            int64_t dts = av_rescale(current_sample->timestamp, AV_TIME_BASE, msc->time_scale);
-            av_dlog(s, "stream %d, sample %d, dts %"PRId64"\n", i, msc->current_sample, dts);
-            if (!sample || (!s->pb->seekable && current_sample->pos < sample->pos) ||
-                (s->pb->seekable &&
-                 ((msc->pb != s->pb && dts < best_dts) || (msc->pb == s->pb &&
-                 ((FFABS(best_dts - dts) <= AV_TIME_BASE && current_sample->pos < sample->pos) ||
-                  (FFABS(best_dts - dts) > AV_TIME_BASE && dts < best_dts)))))) {
-                sample = current_sample;
-                best_dts = dts;
-                *st = avst;
+        msc->sched_sample = msc->current_sample;
+        msc->sched_cursor = msc->cursor;
+        mov_update_sched_dts(avst);
+    }
+
+    for (n = 0; n < MOV_READ_ORDER_SIZE; n++) {
+        AVStream *st = NULL;
+        MOVStreamContext *sc;
+        int64_t best_dts = INT64_MAX;
+        int64_t best_pos = 0;
+
+        for (i = 0; i < s->nb_streams; i++) {
+            AVStream *avst = s->streams[i];
+            MOVStreamContext *msc = avst->priv_data;
+            if (msc->pb && msc->sched_sample < mov_nb_samples(avst)) {
+                int64_t pos = mov_sched_pos(avst);
+                int64_t dts = msc->sched_dts;
+                av_dlog(s, "stream %d, sample %d, dts %"PRId64"\n", i, msc->sched_sample, dts);
+                if (!st || (!s->pb->seekable && pos < best_pos) ||
+                    (s->pb->seekable &&
+                     ((msc->pb != s->pb && dts < best_dts) || (msc->pb == s->pb &&
+                     ((FFABS(best_dts - dts) <= AV_TIME_BASE && pos < best_pos) ||
+                      (FFABS(best_dts - dts) > AV_TIME_BASE && dts < best_dts)))))) {
+                    best_pos = pos;
+                    best_dts = dts;
+                    st = avst;
+                }
             }
         }
+        if (!st)
+            break;
+
+        mov->read_order[n] = st->index;
+        sc = st->priv_data;
+        sc->sched_sample++;
+        if (sc->lazy_index)
+            mov_cursor_next(sc, &sc->sched_cursor);
+        mov_update_sched_dts(st);
     }
-    return sample;
+
+    mov->read_order_count = n;
+    mov->read_order_index = 0;
+    return 0;
+}
+
+/**
+ * Drop the precomputed read order, needed whenever the current sample of
+ * a stream or the index changes by other means than reading.
+ */
+static void mov_reset_read_order(MOVContext *mov)
+{
+    mov->read_order_count = 0;
+    mov->read_order_index = 0;
+}
+
+static AVIndexEntry *mov_find_next_sample(AVFormatContext *s, AVStream **st)
+{
+    MOVContext *mov = s->priv_data;
+    MOVStreamContext *sc;
+
+    if (mov->read_order_index >= mov->read_order_count &&
+        mov_fill_read_order(s) < 0)
+        return NULL;
+    if (!mov->read_order_count)
+        return NULL;
+
+    *st = s->streams[mov->read_order[mov->read_order_index]];
+    sc = (*st)->priv_data;
+    if (sc->lazy_index) {
+        mov_cursor_get_entry(&sc->cursor, &sc->lazy_entry);
+        return &sc->lazy_entry;
+    }
+    return &(*st)->index_entries[sc->current_sample];
 }
 
 static int mov_read_packet(AVFormatContext *s, AVPacket *pkt)
@@ -2500,21 +2796,25 @@ static int mov_read_packet(AVFormatContext *s, AVPacket *pkt)
             url_feof(s->pb))
             return AVERROR_EOF;
         av_dlog(s, "read fragments, offset 0x%"PRIx64"\n", avio_tell(s->pb));
+        mov_reset_read_order(mov);
         goto retry;
     }
     sc = st->priv_data;
     /* must be done just before reading, to avoid infinite loop on sample */
     sc->current_sample++;
+    if (sc->lazy_index)
+        mov_cursor_next(sc, &sc->cursor);
 
     if (st->discard != AVDISCARD_ALL) {
         if (avio_seek(sc->pb, sample->pos, SEEK_SET) != sample->pos) {
             av_log(mov->fc, AV_LOG_ERROR, "stream %d, offset 0x%"PRIx64": partial file\n",
                    sc->ffindex, sample->pos);
-            return -1;
+            ret = -1;
+            goto fail;
         }
         ret = av_get_packet(sc->pb, pkt, sample->size);
         if (ret < 0)
-            return ret;
+            goto fail;
 #if CONFIG_DV_DEMUXER
         if (mov->dv_demux && sc->dv_audio_container) {
             dv_produce_packet(mov->dv_demux, pkt, pkt->data, pkt->size, pkt->pos);
@@ -2522,10 +2822,11 @@ static int mov_read_packet(AVFormatContext *s, AVPacket *pkt)
             pkt->size = 0;
             ret = dv_get_packet(mov->dv_demux, pkt);
             if (ret < 0)
-                return ret;
+                goto fail;
         }
 #endif
     }
+    mov->read_order_index++;
 
     pkt->stream_index = sc->ffindex;
     pkt->dts = sample->timestamp;
@@ -2541,8 +2842,10 @@ static int mov_read_packet(AVFormatContext *s, AVPacket *pkt)
         if (sc->wrong_dts)
             pkt->dts = AV_NOPTS_VALUE;
     } else {
-        int64_t next_dts = (sc->current_sample < st->nb_index_entries) ?
-            st->index_entries[sc->current_sample].timestamp : st->duration;
+        int64_t next_dts = st->duration;
+        if (sc->current_sample < mov_nb_samples(st))
+            next_dts = sc->lazy_index ? sc->cursor.dts :
+                       st->index_entries[sc->current_sample].timestamp;
         pkt->duration = next_dts - pkt->dts;
         pkt->pts = pkt->dts;
     }
@@ -2553,6 +2856,50 @@ static int mov_read_packet(AVFormatContext *s, AVPacket *pkt)
     av_dlog(s, "stream %d, pts %"PRId64", dts %"PRId64", pos 0x%"PRIx64", duration %d\n",
             pkt->stream_index, pkt->pts, pkt->dts, pkt->pos, pkt->duration);
     return 0;
+fail:
+    /* the sample is skipped, so the read order is rebuilt from the
+     * current samples of the tracks */
+    mov_reset_read_order(mov);
+    return ret;
+}
+
+/**
+ * Seek a lazily indexed track: start from the closest sparse index entry
+ * before timestamp and step through the sample tables from there.
+ * @return the sample, now also in sc->cursor, or -1 if none matches
+ */
+static int mov_seek_lazy(AVStream *st, int64_t timestamp, int flags)
+{
+    MOVStreamContext *sc = st->priv_data;
+    MOVSampleCursor c, found;
+    int any = flags & AVSEEK_FLAG_ANY;
+    int i;
+
+    if (!sc->lazy_count)
+        return -1;
+    i = av_index_search_timestamp(st, timestamp, AVSEEK_FLAG_BACKWARD | AVSEEK_FLAG_ANY);
+    c = found = i < 0 ? sc->lazy_start : sc->seek_cursors[i];
+
+    if (flags & AVSEEK_FLAG_BACKWARD) {
+        /* last matching sample not after timestamp */
+        while (c.sample + 1 < sc->lazy_count) {
+            mov_cursor_next(sc, &c);
+            if (c.dts > timestamp)
+                break;
+            if (any || c.keyframe)
+                found = c;
+        }
+    } else {
+        /* first matching sample not before timestamp */
+        while (c.dts < timestamp || !(any || c.keyframe)) {
+            if (c.sample + 1 >= sc->lazy_count)
+                return -1;
+            mov_cursor_next(sc, &c);
+        }
+        found = c;
+    }
+    sc->cursor = found;
+    return found.sample;
 }
 
 static int mov_seek_stream(AVFormatContext *s, AVStream *st, int64_t timestamp, int flags)
@@ -2561,9 +2908,13 @@ static int mov_seek_stream(AVFormatContext *s, AVStream *st, int64_t timestamp,
     int sample, time_sample;
     int i;
 
-    sample = av_index_search_timestamp(st, timestamp, flags);
+    if (sc->lazy_index)
+        sample = mov_seek_lazy(st, timestamp, flags);
+    else
+        sample = av_index_search_timestamp(st, timestamp, flags);
     av_dlog(s, "stream %d, timestamp %"PRId64", sample %d\n", st->index, timestamp, sample);
-    if (sample < 0 && st->nb_index_entries && timestamp < st->index_entries[0].timestamp)
+    if (sample < 0 && !sc->lazy_index &&
+        st->nb_index_entries && timestamp < st->index_entries[0].timestamp)
         sample = 0;
     if (sample < 0) /* not sure what to do */
         return -1;
@@ -2587,6 +2938,7 @@ static int mov_seek_stream(AVFormatContext *s, AVStream *st, int64_t timestamp,
 
 static int mov_read_seek(AVFormatContext *s, int stream_index, int64_t sample_time, int flags)
 {
+    MOVStreamContext *sc;
     AVStream *st;
     int64_t seek_timestamp, timestamp;
     int sample;
@@ -2597,13 +2949,16 @@ static int mov_read_seek(AVFormatContext *s, int stream_index, int64_t sample_ti
     if (sample_time < 0)
         sample_time = 0;
 
+    mov_reset_read_order(s->priv_data);
+
     st = s->streams[stream_index];
     sample = mov_seek_stream(s, st, sample_time, flags);
     if (sample < 0)
         return -1;
 
     /* adjust seek timestamp to found sample timestamp */
-    seek_timestamp = st->index_entries[sample].timestamp;
+    sc = st->priv_data;
+    seek_timestamp = sc->lazy_index ? sc->cursor.dts : st->index_entries[sample].timestamp;
 
     for (i = 0; i < s->nb_streams; i++) {
         st = s->streams[i];
@@ -2621,11 +2976,20 @@ static int mov_read_close(AVFormatContext *s)
     MOVContext *mov = s->priv_data;
     int i, j;
 
+    av_freep(&mov->read_order);
+
     for (i = 0; i < s->nb_streams; i++) {
         AVStream *st = s->streams[i];
         MOVStreamContext *sc = st->priv_data;
 
         av_freep(&sc->ctts_data);
+        av_freep(&sc->seek_cursors);
+        av_freep(&sc->chunk_offsets);
+        av_freep(&sc->stsc_data);
+        av_freep(&sc->sample_sizes);
+        av_freep(&sc->keyframes);
+        av_freep(&sc->stts_data);
+        av_freep(&sc->stps_data);
         for (j = 0; j < sc->drefs_count; j++) {
             av_freep(&sc->drefs[j].path);
             av_freep(&sc->drefs[j].dir);
@@ -2651,6 +3015,19 @@ static int mov_read_close(AVFormatContext *s)
     return 0;
 }
 
+static const AVOption options[] = {
+    { "lazy_index", "resolve samples from the sample tables instead of building a full index",
+      offsetof(MOVContext, lazy_index), FF_OPT_TYPE_INT, {.dbl = 0}, 0, 1, AV_OPT_FLAG_DECODING_PARAM },
+    { NULL },
+};
+
+static const AVClass demuxer_class = {
+    "mov demuxer",
+    av_default_item_name,
+    options,
+    LIBAVUTIL_VERSION_INT,
+};
+
 AVInputFormat ff_mov_demuxer = {
     "mov,mp4,m4a,3gp,3g2,mj2",
     NULL_IF_CONFIG_SMALL("QuickTime/MPEG-4/Motion JPEG 2000 format"),
@@ -2660,4 +3037,5 @@ AVInputFormat ff_mov_demuxer = {
     mov_read_packet,
     mov_read_close,
     mov_read_seek,
+    .priv_class = &demuxer_class,
 };
@@ -122,6 +122,30 @@ struct MpegTSContext {
 
     /** filters for various streams specified by PMT + for the PAT and PMT */
     MpegTSFilter *pids[NB_PID_MAX];
+
+    /** bitmap of the pids only used by discarded programs                */
+    uint32_t discard_pids[NB_PID_MAX / 32];
+    /** set when the programs changed and discard_pids must be rebuilt    */
+    int discard_pids_dirty;
+    /** AVProgram.discard values discard_pids was built for              */
+    enum AVDiscard *prg_discard;
+    int nb_prg_discard;
+
+    /** id of the only program to demux, 0 for all                      */
+    int program;
+};
+
+static const AVOption mpegts_options[] = {
+    {"program", "Only demux the program with this id, the packets of the other programs are dropped unparsed.", offsetof(MpegTSContext, program), FF_OPT_TYPE_INT,
+     {.dbl = 0}, 0, 0xffff, AV_OPT_FLAG_DECODING_PARAM },
+    { NULL },
+};
+
+static const AVClass mpegts_class = {
+    .class_name = "mpegts demuxer",
+    .item_name  = av_default_item_name,
+    .option     = mpegts_options,
+    .version    = LIBAVUTIL_VERSION_INT,
 };
 
 static const AVOption options[] = {
@@ -181,12 +205,14 @@ static void clear_program(MpegTSContext *ts, unsigned int programid)
     for(i=0; i<ts->nb_prg; i++)
         if(ts->prg[i].id == programid)
             ts->prg[i].nb_pids = 0;
+    ts->discard_pids_dirty = 1;
 }
 
 static void clear_programs(MpegTSContext *ts)
 {
     av_freep(&ts->prg);
     ts->nb_prg=0;
+    ts->discard_pids_dirty = 1;
 }
 
 static void add_pat_entry(MpegTSContext *ts, unsigned int programid)
@@ -200,6 +226,7 @@ static void add_pat_entry(MpegTSContext *ts, unsigned int programid)
     p->id = programid;
     p->nb_pids = 0;
     ts->nb_prg++;
+    ts->discard_pids_dirty = 1;
 }
 
 static void add_pid_to_pmt(MpegTSContext *ts, unsigned int programid, unsigned int pid)
@@ -218,6 +245,7 @@ static void add_pid_to_pmt(MpegTSContext *ts, unsigned int programid, unsigned i
     if(p->nb_pids >= MAX_PIDS_PER_PROGRAM)
         return;
     p->pids[p->nb_pids++] = pid;
+    ts->discard_pids_dirty = 1;
 }
 
 static void set_pcr_pid(AVFormatContext *s, unsigned int programid, unsigned int pid)
@@ -232,36 +260,60 @@ static void set_pcr_pid(AVFormatContext *s, unsigned int programid, unsigned int
 }
 
 /**
- * \brief discard_pid() decides if the pid is to be discarded according
- *                      to caller's programs selection
- * \param ts    : - TS context
- * \param pid   : - pid
- * \return 1 if the pid is only comprised in programs that have .discard=AVDISCARD_ALL
- *         0 otherwise
+ * Rebuild the bitmap of the pids to discard according to the caller's
+ * programs selection: a pid is discarded if it is only comprised in
+ * programs that have .discard=AVDISCARD_ALL.
  */
-static int discard_pid(MpegTSContext *ts, unsigned int pid)
+static void update_discard_pids(MpegTSContext *ts)
 {
+    AVFormatContext *s = ts->stream;
+    uint32_t used[NB_PID_MAX / 32] = { 0 };
     int i, j, k;
-    int used = 0, discarded = 0;
-    struct Program *p;
+
+    memset(ts->discard_pids, 0, sizeof(ts->discard_pids));
     for(i=0; i<ts->nb_prg; i++) {
-        p = &ts->prg[i];
-        for(j=0; j<p->nb_pids; j++) {
-            if(p->pids[j] != pid)
+        struct Program *p = &ts->prg[i];
+        for(k=0; k<s->nb_programs; k++) {
+            uint32_t *map;
+            if(s->programs[k]->id != p->id)
                 continue;
-            //is program with id p->id set to be discarded?
-            for(k=0; k<ts->stream->nb_programs; k++) {
-                if(ts->stream->programs[k]->id == p->id) {
-                    if(ts->stream->programs[k]->discard == AVDISCARD_ALL)
-                        discarded++;
-                    else
-                        used++;
-                }
-            }
+            map = s->programs[k]->discard == AVDISCARD_ALL ? ts->discard_pids : used;
+            for(j=0; j<p->nb_pids; j++)
+                map[p->pids[j] >> 5] |= 1U << (p->pids[j] & 31);
         }
     }
+    for(i=0; i<NB_PID_MAX / 32; i++)
+        ts->discard_pids[i] &= ~used[i];
+    ts->discard_pids_dirty = 0;
+}
+
+/**
+ * Check whether the caller changed the programs selection since
+ * discard_pids was built.
+ */
+static void check_programs_discard(MpegTSContext *ts)
+{
+    AVFormatContext *s = ts->stream;
+    int i;
 
-    return !used && discarded;
+    if (ts->nb_prg_discard != s->nb_programs) {
+        enum AVDiscard *tmp = av_realloc(ts->prg_discard,
+                                         s->nb_programs * sizeof(*tmp));
+        if (!tmp && s->nb_programs)
+            return;
+        ts->prg_discard = tmp;
+        ts->nb_prg_discard = s->nb_programs;
+        for(i=0; i<s->nb_programs; i++)
+            ts->prg_discard[i] = s->programs[i]->discard;
+        ts->discard_pids_dirty = 1;
+        return;
+    }
+    for(i=0; i<s->nb_programs; i++) {
+        if (ts->prg_discard[i] != s->programs[i]->discard) {
+            ts->prg_discard[i] = s->programs[i]->discard;
+            ts->discard_pids_dirty = 1;
+        }
+    }
 }
 
 /**
@@ -1046,6 +1098,8 @@ static void pmt_cb(MpegTSFilter *filter, const uint8_t *section, int section_len
 
     if (h->tid != PMT_TID)
         return;
+    if (ts->program && h->id != ts->program)
+        return;
 
     clear_program(ts, h->id);
     pcr_pid = get16(&p, p_end) & 0x1fff;
@@ -1178,6 +1232,8 @@ static void pat_cb(MpegTSFilter *filter, const uint8_t *section, int section_len
 
         if (sid == 0x0000) {
             /* NIT info */
+        } else if (ts->program && sid != ts->program) {
+            /* the pids of this program are not filtered */
         } else {
             program = av_new_program(ts->stream, sid);
             program->program_num = sid;
@@ -1228,6 +1284,10 @@ static void sdt_cb(MpegTSFilter *filter, const uint8_t *section, int section_len
         desc_list_end = p + desc_list_len;
         if (desc_list_end > p_end)
             break;
+        if (ts->program && sid != ts->program) {
+            p = desc_list_end;
+            continue;
+        }
         for(;;) {
             desc_tag = get8(&p, desc_list_end);
             if (desc_tag < 0)
@@ -1278,7 +1338,9 @@ static int handle_packet(MpegTSContext *ts, const uint8_t *packet)
     int64_t pos;
 
     pid = AV_RB16(packet + 1) & 0x1fff;
-    if(pid && discard_pid(ts, pid))
+    if (ts->discard_pids_dirty)
+        update_discard_pids(ts);
+    if(pid && ts->discard_pids[pid >> 5] & (1U << (pid & 31)))
         return 0;
     is_start = packet[1] & 0x40;
     tss = ts->pids[pid];
@@ -1311,7 +1373,8 @@ static int handle_packet(MpegTSContext *ts, const uint8_t *packet)
     if (p >= p_end)
         return 0;
 
-    pos = avio_tell(ts->stream->pb);
+    /* the trailing bytes of a raw packet are skipped after handling it */
+    pos = avio_tell(ts->stream->pb) + ts->raw_packet_size - TS_PACKET_SIZE;
     ts->pos47= pos % ts->raw_packet_size;
 
     if (tss->type == MPEGTS_SECTION) {
@@ -1355,10 +1418,23 @@ static int handle_packet(MpegTSContext *ts, const uint8_t *packet)
 static int mpegts_resync(AVFormatContext *s)
 {
     AVIOContext *pb = s->pb;
-    int c, i;
-
-    for(i = 0;i < MAX_RESYNC_SIZE; i++) {
+    const uint8_t *sync;
+    int c, i, len;
+
+    for(i = 0;i < MAX_RESYNC_SIZE; i += len) {
+        /* search the buffered data at once, memchr() is vectorized */
+        len = FFMIN(pb->buf_end - pb->buf_ptr, MAX_RESYNC_SIZE - i);
+        if (len > 0) {
+            if ((sync = memchr(pb->buf_ptr, 0x47, len))) {
+                pb->buf_ptr += sync - pb->buf_ptr;
+                return 0;
+            }
+            pb->buf_ptr += len;
+            continue;
+        }
+        /* refill the buffer */
         c = avio_r8(pb);
+        len = 1;
         if (url_feof(pb))
             return -1;
         if (c == 0x47) {
@@ -1371,18 +1447,24 @@ static int mpegts_resync(AVFormatContext *s)
     return -1;
 }
 
-/* return -1 if error or EOF. Return 0 if OK. */
-static int read_packet(AVFormatContext *s, uint8_t *buf, int raw_packet_size)
+/**
+ * Read one TS packet. The packet is parsed in place from the AVIOContext
+ * buffer when possible, buf is only used if the packet straddles a buffer
+ * refill. *data stays valid until finished_reading_packet() is called.
+ * @return -1 if error or EOF. Return 0 if OK.
+ */
+static int read_packet(AVFormatContext *s, uint8_t *buf, int raw_packet_size,
+                       const uint8_t **data)
 {
     AVIOContext *pb = s->pb;
-    int skip, len;
+    int len;
 
     for(;;) {
-        len = avio_read(pb, buf, TS_PACKET_SIZE);
+        len = ffio_read_indirect(pb, buf, TS_PACKET_SIZE, data);
         if (len != TS_PACKET_SIZE)
             return len < 0 ? len : AVERROR_EOF;
         /* check paquet sync byte */
-        if (buf[0] != 0x47) {
+        if ((*data)[0] != 0x47) {
             /* find a new packet start */
             avio_seek(pb, -TS_PACKET_SIZE, SEEK_CUR);
             if (mpegts_resync(s) < 0)
@@ -1390,23 +1472,30 @@ static int read_packet(AVFormatContext *s, uint8_t *buf, int raw_packet_size)
             else
                 continue;
         } else {
-            skip = raw_packet_size - TS_PACKET_SIZE;
-            if (skip > 0)
-                avio_skip(pb, skip);
             break;
         }
     }
     return 0;
 }
 
+static void finished_reading_packet(AVFormatContext *s, int raw_packet_size)
+{
+    AVIOContext *pb = s->pb;
+    int skip = raw_packet_size - TS_PACKET_SIZE;
+    if (skip > 0)
+        avio_skip(pb, skip);
+}
+
 static int handle_packets(MpegTSContext *ts, int nb_packets)
 {
     AVFormatContext *s = ts->stream;
     uint8_t packet[TS_PACKET_SIZE];
+    const uint8_t *data;
     int packet_num, ret;
 
     ts->stop_parse = 0;
     packet_num = 0;
+    check_programs_discard(ts);
     for(;;) {
         packet_num++;
         if (nb_packets != 0 && packet_num >= nb_packets ||
@@ -1417,10 +1506,11 @@ static int handle_packets(MpegTSContext *ts, int nb_packets)
         if (ts->stop_parse > 0)
             break;
 
-        ret = read_packet(s, packet, ts->raw_packet_size);
+        ret = read_packet(s, packet, ts->raw_packet_size, &data);
         if (ret != 0)
             return ret;
-        ret = handle_packet(ts, packet);
+        ret = handle_packet(ts, data);
+        finished_reading_packet(s, ts->raw_packet_size);
         if (ret != 0)
             return ret;
     }
@@ -1533,7 +1623,9 @@ static int mpegts_read_header(AVFormatContext *s,
         handle_packets(ts, s->probesize / ts->raw_packet_size);
         /* if could not find service, enable auto_guess */
 
-        ts->auto_guess = 1;
+        ts->auto_guess = !ts->program;
+        if (ts->program && !s->nb_programs)
+            av_log(s, AV_LOG_WARNING, "Program %d not found\n", ts->program);
 
         av_dlog(ts->stream, "tuning done\n");
 
@@ -1544,6 +1636,7 @@ static int mpegts_read_header(AVFormatContext *s,
         int64_t pcrs[2], pcr_h;
         int packet_count[2];
         uint8_t packet[TS_PACKET_SIZE];
+        const uint8_t *data;
 
         /* only read packets */
 
@@ -1559,18 +1652,21 @@ static int mpegts_read_header(AVFormatContext *s,
         nb_pcrs = 0;
         nb_packets = 0;
         for(;;) {
-            ret = read_packet(s, packet, ts->raw_packet_size);
+            ret = read_packet(s, packet, ts->raw_packet_size, &data);
             if (ret < 0)
                 return -1;
-            pid = AV_RB16(packet + 1) & 0x1fff;
+            pid = AV_RB16(data + 1) & 0x1fff;
             if ((pcr_pid == -1 || pcr_pid == pid) &&
-                parse_pcr(&pcr_h, &pcr_l, packet) == 0) {
+                parse_pcr(&pcr_h, &pcr_l, data) == 0) {
+                finished_reading_packet(s, ts->raw_packet_size);
                 pcr_pid = pid;
                 packet_count[nb_pcrs] = nb_packets;
                 pcrs[nb_pcrs] = pcr_h * 300 + pcr_l;
                 nb_pcrs++;
                 if (nb_pcrs >= 2)
                     break;
+            } else {
+                finished_reading_packet(s, ts->raw_packet_size);
             }
             nb_packets++;
         }
@@ -1602,15 +1698,19 @@ static int mpegts_raw_read_packet(AVFormatContext *s,
     int64_t pcr_h, next_pcr_h, pos;
     int pcr_l, next_pcr_l;
     uint8_t pcr_buf[12];
+    const uint8_t *data;
 
     if (av_new_packet(pkt, TS_PACKET_SIZE) < 0)
         return AVERROR(ENOMEM);
     pkt->pos= avio_tell(s->pb);
-    ret = read_packet(s, pkt->data, ts->raw_packet_size);
+    ret = read_packet(s, pkt->data, ts->raw_packet_size, &data);
     if (ret < 0) {
         av_free_packet(pkt);
         return ret;
     }
+    if (data != pkt->data)
+        memcpy(pkt->data, data, TS_PACKET_SIZE);
+    finished_reading_packet(s, ts->raw_packet_size);
     if (ts->mpeg2ts_compute_pcr) {
         /* compute exact PCR for each packet */
         if (parse_pcr(&pcr_h, &pcr_l, pkt->data) == 0) {
@@ -1684,6 +1784,7 @@ static int mpegts_read_close(AVFormatContext *s)
     int i;
 
     clear_programs(ts);
+    av_freep(&ts->prg_discard);
 
     for(i=0;i<NB_PID_MAX;i++)
         if (ts->pids[i]) mpegts_close_filter(ts, ts->pids[i]);
@@ -1867,13 +1968,15 @@ int ff_mpegts_parse_packet(MpegTSContext *ts, AVPacket *pkt,
 
     len1 = len;
     ts->pkt = pkt;
+    check_programs_discard(ts);
     for(;;) {
         ts->stop_parse = 0;
         if (len < TS_PACKET_SIZE)
             return -1;
         if (buf[0] != 0x47) {
-            buf++;
-            len--;
+            const uint8_t *sync = memchr(buf, 0x47, len);
+            len -= sync ? sync - buf : len;
+            buf  = sync;
         } else {
             handle_packet(ts, buf);
             buf += TS_PACKET_SIZE;
@@ -1891,6 +1994,7 @@ void ff_mpegts_parse_close(MpegTSContext *ts)
 
     for(i=0;i<NB_PID_MAX;i++)
         av_free(ts->pids[i]);
+    av_free(ts->prg_discard);
     av_free(ts);
 }
 
@@ -1908,6 +2012,7 @@ AVInputFormat ff_mpegts_demuxer = {
 #ifdef USE_SYNCPOINT_SEARCH
     .read_seek2 = read_seek2,
 #endif
+    .priv_class = &mpegts_class,
 };
 
 AVInputFormat ff_mpegtsraw_demuxer = {
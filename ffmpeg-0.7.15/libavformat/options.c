@@ -81,6 +81,7 @@ static const AVOption options[]={
 #endif
 {"sortdts", "try to interleave outputted packets by dts", 0, FF_OPT_TYPE_CONST, {.dbl = AVFMT_FLAG_SORT_DTS }, INT_MIN, INT_MAX, D, "fflags"},
 {"keepside", "dont merge side data", 0, FF_OPT_TYPE_CONST, {.dbl = AVFMT_FLAG_KEEP_SIDE_DATA }, INT_MIN, INT_MAX, D, "fflags"},
+{"probecache", "reuse the probing results of a previous open of the same file", 0, FF_OPT_TYPE_CONST, {.dbl = AVFMT_FLAG_PROBE_CACHE }, INT_MIN, INT_MAX, D, "fflags"},
 {"latm", "enable RTP MP4A-LATM payload", 0, FF_OPT_TYPE_CONST, {.dbl = AVFMT_FLAG_MP4A_LATM }, INT_MIN, INT_MAX, E, "fflags"},
 {"analyzeduration", "how many microseconds are analyzed to estimate duration", OFFSET(max_analyze_duration), FF_OPT_TYPE_INT, {.dbl = 5*AV_TIME_BASE }, 0, INT_MAX, D},
 {"cryptokey", "decryption key", OFFSET(key), FF_OPT_TYPE_BINARY, {.dbl = 0}, 0, 0, D},
@@ -90,6 +91,8 @@ static const AVOption options[]={
 {"ts", NULL, 0, FF_OPT_TYPE_CONST, {.dbl = FF_FDEBUG_TS }, INT_MIN, INT_MAX, E|D, "fdebug"},
 {"max_delay", "maximum muxing or demuxing delay in microseconds", OFFSET(max_delay), FF_OPT_TYPE_INT, {.dbl = DEFAULT }, 0, INT_MAX, E|D},
 {"fpsprobesize", "number of frames used to probe fps", OFFSET(fps_probe_size), FF_OPT_TYPE_INT, {.dbl = -1}, -1, INT_MAX-1, D},
+{"probethreads", "number of threads decoding streams in parallel while probing, 0 for one per stream", OFFSET(probe_threads), FF_OPT_TYPE_INT, {.dbl = 1 }, 0, INT_MAX, D},
+{"probetime", "maximum time in milliseconds spent probing stream parameters, 0 for no limit", OFFSET(probe_time), FF_OPT_TYPE_INT, {.dbl = 0 }, 0, INT_MAX, D},
 {NULL},
 };
 
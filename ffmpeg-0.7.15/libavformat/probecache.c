@@ -0,0 +1,410 @@
+/*
+ * In-process cache of the probing results of local files
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Cache of the format, stream parameters and seek index of local files,
+ * keyed by path, size and modification time, so that opening the same file
+ * again skips av_probe_input_buffer(), avformat_find_stream_info() and
+ * reading the index.
+ */
+
+#include "libavutil/avstring.h"
+#include "avformat.h"
+#include "probecache.h"
+#include <sys/stat.h>
+#if HAVE_PTHREADS
+#include <pthread.h>
+#endif
+
+/* entries kept, the least recently used ones are dropped first */
+#define PROBE_CACHE_MAX_ENTRIES 64
+
+typedef struct ProbeCacheStream {
+    enum CodecID header_codec_id;   ///< codec_id after read_header()
+    AVCodecContext *codec;
+    AVRational r_frame_rate;
+    AVRational avg_frame_rate;
+    AVRational sample_aspect_ratio;
+    int64_t start_time;
+    int64_t duration;
+    int disposition;
+    int codec_info_nb_frames;
+    AVIndexEntry *index_entries;
+    int nb_index_entries;
+} ProbeCacheStream;
+
+typedef struct ProbeCacheEntry {
+    char *path;
+    int64_t size;
+    int64_t mtime;
+    AVInputFormat *iformat;
+    int nb_streams;
+    ProbeCacheStream *streams;
+    int64_t start_time;
+    int64_t duration;
+    int64_t file_size;
+    int bit_rate;
+    int cached;     ///< the entry is complete and in the cache
+    int refcount;
+    struct ProbeCacheEntry *next;
+} ProbeCacheEntry;
+
+static ProbeCacheEntry *cache;
+static int nb_entries;
+static unsigned hits, misses;
+
+#if HAVE_PTHREADS
+static pthread_mutex_t cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+#define LOCK()   pthread_mutex_lock(&cache_mutex)
+#define UNLOCK() pthread_mutex_unlock(&cache_mutex)
+#else
+#define LOCK()
+#define UNLOCK()
+#endif
+
+static void free_entry(ProbeCacheEntry *e)
+{
+    int i;
+
+    for (i = 0; i < e->nb_streams; i++) {
+        ProbeCacheStream *cs = &e->streams[i];
+        if (cs->codec) {
+            av_freep(&cs->codec->extradata);
+            av_freep(&cs->codec->rc_eq);
+            av_freep(&cs->codec->intra_matrix);
+            av_freep(&cs->codec->inter_matrix);
+            av_freep(&cs->codec->rc_override);
+            av_freep(&cs->codec);
+        }
+        av_freep(&cs->index_entries);
+    }
+    av_freep(&e->streams);
+    av_freep(&e->path);
+    av_free(e);
+}
+
+/* must be called with the lock held */
+static void unref_entry(ProbeCacheEntry *e)
+{
+    if (!--e->refcount)
+        free_entry(e);
+}
+
+/* local path of filename, NULL if it is not a local file */
+static const char *local_path(const char *filename)
+{
+    const char *path;
+
+    if (av_strstart(filename, "file:", &path) ||
+        av_strstart(filename, "mmap:", &path))
+        return path;
+    return strchr(filename, ':') ? NULL : filename;
+}
+
+void ff_probe_cache_open(AVFormatContext *s, const char *filename)
+{
+    ProbeCacheEntry *e, **prev;
+    struct stat st;
+    const char *path;
+
+    if (!(s->flags & AVFMT_FLAG_PROBE_CACHE) || s->iformat || s->pb ||
+        !filename || !(path = local_path(filename)) ||
+        stat(path, &st) < 0 || !S_ISREG(st.st_mode))
+        return;
+
+    LOCK();
+    for (prev = &cache; (e = *prev); prev = &e->next) {
+        if (e->size == st.st_size && e->mtime == st.st_mtime &&
+            !strcmp(e->path, path)) {
+            /* move it to the front */
+            *prev = e->next;
+            e->next = cache;
+            cache = e;
+            e->refcount++;
+            s->probe_cache = e;
+            s->iformat     = e->iformat;
+            break;
+        }
+    }
+    UNLOCK();
+    if (e)
+        return;
+
+    if (!(e = av_mallocz(sizeof(*e))) || !(e->path = av_strdup(path))) {
+        av_free(e);
+        return;
+    }
+    e->size     = st.st_size;
+    e->mtime    = st.st_mtime;
+    e->refcount = 1;
+    s->probe_cache = e;
+}
+
+static void restore_index(AVFormatContext *s, ProbeCacheEntry *e)
+{
+    int i;
+
+    if (s->flags & AVFMT_FLAG_IGNIDX)
+        return;
+    for (i = 0; i < s->nb_streams; i++) {
+        AVStream *st = s->streams[i];
+        ProbeCacheStream *cs = &e->streams[i];
+        unsigned size = cs->nb_index_entries * sizeof(*cs->index_entries);
+
+        if (st->nb_index_entries || !cs->nb_index_entries)
+            continue;
+        if (!(st->index_entries = av_malloc(size)))
+            continue;
+        memcpy(st->index_entries, cs->index_entries, size);
+        st->nb_index_entries = cs->nb_index_entries;
+        st->index_entries_allocated_size = size;
+    }
+}
+
+void ff_probe_cache_header_read(AVFormatContext *s)
+{
+    ProbeCacheEntry *e = s->probe_cache;
+    unsigned nb_hits, nb_misses;
+    int i;
+
+    if (!e)
+        return;
+
+    if (e->cached) {
+        for (i = 0; i < s->nb_streams && i < e->nb_streams; i++)
+            if (s->streams[i]->codec->codec_id != e->streams[i].header_codec_id)
+                break;
+        if (i == s->nb_streams && i == e->nb_streams) {
+            restore_index(s, e);
+            LOCK();
+            nb_hits   = ++hits;
+            nb_misses = misses;
+            UNLOCK();
+            av_log(s, AV_LOG_VERBOSE, "Probe cache hit for %s (%u hits, %u misses)\n",
+                   e->path, nb_hits, nb_misses);
+            return;
+        }
+        /* the file was replaced without changing size nor mtime */
+        LOCK();
+        unref_entry(e);
+        UNLOCK();
+        s->probe_cache = NULL;
+        return;
+    }
+
+    LOCK();
+    nb_hits   = hits;
+    nb_misses = ++misses;
+    UNLOCK();
+    av_log(s, AV_LOG_VERBOSE, "Probe cache miss for %s (%u hits, %u misses)\n",
+           e->path, nb_hits, nb_misses);
+
+    e->iformat    = s->iformat;
+    e->nb_streams = s->nb_streams;
+    if (!(e->streams = av_mallocz(s->nb_streams * sizeof(*e->streams)))) {
+        ff_probe_cache_close(s);
+        return;
+    }
+    for (i = 0; i < s->nb_streams; i++)
+        e->streams[i].header_codec_id = s->streams[i]->codec->codec_id;
+}
+
+int ff_probe_cache_has_index(AVFormatContext *s)
+{
+    ProbeCacheEntry *e = s->probe_cache;
+    int i;
+
+    if (!e || !e->cached || (s->flags & AVFMT_FLAG_IGNIDX))
+        return 0;
+    for (i = 0; i < e->nb_streams; i++)
+        if (e->streams[i].nb_index_entries)
+            return 1;
+    return 0;
+}
+
+int ff_probe_cache_apply(AVFormatContext *s)
+{
+    ProbeCacheEntry *e = s->probe_cache;
+    int i;
+
+    if (!e || !e->cached)
+        return 0;
+
+    for (i = 0; i < s->nb_streams; i++) {
+        AVStream *st = s->streams[i];
+        AVCodecContext *dst = st->codec;
+        ProbeCacheStream *cs = &e->streams[i];
+        const AVCodecContext *src = cs->codec;
+
+#define COPY(x) dst->x = src->x
+        COPY(codec_type);
+        COPY(codec_id);
+        COPY(codec_tag);
+        COPY(stream_codec_tag);
+        COPY(bit_rate);
+        COPY(width);
+        COPY(height);
+        COPY(coded_width);
+        COPY(coded_height);
+        COPY(pix_fmt);
+        COPY(has_b_frames);
+        COPY(sample_aspect_ratio);
+        COPY(time_base);
+        COPY(ticks_per_frame);
+        COPY(sample_rate);
+        COPY(channels);
+        COPY(channel_layout);
+        COPY(sample_fmt);
+        COPY(frame_size);
+        COPY(block_align);
+        COPY(bits_per_coded_sample);
+        COPY(bits_per_raw_sample);
+        COPY(profile);
+        COPY(level);
+        COPY(refs);
+        COPY(sub_id);
+        COPY(audio_service_type);
+        COPY(chroma_sample_location);
+        COPY(color_primaries);
+        COPY(color_trc);
+        COPY(colorspace);
+        COPY(color_range);
+#undef COPY
+        /* extradata split from the first packets */
+        if (!dst->extradata && src->extradata) {
+            dst->extradata = av_mallocz(src->extradata_size + FF_INPUT_BUFFER_PADDING_SIZE);
+            if (dst->extradata) {
+                memcpy(dst->extradata, src->extradata, src->extradata_size);
+                dst->extradata_size = src->extradata_size;
+            }
+        }
+
+        st->r_frame_rate         = cs->r_frame_rate;
+        st->avg_frame_rate       = cs->avg_frame_rate;
+        st->sample_aspect_ratio  = cs->sample_aspect_ratio;
+        st->start_time           = cs->start_time;
+        st->duration             = cs->duration;
+        st->disposition          = cs->disposition;
+        st->codec_info_nb_frames = cs->codec_info_nb_frames;
+    }
+    s->start_time = e->start_time;
+    s->duration   = e->duration;
+    s->file_size  = e->file_size;
+    s->bit_rate   = e->bit_rate;
+    return 1;
+}
+
+void ff_probe_cache_store(AVFormatContext *s)
+{
+    ProbeCacheEntry *e = s->probe_cache, **prev;
+    int i;
+
+    /* streams found while probing cannot be created on the next open */
+    if (!e || e->cached || !e->streams || e->nb_streams != s->nb_streams)
+        return;
+
+    for (i = 0; i < s->nb_streams; i++) {
+        AVStream *st = s->streams[i];
+        ProbeCacheStream *cs = &e->streams[i];
+        unsigned size = st->nb_index_entries * sizeof(*st->index_entries);
+        int ret;
+
+        if (!(cs->codec = avcodec_alloc_context()))
+            return;
+        ret = avcodec_copy_context(cs->codec, st->codec);
+        /* not duplicated by avcodec_copy_context() and not needed */
+        cs->codec->subtitle_header      = NULL;
+        cs->codec->subtitle_header_size = 0;
+        if (ret < 0)
+            return;
+        if (size) {
+            if (!(cs->index_entries = av_malloc(size)))
+                return;
+            memcpy(cs->index_entries, st->index_entries, size);
+            cs->nb_index_entries = st->nb_index_entries;
+        }
+        cs->r_frame_rate         = st->r_frame_rate;
+        cs->avg_frame_rate       = st->avg_frame_rate;
+        cs->sample_aspect_ratio  = st->sample_aspect_ratio;
+        cs->start_time           = st->start_time;
+        cs->duration             = st->duration;
+        cs->disposition          = st->disposition;
+        cs->codec_info_nb_frames = st->codec_info_nb_frames;
+    }
+    e->start_time = s->start_time;
+    e->duration   = s->duration;
+    e->file_size  = s->file_size;
+    e->bit_rate   = s->bit_rate;
+
+    LOCK();
+    /* replace an older entry for the same file */
+    for (prev = &cache; *prev; prev = &(*prev)->next) {
+        ProbeCacheEntry *old = *prev;
+        if (!strcmp(old->path, e->path)) {
+            *prev = old->next;
+            nb_entries--;
+            unref_entry(old);
+            break;
+        }
+    }
+    e->cached = 1;
+    e->refcount++;
+    e->next = cache;
+    cache = e;
+    if (++nb_entries > PROBE_CACHE_MAX_ENTRIES) {
+        for (prev = &cache; (*prev)->next; prev = &(*prev)->next)
+            ;
+        unref_entry(*prev);
+        *prev = NULL;
+        nb_entries--;
+    }
+    UNLOCK();
+}
+
+void ff_probe_cache_close(AVFormatContext *s)
+{
+    if (!s->probe_cache)
+        return;
+    LOCK();
+    unref_entry(s->probe_cache);
+    UNLOCK();
+    s->probe_cache = NULL;
+}
+
+void av_probe_cache_stats(unsigned *nb_hits, unsigned *nb_misses)
+{
+    LOCK();
+    *nb_hits   = hits;
+    *nb_misses = misses;
+    UNLOCK();
+}
+
+void av_probe_cache_flush(void)
+{
+    LOCK();
+    while (cache) {
+        ProbeCacheEntry *e = cache;
+        cache = e->next;
+        unref_entry(e);
+    }
+    nb_entries = 0;
+    UNLOCK();
+}
@@ -0,0 +1,58 @@
+/*
+ * In-process cache of the probing results of local files
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFORMAT_PROBECACHE_H
+#define AVFORMAT_PROBECACHE_H
+
+#include "avformat.h"
+
+/**
+ * Look filename up in the cache when AVFMT_FLAG_PROBE_CACHE is set.
+ * On a hit s->iformat is set, so the format is not probed.
+ */
+void ff_probe_cache_open(AVFormatContext *s, const char *filename);
+
+/**
+ * Check the streams created by read_header() against the cache entry and
+ * restore the cached seek index, or remember them for ff_probe_cache_store().
+ */
+void ff_probe_cache_header_read(AVFormatContext *s);
+
+/**
+ * @return 1 if the seek index of s is restored from the cache, so the
+ *         demuxer does not need to read it from the file
+ */
+int ff_probe_cache_has_index(AVFormatContext *s);
+
+/**
+ * Set the stream parameters found by avformat_find_stream_info() on a
+ * previous open.
+ * @return 1 if they were set, 0 if the file has to be probed
+ */
+int ff_probe_cache_apply(AVFormatContext *s);
+
+/**
+ * Store the results of avformat_find_stream_info() for the next opens.
+ */
+void ff_probe_cache_store(AVFormatContext *s);
+
+void ff_probe_cache_close(AVFormatContext *s);
+
+#endif /* AVFORMAT_PROBECACHE_H */
@@ -60,6 +60,14 @@ typedef struct URLProtocol {
     const AVClass *priv_data_class;
     int flags;
     int (*url_check)(URLContext *h, int mask);
+    /**
+     * Return in *data a pointer to up to size bytes at the current
+     * position and advance it, for protocols whose data is mapped in
+     * memory. The data stays valid until the context is closed and must
+     * not be written to.
+     * @return the number of bytes, 0 at the end, or a negative AVERROR
+     */
+    int (*url_read_map)(URLContext *h, uint8_t **data, int size);
 } URLProtocol;
 #endif
 
@@ -34,6 +34,7 @@
 #include "libavutil/avstring.h"
 #include "riff.h"
 #include "audiointerleave.h"
+#include "probecache.h"
 #include "url.h"
 #include <sys/time.h>
 #include <time.h>
@@ -42,6 +43,9 @@
 #if CONFIG_NETWORK
 #include "network.h"
 #endif
+#if HAVE_PTHREADS
+#include <pthread.h>
+#endif
 
 #undef NDEBUG
 #include <assert.h>
@@ -561,6 +565,7 @@ int av_demuxer_open(AVFormatContext *ic, AVFormatParameters *ap){
         if (err < 0)
             return err;
     }
+    ff_probe_cache_header_read(ic);
 
     if (ic->pb && !ic->data_offset)
         ic->data_offset = avio_tell(ic->pb);
@@ -710,6 +715,8 @@ int avformat_open_input(AVFormatContext **ps, const char *filename, AVInputForma
     if ((ret = av_opt_set_dict(s, &tmp)) < 0)
         goto fail;
 
+    ff_probe_cache_open(s, filename);
+
     if ((ret = init_input(s, filename)) < 0)
         goto fail;
 
@@ -746,6 +753,9 @@ int avformat_open_input(AVFormatContext **ps, const char *filename, AVInputForma
         if ((ret = s->iformat->read_header(s, &ap)) < 0)
             goto fail;
 
+    if (!(s->flags&AVFMT_FLAG_PRIV_OPT))
+        ff_probe_cache_header_read(s);
+
     if (!(s->flags&AVFMT_FLAG_PRIV_OPT) && s->pb && !s->data_offset)
         s->data_offset = avio_tell(s->pb);
 
@@ -1194,6 +1204,8 @@ static void compute_pkt_fields(AVFormatContext *s, AVStream *st,
 }
 
 
+static void probe_threads_run(struct ProbeThreads *p);
+
 static int av_read_frame_internal(AVFormatContext *s, AVPacket *pkt)
 {
     AVStream *st;
@@ -1204,6 +1216,9 @@ static int av_read_frame_internal(AVFormatContext *s, AVPacket *pkt)
     for(;;) {
         /* select current input stream component */
         st = s->cur_st;
+        /* avformat_find_stream_info() may still be decoding a packet of st */
+        if (st && st->info && st->info->decode_pending)
+            probe_threads_run(s->probe_thread_pool);
         if (st) {
             if (!st->need_parsing || !st->parser) {
                 /* no parsing needed: we just output the packet as is */
@@ -1269,6 +1284,7 @@ static int av_read_frame_internal(AVFormatContext *s, AVPacket *pkt)
             if (ret < 0) {
                 if (ret == AVERROR(EAGAIN))
                     return ret;
+                probe_threads_run(s->probe_thread_pool);
                 /* return the last frames, if any */
                 for(i = 0; i < s->nb_streams; i++) {
                     st = s->streams[i];
@@ -2187,29 +2203,43 @@ static int has_codec_parameters(AVCodecContext *enc)
     return enc->codec_id != CODEC_ID_NONE && val != 0;
 }
 
-static int has_decode_delay_been_guessed(AVStream *st)
+static int decode_delay_guessed(AVStream *st, int nb_frames)
 {
     return st->codec->codec_id != CODEC_ID_H264 ||
-        st->codec_info_nb_frames >= 6 + st->codec->has_b_frames;
+        nb_frames >= 6 + st->codec->has_b_frames;
 }
 
-static int try_decode_frame(AVStream *st, AVPacket *avpkt, AVDictionary **options)
+static int has_decode_delay_been_guessed(AVStream *st)
+{
+    return decode_delay_guessed(st, st->codec_info_nb_frames);
+}
+
+static int open_probe_decoder(AVStream *st, AVDictionary **options)
 {
-    int16_t *samples;
     AVCodec *codec;
-    int got_picture, data_size, ret=0;
-    AVFrame picture;
 
     if(!st->codec->codec){
         codec = avcodec_find_decoder(st->codec->codec_id);
         if (!codec)
             return -1;
-        ret = avcodec_open2(st->codec, codec, options);
-        if (ret < 0)
-            return ret;
+        return avcodec_open2(st->codec, codec, options);
     }
+    return 0;
+}
 
-    if(!has_codec_parameters(st->codec) || !has_decode_delay_been_guessed(st)){
+/**
+ * Decode a packet with the decoder opened by open_probe_decoder() unless
+ * the parameters are known already.
+ * @param nb_frames number of packets of the stream preceding avpkt
+ */
+static int try_decode_frame(AVStream *st, AVPacket *avpkt, int nb_frames)
+{
+    int16_t *samples;
+    int got_picture, data_size, ret=0;
+    AVFrame picture;
+    int64_t start = av_gettime();
+
+    if(!has_codec_parameters(st->codec) || !decode_delay_guessed(st, nb_frames)){
         switch(st->codec->codec_type) {
         case AVMEDIA_TYPE_VIDEO:
             avcodec_get_frame_defaults(&picture);
@@ -2230,9 +2260,163 @@ static int try_decode_frame(AVStream *st, AVPacket *avpkt, AVDictionary **option
         }
     }
  fail:
+    st->info->decode_time += av_gettime() - start;
     return ret;
 }
 
+#if HAVE_PTHREADS
+/* upper bound on the threads decoding streams in avformat_find_stream_info() */
+#define PROBE_MAX_THREADS 16
+
+/**
+ * Threads decoding the packets queued for different streams in parallel.
+ * Reading and parsing stay in the calling thread, which waits for the
+ * queued packets to be decoded before it touches the codec context of a
+ * stream again, so the probing result does not depend on the threads.
+ */
+typedef struct ProbeThreads {
+    AVFormatContext *ic;
+    pthread_t threads[PROBE_MAX_THREADS];
+    int nb_threads;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;    ///< signaled when decoding starts, finishes or exits
+    int next_stream;        ///< next stream to look for a queued packet at
+    int nb_streams;         ///< streams being decoded, 0 when idle
+    int nb_pending;         ///< queued packets not decoded yet
+    int quit;
+} ProbeThreads;
+
+static AVStream *probe_next_stream(ProbeThreads *p)
+{
+    while (p->next_stream < p->nb_streams) {
+        AVStream *st = p->ic->streams[p->next_stream++];
+        if (st->info->decode_pending)
+            return st;
+    }
+    return NULL;
+}
+
+static void *probe_worker(void *arg)
+{
+    ProbeThreads *p = arg;
+    AVStream *st;
+
+    pthread_mutex_lock(&p->mutex);
+    for (;;) {
+        while (!p->quit && !(st = probe_next_stream(p)))
+            pthread_cond_wait(&p->cond, &p->mutex);
+        if (p->quit)
+            break;
+        pthread_mutex_unlock(&p->mutex);
+        try_decode_frame(st, st->info->pending_pkt, st->info->pending_nb_frames);
+        pthread_mutex_lock(&p->mutex);
+        if (!--p->nb_pending)
+            pthread_cond_broadcast(&p->cond);
+    }
+    pthread_mutex_unlock(&p->mutex);
+    return NULL;
+}
+
+static ProbeThreads *probe_threads_init(AVFormatContext *ic)
+{
+    ProbeThreads *p;
+    int i, nb_threads = ic->probe_threads ? ic->probe_threads : ic->nb_streams;
+
+    nb_threads = FFMIN(nb_threads, PROBE_MAX_THREADS);
+    if (nb_threads <= 1 || !(p = av_mallocz(sizeof(*p))))
+        return NULL;
+    p->ic = ic;
+    pthread_mutex_init(&p->mutex, NULL);
+    pthread_cond_init(&p->cond, NULL);
+    /* the calling thread decodes too */
+    for (i = 0; i < nb_threads - 1; i++) {
+        if (pthread_create(&p->threads[i], NULL, probe_worker, p))
+            break;
+        p->nb_threads++;
+    }
+    if (!p->nb_threads) {
+        pthread_cond_destroy(&p->cond);
+        pthread_mutex_destroy(&p->mutex);
+        av_freep(&p);
+    }
+    return p;
+}
+
+/**
+ * Decode the queued packets and wait for all of them.
+ */
+static void probe_threads_run(ProbeThreads *p)
+{
+    AVStream *st;
+    int i;
+
+    if (!p || !p->nb_pending)
+        return;
+    pthread_mutex_lock(&p->mutex);
+    p->next_stream = 0;
+    p->nb_streams  = p->ic->nb_streams;
+    pthread_cond_broadcast(&p->cond);
+    while ((st = probe_next_stream(p))) {
+        pthread_mutex_unlock(&p->mutex);
+        try_decode_frame(st, st->info->pending_pkt, st->info->pending_nb_frames);
+        pthread_mutex_lock(&p->mutex);
+        p->nb_pending--;
+    }
+    while (p->nb_pending)
+        pthread_cond_wait(&p->cond, &p->mutex);
+    p->nb_streams = 0;
+    pthread_mutex_unlock(&p->mutex);
+
+    for (i = 0; i < p->ic->nb_streams; i++)
+        p->ic->streams[i]->info->decode_pending = 0;
+}
+
+static void probe_threads_free(ProbeThreads **pp)
+{
+    ProbeThreads *p = *pp;
+    int i;
+
+    if (!p)
+        return;
+    probe_threads_run(p);
+    pthread_mutex_lock(&p->mutex);
+    p->quit = 1;
+    pthread_cond_broadcast(&p->cond);
+    pthread_mutex_unlock(&p->mutex);
+    for (i = 0; i < p->nb_threads; i++)
+        pthread_join(p->threads[i], NULL);
+    pthread_cond_destroy(&p->cond);
+    pthread_mutex_destroy(&p->mutex);
+    av_freep(pp);
+}
+#else
+typedef struct ProbeThreads {
+    int nb_pending;
+} ProbeThreads;
+
+static ProbeThreads *probe_threads_init(AVFormatContext *ic) { return NULL; }
+static void probe_threads_run(ProbeThreads *p) { }
+static void probe_threads_free(ProbeThreads **pp) { }
+#endif
+
+/**
+ * Decode pkt for st, right away or with the probe threads if there are.
+ */
+static void queue_probe_decode(ProbeThreads *p, AVStream *st, AVPacket *pkt,
+                               AVDictionary **options)
+{
+    if (open_probe_decoder(st, options) < 0)
+        return;
+    if (!p) {
+        try_decode_frame(st, pkt, st->codec_info_nb_frames);
+        return;
+    }
+    st->info->decode_pending    = 1;
+    st->info->pending_pkt       = pkt;
+    st->info->pending_nb_frames = st->codec_info_nb_frames;
+    p->nb_pending++;
+}
+
 unsigned int ff_codec_get_tag(const AVCodecTag *tags, enum CodecID id)
 {
     while (tags->id != CODEC_ID_NONE) {
@@ -2323,6 +2507,34 @@ static int tb_unreliable(AVCodecContext *c){
     return 0;
 }
 
+/**
+ * Check whether more packets of st are needed to find its parameters.
+ */
+static int stream_info_needed(AVFormatContext *ic, AVStream *st)
+{
+    int fps_analyze_framecount = 20;
+
+    if (!has_codec_parameters(st->codec))
+        return 1;
+    /* if the timebase is coarse (like the usual millisecond precision
+       of mkv), we need to analyze more frames to reliably arrive at
+       the correct fps */
+    if (av_q2d(st->time_base) > 0.0005)
+        fps_analyze_framecount *= 2;
+    if (ic->fps_probe_size >= 0)
+        fps_analyze_framecount = ic->fps_probe_size;
+    /* variable fps and no guess at the real fps */
+    if(   tb_unreliable(st->codec) && !(st->r_frame_rate.num && st->avg_frame_rate.num)
+       && st->info->duration_count < fps_analyze_framecount
+       && st->codec->codec_type == AVMEDIA_TYPE_VIDEO)
+        return 1;
+    if(st->parser && st->parser->parser->split && !st->codec->extradata)
+        return 1;
+    if(st->first_dts == AV_NOPTS_VALUE)
+        return 1;
+    return 0;
+}
+
 #if FF_API_FORMAT_PARAMETERS
 int av_find_stream_info(AVFormatContext *ic)
 {
@@ -2337,6 +2549,12 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
     AVPacket pkt1, *pkt;
     int64_t old_offset = avio_tell(ic->pb);
     int orig_nb_streams = ic->nb_streams;        // new streams might appear, no options for those
+    int64_t start_time = av_gettime();
+    ProbeThreads *probe;
+
+    /* the file was probed when it was opened before */
+    if (ff_probe_cache_apply(ic))
+        return 0;
 
     for(i=0;i<ic->nb_streams;i++) {
         AVCodec *codec;
@@ -2384,42 +2602,38 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
 
     for (i=0; i<ic->nb_streams; i++) {
         ic->streams[i]->info->last_dts = AV_NOPTS_VALUE;
+        ic->streams[i]->info->ready_time = AV_NOPTS_VALUE;
     }
 
+    ic->probe_thread_pool = probe = probe_threads_init(ic);
+
     count = 0;
     read_size = 0;
     for(;;) {
+        int ready = 1;
+
         if(url_interrupt_cb()){
             ret= AVERROR_EXIT;
             av_log(ic, AV_LOG_DEBUG, "interrupted\n");
             break;
         }
 
-        /* check if one codec still needs to be handled */
+        /* check if one codec still needs to be handled, streams with a
+           packet being decoded are checked once it is if all others are done */
         for(i=0;i<ic->nb_streams;i++) {
-            int fps_analyze_framecount = 20;
-
             st = ic->streams[i];
-            if (!has_codec_parameters(st->codec))
-                break;
-            /* if the timebase is coarse (like the usual millisecond precision
-               of mkv), we need to analyze more frames to reliably arrive at
-               the correct fps */
-            if (av_q2d(st->time_base) > 0.0005)
-                fps_analyze_framecount *= 2;
-            if (ic->fps_probe_size >= 0)
-                fps_analyze_framecount = ic->fps_probe_size;
-            /* variable fps and no guess at the real fps */
-            if(   tb_unreliable(st->codec) && !(st->r_frame_rate.num && st->avg_frame_rate.num)
-               && st->info->duration_count < fps_analyze_framecount
-               && st->codec->codec_type == AVMEDIA_TYPE_VIDEO)
-                break;
-            if(st->parser && st->parser->parser->split && !st->codec->extradata)
-                break;
-            if(st->first_dts == AV_NOPTS_VALUE)
-                break;
+            if (st->info->decode_pending)
+                continue;
+            if (stream_info_needed(ic, st))
+                ready = 0;
+            else if (st->info->ready_time == AV_NOPTS_VALUE)
+                st->info->ready_time = av_gettime() - start_time;
         }
-        if (i == ic->nb_streams) {
+        if (ready && probe && probe->nb_pending) {
+            probe_threads_run(probe);
+            continue;
+        }
+        if (ready) {
             /* NOTE: if the format has no header, then we need to read
                some packets to get most of the streams, so we cannot
                stop here */
@@ -2436,12 +2650,18 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
             av_log(ic, AV_LOG_DEBUG, "Probe buffer size limit %d reached\n", ic->probesize);
             break;
         }
+        if (ic->probe_time && av_gettime() - start_time >= ic->probe_time * 1000LL) {
+            ret = count;
+            av_log(ic, AV_LOG_DEBUG, "Probe time limit %d ms reached\n", ic->probe_time);
+            break;
+        }
 
         /* NOTE: a new stream can be added there if no header in file
            (AVFMTCTX_NOHEADER) */
         ret = av_read_frame_internal(ic, &pkt1);
         if (ret < 0 && ret != AVERROR(EAGAIN)) {
             /* EOF or error */
+            probe_threads_run(probe);
             ret = -1; /* we could not have all the codec parameters before EOF */
             for(i=0;i<ic->nb_streams;i++) {
                 st = ic->streams[i];
@@ -2514,12 +2734,30 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
            it takes longer and uses more memory. For MPEG-4, we need to
            decompress for QuickTime. */
         if (!has_codec_parameters(st->codec) || !has_decode_delay_been_guessed(st))
-            try_decode_frame(st, pkt, (options && i < orig_nb_streams )? &options[i] : NULL);
+            queue_probe_decode(probe, st, pkt, (options && pkt->stream_index < orig_nb_streams) ?
+                               &options[pkt->stream_index] : NULL);
 
         st->codec_info_nb_frames++;
         count++;
     }
 
+    probe_threads_free(&probe);
+    ic->probe_thread_pool = NULL;
+
+    for (i = 0; i < ic->nb_streams; i++) {
+        st = ic->streams[i];
+        if (st->info->ready_time == AV_NOPTS_VALUE && !stream_info_needed(ic, st))
+            st->info->ready_time = av_gettime() - start_time;
+        if (st->info->ready_time != AV_NOPTS_VALUE)
+            av_log(ic, AV_LOG_VERBOSE, "Stream #%d: parameters found after %.1f ms, "
+                   "%d packets read, %.1f ms decoding\n", i, st->info->ready_time / 1000.0,
+                   st->codec_info_nb_frames, st->info->decode_time / 1000.0);
+        else
+            av_log(ic, AV_LOG_VERBOSE, "Stream #%d: parameters not found after %.1f ms, "
+                   "%d packets read, %.1f ms decoding\n", i, (av_gettime() - start_time) / 1000.0,
+                   st->codec_info_nb_frames, st->info->decode_time / 1000.0);
+    }
+
     // close codecs which were opened in try_decode_frame()
     for(i=0;i<ic->nb_streams;i++) {
         st = ic->streams[i];
@@ -2624,7 +2862,12 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
     }
 #endif
 
+    if (ret >= 0)
+        ff_probe_cache_store(ic);
+
  find_stream_info_err:
+    probe_threads_free(&probe);
+    ic->probe_thread_pool = NULL;
     for (i=0; i < ic->nb_streams; i++)
         av_freep(&ic->streams[i]->info);
     return ret;
@@ -2734,6 +2977,12 @@ void avformat_free_context(AVFormatContext *s)
     for(i=0;i<s->nb_streams;i++) {
         /* free all data in a stream component */
         st = s->streams[i];
+        while (st->first_in_packet_buffer) {
+            AVPacketList *pktl = st->first_in_packet_buffer;
+            st->first_in_packet_buffer = pktl->next;
+            av_free_packet(&pktl->pkt);
+            av_free(pktl);
+        }
         if (st->parser) {
             av_parser_close(st->parser);
             av_free_packet(&st->cur_pkt);
@@ -2770,6 +3019,13 @@ void avformat_free_context(AVFormatContext *s)
     }
     av_freep(&s->chapters);
     av_metadata_free(&s->metadata);
+    while (s->packet_pool) {
+        AVPacketList *pktl = s->packet_pool;
+        s->packet_pool = pktl->next;
+        av_free(pktl);
+    }
+    av_freep(&s->interleave_heap);
+    ff_probe_cache_close(s);
 //    av_freep(&s->key);
     av_free(s);
 }
@@ -3245,40 +3501,109 @@ int av_write_frame(AVFormatContext *s, AVPacket *pkt)
     return ret;
 }
 
-void ff_interleave_add_packet(AVFormatContext *s, AVPacket *pkt,
-                              int (*compare)(AVFormatContext *, AVPacket *, AVPacket *))
+/* The interleaving queue is a FIFO of packets per stream, plus a min-heap
+   of the streams with queued packets ordered by their first packet, so a
+   packet is queued in O(1) and taken out in O(log(nb_streams)). */
+
+static int interleave_heap_less(AVFormatContext *s, int a, int b)
+{
+    return s->interleave_compare(s, &s->streams[b]->first_in_packet_buffer->pkt,
+                                    &s->streams[a]->first_in_packet_buffer->pkt);
+}
+
+static void interleave_heap_up(AVFormatContext *s, int i)
+{
+    int *heap = s->interleave_heap;
+
+    while (i > 0) {
+        int parent = (i - 1) >> 1;
+        if (!interleave_heap_less(s, heap[i], heap[parent]))
+            break;
+        FFSWAP(int, heap[i], heap[parent]);
+        i = parent;
+    }
+}
+
+static void interleave_heap_down(AVFormatContext *s, int i)
+{
+    int *heap = s->interleave_heap;
+
+    for (;;) {
+        int child = 2*i + 1;
+        if (child >= s->nb_interleave_heap)
+            break;
+        if (child + 1 < s->nb_interleave_heap &&
+            interleave_heap_less(s, heap[child + 1], heap[child]))
+            child++;
+        if (!interleave_heap_less(s, heap[child], heap[i]))
+            break;
+        FFSWAP(int, heap[i], heap[child]);
+        i = child;
+    }
+}
+
+int ff_interleave_add_packet(AVFormatContext *s, AVPacket *pkt,
+                             int (*compare)(AVFormatContext *, AVPacket *, AVPacket *))
 {
-    AVPacketList **next_point, *this_pktl;
+    AVStream *st = s->streams[pkt->stream_index];
+    AVPacketList *this_pktl;
 
-    this_pktl = av_mallocz(sizeof(AVPacketList));
-    this_pktl->pkt= *pkt;
+    if (!st->last_in_packet_buffer) {
+        int *heap = av_fast_realloc(s->interleave_heap, &s->interleave_heap_size,
+                                    s->nb_streams * sizeof(*s->interleave_heap));
+        if (!heap)
+            return AVERROR(ENOMEM);
+        s->interleave_heap = heap;
+    }
+
+    this_pktl = s->packet_pool;
+    if (this_pktl) {
+        s->packet_pool = this_pktl->next;
+    } else {
+        this_pktl = av_malloc(sizeof(AVPacketList));
+        if (!this_pktl)
+            return AVERROR(ENOMEM);
+    }
+    this_pktl->pkt = *pkt;
+    this_pktl->next = NULL;
     pkt->destruct= NULL;             // do not free original but only the copy
     av_dup_packet(&this_pktl->pkt);  // duplicate the packet if it uses non-alloced memory
 
-    if(s->streams[pkt->stream_index]->last_in_packet_buffer){
-        next_point = &(s->streams[pkt->stream_index]->last_in_packet_buffer->next);
-    }else
-        next_point = &s->packet_buffer;
-
-    if(*next_point){
-        if(compare(s, &s->packet_buffer_end->pkt, pkt)){
-            while(!compare(s, &(*next_point)->pkt, pkt)){
-                next_point= &(*next_point)->next;
-            }
-            goto next_non_null;
-        }else{
-            next_point = &(s->packet_buffer_end->next);
-        }
+    s->interleave_compare = compare;
+    if (st->last_in_packet_buffer) {
+        /* packets of a stream never need reordering among themselves */
+        st->last_in_packet_buffer->next = this_pktl;
+    } else {
+        st->first_in_packet_buffer = this_pktl;
+        s->interleave_heap[s->nb_interleave_heap++] = pkt->stream_index;
+        interleave_heap_up(s, s->nb_interleave_heap - 1);
     }
-    assert(!*next_point);
+    st->last_in_packet_buffer = this_pktl;
+    return 0;
+}
+
+int ff_interleave_get_packet(AVFormatContext *s, AVPacket *out)
+{
+    AVPacketList *pktl;
+    AVStream *st;
 
-    s->packet_buffer_end= this_pktl;
-next_non_null:
+    if (!s->nb_interleave_heap)
+        return 0;
 
-    this_pktl->next= *next_point;
+    st   = s->streams[s->interleave_heap[0]];
+    pktl = st->first_in_packet_buffer;
+    *out = pktl->pkt;
 
-    s->streams[pkt->stream_index]->last_in_packet_buffer=
-    *next_point= this_pktl;
+    st->first_in_packet_buffer = pktl->next;
+    if (!pktl->next) {
+        st->last_in_packet_buffer = NULL;
+        s->interleave_heap[0] = s->interleave_heap[--s->nb_interleave_heap];
+    }
+    interleave_heap_down(s, 0);
+
+    pktl->next = s->packet_pool;
+    s->packet_pool = pktl;
+    return 1;
 }
 
 static int ff_interleave_compare_dts(AVFormatContext *s, AVPacket *next, AVPacket *pkt)
@@ -3294,29 +3619,17 @@ static int ff_interleave_compare_dts(AVFormatContext *s, AVPacket *next, AVPacke
 }
 
 int av_interleave_packet_per_dts(AVFormatContext *s, AVPacket *out, AVPacket *pkt, int flush){
-    AVPacketList *pktl;
-    int stream_count=0;
-    int i;
+    int stream_count, ret;
 
     if(pkt){
-        ff_interleave_add_packet(s, pkt, ff_interleave_compare_dts);
+        if ((ret = ff_interleave_add_packet(s, pkt, ff_interleave_compare_dts)) < 0)
+            return ret;
     }
 
-    for(i=0; i < s->nb_streams; i++)
-        stream_count+= !!s->streams[i]->last_in_packet_buffer;
+    stream_count = s->nb_interleave_heap;
 
     if(stream_count && (s->nb_streams == stream_count || flush)){
-        pktl= s->packet_buffer;
-        *out= pktl->pkt;
-
-        s->packet_buffer= pktl->next;
-        if(!s->packet_buffer)
-            s->packet_buffer_end= NULL;
-
-        if(s->streams[out->stream_index]->last_in_packet_buffer == pktl)
-            s->streams[out->stream_index]->last_in_packet_buffer= NULL;
-        av_freep(&pktl);
-        return 1;
+        return ff_interleave_get_packet(s, out);
     }else{
         av_init_packet(out);
         return 0;
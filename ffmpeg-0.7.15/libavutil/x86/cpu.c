@@ -25,7 +25,8 @@
 #include "libavutil/x86_cpu.h"
 #include "libavutil/cpu.h"
 
-/* ebx saving is necessary for PIC. gcc seems unable to see it alone */
+/* ebx saving is necessary for PIC. gcc seems unable to see it alone.
+ * ecx selects the subleaf of leaf 7 and is ignored by the others. */
 #define cpuid(index,eax,ebx,ecx,edx)\
     __asm__ volatile\
         ("mov %%"REG_b", %%"REG_S"\n\t"\
@@ -33,7 +34,7 @@
          "xchg %%"REG_b", %%"REG_S\
          : "=a" (eax), "=S" (ebx),\
            "=c" (ecx), "=d" (edx)\
-         : "0" (index));
+         : "0" (index), "2" (0));
 
 #define xgetbv(index,eax,edx)                                   \
     __asm__ (".byte 0x0f, 0x01, 0xd0" : "=a"(eax), "=d"(edx) : "c" (index))
@@ -104,6 +105,13 @@ int ff_get_cpu_flags_x86(void)
             if ((eax & 0x6) == 0x6)
                 rval |= AV_CPU_FLAG_AVX;
         }
+#if HAVE_AVX2
+        if (max_std_level >= 7 && rval & AV_CPU_FLAG_AVX) {
+            cpuid(7, eax, ebx, ecx, edx);
+            if (ebx & 0x00000020)
+                rval |= AV_CPU_FLAG_AVX2;
+        }
+#endif
 #endif
 #endif
                   ;
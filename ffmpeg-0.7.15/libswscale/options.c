@@ -62,6 +62,7 @@ static const AVOption options[] = {
     { "dst_range" , "destination range" , OFFSET(dstRange) , FF_OPT_TYPE_INT, {.dbl = DEFAULT }, 0, 1, VE },
     { "param0" , "scaler param 0" , OFFSET(param[0]) , FF_OPT_TYPE_DOUBLE, {.dbl = SWS_PARAM_DEFAULT}, INT_MIN, INT_MAX, VE },
     { "param1" , "scaler param 1" , OFFSET(param[1]) , FF_OPT_TYPE_DOUBLE, {.dbl = SWS_PARAM_DEFAULT}, INT_MIN, INT_MAX, VE },
+    { "threads", "number of threads scaling a frame", OFFSET(thread_count), FF_OPT_TYPE_INT, {.dbl = 1 }, 1, INT_MAX, VE },
 
     { NULL }
 };
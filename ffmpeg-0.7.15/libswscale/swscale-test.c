@@ -23,14 +23,17 @@
 #include <string.h>
 #include <inttypes.h>
 #include <stdarg.h>
+#include <sys/time.h>
 
 #undef HAVE_AV_CONFIG_H
 #include "libavutil/imgutils.h"
 #include "libavutil/mem.h"
 #include "libavutil/avutil.h"
+#include "libavutil/cpu.h"
 #include "libavutil/crc.h"
 #include "libavutil/pixdesc.h"
 #include "libavutil/lfg.h"
+#include "libavutil/opt.h"
 #include "swscale.h"
 
 /* HACK Duplicated from swscale_internal.h.
@@ -335,6 +338,113 @@ static int fileTest(uint8_t *ref[4], int refStride[4], int w, int h, FILE *fp,
 #define W 96
 #define H 96
 
+#define BENCH_SRC_W 3840
+#define BENCH_SRC_H 2160
+#define BENCH_DST_W 1280
+#define BENCH_DST_H  720
+#define BENCH_FRAMES  50
+
+static int64_t gettime(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+// scale a 2160p frame to 720p with 1 to max_threads threads
+static int benchmark(int max_threads, enum PixelFormat srcFormat,
+                     enum PixelFormat dstFormat)
+{
+    uint8_t *src[4] = {0}, *dst[4] = {0};
+    int srcStride[4], dstStride[4];
+    uint32_t crc1 = 0;
+    AVLFG rand;
+    int i, j, threads, res = 0;
+
+    if (srcFormat == PIX_FMT_NONE) srcFormat = PIX_FMT_YUV420P;
+    if (dstFormat == PIX_FMT_NONE) dstFormat = PIX_FMT_YUV420P;
+
+    av_lfg_init(&rand, 1);
+    av_image_fill_linesizes(srcStride, srcFormat, BENCH_SRC_W);
+    av_image_fill_linesizes(dstStride, dstFormat, BENCH_DST_W);
+    for (i = 0; i < 4; i++) {
+        if (srcStride[i]) {
+            if (!(src[i] = av_malloc(srcStride[i] * BENCH_SRC_H + 16)))
+                goto nomem;
+            for (j = 0; j < srcStride[i] * BENCH_SRC_H; j++)
+                src[i][j] = av_lfg_get(&rand);
+        }
+        /* An extra 16 bytes is being allocated because some scalers may write
+         * out of bounds. */
+        if (dstStride[i] && !(dst[i] = av_mallocz(dstStride[i] * BENCH_DST_H + 16)))
+            goto nomem;
+    }
+
+    printf("%s %dx%d -> %s %dx%d bicubic, %d frames\n",
+           av_pix_fmt_descriptors[srcFormat].name, BENCH_SRC_W, BENCH_SRC_H,
+           av_pix_fmt_descriptors[dstFormat].name, BENCH_DST_W, BENCH_DST_H,
+           BENCH_FRAMES);
+
+    for (threads = 1; threads <= max_threads; threads++) {
+        struct SwsContext *sws = sws_alloc_context();
+        uint32_t crc = 0;
+        int64_t t;
+
+        if (!sws)
+            goto nomem;
+        av_set_int(sws, "srcw", BENCH_SRC_W);
+        av_set_int(sws, "srch", BENCH_SRC_H);
+        av_set_int(sws, "src_format", srcFormat);
+        av_set_int(sws, "dstw", BENCH_DST_W);
+        av_set_int(sws, "dsth", BENCH_DST_H);
+        av_set_int(sws, "dst_format", dstFormat);
+        av_set_int(sws, "sws_flags", SWS_BICUBIC);
+        av_set_int(sws, "threads", threads);
+        if (sws_init_context(sws, NULL, NULL) < 0) {
+            fprintf(stderr, "Failed to get %s ---> %s\n",
+                    av_pix_fmt_descriptors[srcFormat].name,
+                    av_pix_fmt_descriptors[dstFormat].name);
+            sws_freeContext(sws);
+            res = -1;
+            goto end;
+        }
+        sws_setColorspaceDetails(sws, sws_getCoefficients(SWS_CS_DEFAULT), av_get_int(sws, "src_range", NULL),
+                                      sws_getCoefficients(SWS_CS_DEFAULT), av_get_int(sws, "dst_range", NULL),
+                                 0, 1 << 16, 1 << 16);
+
+        sws_scale(sws, (const uint8_t * const*)src, srcStride, 0, BENCH_SRC_H, dst, dstStride);
+        t = gettime();
+        for (i = 0; i < BENCH_FRAMES; i++)
+            sws_scale(sws, (const uint8_t * const*)src, srcStride, 0, BENCH_SRC_H, dst, dstStride);
+        t = gettime() - t;
+        sws_freeContext(sws);
+
+        for (i = 0; i < 4 && dstStride[i]; i++)
+            crc = av_crc(av_crc_get_table(AV_CRC_32_IEEE), crc, dst[i], dstStride[i] * BENCH_DST_H);
+        if (threads == 1)
+            crc1 = crc;
+
+        // pixel rates are given for the source picture
+        printf(" threads=%2d %7.1f Mpix/s %6.1f fps CRC=%08x%s\n", threads,
+               (double)BENCH_SRC_W * BENCH_SRC_H * BENCH_FRAMES / FFMAX(t, 1),
+               BENCH_FRAMES * 1000000.0 / FFMAX(t, 1),
+               crc, crc != crc1 ? " MISMATCH" : "");
+        if (crc != crc1)
+            res = -1;
+    }
+    goto end;
+
+nomem:
+    perror("Malloc");
+    res = -1;
+end:
+    for (i = 0; i < 4; i++) {
+        av_free(src[i]);
+        av_free(dst[i]);
+    }
+    return res;
+}
+
 int main(int argc, char **argv)
 {
     enum PixelFormat srcFormat = PIX_FMT_NONE;
@@ -349,6 +459,7 @@ int main(int argc, char **argv)
     struct SwsContext *sws;
     AVLFG rand;
     int res = -1;
+    int threads = 0;
     int i;
 
     if (!rgb_data || !data)
@@ -391,6 +502,14 @@ int main(int argc, char **argv)
                 fprintf(stderr, "invalid pixel format %s\n", argv[i+1]);
                 return -1;
             }
+        } else if (!strcmp(argv[i], "-cpuflags")) {
+            av_force_cpu_flags(strtol(argv[i+1], NULL, 0));
+        } else if (!strcmp(argv[i], "-threads")) {
+            threads = atoi(argv[i+1]);
+            if (threads < 1) {
+                fprintf(stderr, "invalid thread count %s\n", argv[i+1]);
+                return -1;
+            }
         } else {
 bad_option:
             fprintf(stderr, "bad option or argument missing (%s)\n", argv[i]);
@@ -398,6 +517,11 @@ bad_option:
         }
     }
 
+    if (threads) {
+        res = benchmark(threads, srcFormat, dstFormat);
+        goto error;
+    }
+
     selfTest(src, stride, W, H, srcFormat, dstFormat);
 end:
     res = 0;
@@ -2188,6 +2188,7 @@ static int swScale(SwsContext *c, const uint8_t* src[],
     const int srcW= c->srcW;
     const int dstW= c->dstW;
     const int dstH= c->dstH;
+    const int dstYEnd= c->dstYEnd ? c->dstYEnd : dstH;
     const int chrDstW= c->chrDstW;
     const int chrSrcW= c->chrSrcW;
     const int lumXInc= c->lumXInc;
@@ -2270,14 +2271,14 @@ static int swScale(SwsContext *c, const uint8_t* src[],
     if (srcSliceY ==0) {
         lumBufIndex=-1;
         chrBufIndex=-1;
-        dstY=0;
+        dstY= c->dstYStart;
         lastInLumBuf= -1;
         lastInChrBuf= -1;
     }
 
     lastDstY= dstY;
 
-    for (;dstY < dstH; dstY++) {
+    for (;dstY < dstYEnd; dstY++) {
         unsigned char *dest =dst[0]+dstStride[0]*dstY;
         const int chrDstY= dstY>>c->chrDstVSubSample;
         unsigned char *uDest=dst[1]+dstStride[1]*chrDstY;
@@ -2293,6 +2294,7 @@ static int swScale(SwsContext *c, const uint8_t* src[],
         int lastLumSrcY2=firstLumSrcY2+ vLumFilterSize -1; // Last line needed as input
         int lastChrSrcY= firstChrSrcY + vChrFilterSize -1; // Last line needed as input
         int enough_lines;
+        uint8_t *bandDest[4]= { NULL };
 
         //handle holes (FAST_BILINEAR & weird filters)
         if (firstLumSrcY > lastInLumBuf) lastInLumBuf= firstLumSrcY-1;
@@ -2369,6 +2371,14 @@ static int swScale(SwsContext *c, const uint8_t* src[],
             find_c_packed_planar_out_funcs(c, &yuv2yuv1, &yuv2yuvX,
                                            &yuv2packed1, &yuv2packed2,
                                            &yuv2packedX);
+        } else if (dstYEnd < dstH && dstY >= dstYEnd - (1<<c->chrDstVSubSample)) {
+            /* The next luma or chroma line belongs to another band, which
+             * may be output concurrently, so do not let the SIMD code write
+             * past the end of the line: output to a temporary line instead. */
+            bandDest[0]= dest;  dest = c->bandLineBuf[0];
+            bandDest[1]= uDest; uDest= c->bandLineBuf[1];
+            bandDest[2]= vDest; vDest= c->bandLineBuf[2];
+            bandDest[3]= aDest; aDest= aDest ? c->bandLineBuf[3] : NULL;
         }
 
         {
@@ -2422,6 +2432,18 @@ static int swScale(SwsContext *c, const uint8_t* src[],
                 }
             }
         }
+        if (bandDest[0]) {
+            memcpy(bandDest[0], dest, c->bandLineSize[0]);
+            if (isPlanarYUV(dstFormat) || dstFormat==PIX_FMT_GRAY8) {
+                if (uDest) {
+                    memcpy(bandDest[1], uDest, c->bandLineSize[1]);
+                    if (c->bandLineSize[2])
+                        memcpy(bandDest[2], vDest, c->bandLineSize[2]);
+                }
+                if (aDest)
+                    memcpy(bandDest[3], aDest, c->bandLineSize[3]);
+            }
+        }
     }
 
     if ((dstFormat == PIX_FMT_YUVA420P) && !alpPixBuf)
@@ -167,6 +167,12 @@ int sws_isSupportedOutput(enum PixelFormat pix_fmt);
  * Allocates an empty SwsContext. This must be filled and passed to
  * sws_init_context(). For filling see AVOptions, options.c and
  * sws_setColorspaceDetails().
+ *
+ * Options without a parameter in sws_getContext() and
+ * sws_getCachedContext(), such as "threads", can only be set this way.
+ * sws_init_context() leaves the colorspace details unset, so
+ * sws_setColorspaceDetails() must be called before scaling from or to
+ * RGB.
  */
 struct SwsContext *sws_alloc_context(void);
 
@@ -197,6 +203,8 @@ void sws_freeContext(struct SwsContext *swsContext);
  * @param dstFormat the destination image format
  * @param flags specify which algorithm and options to use for rescaling
  * @return a pointer to an allocated context, or NULL in case of error
+ * @note the context scales with a single thread, see sws_alloc_context()
+ *       for setting the "threads" option
  * @note this function is to be removed after a saner alternative is
  *       written
  * @deprecated Use sws_getCachedContext() instead.
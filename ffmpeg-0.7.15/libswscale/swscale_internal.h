@@ -325,6 +325,36 @@ typedef struct SwsContext {
 
     int needs_hcscale; ///< Set if there are chroma planes to be converted.
 
+    /**
+     * @name Slice threading
+     * With several threads, a whole frame passed to sws_scale() is split
+     * into bands of destination lines, each one scaled by a copy of the
+     * context owning its own ring buffers.
+     */
+    //@{
+    int thread_count;             ///< Number of threads used to scale a frame.
+    struct SwsThreadContext *thread_ctx;
+    int dstYStart;                ///< First destination line output by a band context.
+    int dstYEnd;                  ///< Destination line after the band, 0 if the context outputs all lines.
+    uint8_t *bandLineBuf[4];      ///< Temporary output for the last lines of a band, per plane.
+    int bandLineSize[4];          ///< Size in bytes of a destination line, per plane.
+    //@}
+
+    /**
+     * @name Unscaled bit depth conversion
+     * Convert one native endian line of a plane in the unscaled planar
+     * copy, NULL if only the generic C loops are available.
+     */
+    //@{
+    void (*depthDown8)(uint8_t *dst, const uint16_t *src, int width,
+                       const uint8_t *dither, int scale, int shift);
+    void (*depthDown16)(uint16_t *dst, const uint16_t *src, int width,
+                        const uint8_t *dither, int scale, int shift,
+                        int dstDepth);
+    void (*depthUp8)(uint16_t *dst, const uint8_t *src, int width, int dstDepth);
+    void (*depthUp16)(uint16_t *dst, const uint16_t *src, int width,
+                      int srcDepth, int dstDepth);
+    //@}
 } SwsContext;
 //FIXME check init (where 0)
 
@@ -338,6 +368,24 @@ void ff_yuv2rgb_init_tables_altivec(SwsContext *c, const int inv_table[4],
 void updateMMXDitherTables(SwsContext *c, int dstY, int lumBufIndex, int chrBufIndex,
                            int lastInLumBuf, int lastInChrBuf);
 
+int ff_sws_alloc_pixbufs(SwsContext *c);
+void ff_sws_free_pixbufs(SwsContext *c);
+
+/**
+ * Create the band contexts and the worker threads for c->thread_count.
+ * Called by sws_scale() for the first whole frame; c->thread_ctx stays
+ * NULL if the frame is too small to be split.
+ */
+int ff_sws_init_threads(SwsContext *c);
+void ff_sws_free_threads(SwsContext *c);
+
+/**
+ * Scale a whole frame with the worker threads, the arguments are those
+ * passed to c->swScale().
+ */
+int ff_sws_scale_threaded(SwsContext *c, const uint8_t *src[], int srcStride[],
+                          uint8_t *dst[], int dstStride[]);
+
 SwsFunc ff_yuv2rgb_init_mmx(SwsContext *c);
 SwsFunc ff_yuv2rgb_init_vis(SwsContext *c);
 SwsFunc ff_yuv2rgb_init_mlib(SwsContext *c);
@@ -518,6 +566,7 @@ extern const AVClass sws_context_class;
 void ff_get_unscaled_swscale(SwsContext *c);
 
 void ff_swscale_get_unscaled_altivec(SwsContext *c);
+void ff_get_unscaled_swscale_sse2(SwsContext *c);
 
 /**
  * Returns function pointer to fastest main scaler path function depending
@@ -527,5 +576,6 @@ SwsFunc ff_getSwsFunc(SwsContext *c);
 
 void ff_sws_init_swScale_altivec(SwsContext *c);
 void ff_sws_init_swScale_mmx(SwsContext *c);
+void ff_sws_init_swScale_sse2(SwsContext *c);
 
 #endif /* SWSCALE_SWSCALE_INTERNAL_H */
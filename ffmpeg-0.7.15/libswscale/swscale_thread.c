@@ -0,0 +1,260 @@
+/*
+ * Slice threading for the scaler
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * The destination picture is split into bands of lines, one per thread.
+ * Each band is scaled by a copy of the context with its own vertical
+ * filter ring buffers; swScale() fills them from the first source line the
+ * band needs, so bands overlap on the source lines shared by their vertical
+ * filters and the output is identical to the single threaded one.
+ */
+
+#include <pthread.h>
+#include <string.h>
+
+#include "libavutil/imgutils.h"
+#include "swscale.h"
+#include "swscale_internal.h"
+
+/* room for the SIMD output functions writing past the end of a line */
+#define BAND_LINE_PADDING 128
+
+typedef struct SwsThreadContext {
+    SwsContext **band;              ///< context of each band
+    int nb_bands;
+    pthread_t *workers;
+    int nb_workers;
+    pthread_mutex_t mutex;
+    pthread_cond_t work_cond;       ///< signaled when a frame is available or on exit
+    pthread_cond_t done_cond;       ///< signaled when all bands of the frame are scaled
+    int next_band;                  ///< next band to be scaled, nb_bands between frames
+    int bands_done;
+    int exit;
+
+    const uint8_t *src[4];
+    int srcStride[4];
+    uint8_t *dst[4];
+    int dstStride[4];
+} SwsThreadContext;
+
+static void scale_band(SwsThreadContext *t, int i)
+{
+    SwsContext *b = t->band[i];
+    const uint8_t *src[4]= { t->src[0], t->src[1], t->src[2], t->src[3] };
+    uint8_t *dst[4]= { t->dst[0], t->dst[1], t->dst[2], t->dst[3] };
+    int srcStride[4], dstStride[4];
+
+    memcpy(srcStride, t->srcStride, sizeof(srcStride));
+    memcpy(dstStride, t->dstStride, sizeof(dstStride));
+    b->swScale(b, src, srcStride, 0, b->srcH, dst, dstStride);
+
+    pthread_mutex_lock(&t->mutex);
+    if (++t->bands_done == t->nb_bands)
+        pthread_cond_signal(&t->done_cond);
+    pthread_mutex_unlock(&t->mutex);
+}
+
+static void *worker(void *arg)
+{
+    SwsThreadContext *t = arg;
+
+    pthread_mutex_lock(&t->mutex);
+    for (;;) {
+        int i;
+
+        while (!t->exit && t->next_band >= t->nb_bands)
+            pthread_cond_wait(&t->work_cond, &t->mutex);
+        if (t->exit)
+            break;
+        i = t->next_band++;
+        pthread_mutex_unlock(&t->mutex);
+        scale_band(t, i);
+        pthread_mutex_lock(&t->mutex);
+    }
+    pthread_mutex_unlock(&t->mutex);
+
+    return NULL;
+}
+
+static void free_band(SwsContext *b)
+{
+    if (!b)
+        return;
+    ff_sws_free_pixbufs(b);
+    av_free(b->formatConvBuffer);
+    av_free(b->bandLineBuf[0]);
+    av_free(b);
+}
+
+static int alloc_band(SwsContext *c, SwsContext **band)
+{
+    SwsContext *b;
+    int i, size = 0;
+
+    if (!(b = *band = av_malloc(sizeof(*b))))
+        return AVERROR(ENOMEM);
+    memcpy(b, c, sizeof(*b));
+    b->lumPixBuf  = NULL;
+    b->chrUPixBuf = NULL;
+    b->chrVPixBuf = NULL;
+    b->alpPixBuf  = NULL;
+    b->formatConvBuffer = NULL;
+    b->bandLineBuf[0]   = NULL;
+    if (ff_sws_alloc_pixbufs(b) < 0)
+        return AVERROR(ENOMEM);
+    FF_ALLOC_OR_GOTO(c, b->formatConvBuffer, FFALIGN(c->srcW*2+78, 16) * 2, fail);
+
+    av_image_fill_linesizes(b->bandLineSize, c->dstFormat, c->dstW);
+    for (i = 0; i < 4; i++)
+        size += FFALIGN(b->bandLineSize[i], 16) + BAND_LINE_PADDING;
+    FF_ALLOC_OR_GOTO(c, b->bandLineBuf[0], size, fail);
+    for (i = 1; i < 4; i++)
+        b->bandLineBuf[i] = b->bandLineBuf[i-1] + FFALIGN(b->bandLineSize[i-1], 16) + BAND_LINE_PADDING;
+    return 0;
+fail:
+    return AVERROR(ENOMEM);
+}
+
+int ff_sws_init_threads(SwsContext *c)
+{
+    SwsThreadContext *t;
+    int i;
+
+    t = c->thread_ctx = av_mallocz(sizeof(*t));
+    if (!t)
+        return AVERROR(ENOMEM);
+
+    /* start bands on a chroma line so that no chroma line is shared */
+    t->nb_bands = FFMIN(c->thread_count, c->dstH >> c->chrDstVSubSample);
+    if (t->nb_bands < 2) {
+        av_freep(&c->thread_ctx);
+        return 0;
+    }
+    t->next_band = t->nb_bands;
+    pthread_mutex_init(&t->mutex, NULL);
+    pthread_cond_init(&t->work_cond, NULL);
+    pthread_cond_init(&t->done_cond, NULL);
+    if (!(t->band = av_mallocz(t->nb_bands * sizeof(*t->band))))
+        goto fail;
+    for (i = 0; i < t->nb_bands; i++)
+        if (alloc_band(c, &t->band[i]) < 0)
+            goto fail;
+    if (!(t->workers = av_malloc((t->nb_bands - 1) * sizeof(*t->workers))))
+        goto fail;
+    for (i = 0; i < t->nb_bands - 1; i++) {
+        if (pthread_create(&t->workers[i], NULL, worker, t)) {
+            av_log(c, AV_LOG_ERROR, "pthread_create failed\n");
+            goto fail;
+        }
+        t->nb_workers++;
+    }
+    av_log(c, AV_LOG_VERBOSE, "scaling in %d bands\n", t->nb_bands);
+    return 0;
+fail:
+    ff_sws_free_threads(c);
+    return AVERROR(ENOMEM);
+}
+
+void ff_sws_free_threads(SwsContext *c)
+{
+    SwsThreadContext *t = c->thread_ctx;
+    int i;
+
+    if (!t)
+        return;
+    if (t->workers) {
+        pthread_mutex_lock(&t->mutex);
+        t->exit = 1;
+        pthread_cond_broadcast(&t->work_cond);
+        pthread_mutex_unlock(&t->mutex);
+        for (i = 0; i < t->nb_workers; i++)
+            pthread_join(t->workers[i], NULL);
+        av_freep(&t->workers);
+    }
+    if (t->band) {
+        for (i = 0; i < t->nb_bands; i++)
+            free_band(t->band[i]);
+        av_freep(&t->band);
+    }
+    pthread_cond_destroy(&t->done_cond);
+    pthread_cond_destroy(&t->work_cond);
+    pthread_mutex_destroy(&t->mutex);
+    av_freep(&c->thread_ctx);
+}
+
+int ff_sws_scale_threaded(SwsContext *c, const uint8_t *src[], int srcStride[],
+                          uint8_t *dst[], int dstStride[])
+{
+    SwsThreadContext *t = c->thread_ctx;
+    int i;
+
+    /* the band contexts follow any change of the context since the last
+     * frame, colorspace details or palette, but keep their own buffers */
+    for (i = 0; i < t->nb_bands; i++) {
+        SwsContext *b = t->band[i];
+        int16_t **lumPixBuf  = b->lumPixBuf;
+        int16_t **chrUPixBuf = b->chrUPixBuf;
+        int16_t **chrVPixBuf = b->chrVPixBuf;
+        int16_t **alpPixBuf  = b->alpPixBuf;
+        uint8_t *formatConvBuffer = b->formatConvBuffer;
+        uint8_t *bandLineBuf[4];
+        int bandLineSize[4];
+
+        memcpy(bandLineBuf,  b->bandLineBuf,  sizeof(bandLineBuf));
+        memcpy(bandLineSize, b->bandLineSize, sizeof(bandLineSize));
+        memcpy(b, c, sizeof(*b));
+        b->lumPixBuf        = lumPixBuf;
+        b->chrUPixBuf       = chrUPixBuf;
+        b->chrVPixBuf       = chrVPixBuf;
+        b->alpPixBuf        = alpPixBuf;
+        b->formatConvBuffer = formatConvBuffer;
+        memcpy(b->bandLineBuf,  bandLineBuf,  sizeof(bandLineBuf));
+        memcpy(b->bandLineSize, bandLineSize, sizeof(bandLineSize));
+        b->thread_ctx = NULL;
+        b->dstYStart  = (c->dstH *  i    / t->nb_bands) >> c->chrDstVSubSample << c->chrDstVSubSample;
+        b->dstYEnd    = i == t->nb_bands - 1 ? c->dstH :
+                        (c->dstH * (i+1) / t->nb_bands) >> c->chrDstVSubSample << c->chrDstVSubSample;
+    }
+
+    pthread_mutex_lock(&t->mutex);
+    memcpy(t->src, src, sizeof(t->src));
+    memcpy(t->srcStride, srcStride, sizeof(t->srcStride));
+    memcpy(t->dst, dst, sizeof(t->dst));
+    memcpy(t->dstStride, dstStride, sizeof(t->dstStride));
+    t->bands_done = 0;
+    t->next_band  = 0;
+    pthread_cond_broadcast(&t->work_cond);
+
+    /* the calling thread scales bands too */
+    while (t->next_band < t->nb_bands) {
+        i = t->next_band++;
+        pthread_mutex_unlock(&t->mutex);
+        scale_band(t, i);
+        pthread_mutex_lock(&t->mutex);
+    }
+    while (t->bands_done < t->nb_bands)
+        pthread_cond_wait(&t->done_cond, &t->mutex);
+    pthread_mutex_unlock(&t->mutex);
+
+    /* the bands together output the whole frame, like swScale() does */
+    c->dstY = c->dstH;
+    return c->dstH;
+}
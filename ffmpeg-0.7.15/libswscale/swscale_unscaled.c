@@ -412,23 +412,26 @@ static int packedCopyWrapper(SwsContext *c, const uint8_t* src[], int srcStride[
     return srcSliceH;
 }
 
-#define DITHER_COPY(dst, dstStride, src, srcStride, bswap, dbswap)\
-    uint16_t scale= dither_scale[dst_depth-1][src_depth-1];\
+#define DITHER_SCALE \
+    unsigned scale= dither_scale[dst_depth-1][src_depth-1];\
     int shift= src_depth-dst_depth + dither_scale[src_depth-2][dst_depth-1];\
+    unsigned max= (1<<dst_depth)-1;
+
+#define DITHER_COPY(dst, dstStride, src, srcStride, bswap, dbswap)\
     for (i = 0; i < height; i++) {\
-        const uint8_t *dither= dithers[src_depth-9][i&7];\
+        const uint8_t *dither= dithers[src_depth-9][(y+i)&7];\
         for (j = 0; j < length-7; j+=8){\
-            dst[j+0] = dbswap((bswap(src[j+0]) + dither[0])*scale>>shift);\
-            dst[j+1] = dbswap((bswap(src[j+1]) + dither[1])*scale>>shift);\
-            dst[j+2] = dbswap((bswap(src[j+2]) + dither[2])*scale>>shift);\
-            dst[j+3] = dbswap((bswap(src[j+3]) + dither[3])*scale>>shift);\
-            dst[j+4] = dbswap((bswap(src[j+4]) + dither[4])*scale>>shift);\
-            dst[j+5] = dbswap((bswap(src[j+5]) + dither[5])*scale>>shift);\
-            dst[j+6] = dbswap((bswap(src[j+6]) + dither[6])*scale>>shift);\
-            dst[j+7] = dbswap((bswap(src[j+7]) + dither[7])*scale>>shift);\
+            dst[j+0] = dbswap(FFMIN((bswap(src[j+0]) + dither[0])*scale>>shift, max));\
+            dst[j+1] = dbswap(FFMIN((bswap(src[j+1]) + dither[1])*scale>>shift, max));\
+            dst[j+2] = dbswap(FFMIN((bswap(src[j+2]) + dither[2])*scale>>shift, max));\
+            dst[j+3] = dbswap(FFMIN((bswap(src[j+3]) + dither[3])*scale>>shift, max));\
+            dst[j+4] = dbswap(FFMIN((bswap(src[j+4]) + dither[4])*scale>>shift, max));\
+            dst[j+5] = dbswap(FFMIN((bswap(src[j+5]) + dither[5])*scale>>shift, max));\
+            dst[j+6] = dbswap(FFMIN((bswap(src[j+6]) + dither[6])*scale>>shift, max));\
+            dst[j+7] = dbswap(FFMIN((bswap(src[j+7]) + dither[7])*scale>>shift, max));\
         }\
         for (; j < length; j++)\
-            dst[j] = dbswap((bswap(src[j]) + dither[j&7])*scale>>shift);\
+            dst[j] = dbswap(FFMIN((bswap(src[j]) + dither[j&7])*scale>>shift, max));\
         dst += dstStride;\
         src += srcStride;\
     }
@@ -461,15 +464,30 @@ static int planarCopyWrapper(SwsContext *c, const uint8_t* src[], int srcStride[
                 const uint16_t *srcPtr2 = (const uint16_t*)srcPtr;
                 uint16_t *dstPtr2 = (uint16_t*)dstPtr;
 
+                /* the SIMD line converters only handle native endian lines */
+                const int srcNative = src_depth == 8 || isBE(c->srcFormat) == HAVE_BIGENDIAN;
+                const int dstNative = dst_depth == 8 || isBE(c->dstFormat) == HAVE_BIGENDIAN;
+                const int native = srcNative && dstNative;
+
                 if (dst_depth == 8) {
-                    if(isBE(c->srcFormat) == HAVE_BIGENDIAN){
+                    DITHER_SCALE
+                    if (native && c->depthDown8) {
+                        for (i = 0; i < height; i++) {
+                            c->depthDown8(dstPtr, srcPtr2, length,
+                                          dithers[src_depth-9][(y+i)&7], scale, shift);
+                            dstPtr  += dstStride[plane];
+                            srcPtr2 += srcStride[plane]/2;
+                        }
+                    } else if(isBE(c->srcFormat) == HAVE_BIGENDIAN){
                         DITHER_COPY(dstPtr, dstStride[plane], srcPtr2, srcStride[plane]/2, , )
                     } else {
                         DITHER_COPY(dstPtr, dstStride[plane], srcPtr2, srcStride[plane]/2, av_bswap16, )
                     }
                 } else if (src_depth == 8) {
                     for (i = 0; i < height; i++) {
-                        if(isBE(c->dstFormat)){
+                        if (native && c->depthUp8) {
+                            c->depthUp8(dstPtr2, srcPtr, length, dst_depth);
+                        } else if(isBE(c->dstFormat)){
                             for (j = 0; j < length; j++)
                                 AV_WB16(&dstPtr2[j], (srcPtr[j]<<(dst_depth-8)) |
                                                      (srcPtr[j]>>(2*8-dst_depth)));
@@ -489,7 +507,9 @@ static int planarCopyWrapper(SwsContext *c, const uint8_t* src[], int srcStride[
         w(&dstPtr2[j], (v<<(dst_depth-src_depth)) | \
                        (v>>(2*src_depth-dst_depth)));\
     }
-                        if(isBE(c->srcFormat)){
+                        if (native && c->depthUp16) {
+                            c->depthUp16(dstPtr2, srcPtr2, length, src_depth, dst_depth);
+                        } else if(isBE(c->srcFormat)){
                             if(isBE(c->dstFormat)){
                                 COPY_UP(AV_RB16, AV_WB16)
                             } else {
@@ -506,7 +526,16 @@ static int planarCopyWrapper(SwsContext *c, const uint8_t* src[], int srcStride[
                         srcPtr2 += srcStride[plane]/2;
                     }
                 } else {
-                    if(isBE(c->srcFormat) == HAVE_BIGENDIAN){
+                    DITHER_SCALE
+                    if (native && c->depthDown16) {
+                        for (i = 0; i < height; i++) {
+                            c->depthDown16(dstPtr2, srcPtr2, length,
+                                           dithers[src_depth-9][(y+i)&7], scale, shift,
+                                           dst_depth);
+                            dstPtr2 += dstStride[plane]/2;
+                            srcPtr2 += srcStride[plane]/2;
+                        }
+                    } else if(isBE(c->srcFormat) == HAVE_BIGENDIAN){
                         if(isBE(c->dstFormat) == HAVE_BIGENDIAN){
                             DITHER_COPY(dstPtr2, dstStride[plane]/2, srcPtr2, srcStride[plane]/2, , )
                         } else {
@@ -649,6 +678,9 @@ void ff_get_unscaled_swscale(SwsContext *c)
             c->swScale= planarCopyWrapper;
     }
 
+    if (c->swScale == planarCopyWrapper && HAVE_SSE)
+        ff_get_unscaled_swscale_sse2(c);
+
     if (ARCH_BFIN)
         ff_bfin_get_unscaled_swscale(c);
     if (HAVE_ALTIVEC)
@@ -790,6 +822,17 @@ int sws_scale(SwsContext *c, const uint8_t* const src[], const int srcStride[],
         if (srcSliceY + srcSliceH == c->srcH)
             c->sliceDir = 0;
 
+#if HAVE_PTHREADS
+        if (c->thread_count > 1 && srcSliceY == 0 && srcSliceH == c->srcH) {
+            /* workers are started by the first whole frame, so contexts
+             * which are never used for one do not hold idle threads */
+            if (!c->thread_ctx && ff_sws_init_threads(c) < 0)
+                av_log(c, AV_LOG_WARNING, "Falling back to a single thread.\n");
+            if (c->thread_ctx)
+                return ff_sws_scale_threaded(c, src2, srcStride2, dst2, dstStride2);
+            c->thread_count = 1;
+        }
+#endif
         return c->swScale(c, src2, srcStride2, srcSliceY, srcSliceH, dst2, dstStride2);
     } else {
         // slices go from bottom to top => we flip the image internally
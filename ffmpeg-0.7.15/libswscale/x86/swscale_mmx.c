@@ -224,4 +224,7 @@ void ff_sws_init_swScale_mmx(SwsContext *c)
     if (cpu_flags & AV_CPU_FLAG_MMX2)
         sws_init_swScale_MMX2(c);
 #endif
+#if HAVE_SSE
+    ff_sws_init_swScale_sse2(c);
+#endif
 }
@@ -0,0 +1,516 @@
+/*
+ * SSE2, SSSE3 and AVX2 horizontal and vertical scaler kernels
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Unlike the MMX yuv2yuvX, which drops the low bits of the products with
+ * pmulhw, these kernels compute exactly what hScale_c() and yuv2yuvX_c()
+ * do, so they are used with SWS_BITEXACT and SWS_ACCURATE_RND too.
+ * The last pixels of a line are done in C, no kernel writes past dstW.
+ */
+
+#include "config.h"
+#include "libswscale/swscale.h"
+#include "libswscale/swscale_internal.h"
+#include "libavutil/x86_cpu.h"
+#include "libavutil/cpu.h"
+
+#if HAVE_7REGS
+
+static av_always_inline void hscale_tail(int16_t *dst, int i, int dstW,
+                                         const uint8_t *src, const int16_t *filter,
+                                         const int16_t *filterPos, int filterSize)
+{
+    for (; i < dstW; i++) {
+        int j, val = 0;
+        for (j = 0; j < filterSize; j++)
+            val += src[filterPos[i] + j] * filter[filterSize * i + j];
+        dst[i] = FFMIN(val >> 7, (1 << 15) - 1);
+    }
+}
+
+/* acc += taps of one output pixel; %%xmm7 is zero */
+#define HSCALE_TAPS8(src, filter, acc)      \
+    "movq      "src", %%xmm4        \n\t"   \
+    "punpcklbw %%xmm7, %%xmm4       \n\t"   \
+    "movdqu    "filter", %%xmm5     \n\t"   \
+    "pmaddwd   %%xmm5, %%xmm4       \n\t"   \
+    "paddd     %%xmm4, "acc"        \n\t"
+
+#define HSCALE_TAPS4(src, filter, acc)      \
+    "movd      "src", %%xmm4        \n\t"   \
+    "punpcklbw %%xmm7, %%xmm4       \n\t"   \
+    "movq      "filter", %%xmm5     \n\t"   \
+    "pmaddwd   %%xmm5, %%xmm4       \n\t"   \
+    "paddd     %%xmm4, "acc"        \n\t"
+
+/* sum the dwords of %%xmm0-3 into %%xmm0 */
+#define HSCALE_REDUCE_SSE2                  \
+    "movdqa    %%xmm0, %%xmm4       \n\t"   \
+    "punpckldq %%xmm1, %%xmm0       \n\t"   \
+    "punpckhdq %%xmm1, %%xmm4       \n\t"   \
+    "paddd     %%xmm4, %%xmm0       \n\t"   \
+    "movdqa    %%xmm2, %%xmm5       \n\t"   \
+    "punpckldq %%xmm3, %%xmm2       \n\t"   \
+    "punpckhdq %%xmm3, %%xmm5       \n\t"   \
+    "paddd     %%xmm5, %%xmm2       \n\t"   \
+    "movdqa    %%xmm0, %%xmm4       \n\t"   \
+    "punpcklqdq %%xmm2, %%xmm0      \n\t"   \
+    "punpckhqdq %%xmm2, %%xmm4      \n\t"   \
+    "paddd     %%xmm4, %%xmm0       \n\t"
+
+#define HSCALE_REDUCE_SSSE3                 \
+    "phaddd    %%xmm1, %%xmm0       \n\t"   \
+    "phaddd    %%xmm3, %%xmm2       \n\t"   \
+    "phaddd    %%xmm2, %%xmm0       \n\t"
+
+/**
+ * 4 output pixels per iteration, the taps in steps of 8 and a final step
+ * of 4, as the filter size is a multiple of 4 when MMX is available.
+ * The filter of the 4th pixel is addressed by moving the filter pointer,
+ * which leaves one register for x86_32.
+ */
+#define HSCALE_FUNC(ext, REDUCE)                                                \
+static void hScale_ ## ext(int16_t *dst, int dstW, const uint8_t *src,         \
+                           int srcW, int xInc, const int16_t *filter,          \
+                           const int16_t *filterPos, int filterSize)           \
+{                                                                               \
+    x86_reg fstride = filterSize * 2;                                           \
+    int tail4 = filterSize & 4;                                                 \
+    int i;                                                                      \
+                                                                                \
+    for (i = 0; i + 3 < dstW; i += 4) {                                         \
+        const uint8_t *s0 = src + filterPos[i    ];                            \
+        const uint8_t *s1 = src + filterPos[i + 1];                            \
+        const uint8_t *s2 = src + filterPos[i + 2];                            \
+        const uint8_t *s3 = src + filterPos[i + 3];                            \
+        const int16_t *f    = filter + filterSize * i;                          \
+        const int16_t *fend = f + (filterSize & ~7);                            \
+                                                                                \
+        __asm__ volatile(                                                       \
+            "pxor      %%xmm0, %%xmm0       \n\t"                               \
+            "pxor      %%xmm1, %%xmm1       \n\t"                               \
+            "pxor      %%xmm2, %%xmm2       \n\t"                               \
+            "pxor      %%xmm3, %%xmm3       \n\t"                               \
+            "pxor      %%xmm7, %%xmm7       \n\t"                               \
+            "cmp       %6, %4               \n\t"                               \
+            "jae       2f                   \n\t"                               \
+            "1:                             \n\t"                               \
+            HSCALE_TAPS8("(%0)", "(%4)",         "%%xmm0")                      \
+            HSCALE_TAPS8("(%1)", "(%4, %5)",     "%%xmm1")                      \
+            HSCALE_TAPS8("(%2)", "(%4, %5, 2)",  "%%xmm2")                      \
+            "add       %5, %4               \n\t"                               \
+            HSCALE_TAPS8("(%3)", "(%4, %5, 2)",  "%%xmm3")                      \
+            "sub       %5, %4               \n\t"                               \
+            "add       $8, %0               \n\t"                               \
+            "add       $8, %1               \n\t"                               \
+            "add       $8, %2               \n\t"                               \
+            "add       $8, %3               \n\t"                               \
+            "add       $16, %4              \n\t"                               \
+            "cmp       %6, %4               \n\t"                               \
+            "jb        1b                   \n\t"                               \
+            "2:                             \n\t"                               \
+            "cmpl      $0, %7               \n\t"                               \
+            "je        3f                   \n\t"                               \
+            HSCALE_TAPS4("(%0)", "(%4)",         "%%xmm0")                      \
+            HSCALE_TAPS4("(%1)", "(%4, %5)",     "%%xmm1")                      \
+            HSCALE_TAPS4("(%2)", "(%4, %5, 2)",  "%%xmm2")                      \
+            "add       %5, %4               \n\t"                               \
+            HSCALE_TAPS4("(%3)", "(%4, %5, 2)",  "%%xmm3")                      \
+            "3:                             \n\t"                               \
+            REDUCE                                                              \
+            "psrad     $7, %%xmm0           \n\t"                               \
+            "packssdw  %%xmm0, %%xmm0       \n\t"                               \
+            "movq      %%xmm0, %8           \n\t"                               \
+            : "+r"(s0), "+r"(s1), "+r"(s2), "+r"(s3), "+r"(f)                   \
+            : "r"(fstride), "m"(fend), "m"(tail4),                              \
+              "m"(*(uint64_t *)(dst + i))                                       \
+            : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3",                  \
+                           "%xmm4", "%xmm5", "%xmm7",) "memory"                 \
+        );                                                                      \
+    }                                                                           \
+    hscale_tail(dst, i, dstW, src, filter, filterPos, filterSize);              \
+}
+
+HSCALE_FUNC(sse2,  HSCALE_REDUCE_SSE2)
+#if HAVE_SSSE3
+HSCALE_FUNC(ssse3, HSCALE_REDUCE_SSSE3)
+#endif
+
+#if HAVE_AVX2
+#define HSCALE_TAPS16_AVX2(src, filter, acc)            \
+    "vpmovzxbw "src", %%ymm4                    \n\t"   \
+    "vpmaddwd  "filter", %%ymm4, %%ymm4         \n\t"   \
+    "vpaddd    %%ymm4, "acc", "acc"             \n\t"
+
+#define HSCALE_TAPS8_AVX2(src, filter, acc)             \
+    "vpmovzxbw "src", %%xmm4                    \n\t"   \
+    "vpmaddwd  "filter", %%xmm4, %%xmm4         \n\t"   \
+    "vpaddd    %%ymm4, "acc", "acc"             \n\t"
+
+#define HSCALE_TAPS4_AVX2(src, filter, acc)             \
+    "vmovd     "src", %%xmm4                    \n\t"   \
+    "vpmovzxbw %%xmm4, %%xmm4                   \n\t"   \
+    "vmovq     "filter", %%xmm5                 \n\t"   \
+    "vpmaddwd  %%xmm5, %%xmm4, %%xmm4           \n\t"   \
+    "vpaddd    %%ymm4, "acc", "acc"             \n\t"
+
+static void hScale_avx2(int16_t *dst, int dstW, const uint8_t *src,
+                        int srcW, int xInc, const int16_t *filter,
+                        const int16_t *filterPos, int filterSize)
+{
+    x86_reg fstride = filterSize * 2;
+    int tail = filterSize & 12;
+    int i;
+
+    for (i = 0; i + 3 < dstW; i += 4) {
+        const uint8_t *s0 = src + filterPos[i    ];
+        const uint8_t *s1 = src + filterPos[i + 1];
+        const uint8_t *s2 = src + filterPos[i + 2];
+        const uint8_t *s3 = src + filterPos[i + 3];
+        const int16_t *f    = filter + filterSize * i;
+        const int16_t *fend = f + (filterSize & ~15);
+
+        __asm__ volatile(
+            "vpxor     %%ymm0, %%ymm0, %%ymm0           \n\t"
+            "vpxor     %%ymm1, %%ymm1, %%ymm1           \n\t"
+            "vpxor     %%ymm2, %%ymm2, %%ymm2           \n\t"
+            "vpxor     %%ymm3, %%ymm3, %%ymm3           \n\t"
+            "cmp       %6, %4                           \n\t"
+            "jae       2f                               \n\t"
+            "1:                                         \n\t"
+            HSCALE_TAPS16_AVX2("(%0)", "(%4)",        "%%ymm0")
+            HSCALE_TAPS16_AVX2("(%1)", "(%4, %5)",    "%%ymm1")
+            HSCALE_TAPS16_AVX2("(%2)", "(%4, %5, 2)", "%%ymm2")
+            "add       %5, %4                           \n\t"
+            HSCALE_TAPS16_AVX2("(%3)", "(%4, %5, 2)", "%%ymm3")
+            "sub       %5, %4                           \n\t"
+            "add       $16, %0                          \n\t"
+            "add       $16, %1                          \n\t"
+            "add       $16, %2                          \n\t"
+            "add       $16, %3                          \n\t"
+            "add       $32, %4                          \n\t"
+            "cmp       %6, %4                           \n\t"
+            "jb        1b                               \n\t"
+            "2:                                         \n\t"
+            "testl     $8, %7                           \n\t"
+            "je        3f                               \n\t"
+            HSCALE_TAPS8_AVX2("(%0)", "(%4)",         "%%ymm0")
+            HSCALE_TAPS8_AVX2("(%1)", "(%4, %5)",     "%%ymm1")
+            HSCALE_TAPS8_AVX2("(%2)", "(%4, %5, 2)",  "%%ymm2")
+            "add       %5, %4                           \n\t"
+            HSCALE_TAPS8_AVX2("(%3)", "(%4, %5, 2)",  "%%ymm3")
+            "sub       %5, %4                           \n\t"
+            "add       $8, %0                           \n\t"
+            "add       $8, %1                           \n\t"
+            "add       $8, %2                           \n\t"
+            "add       $8, %3                           \n\t"
+            "add       $16, %4                          \n\t"
+            "3:                                         \n\t"
+            "testl     $4, %7                           \n\t"
+            "je        4f                               \n\t"
+            HSCALE_TAPS4_AVX2("(%0)", "(%4)",         "%%ymm0")
+            HSCALE_TAPS4_AVX2("(%1)", "(%4, %5)",     "%%ymm1")
+            HSCALE_TAPS4_AVX2("(%2)", "(%4, %5, 2)",  "%%ymm2")
+            "add       %5, %4                           \n\t"
+            HSCALE_TAPS4_AVX2("(%3)", "(%4, %5, 2)",  "%%ymm3")
+            "4:                                         \n\t"
+            "vphaddd   %%ymm1, %%ymm0, %%ymm0           \n\t"
+            "vphaddd   %%ymm3, %%ymm2, %%ymm2           \n\t"
+            "vphaddd   %%ymm2, %%ymm0, %%ymm0           \n\t"
+            "vextracti128 $1, %%ymm0, %%xmm1            \n\t"
+            "vpaddd    %%xmm1, %%xmm0, %%xmm0           \n\t"
+            "vpsrad    $7, %%xmm0, %%xmm0               \n\t"
+            "vpackssdw %%xmm0, %%xmm0, %%xmm0           \n\t"
+            "vmovq     %%xmm0, %8                       \n\t"
+            "vzeroupper                                 \n\t"
+            : "+r"(s0), "+r"(s1), "+r"(s2), "+r"(s3), "+r"(f)
+            : "r"(fstride), "m"(fend), "m"(tail),
+              "m"(*(uint64_t *)(dst + i))
+            : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3",
+                           "%xmm4", "%xmm5",) "memory"
+        );
+    }
+    hscale_tail(dst, i, dstW, src, filter, filterPos, filterSize);
+}
+#endif /* HAVE_AVX2 */
+
+static av_always_inline void planeX_tail(const int16_t *filter, int filterSize,
+                                         const int16_t **src, uint8_t *dest,
+                                         int i, int dstW,
+                                         const uint8_t *dither, int offset)
+{
+    for (; i < dstW; i++) {
+        int j, val = dither[(i + offset) & 7] << 12;
+        for (j = 0; j < filterSize; j++)
+            val += src[j][i] * filter[j];
+        dest[i] = av_clip_uint8(val >> 19);
+    }
+}
+
+/**
+ * 16 pixels per iteration, the taps by pairs interleaved for pmaddwd,
+ * an odd last tap is paired with a zero coefficient.
+ */
+static void yuv2planeX_sse2(const int16_t *filter, int filterSize,
+                            const int16_t **src, uint8_t *dest, int dstW,
+                            const uint8_t *dither, int offset)
+{
+    DECLARE_ALIGNED(16, int32_t, dith)[2][4];
+    x86_reg i = 0, end = dstW & ~15;
+    x86_reg fsize = filterSize, fpairs = filterSize & ~1;
+    x86_reg j, p0, p1;
+    int k;
+
+    for (k = 0; k < 8; k++)
+        dith[k >> 2][k & 3] = dither[(k + offset) & 7] << 12;
+
+    if (end)
+        __asm__ volatile(
+            "1:                                         \n\t"
+            "movdqa    %10, %%xmm0                      \n\t"
+            "movdqa    %11, %%xmm1                      \n\t"
+            "movdqa    %%xmm0, %%xmm2                   \n\t"
+            "movdqa    %%xmm1, %%xmm3                   \n\t"
+            "xor       %1, %1                           \n\t"
+            "cmp       %8, %1                           \n\t"
+            "jae       3f                               \n\t"
+            "2:                                         \n\t"
+            "mov       (%4, %1, "PTR_SIZE"), %2         \n\t"
+            "mov       "PTR_SIZE"(%4, %1, "PTR_SIZE"), %3 \n\t"
+            "movd      (%5, %1, 2), %%xmm7              \n\t"
+            "pshufd    $0, %%xmm7, %%xmm7               \n\t"
+            "movdqu    (%2, %0, 2), %%xmm4              \n\t"
+            "movdqu    (%3, %0, 2), %%xmm5              \n\t"
+            "movdqa    %%xmm4, %%xmm6                   \n\t"
+            "punpcklwd %%xmm5, %%xmm4                   \n\t"
+            "punpckhwd %%xmm5, %%xmm6                   \n\t"
+            "pmaddwd   %%xmm7, %%xmm4                   \n\t"
+            "pmaddwd   %%xmm7, %%xmm6                   \n\t"
+            "paddd     %%xmm4, %%xmm0                   \n\t"
+            "paddd     %%xmm6, %%xmm1                   \n\t"
+            "movdqu  16(%2, %0, 2), %%xmm4              \n\t"
+            "movdqu  16(%3, %0, 2), %%xmm5              \n\t"
+            "movdqa    %%xmm4, %%xmm6                   \n\t"
+            "punpcklwd %%xmm5, %%xmm4                   \n\t"
+            "punpckhwd %%xmm5, %%xmm6                   \n\t"
+            "pmaddwd   %%xmm7, %%xmm4                   \n\t"
+            "pmaddwd   %%xmm7, %%xmm6                   \n\t"
+            "paddd     %%xmm4, %%xmm2                   \n\t"
+            "paddd     %%xmm6, %%xmm3                   \n\t"
+            "add       $2, %1                           \n\t"
+            "cmp       %8, %1                           \n\t"
+            "jb        2b                               \n\t"
+            "3:                                         \n\t"
+            "cmp       %9, %1                           \n\t"
+            "jae       4f                               \n\t"
+            "mov       (%4, %1, "PTR_SIZE"), %2         \n\t"
+            "movzwl    (%5, %1, 2), %k3                 \n\t"
+            "movd      %k3, %%xmm7                      \n\t"
+            "pshufd    $0, %%xmm7, %%xmm7               \n\t"
+            "movdqu    (%2, %0, 2), %%xmm4              \n\t"
+            "movdqa    %%xmm4, %%xmm6                   \n\t"
+            "punpcklwd %%xmm4, %%xmm4                   \n\t"
+            "punpckhwd %%xmm6, %%xmm6                   \n\t"
+            "pmaddwd   %%xmm7, %%xmm4                   \n\t"
+            "pmaddwd   %%xmm7, %%xmm6                   \n\t"
+            "paddd     %%xmm4, %%xmm0                   \n\t"
+            "paddd     %%xmm6, %%xmm1                   \n\t"
+            "movdqu  16(%2, %0, 2), %%xmm4              \n\t"
+            "movdqa    %%xmm4, %%xmm6                   \n\t"
+            "punpcklwd %%xmm4, %%xmm4                   \n\t"
+            "punpckhwd %%xmm6, %%xmm6                   \n\t"
+            "pmaddwd   %%xmm7, %%xmm4                   \n\t"
+            "pmaddwd   %%xmm7, %%xmm6                   \n\t"
+            "paddd     %%xmm4, %%xmm2                   \n\t"
+            "paddd     %%xmm6, %%xmm3                   \n\t"
+            "4:                                         \n\t"
+            "psrad     $19, %%xmm0                      \n\t"
+            "psrad     $19, %%xmm1                      \n\t"
+            "psrad     $19, %%xmm2                      \n\t"
+            "psrad     $19, %%xmm3                      \n\t"
+            "packssdw  %%xmm1, %%xmm0                   \n\t"
+            "packssdw  %%xmm3, %%xmm2                   \n\t"
+            "packuswb  %%xmm2, %%xmm0                   \n\t"
+            "mov       %6, %2                           \n\t"
+            "movdqu    %%xmm0, (%2, %0)                 \n\t"
+            "add       $16, %0                          \n\t"
+            "cmp       %7, %0                           \n\t"
+            "jb        1b                               \n\t"
+            : "+r"(i), "=&r"(j), "=&r"(p0), "=&r"(p1)
+            : "r"(src), "r"(filter), "m"(dest), "m"(end),
+              "m"(fpairs), "m"(fsize), "m"(dith[0]), "m"(dith[1])
+            : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3",
+                           "%xmm4", "%xmm5", "%xmm6", "%xmm7",) "memory"
+        );
+    planeX_tail(filter, filterSize, src, dest, end, dstW, dither, offset);
+}
+
+#if HAVE_AVX2
+#define PLANEX_TAPS_AVX2(off, acc0, acc1)                       \
+    "vmovdqu   "#off"(%2, %0, 2), %%ymm4            \n\t"       \
+    "vmovdqu   "#off"(%3, %0, 2), %%ymm5            \n\t"       \
+    "vpunpcklwd %%ymm5, %%ymm4, %%ymm6              \n\t"       \
+    "vpunpckhwd %%ymm5, %%ymm4, %%ymm4              \n\t"       \
+    "vpmaddwd  %%ymm7, %%ymm6, %%ymm6               \n\t"       \
+    "vpmaddwd  %%ymm7, %%ymm4, %%ymm4               \n\t"       \
+    "vpaddd    %%ymm6, "acc0", "acc0"               \n\t"       \
+    "vpaddd    %%ymm4, "acc1", "acc1"               \n\t"
+
+#define PLANEX_TAP_AVX2(off, acc0, acc1)                        \
+    "vmovdqu   "#off"(%2, %0, 2), %%ymm4            \n\t"       \
+    "vpunpcklwd %%ymm4, %%ymm4, %%ymm6              \n\t"       \
+    "vpunpckhwd %%ymm4, %%ymm4, %%ymm4              \n\t"       \
+    "vpmaddwd  %%ymm7, %%ymm6, %%ymm6               \n\t"       \
+    "vpmaddwd  %%ymm7, %%ymm4, %%ymm4               \n\t"       \
+    "vpaddd    %%ymm6, "acc0", "acc0"               \n\t"       \
+    "vpaddd    %%ymm4, "acc1", "acc1"               \n\t"
+
+/**
+ * 32 pixels per iteration; the unpacks and packs work within 128-bit
+ * lanes, so each accumulator holds pixels from both halves and the
+ * bytes are put back in order with vpermq.
+ */
+static void yuv2planeX_avx2(const int16_t *filter, int filterSize,
+                            const int16_t **src, uint8_t *dest, int dstW,
+                            const uint8_t *dither, int offset)
+{
+    DECLARE_ALIGNED(32, int32_t, dith)[2][8];
+    x86_reg i = 0, end = dstW & ~31;
+    x86_reg fsize = filterSize, fpairs = filterSize & ~1;
+    x86_reg j, p0, p1;
+    int k;
+
+    for (k = 0; k < 8; k++)
+        dith[k >> 2][k & 3] = dith[k >> 2][(k & 3) + 4] = dither[(k + offset) & 7] << 12;
+
+    if (end)
+        __asm__ volatile(
+            "1:                                         \n\t"
+            "vmovdqu   %10, %%ymm0                      \n\t"
+            "vmovdqu   %11, %%ymm1                      \n\t"
+            "vmovdqa   %%ymm0, %%ymm2                   \n\t"
+            "vmovdqa   %%ymm1, %%ymm3                   \n\t"
+            "xor       %1, %1                           \n\t"
+            "cmp       %8, %1                           \n\t"
+            "jae       3f                               \n\t"
+            "2:                                         \n\t"
+            "mov       (%4, %1, "PTR_SIZE"), %2         \n\t"
+            "mov       "PTR_SIZE"(%4, %1, "PTR_SIZE"), %3 \n\t"
+            "vpbroadcastd (%5, %1, 2), %%ymm7           \n\t"
+            PLANEX_TAPS_AVX2( 0, "%%ymm0", "%%ymm1")
+            PLANEX_TAPS_AVX2(32, "%%ymm2", "%%ymm3")
+            "add       $2, %1                           \n\t"
+            "cmp       %8, %1                           \n\t"
+            "jb        2b                               \n\t"
+            "3:                                         \n\t"
+            "cmp       %9, %1                           \n\t"
+            "jae       4f                               \n\t"
+            "mov       (%4, %1, "PTR_SIZE"), %2         \n\t"
+            "movzwl    (%5, %1, 2), %k3                 \n\t"
+            "vmovd     %k3, %%xmm7                      \n\t"
+            "vpbroadcastd %%xmm7, %%ymm7                \n\t"
+            PLANEX_TAP_AVX2( 0, "%%ymm0", "%%ymm1")
+            PLANEX_TAP_AVX2(32, "%%ymm2", "%%ymm3")
+            "4:                                         \n\t"
+            "vpsrad    $19, %%ymm0, %%ymm0              \n\t"
+            "vpsrad    $19, %%ymm1, %%ymm1              \n\t"
+            "vpsrad    $19, %%ymm2, %%ymm2              \n\t"
+            "vpsrad    $19, %%ymm3, %%ymm3              \n\t"
+            "vpackssdw %%ymm1, %%ymm0, %%ymm0           \n\t"
+            "vpackssdw %%ymm3, %%ymm2, %%ymm2           \n\t"
+            "vpackuswb %%ymm2, %%ymm0, %%ymm0           \n\t"
+            "vpermq    $0xd8, %%ymm0, %%ymm0            \n\t"
+            "mov       %6, %2                           \n\t"
+            "vmovdqu   %%ymm0, (%2, %0)                 \n\t"
+            "add       $32, %0                          \n\t"
+            "cmp       %7, %0                           \n\t"
+            "jb        1b                               \n\t"
+            "vzeroupper                                 \n\t"
+            : "+r"(i), "=&r"(j), "=&r"(p0), "=&r"(p1)
+            : "r"(src), "r"(filter), "m"(dest), "m"(end),
+              "m"(fpairs), "m"(fsize), "m"(dith[0]), "m"(dith[1])
+            : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3",
+                           "%xmm4", "%xmm5", "%xmm6", "%xmm7",) "memory"
+        );
+    planeX_tail(filter, filterSize, src, dest, end, dstW, dither, offset);
+}
+#endif /* HAVE_AVX2 */
+
+#define YUV2YUVX_FUNC(ext)                                                      \
+static void yuv2yuvX_ ## ext(SwsContext *c, const int16_t *lumFilter,          \
+                             const int16_t **lumSrc, int lumFilterSize,         \
+                             const int16_t *chrFilter, const int16_t **chrUSrc, \
+                             const int16_t **chrVSrc, int chrFilterSize,        \
+                             const int16_t **alpSrc, uint8_t *dest,             \
+                             uint8_t *uDest, uint8_t *vDest, uint8_t *aDest,    \
+                             int dstW, int chrDstW,                             \
+                             const uint8_t *lumDither, const uint8_t *chrDither) \
+{                                                                               \
+    yuv2planeX_ ## ext(lumFilter, lumFilterSize, lumSrc, dest, dstW,            \
+                       lumDither, 0);                                           \
+    if (uDest) {                                                                \
+        yuv2planeX_ ## ext(chrFilter, chrFilterSize, chrUSrc, uDest, chrDstW,   \
+                           chrDither, 0);                                       \
+        yuv2planeX_ ## ext(chrFilter, chrFilterSize, chrVSrc, vDest, chrDstW,   \
+                           chrDither, 3);                                       \
+    }                                                                           \
+    if (CONFIG_SWSCALE_ALPHA && aDest)                                          \
+        yuv2planeX_ ## ext(lumFilter, lumFilterSize, alpSrc, aDest, dstW,       \
+                           lumDither, 0);                                       \
+}
+
+YUV2YUVX_FUNC(sse2)
+#if HAVE_AVX2
+YUV2YUVX_FUNC(avx2)
+#endif
+
+#endif /* HAVE_7REGS */
+
+void ff_sws_init_swScale_sse2(SwsContext *c)
+{
+#if HAVE_7REGS
+    int cpu_flags = av_get_cpu_flags();
+    enum PixelFormat dstFormat = c->dstFormat;
+    /* the hScale kernels rely on the MMX filter alignment */
+    int hscale = !(c->hLumFilterSize & 3) && !(c->hChrFilterSize & 3);
+    int planar8 = !is16BPS(dstFormat) && !is9_OR_10BPS(dstFormat) &&
+                  dstFormat != PIX_FMT_NV12 && dstFormat != PIX_FMT_NV21;
+
+    if (cpu_flags & AV_CPU_FLAG_SSE2) {
+        if (hscale)
+            c->hScale = hScale_sse2;
+        if (planar8)
+            c->yuv2yuvX = yuv2yuvX_sse2;
+    }
+#if HAVE_SSSE3
+    if (cpu_flags & AV_CPU_FLAG_SSSE3 && hscale)
+        c->hScale = hScale_ssse3;
+#endif
+#if HAVE_AVX2
+    if (cpu_flags & AV_CPU_FLAG_AVX2) {
+        if (hscale)
+            c->hScale = hScale_avx2;
+        if (planar8)
+            c->yuv2yuvX = yuv2yuvX_avx2;
+    }
+#endif
+#endif /* HAVE_7REGS */
+}
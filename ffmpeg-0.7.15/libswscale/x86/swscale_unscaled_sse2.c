@@ -0,0 +1,209 @@
+/*
+ * SSE2 bit depth conversion for the unscaled planar copy
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Line converters between 8, 9, 10 and 16 bit planes, giving the same
+ * output as the C loops of planarCopyWrapper().
+ * Reducing the depth computes (src + dither) * scale >> shift on 32 bits:
+ * the products src * scale are built from pmullw and pmulhuw, the dither
+ * products are precomputed for the line, so 16 bit sources cannot overflow.
+ * Results are clipped to the destination depth.
+ */
+
+#include "config.h"
+#include "libswscale/swscale.h"
+#include "libswscale/swscale_internal.h"
+#include "libavutil/x86_cpu.h"
+#include "libavutil/cpu.h"
+
+/**
+ * Load the dither products of a line into %%xmm4/%%xmm5, scale into the
+ * words of %%xmm6 and shift into %%xmm7.
+ */
+#define DEPTH_DOWN_SETUP                    \
+    "movd       %4, %%xmm6          \n\t"   \
+    "pshuflw    $0, %%xmm6, %%xmm6  \n\t"   \
+    "punpcklqdq %%xmm6, %%xmm6      \n\t"   \
+    "movd       %5, %%xmm7          \n\t"   \
+    "movdqa     (%3), %%xmm4        \n\t"   \
+    "movdqa   16(%3), %%xmm5        \n\t"
+
+/* 8 source pixels at %1 + 2 * %0 to 8 words in %%xmm0 */
+#define DEPTH_DOWN_8PIX                     \
+    "movdqu     (%1, %0, 2), %%xmm0 \n\t"   \
+    "movdqa     %%xmm0, %%xmm1      \n\t"   \
+    "pmullw     %%xmm6, %%xmm0      \n\t"   \
+    "pmulhuw    %%xmm6, %%xmm1      \n\t"   \
+    "movdqa     %%xmm0, %%xmm2      \n\t"   \
+    "punpcklwd  %%xmm1, %%xmm0      \n\t"   \
+    "punpckhwd  %%xmm1, %%xmm2      \n\t"   \
+    "paddd      %%xmm4, %%xmm0      \n\t"   \
+    "paddd      %%xmm5, %%xmm2      \n\t"   \
+    "psrld      %%xmm7, %%xmm0      \n\t"   \
+    "psrld      %%xmm7, %%xmm2      \n\t"   \
+    "packssdw   %%xmm2, %%xmm0      \n\t"
+
+static void depth_down8_sse2(uint8_t *dst, const uint16_t *src, int width,
+                             const uint8_t *dither, int scale, int shift)
+{
+    DECLARE_ALIGNED(16, uint32_t, dith)[8];
+    x86_reg i = -(width & ~7);
+    int j;
+
+    for (j = 0; j < 8; j++)
+        dith[j] = dither[j] * scale;
+    if (i) {
+        __asm__ volatile(
+            DEPTH_DOWN_SETUP
+            "1:                             \n\t"
+            DEPTH_DOWN_8PIX
+            "packuswb   %%xmm0, %%xmm0      \n\t"
+            "movq       %%xmm0, (%2, %0)    \n\t"
+            "add        $8, %0              \n\t"
+            " js        1b                  \n\t"
+            : "+r"(i)
+            : "r"(src + (width & ~7)), "r"(dst + (width & ~7)), "r"(dith),
+              "rm"(scale), "rm"(shift)
+            : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm4", "%xmm5",
+                           "%xmm6", "%xmm7",) "memory"
+        );
+    }
+    for (j = width & ~7; j < width; j++)
+        dst[j] = (src[j] + dither[j&7]) * (unsigned)scale >> shift;
+}
+
+static void depth_down16_sse2(uint16_t *dst, const uint16_t *src, int width,
+                              const uint8_t *dither, int scale, int shift,
+                              int dstDepth)
+{
+    DECLARE_ALIGNED(16, uint32_t, dith)[8];
+    x86_reg i = -(width & ~7);
+    unsigned max = (1 << dstDepth) - 1;
+    int j;
+
+    for (j = 0; j < 8; j++)
+        dith[j] = dither[j] * scale;
+    if (i) {
+        __asm__ volatile(
+            DEPTH_DOWN_SETUP
+            "movd       %6, %%xmm3          \n\t"
+            "pshuflw    $0, %%xmm3, %%xmm3  \n\t"
+            "punpcklqdq %%xmm3, %%xmm3      \n\t"
+            "1:                             \n\t"
+            DEPTH_DOWN_8PIX
+            "pminsw     %%xmm3, %%xmm0      \n\t"
+            "movdqu     %%xmm0, (%2, %0, 2) \n\t"
+            "add        $8, %0              \n\t"
+            " js        1b                  \n\t"
+            : "+r"(i)
+            : "r"(src + (width & ~7)), "r"(dst + (width & ~7)), "r"(dith),
+              "rm"(scale), "rm"(shift), "rm"(max)
+            : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3", "%xmm4",
+                           "%xmm5", "%xmm6", "%xmm7",) "memory"
+        );
+    }
+    for (j = width & ~7; j < width; j++)
+        dst[j] = FFMIN((src[j] + dither[j&7]) * (unsigned)scale >> shift, max);
+}
+
+/* v << up | v >> down, shift counts in %%xmm6 and %%xmm7 */
+#define DEPTH_UP(reg, tmp)                  \
+    "movdqa     "reg", "tmp"        \n\t"   \
+    "psllw      %%xmm6, "reg"       \n\t"   \
+    "psrlw      %%xmm7, "tmp"       \n\t"   \
+    "por        "tmp", "reg"        \n\t"
+
+static void depth_up8_sse2(uint16_t *dst, const uint8_t *src, int width,
+                           int dstDepth)
+{
+    x86_reg i = -(width & ~15);
+    int j;
+
+    if (i) {
+        __asm__ volatile(
+            "movd       %3, %%xmm6          \n\t"
+            "movd       %4, %%xmm7          \n\t"
+            "pxor       %%xmm5, %%xmm5      \n\t"
+            "1:                             \n\t"
+            "movdqu     (%1, %0), %%xmm0    \n\t"
+            "movdqa     %%xmm0, %%xmm1      \n\t"
+            "punpcklbw  %%xmm5, %%xmm0      \n\t"
+            "punpckhbw  %%xmm5, %%xmm1      \n\t"
+            DEPTH_UP("%%xmm0", "%%xmm2")
+            DEPTH_UP("%%xmm1", "%%xmm3")
+            "movdqu     %%xmm0,   (%2, %0, 2) \n\t"
+            "movdqu     %%xmm1, 16(%2, %0, 2) \n\t"
+            "add        $16, %0             \n\t"
+            " js        1b                  \n\t"
+            : "+r"(i)
+            : "r"(src + (width & ~15)), "r"(dst + (width & ~15)),
+              "rm"(dstDepth - 8), "rm"(16 - dstDepth)
+            : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3", "%xmm5",
+                           "%xmm6", "%xmm7",) "memory"
+        );
+    }
+    for (j = width & ~15; j < width; j++)
+        dst[j] = (src[j] << (dstDepth - 8)) | (src[j] >> (16 - dstDepth));
+}
+
+static void depth_up16_sse2(uint16_t *dst, const uint16_t *src, int width,
+                            int srcDepth, int dstDepth)
+{
+    x86_reg i = -(width & ~15);
+    int j;
+
+    if (i) {
+        __asm__ volatile(
+            "movd       %3, %%xmm6          \n\t"
+            "movd       %4, %%xmm7          \n\t"
+            "1:                             \n\t"
+            "movdqu       (%1, %0, 2), %%xmm0 \n\t"
+            "movdqu     16(%1, %0, 2), %%xmm1 \n\t"
+            DEPTH_UP("%%xmm0", "%%xmm2")
+            DEPTH_UP("%%xmm1", "%%xmm3")
+            "movdqu     %%xmm0,   (%2, %0, 2) \n\t"
+            "movdqu     %%xmm1, 16(%2, %0, 2) \n\t"
+            "add        $16, %0             \n\t"
+            " js        1b                  \n\t"
+            : "+r"(i)
+            : "r"(src + (width & ~15)), "r"(dst + (width & ~15)),
+              "rm"(dstDepth - srcDepth), "rm"(2 * srcDepth - dstDepth)
+            : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3",
+                           "%xmm6", "%xmm7",) "memory"
+        );
+    }
+    for (j = width & ~15; j < width; j++) {
+        unsigned int v = src[j];
+        dst[j] = (v << (dstDepth - srcDepth)) | (v >> (2 * srcDepth - dstDepth));
+    }
+}
+
+void ff_get_unscaled_swscale_sse2(SwsContext *c)
+{
+    int cpu_flags = av_get_cpu_flags();
+
+    if (cpu_flags & AV_CPU_FLAG_SSE2) {
+        c->depthDown8  = depth_down8_sse2;
+        c->depthDown16 = depth_down16_sse2;
+        c->depthUp8    = depth_up8_sse2;
+        c->depthUp16   = depth_up16_sse2;
+    }
+}
@@ -64,6 +64,348 @@ DECLARE_ASM_CONST(8, uint64_t, pb_07) = 0x0707070707070707ULL;
 #include "yuv2rgb_template.c"
 #endif /* HAVE_MMX2 */
 
+//SSE2 versions
+#if HAVE_SSE
+DECLARE_ASM_CONST(16, uint64_t, sse2_00ffw)[2]   = { 0x00ff00ff00ff00ffULL, 0x00ff00ff00ff00ffULL };
+DECLARE_ASM_CONST(16, uint64_t, sse2_redmask)[2] = { 0xf8f8f8f8f8f8f8f8ULL, 0xf8f8f8f8f8f8f8f8ULL };
+DECLARE_ASM_CONST(16, uint64_t, sse2_pb_e0)[2]   = { 0xe0e0e0e0e0e0e0e0ULL, 0xe0e0e0e0e0e0e0e0ULL };
+DECLARE_ASM_CONST(16, uint64_t, sse2_pb_03)[2]   = { 0x0303030303030303ULL, 0x0303030303030303ULL };
+DECLARE_ASM_CONST(16, uint64_t, sse2_pb_07)[2]   = { 0x0707070707070707ULL, 0x0707070707070707ULL };
+DECLARE_ASM_CONST(16, uint8_t,  ssse3_pack24)[16] = { 0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14,
+                                                      0x80, 0x80, 0x80, 0x80 };
+
+/* The MMX functions with 16 pixels per iteration; the coefficients
+ * are copied from the context into a 16 byte aligned table, so the
+ * output is identical. Lines with a multiple of 8 but not of 16 pixels
+ * are left to the MMX functions. */
+#define YUV2RGB_LOOP_SSE2(depth, fallback)                             \
+    DECLARE_ALIGNED(16, uint64_t, coeffs)[11][2];                      \
+    int y, k, h_size, vshift;                                          \
+                                                                       \
+    h_size = (c->dstW + 7) & ~7;                                       \
+    if (h_size * depth > FFABS(dstStride[0]))                          \
+        h_size -= 8;                                                   \
+    if (h_size & 15)                                                   \
+        return fallback(c, src, srcStride, srcSliceY, srcSliceH,       \
+                        dst, dstStride);                               \
+                                                                       \
+    vshift = c->srcFormat != PIX_FMT_YUV422P;                          \
+                                                                       \
+    for (k = 0; k < 11; k++)                                           \
+        coeffs[k][0] = coeffs[k][1] = (&c->redDither)[k];              \
+    for (y = 0; y < srcSliceH; y++) {                                  \
+        uint8_t *image    = dst[0] + (y + srcSliceY) * dstStride[0];   \
+        const uint8_t *py = src[0] +               y * srcStride[0];   \
+        const uint8_t *pu = src[1] +   (y >> vshift) * srcStride[1];   \
+        const uint8_t *pv = src[2] +   (y >> vshift) * srcStride[2];   \
+        x86_reg index = -h_size / 2;                                   \
+
+#define YUV2RGB_INITIAL_LOAD_SSE2     \
+    __asm__ volatile (                \
+        "pxor   %%xmm4, %%xmm4\n\t"   \
+        "1: \n\t"                     \
+        "movdqu (%5, %0, 2), %%xmm6\n\t" \
+        "movq      (%2, %0), %%xmm0\n\t" \
+        "movq      (%3, %0), %%xmm1\n\t" \
+
+/* same as YUV2RGB on xmm registers, 8 U and V, 16 Y */
+#define YUV2RGB_SSE2                                 \
+    "movdqa    %%xmm6, %%xmm7\n\t"                   \
+    "punpcklbw %%xmm4, %%xmm0\n\t"                   \
+    "punpcklbw %%xmm4, %%xmm1\n\t"                   \
+    "pand     "MANGLE(sse2_00ffw)", %%xmm6\n\t"      \
+    "psrlw     $8,     %%xmm7\n\t"                   \
+    "psllw     $3,     %%xmm0\n\t"                   \
+    "psllw     $3,     %%xmm1\n\t"                   \
+    "psllw     $3,     %%xmm6\n\t"                   \
+    "psllw     $3,     %%xmm7\n\t"                   \
+    "psubsw   2*"U_OFFSET"(%4), %%xmm0\n\t"          \
+    "psubsw   2*"V_OFFSET"(%4), %%xmm1\n\t"          \
+    "psubw    2*"Y_OFFSET"(%4), %%xmm6\n\t"          \
+    "psubw    2*"Y_OFFSET"(%4), %%xmm7\n\t"          \
+\
+    "movdqa    %%xmm0, %%xmm2\n\t"                   \
+    "movdqa    %%xmm1, %%xmm3\n\t"                   \
+    "pmulhw   2*"UG_COEFF"(%4), %%xmm2\n\t"          \
+    "pmulhw   2*"VG_COEFF"(%4), %%xmm3\n\t"          \
+    "pmulhw   2*"Y_COEFF" (%4), %%xmm6\n\t"          \
+    "pmulhw   2*"Y_COEFF" (%4), %%xmm7\n\t"          \
+    "pmulhw   2*"UB_COEFF"(%4), %%xmm0\n\t"          \
+    "pmulhw   2*"VR_COEFF"(%4), %%xmm1\n\t"          \
+    "paddsw    %%xmm3, %%xmm2\n\t"                   \
+\
+    "movdqa    %%xmm7, %%xmm3\n\t"                   \
+    "movdqa    %%xmm7, %%xmm5\n\t"                   \
+    "paddsw    %%xmm0, %%xmm3\n\t"                   \
+    "paddsw    %%xmm1, %%xmm5\n\t"                   \
+    "paddsw    %%xmm2, %%xmm7\n\t"                   \
+    "paddsw    %%xmm6, %%xmm0\n\t"                   \
+    "paddsw    %%xmm6, %%xmm1\n\t"                   \
+    "paddsw    %%xmm6, %%xmm2\n\t"                   \
+
+#define RGB_PACK_INTERLEAVE_SSE2                     \
+    "packuswb  %%xmm1, %%xmm0\n\t"                   \
+    "packuswb  %%xmm5, %%xmm3\n\t"                   \
+    "packuswb  %%xmm2, %%xmm2\n\t"                   \
+    "movdqa    %%xmm0, %%xmm1\n\t"                   \
+    "packuswb  %%xmm7, %%xmm7\n\t"                   \
+    "punpcklbw %%xmm3, %%xmm0\n\t"                   \
+    "punpckhbw %%xmm3, %%xmm1\n\t"                   \
+    "punpcklbw %%xmm7, %%xmm2\n\t"                   \
+
+#define YUV2RGB_ENDLOOP_SSE2(depth)                  \
+    "add $"AV_STRINGIFY(depth * 16)", %1\n\t"        \
+    "add  $8, %0\n\t"                                \
+    "js   1b\n\t"                                    \
+
+#define YUV2RGB_ENDFUNC_SSE2                         \
+    return srcSliceH;                                \
+
+#define RGB_PACK16_SSE2(gmask, is15)                 \
+    "pand      "MANGLE(sse2_redmask)", %%xmm0\n\t"   \
+    "pand      "MANGLE(sse2_redmask)", %%xmm1\n\t"   \
+    "movdqa    %%xmm2,     %%xmm3\n\t"               \
+    "psllw   $"AV_STRINGIFY(3-is15)", %%xmm2\n\t"    \
+    "psrlw   $"AV_STRINGIFY(5+is15)", %%xmm3\n\t"    \
+    "psrlw     $3,         %%xmm0\n\t"               \
+    IF##is15("psrlw  $1,   %%xmm1\n\t")              \
+    "pand "MANGLE(sse2_pb_e0)", %%xmm2\n\t"          \
+    "pand "MANGLE(gmask)", %%xmm3\n\t"               \
+    "por       %%xmm2,     %%xmm0\n\t"               \
+    "por       %%xmm3,     %%xmm1\n\t"               \
+    "movdqa    %%xmm0,     %%xmm2\n\t"               \
+    "punpcklbw %%xmm1,     %%xmm0\n\t"               \
+    "punpckhbw %%xmm1,     %%xmm2\n\t"               \
+    "movdqu    %%xmm0,      (%1)\n\t"                \
+    "movdqu    %%xmm2,    16(%1)\n\t"                \
+
+#define DITHER_RGB_SSE2                              \
+    "paddusb 2*"BLUE_DITHER"(%4),  %%xmm0\n\t"       \
+    "paddusb 2*"GREEN_DITHER"(%4), %%xmm2\n\t"       \
+    "paddusb 2*"RED_DITHER"(%4),   %%xmm1\n\t"       \
+
+#define SET_DITHER_SSE2(blue, green, red)            \
+    coeffs[0][0] = coeffs[0][1] = red;               \
+    coeffs[1][0] = coeffs[1][1] = green;             \
+    coeffs[2][0] = coeffs[2][1] = blue;              \
+
+#define YUV2RGB_OPERANDS_SSE2                                       \
+        : "+r" (index), "+r" (image)                                \
+        : "r" (pu - index), "r" (pv - index), "r"(coeffs),          \
+          "r" (py - 2*index)                                        \
+        : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3",          \
+                       "%xmm4", "%xmm5", "%xmm6", "%xmm7",) "memory" \
+        );                                                          \
+    }                                                               \
+
+#define YUV2RGB_OPERANDS_ALPHA_SSE2                                 \
+        : "+r" (index), "+r" (image)                                \
+        : "r" (pu - index), "r" (pv - index), "r"(coeffs),          \
+          "r" (py - 2*index), "r" (pa - 2*index)                    \
+        : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3",          \
+                       "%xmm4", "%xmm5", "%xmm6", "%xmm7",) "memory" \
+        );                                                          \
+    }                                                               \
+
+static int yuv420_rgb15_SSE2(SwsContext *c, const uint8_t *src[],
+                             int srcStride[], int srcSliceY, int srcSliceH,
+                             uint8_t *dst[], int dstStride[])
+{
+    YUV2RGB_LOOP_SSE2(2, yuv420_rgb15_MMX)
+
+        SET_DITHER_SSE2(ff_dither8[y & 1], ff_dither8[y & 1], ff_dither8[(y + 1) & 1])
+        YUV2RGB_INITIAL_LOAD_SSE2
+        YUV2RGB_SSE2
+        RGB_PACK_INTERLEAVE_SSE2
+        DITHER_RGB_SSE2
+        RGB_PACK16_SSE2(sse2_pb_03, 1)
+
+    YUV2RGB_ENDLOOP_SSE2(2)
+    YUV2RGB_OPERANDS_SSE2
+    YUV2RGB_ENDFUNC_SSE2
+}
+
+static int yuv420_rgb16_SSE2(SwsContext *c, const uint8_t *src[],
+                             int srcStride[], int srcSliceY, int srcSliceH,
+                             uint8_t *dst[], int dstStride[])
+{
+    YUV2RGB_LOOP_SSE2(2, yuv420_rgb16_MMX)
+
+        SET_DITHER_SSE2(ff_dither8[y & 1], ff_dither4[y & 1], ff_dither8[(y + 1) & 1])
+        YUV2RGB_INITIAL_LOAD_SSE2
+        YUV2RGB_SSE2
+        RGB_PACK_INTERLEAVE_SSE2
+        DITHER_RGB_SSE2
+        RGB_PACK16_SSE2(sse2_pb_07, 0)
+
+    YUV2RGB_ENDLOOP_SSE2(2)
+    YUV2RGB_OPERANDS_SSE2
+    YUV2RGB_ENDFUNC_SSE2
+}
+
+#define SET_EMPTY_ALPHA_SSE2                                                   \
+    "pcmpeqd   %%xmm"REG_ALPHA", %%xmm"REG_ALPHA"\n\t" /* set alpha to 0xFF */ \
+
+#define LOAD_ALPHA_SSE2                                  \
+    "movdqu    (%6, %0, 2),     %%xmm"REG_ALPHA"\n\t"    \
+
+#define RGB_PACK32_SSE2(red, green, blue, alpha)  \
+    "movdqa    %%xmm"blue",  %%xmm5\n\t"          \
+    "movdqa    %%xmm"red",   %%xmm6\n\t"          \
+    "punpckhbw %%xmm"green", %%xmm5\n\t"          \
+    "punpcklbw %%xmm"green", %%xmm"blue"\n\t"     \
+    "punpckhbw %%xmm"alpha", %%xmm6\n\t"          \
+    "punpcklbw %%xmm"alpha", %%xmm"red"\n\t"      \
+    "movdqa    %%xmm"blue",  %%xmm"green"\n\t"    \
+    "movdqa    %%xmm5,       %%xmm"alpha"\n\t"    \
+    "punpcklwd %%xmm"red",   %%xmm"blue"\n\t"     \
+    "punpckhwd %%xmm"red",   %%xmm"green"\n\t"    \
+    "punpcklwd %%xmm6,       %%xmm5\n\t"          \
+    "punpckhwd %%xmm6,       %%xmm"alpha"\n\t"    \
+    "movdqu    %%xmm"blue",   0(%1)\n\t"          \
+    "movdqu    %%xmm"green", 16(%1)\n\t"          \
+    "movdqu    %%xmm5,       32(%1)\n\t"          \
+    "movdqu    %%xmm"alpha", 48(%1)\n\t"          \
+
+static int yuv420_rgb32_SSE2(SwsContext *c, const uint8_t *src[],
+                             int srcStride[], int srcSliceY, int srcSliceH,
+                             uint8_t *dst[], int dstStride[])
+{
+    YUV2RGB_LOOP_SSE2(4, yuv420_rgb32_MMX)
+
+        YUV2RGB_INITIAL_LOAD_SSE2
+        YUV2RGB_SSE2
+        RGB_PACK_INTERLEAVE_SSE2
+        SET_EMPTY_ALPHA_SSE2
+        RGB_PACK32_SSE2(REG_RED, REG_GREEN, REG_BLUE, REG_ALPHA)
+
+    YUV2RGB_ENDLOOP_SSE2(4)
+    YUV2RGB_OPERANDS_SSE2
+    YUV2RGB_ENDFUNC_SSE2
+}
+
+static int yuv420_bgr32_SSE2(SwsContext *c, const uint8_t *src[],
+                             int srcStride[], int srcSliceY, int srcSliceH,
+                             uint8_t *dst[], int dstStride[])
+{
+    YUV2RGB_LOOP_SSE2(4, yuv420_bgr32_MMX)
+
+        YUV2RGB_INITIAL_LOAD_SSE2
+        YUV2RGB_SSE2
+        RGB_PACK_INTERLEAVE_SSE2
+        SET_EMPTY_ALPHA_SSE2
+        RGB_PACK32_SSE2(REG_BLUE, REG_GREEN, REG_RED, REG_ALPHA)
+
+    YUV2RGB_ENDLOOP_SSE2(4)
+    YUV2RGB_OPERANDS_SSE2
+    YUV2RGB_ENDFUNC_SSE2
+}
+
+#if HAVE_7REGS && CONFIG_SWSCALE_ALPHA
+static int yuva420_rgb32_SSE2(SwsContext *c, const uint8_t *src[],
+                              int srcStride[], int srcSliceY, int srcSliceH,
+                              uint8_t *dst[], int dstStride[])
+{
+    YUV2RGB_LOOP_SSE2(4, yuva420_rgb32_MMX)
+
+        const uint8_t *pa = src[3] + y * srcStride[3];
+        YUV2RGB_INITIAL_LOAD_SSE2
+        YUV2RGB_SSE2
+        RGB_PACK_INTERLEAVE_SSE2
+        LOAD_ALPHA_SSE2
+        RGB_PACK32_SSE2(REG_RED, REG_GREEN, REG_BLUE, REG_ALPHA)
+
+    YUV2RGB_ENDLOOP_SSE2(4)
+    YUV2RGB_OPERANDS_ALPHA_SSE2
+    YUV2RGB_ENDFUNC_SSE2
+}
+
+static int yuva420_bgr32_SSE2(SwsContext *c, const uint8_t *src[],
+                              int srcStride[], int srcSliceY, int srcSliceH,
+                              uint8_t *dst[], int dstStride[])
+{
+    YUV2RGB_LOOP_SSE2(4, yuva420_bgr32_MMX)
+
+        const uint8_t *pa = src[3] + y * srcStride[3];
+        YUV2RGB_INITIAL_LOAD_SSE2
+        YUV2RGB_SSE2
+        RGB_PACK_INTERLEAVE_SSE2
+        LOAD_ALPHA_SSE2
+        RGB_PACK32_SSE2(REG_BLUE, REG_GREEN, REG_RED, REG_ALPHA)
+
+    YUV2RGB_ENDLOOP_SSE2(4)
+    YUV2RGB_OPERANDS_ALPHA_SSE2
+    YUV2RGB_ENDFUNC_SSE2
+}
+#endif
+
+#if HAVE_SSSE3
+/* interleave to 4 byte pixels, then drop every 4th byte with pshufb */
+#define RGB_PACK24_SSSE3(first, last)                \
+    "movdqa    %%xmm"first", %%xmm5\n\t"             \
+    "punpcklbw %%xmm2,       %%xmm"first"\n\t"       \
+    "punpckhbw %%xmm2,       %%xmm5\n\t"             \
+    "movdqa    %%xmm"last",  %%xmm6\n\t"             \
+    "punpcklbw %%xmm4,       %%xmm"last"\n\t"        \
+    "punpckhbw %%xmm4,       %%xmm6\n\t"             \
+    "movdqa    %%xmm"first", %%xmm7\n\t"             \
+    "movdqa    %%xmm5,       %%xmm3\n\t"             \
+    "punpcklwd %%xmm"last",  %%xmm"first"\n\t"       \
+    "punpckhwd %%xmm"last",  %%xmm7\n\t"             \
+    "punpcklwd %%xmm6,       %%xmm5\n\t"             \
+    "punpckhwd %%xmm6,       %%xmm3\n\t"             \
+    "pshufb "MANGLE(ssse3_pack24)", %%xmm"first"\n\t"\
+    "pshufb "MANGLE(ssse3_pack24)", %%xmm7\n\t"      \
+    "pshufb "MANGLE(ssse3_pack24)", %%xmm5\n\t"      \
+    "pshufb "MANGLE(ssse3_pack24)", %%xmm3\n\t"      \
+    "movdqa    %%xmm7,       %%xmm6\n\t"             \
+    "pslldq    $12,          %%xmm6\n\t"             \
+    "psrldq    $4,           %%xmm7\n\t"             \
+    "por       %%xmm6,       %%xmm"first"\n\t"       \
+    "movdqa    %%xmm5,       %%xmm6\n\t"             \
+    "pslldq    $8,           %%xmm6\n\t"             \
+    "psrldq    $8,           %%xmm5\n\t"             \
+    "pslldq    $4,           %%xmm3\n\t"             \
+    "por       %%xmm6,       %%xmm7\n\t"             \
+    "por       %%xmm3,       %%xmm5\n\t"             \
+    "movdqu    %%xmm"first",  0(%1)\n\t"             \
+    "movdqu    %%xmm7,       16(%1)\n\t"             \
+    "movdqu    %%xmm5,       32(%1)\n\t"             \
+
+static int yuv420_rgb24_SSSE3(SwsContext *c, const uint8_t *src[],
+                              int srcStride[], int srcSliceY, int srcSliceH,
+                              uint8_t *dst[], int dstStride[])
+{
+    YUV2RGB_LOOP_SSE2(3, yuv420_rgb24_MMX)
+
+        YUV2RGB_INITIAL_LOAD_SSE2
+        YUV2RGB_SSE2
+        RGB_PACK_INTERLEAVE_SSE2
+        RGB_PACK24_SSSE3(REG_RED, REG_BLUE)
+
+    YUV2RGB_ENDLOOP_SSE2(3)
+    YUV2RGB_OPERANDS_SSE2
+    YUV2RGB_ENDFUNC_SSE2
+}
+
+static int yuv420_bgr24_SSSE3(SwsContext *c, const uint8_t *src[],
+                              int srcStride[], int srcSliceY, int srcSliceH,
+                              uint8_t *dst[], int dstStride[])
+{
+    YUV2RGB_LOOP_SSE2(3, yuv420_bgr24_MMX)
+
+        YUV2RGB_INITIAL_LOAD_SSE2
+        YUV2RGB_SSE2
+        RGB_PACK_INTERLEAVE_SSE2
+        RGB_PACK24_SSSE3(REG_BLUE, REG_RED)
+
+    YUV2RGB_ENDLOOP_SSE2(3)
+    YUV2RGB_OPERANDS_SSE2
+    YUV2RGB_ENDFUNC_SSE2
+}
+#endif /* HAVE_SSSE3 */
+#endif /* HAVE_SSE */
+
 SwsFunc ff_yuv2rgb_init_mmx(SwsContext *c)
 {
     int cpu_flags = av_get_cpu_flags();
@@ -72,6 +414,39 @@ SwsFunc ff_yuv2rgb_init_mmx(SwsContext *c)
         c->srcFormat != PIX_FMT_YUVA420P)
         return NULL;
 
+#if HAVE_SSE
+    if (cpu_flags & AV_CPU_FLAG_SSE2) {
+        switch (c->dstFormat) {
+            case PIX_FMT_RGB32:
+                if (c->srcFormat == PIX_FMT_YUVA420P) {
+#if HAVE_7REGS && CONFIG_SWSCALE_ALPHA
+                    return yuva420_rgb32_SSE2;
+#endif
+                    break;
+                } else return yuv420_rgb32_SSE2;
+            case PIX_FMT_BGR32:
+                if (c->srcFormat == PIX_FMT_YUVA420P) {
+#if HAVE_7REGS && CONFIG_SWSCALE_ALPHA
+                    return yuva420_bgr32_SSE2;
+#endif
+                    break;
+                } else return yuv420_bgr32_SSE2;
+#if HAVE_SSSE3
+            case PIX_FMT_RGB24:
+                if (cpu_flags & AV_CPU_FLAG_SSSE3)
+                    return yuv420_rgb24_SSSE3;
+                break;
+            case PIX_FMT_BGR24:
+                if (cpu_flags & AV_CPU_FLAG_SSSE3)
+                    return yuv420_bgr24_SSSE3;
+                break;
+#endif
+            case PIX_FMT_RGB565: return yuv420_rgb16_SSE2;
+            case PIX_FMT_RGB555: return yuv420_rgb15_SSE2;
+        }
+    }
+#endif
+
 #if HAVE_MMX2
     if (cpu_flags & AV_CPU_FLAG_MMX2) {
         switch (c->dstFormat) {
@@ -114,6 +114,11 @@ do_video_encoding huffyuv.avi "-an -vcodec huffyuv -pix_fmt yuv422p -sws_flags n
 do_video_decoding "" "-strict -2 -pix_fmt yuv420p -sws_flags neighbor+bitexact"
 fi
 
+if [ -n "$do_ffvhuffslice" ] ; then
+do_video_encoding ffvhuff-slice.avi "-an -vcodec ffvhuff -context 1 -slices 4 -threads 2"
+do_video_decoding "-threads 2 -thread_type slice"
+fi
+
 if [ -n "$do_rc" ] ; then
 do_video_encoding mpeg4-rc.avi "-b 400k -bf 2 -an -vcodec mpeg4"
 do_video_decoding
@@ -198,6 +203,11 @@ do_video_encoding ffv1.avi "-strict -2 -an -vcodec ffv1"
 do_video_decoding
 fi
 
+if [ -n "$do_ffv1slice" ] ; then
+do_video_encoding ffv1-slice.avi "-strict -2 -an -vcodec ffv1 -slices 6 -threads 2"
+do_video_decoding "-threads 2 -thread_type slice"
+fi
+
 if [ -n "$do_snow" ] ; then
 do_video_encoding snow.avi "-strict -2 -an -vcodec snow -qscale 2 -flags +qpel -me_method iter -dia_size 2 -cmp 12 -subcmp 12 -s 128x64"
 do_video_decoding "" "-s 352x288"
@@ -92,6 +92,24 @@ if [ -n "$do_mov" ] ; then
 do_lavf mov "-acodec pcm_alaw"
 fi
 
+if [ -n "$do_mov_tracks" ] ; then
+# the audio tracks start before the video one, so their samples are stored
+# behind video samples with a higher dts and the demuxer has to choose
+# among three tracks whose samples are not stored in dts order
+file=${outfile}lavf.tracks.mov
+run_ffmpeg $DEC_OPTS -f image2 -vcodec pgmyuv -i $raw_src $ENC_OPTS -t 1 -qscale 10 $target_path/${outfile}tracks.nut
+run_ffmpeg $DEC_OPTS -ar 44100 -f s16le -i $pcm_src $ENC_OPTS -t 1 $target_path/${outfile}tracks.wav
+run_ffmpeg $DEC_OPTS -ar 44100 -f s16le -i $pcm_src $ENC_OPTS -t 1 -acodec adpcm_ima_qt -ar 22050 $target_path/${outfile}tracks.mov
+run_ffmpeg $DEC_OPTS -i $target_path/${outfile}tracks.nut -itsoffset -0.9 -i $target_path/${outfile}tracks.wav \
+           -itsoffset -1.8 -i $target_path/${outfile}tracks.mov -map 0:0 -map 1:0 -map 2:0 \
+           $ENC_OPTS -vcodec copy -acodec copy $target_path/$file -acodec copy -newaudio
+do_md5sum $file >> $logfile
+wc -c $file >> $logfile
+# the packets in the order they are read
+$ffprobe -show_packets $target_path/$file 2>/dev/null | grep -E '^(stream_index|dts|pos)=' > ${outfile}tracks.pkts
+do_md5sum ${outfile}tracks.pkts >> $logfile
+fi
+
 if [ -n "$do_dv_fmt" ] ; then
 do_lavf dv "-ar 48000 -r 25 -s pal -ac 2"
 fi
@@ -30,16 +30,25 @@ do_lavfi() {
     fi
 }
 
+do_lavfi "bitdepth"           "format=yuv420p16le,format=yuv420p10le,format=yuv420p9le,format=yuv420p16le,format=yuv420p10le,format=yuv420p"
 do_lavfi "crop"               "crop=iw-100:ih-100:100:100"
 do_lavfi "crop_scale"         "crop=iw-100:ih-100:100:100,scale=400:-1"
 do_lavfi "crop_scale_vflip"   "null,null,crop=iw-200:ih-200:200:200,crop=iw-20:ih-20:20:20,scale=200:200,scale=250:250,vflip,vflip,null,scale=200:200,crop=iw-100:ih-100:100:100,vflip,scale=200:200,null,vflip,crop=iw-100:ih-100:100:100,null"
 do_lavfi "crop_vflip"         "crop=iw-100:ih-100:100:100,vflip"
 do_lavfi "null"               "null"
+do_lavfi "overlay"            "null[m];color=red@0.5:100x80,pad=160:100:40:10:blue@0,format=yuva420p[o];[m][o]overlay=10:20"
 do_lavfi "scale200"           "scale=200:200"
 do_lavfi "scale500"           "scale=500:500"
+do_lavfi "unsharp"            "unsharp=7:3:1.5:4:6:-0.8"
 do_lavfi "vflip"              "vflip"
 do_lavfi "vflip_crop"         "vflip,crop=iw-100:ih-100:100:100"
 do_lavfi "vflip_vflip"        "vflip,vflip"
+do_lavfi "yadif"              "yadif=1"
+
+# whole frames, the scalers only split those into bands for their threads
+if [ $test = "scale_rgb_threads" ] ; then
+    do_video_filter $test "format=rgb24,hflip,scale=200:200,format=bgra,format=yuv420p" -filter_threads 4
+fi
 
 do_lavfi_pixfmts(){
     test ${test%_[bl]e} = pixfmts_$1 || return 0
@@ -0,0 +1,304 @@
+/*
+ * Copyright (c) 2011 FFmpeg developers
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Measure the FFV1 encoding and decoding speed with 1 to N threads.
+ * Every frame is decoded again and checked against the input, the slice
+ * grid follows the thread count unless it is given.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>             /* getopt */
+
+#undef HAVE_AV_CONFIG_H
+#include "libavutil/crc.h"
+#include "libavutil/imgutils.h"
+#include "libavutil/lfg.h"
+#include "libavutil/parseutils.h"
+#include "libavutil/pixdesc.h"
+#include "libavcodec/avcodec.h"
+
+static void usage(void)
+{
+    printf("Measure the FFV1 encoding and decoding speed\n");
+    printf("Usage: ffv1-bench [OPTIONS]\n");
+    printf("\n"
+           "Options:\n"
+           "-s SIZE           set the frame size, 1920x1080 if omitted\n"
+           "-p PIX_FMT        set the pixel format, yuv422p10 if omitted\n"
+           "-n FRAMES         set the number of frames, 50 if omitted\n"
+           "-t THREADS        run with 1 to THREADS threads, 4 if omitted\n"
+           "-c SLICES         set the number of slices, chosen from the thread count if omitted\n"
+           "-e 0|1            disable or enable the slice CRCs, enabled if omitted\n"
+           "-h                print this help\n");
+}
+
+static int64_t gettime(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static uint32_t picture_crc(uint8_t *data[4], int linesize[4],
+                            enum PixelFormat pix_fmt, int w, int h)
+{
+    const AVPixFmtDescriptor *desc = &av_pix_fmt_descriptors[pix_fmt];
+    uint32_t crc = 0;
+    int i, y;
+
+    for (i = 0; i < 4 && data[i]; i++) {
+        int plane_h = i == 1 || i == 2 ? -((-h) >> desc->log2_chroma_h) : h;
+        int bytes   = av_image_get_linesize(pix_fmt, w, i);
+
+        for (y = 0; y < plane_h; y++)
+            crc = av_crc(av_crc_get_table(AV_CRC_32_IEEE), crc,
+                         data[i] + y * linesize[i], bytes);
+    }
+    return crc;
+}
+
+/* smooth gradients with some noise, random samples would not compress */
+static void fill_picture(uint8_t *data[4], int linesize[4],
+                         enum PixelFormat pix_fmt, int w, int h)
+{
+    const AVPixFmtDescriptor *desc = &av_pix_fmt_descriptors[pix_fmt];
+    AVLFG rand;
+    int i, x, y;
+
+    av_lfg_init(&rand, 1);
+    for (i = 0; i < desc->nb_components; i++) {
+        const AVComponentDescriptor *comp = &desc->comp[i];
+        int plane_w = i == 1 || i == 2 ? -((-w) >> desc->log2_chroma_w) : w;
+        int plane_h = i == 1 || i == 2 ? -((-h) >> desc->log2_chroma_h) : h;
+        int max     = (1 << (comp->depth_minus1 + 1)) - 1;
+        uint16_t line[8192];
+
+        for (y = 0; y < plane_h; y++) {
+            for (x = 0; x < plane_w; x++)
+                line[x] = av_clip((x + y) * max / (plane_w + plane_h) +
+                                  (av_lfg_get(&rand) & 3), 0, max);
+            av_write_image_line(line, data, linesize, desc, 0, y, i, plane_w);
+        }
+    }
+}
+
+static int open_codec(AVCodecContext **avctx, AVCodec *codec, int w, int h,
+                      enum PixelFormat pix_fmt, int threads, int slices,
+                      const char *slicecrc)
+{
+    AVDictionary *opts = NULL;
+    int ret;
+
+    if (!(*avctx = avcodec_alloc_context3(codec)))
+        return AVERROR(ENOMEM);
+    (*avctx)->width                 = w;
+    (*avctx)->height                = h;
+    (*avctx)->pix_fmt               = pix_fmt;
+    (*avctx)->bits_per_raw_sample   = av_pix_fmt_descriptors[pix_fmt].comp[0].depth_minus1 + 1;
+    (*avctx)->coder_type            = FF_CODER_TYPE_AC;
+    (*avctx)->time_base             = (AVRational){ 1, 25 };
+    (*avctx)->thread_count          = threads;
+    (*avctx)->slices                = slices;
+    (*avctx)->strict_std_compliance = FF_COMPLIANCE_EXPERIMENTAL;
+    if (slicecrc)
+        av_dict_set(&opts, "slicecrc", slicecrc, 0);
+    ret = avcodec_open2(*avctx, codec, &opts);
+    av_dict_free(&opts);
+    return ret;
+}
+
+static void close_codec(AVCodecContext **avctx)
+{
+    if (!*avctx)
+        return;
+    avcodec_close(*avctx);
+    av_freep(&(*avctx)->extradata);
+    av_freep(avctx);
+}
+
+int main(int argc, char **argv)
+{
+    uint8_t *data[4], *buf;
+    int linesize[4];
+    int w = 1920, h = 1080, frames = 50, max_threads = 4, slices = 0;
+    enum PixelFormat pix_fmt = PIX_FMT_YUV422P10;
+    const char *slicecrc = NULL;
+    AVCodec *encoder, *decoder;
+    AVFrame *in, *out;
+    uint32_t crc_in;
+    int c, i, threads, size, buf_size, res = 0;
+
+    while ((c = getopt(argc, argv, "s:p:n:t:c:e:h")) != -1) {
+        switch (c) {
+        case 's':
+            if (av_parse_video_size(&w, &h, optarg) < 0) {
+                fprintf(stderr, "Invalid frame size '%s'\n", optarg);
+                return 1;
+            }
+            break;
+        case 'p':
+            if ((pix_fmt = av_get_pix_fmt(optarg)) == PIX_FMT_NONE) {
+                fprintf(stderr, "Unknown pixel format '%s'\n", optarg);
+                return 1;
+            }
+            break;
+        case 'n':
+            frames = atoi(optarg);
+            break;
+        case 't':
+            max_threads = atoi(optarg);
+            break;
+        case 'c':
+            slices = atoi(optarg);
+            break;
+        case 'e':
+            slicecrc = optarg;
+            break;
+        case 'h':
+            usage();
+            return 0;
+        default:
+            usage();
+            return 1;
+        }
+    }
+    if (frames < 1 || max_threads < 1 || w > 8192) {
+        usage();
+        return 1;
+    }
+
+    avcodec_register_all();
+    encoder = avcodec_find_encoder(CODEC_ID_FFV1);
+    decoder = avcodec_find_decoder(CODEC_ID_FFV1);
+    if (!encoder || !decoder) {
+        fprintf(stderr, "FFV1 is not available\n");
+        return 1;
+    }
+
+    if ((size = av_image_alloc(data, linesize, w, h, pix_fmt, 16)) < 0) {
+        fprintf(stderr, "Could not allocate the input frame\n");
+        return 1;
+    }
+    fill_picture(data, linesize, pix_fmt, w, h);
+    crc_in   = picture_crc(data, linesize, pix_fmt, w, h);
+    buf_size = 2 * size + FF_MIN_BUFFER_SIZE;
+    in       = avcodec_alloc_frame();
+    out      = avcodec_alloc_frame();
+    buf      = av_malloc(buf_size);
+    if (!in || !out || !buf) {
+        res = 1;
+        goto end;
+    }
+    memcpy(in->data,     data,     sizeof(data));
+    memcpy(in->linesize, linesize, sizeof(linesize));
+
+    printf("%s %dx%d, %d frames, %d bytes per frame, ",
+           av_pix_fmt_descriptors[pix_fmt].name, w, h, frames, size);
+    if (slices)
+        printf("%d slices\n", slices);
+    else
+        printf("slices from the thread count\n");
+
+    for (threads = 1; threads <= max_threads; threads++) {
+        AVCodecContext *enc = NULL, *dec = NULL;
+        int64_t enc_time = 0, dec_time = 0, t, coded = 0;
+        int mismatch = 0;
+
+        if (open_codec(&enc, encoder, w, h, pix_fmt, threads, slices, slicecrc) < 0) {
+            fprintf(stderr, "Could not open the encoder with %d threads\n", threads);
+            close_codec(&enc);
+            res = 1;
+            break;
+        }
+        if (!(dec = avcodec_alloc_context3(decoder))) {
+            close_codec(&enc);
+            res = 1;
+            break;
+        }
+        dec->width          = w;
+        dec->height         = h;
+        dec->thread_count   = threads;
+        dec->extradata      = enc->extradata;
+        dec->extradata_size = enc->extradata_size;
+        if (avcodec_open2(dec, decoder, NULL) < 0) {
+            fprintf(stderr, "Could not open the decoder with %d threads\n", threads);
+            dec->extradata = NULL;
+            close_codec(&dec);
+            close_codec(&enc);
+            res = 1;
+            break;
+        }
+
+        for (i = 0; i < frames; i++) {
+            AVPacket pkt;
+            int got_picture = 0, ret;
+
+            in->pts = i;
+            t = gettime();
+            ret = avcodec_encode_video(enc, buf, buf_size, in);
+            enc_time += gettime() - t;
+            if (ret < 0)
+                break;
+            coded += ret;
+
+            av_init_packet(&pkt);
+            pkt.data  = buf;
+            pkt.size  = ret;
+            pkt.flags = enc->coded_frame->key_frame ? AV_PKT_FLAG_KEY : 0;
+            t = gettime();
+            ret = avcodec_decode_video2(dec, out, &got_picture, &pkt);
+            dec_time += gettime() - t;
+            if (ret < 0 || !got_picture)
+                break;
+            if (picture_crc(out->data, out->linesize, pix_fmt, w, h) != crc_in)
+                mismatch++;
+        }
+        printf(" threads=%2d encode %7.1f MB/s decode %7.1f MB/s ratio %.3f%s\n",
+               threads,
+               (double)size * i / FFMAX(enc_time, 1),
+               (double)size * i / FFMAX(dec_time, 1),
+               (double)coded / FFMAX((int64_t)size * i, 1),
+               mismatch ? " MISMATCH" : "");
+
+        dec->extradata = NULL;
+        close_codec(&dec);
+        close_codec(&enc);
+        if (i < frames) {
+            fprintf(stderr, "Coding failed at frame %d\n", i);
+            res = 1;
+            break;
+        }
+        if (mismatch)
+            res = 1;
+    }
+
+end:
+    av_free(buf);
+    av_free(out);
+    av_free(in);
+    av_free(data[0]);
+    return res;
+}
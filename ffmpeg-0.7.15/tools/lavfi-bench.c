@@ -0,0 +1,251 @@
+/*
+ * Copyright (c) 2011 FFmpeg developers
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Measure the throughput of a video filter graph with 1 to N threads.
+ * The output of the graph is converted back to the input pixel format,
+ * the CRC of its last frame is checked against the single threaded run.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>             /* getopt */
+
+#undef HAVE_AV_CONFIG_H
+#include "libavutil/crc.h"
+#include "libavutil/imgutils.h"
+#include "libavutil/lfg.h"
+#include "libavutil/parseutils.h"
+#include "libavutil/pixdesc.h"
+#include "libavfilter/avfiltergraph.h"
+#include "libavfilter/vsink_buffer.h"
+#include "libavfilter/vsrc_buffer.h"
+
+static void usage(void)
+{
+    printf("Measure the throughput of a video filter graph\n");
+    printf("Usage: lavfi-bench [OPTIONS] GRAPH\n");
+    printf("\n"
+           "Options:\n"
+           "-s SIZE           set the input frame size, 1920x1080 if omitted\n"
+           "-p PIX_FMT        set the input pixel format, yuv420p if omitted\n"
+           "-n FRAMES         set the number of frames, 100 if omitted\n"
+           "-t THREADS        run with 1 to THREADS threads, 4 if omitted\n"
+           "-h                print this help\n");
+}
+
+static int64_t gettime(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static uint32_t frame_crc(uint32_t crc, AVFilterBufferRef *ref)
+{
+    const AVPixFmtDescriptor *desc = &av_pix_fmt_descriptors[ref->format];
+    int i, y;
+
+    for (i = 0; i < (desc->flags & PIX_FMT_PAL ? 1 : 4) && ref->data[i]; i++) {
+        int h     = i == 1 || i == 2 ? -((-ref->video->h) >> desc->log2_chroma_h)
+                                     : ref->video->h;
+        int bytes = av_image_get_linesize(ref->format, ref->video->w, i);
+
+        for (y = 0; y < h; y++)
+            crc = av_crc(av_crc_get_table(AV_CRC_32_IEEE), crc,
+                         ref->data[i] + y * ref->linesize[i], bytes);
+    }
+    return crc;
+}
+
+static int open_graph(AVFilterGraph **graph, AVFilterContext **src,
+                      AVFilterContext **sink, const char *graph_desc,
+                      int w, int h, enum PixelFormat pix_fmt, int threads)
+{
+    enum PixelFormat pix_fmts[] = { pix_fmt, PIX_FMT_NONE };
+    AVFilterInOut *outputs, *inputs;
+    char args[256];
+    int ret;
+
+    if (!(*graph = avfilter_graph_alloc()))
+        return AVERROR(ENOMEM);
+    (*graph)->thread_count = threads;
+
+    snprintf(args, sizeof(args), "%d:%d:%d:%d:%d:%d:%d",
+             w, h, pix_fmt, 1, AV_TIME_BASE, 1, 1);
+    if ((ret = avfilter_graph_create_filter(src, avfilter_get_by_name("buffer"),
+                                            "src", args, NULL, *graph)) < 0)
+        return ret;
+    if ((ret = avfilter_graph_create_filter(sink, avfilter_get_by_name("buffersink"),
+                                            "out", NULL, pix_fmts, *graph)) < 0)
+        return ret;
+
+    outputs = avfilter_inout_alloc();
+    inputs  = avfilter_inout_alloc();
+    if (!outputs || !inputs) {
+        avfilter_inout_free(&outputs);
+        avfilter_inout_free(&inputs);
+        return AVERROR(ENOMEM);
+    }
+    outputs->name       = av_strdup("in");
+    outputs->filter_ctx = *src;
+    outputs->pad_idx    = 0;
+    outputs->next       = NULL;
+    inputs->name        = av_strdup("out");
+    inputs->filter_ctx  = *sink;
+    inputs->pad_idx     = 0;
+    inputs->next        = NULL;
+
+    if ((ret = avfilter_graph_parse(*graph, graph_desc, &inputs, &outputs, NULL)) < 0)
+        return ret;
+
+    return avfilter_graph_config(*graph, NULL);
+}
+
+int main(int argc, char **argv)
+{
+    AVFilterBufferRef *in;
+    uint8_t *data[4];
+    int linesize[4];
+    int w = 1920, h = 1080, frames = 100, max_threads = 4;
+    enum PixelFormat pix_fmt = PIX_FMT_YUV420P;
+    const char *graph_desc;
+    uint32_t crc1 = 0;
+    AVLFG rand;
+    int c, i, j, threads, size, ret, res = 0;
+
+    while ((c = getopt(argc, argv, "s:p:n:t:h")) != -1) {
+        switch (c) {
+        case 's':
+            if (av_parse_video_size(&w, &h, optarg) < 0) {
+                fprintf(stderr, "Invalid frame size '%s'\n", optarg);
+                return 1;
+            }
+            break;
+        case 'p':
+            if ((pix_fmt = av_get_pix_fmt(optarg)) == PIX_FMT_NONE) {
+                fprintf(stderr, "Unknown pixel format '%s'\n", optarg);
+                return 1;
+            }
+            break;
+        case 'n':
+            frames = atoi(optarg);
+            break;
+        case 't':
+            max_threads = atoi(optarg);
+            break;
+        case 'h':
+            usage();
+            return 0;
+        default:
+            usage();
+            return 1;
+        }
+    }
+    if (optind >= argc || frames < 1 || max_threads < 1) {
+        usage();
+        return 1;
+    }
+    graph_desc = argv[optind];
+
+    avfilter_register_all();
+
+    if ((size = av_image_alloc(data, linesize, w, h, pix_fmt, 16)) < 0) {
+        fprintf(stderr, "Could not allocate the input frame\n");
+        return 1;
+    }
+    av_lfg_init(&rand, 1);
+    for (j = 0; j < size; j++)
+        data[0][j] = av_lfg_get(&rand);
+    if (!(in = avfilter_get_video_buffer_ref_from_arrays(data, linesize, AV_PERM_READ,
+                                                         w, h, pix_fmt))) {
+        av_free(data[0]);
+        return 1;
+    }
+
+    printf("%s %dx%d '%s', %d frames\n",
+           av_pix_fmt_descriptors[pix_fmt].name, w, h, graph_desc, frames);
+
+    for (threads = 1; threads <= max_threads; threads++) {
+        AVFilterGraph *graph;
+        AVFilterContext *src, *sink;
+        AVFilterBufferRef *out, *last = NULL;
+        AVFilterPoolStats stats;
+        uint32_t crc = 0;
+        int64_t t;
+        int out_frames = 0;
+
+        if (open_graph(&graph, &src, &sink, graph_desc, w, h, pix_fmt, threads) < 0) {
+            fprintf(stderr, "Failed to configure the graph '%s'\n", graph_desc);
+            avfilter_graph_free(&graph);
+            res = 1;
+            break;
+        }
+
+        t = gettime();
+        for (i = 0; i < frames; i++) {
+            in->pts = i;
+            if (av_vsrc_buffer_add_video_buffer_ref(src, in, AV_VSRC_BUF_FLAG_OVERWRITE) < 0)
+                break;
+            /* filters with a delay or several outputs per input, like yadif,
+             * give any number of frames for each frame added */
+            while ((ret = avfilter_poll_frame(sink->inputs[0])) > 0) {
+                if ((ret = av_vsink_buffer_get_video_buffer_ref(sink, &out, 0)) < 0)
+                    break;
+                avfilter_unref_buffer(last);
+                last = out;
+                out_frames++;
+            }
+            if (ret < 0)
+                break;
+        }
+        t = gettime() - t;
+        if (last)
+            crc = frame_crc(0, last);
+        avfilter_unref_buffer(last);
+        avfilter_graph_get_pool_stats(graph, &stats);
+        avfilter_graph_free(&graph);
+
+        if (i < frames) {
+            fprintf(stderr, "Filtering failed at frame %d\n", i);
+            res = 1;
+            break;
+        }
+        if (threads == 1)
+            crc1 = crc;
+        // pixel rates are given for the input frames, fps for the output ones
+        printf(" threads=%2d %7.1f Mpix/s %6.1f fps CRC=%08x"
+               " buffers: %"PRIu64" allocs, %.1f%% hits, %d max in use%s\n", threads,
+               (double)w * h * frames / FFMAX(t, 1),
+               out_frames * 1000000.0 / FFMAX(t, 1),
+               crc, stats.nb_allocs,
+               stats.nb_requests ? stats.nb_hits * 100.0 / stats.nb_requests : 0.0,
+               stats.nb_used_max, crc != crc1 ? " MISMATCH" : "");
+        if (crc != crc1)
+            res = 1;
+    }
+
+    avfilter_unref_buffer(in);
+    return res;
+}